@@ -0,0 +1,448 @@
+/**
+ * @file cfg.h
+ * @brief Control-flow graphs and data-flow analyses for ILOC functions
+ *
+ * This module splits an ILOC program into functions, builds a control-flow
+ * graph (CFG) of basic blocks for each function, and provides the analyses
+ * that the optimization passes and the register allocator need (reachability,
+ * dominators, dominance frontiers, and liveness).
+ */
+#ifndef __CFG_H
+#define __CFG_H
+
+#include "common.h"
+#include "iloc.h"
+
+/**
+ * @brief Fixed-size set of small non-negative integers (usually register IDs)
+ *
+ * Allocate with @ref BitSet_new and de-allocate with @ref BitSet_free.
+ */
+typedef struct BitSet
+{
+    /**
+     * @brief Number of elements that can be stored (elements are 0 to size-1)
+     */
+    int size;
+
+    /**
+     * @brief Number of 64-bit words in @ref BitSet::words
+     */
+    int num_words;
+
+    /**
+     * @brief Bit storage
+     */
+    uint64_t* words;
+
+} BitSet;
+
+/**
+ * @brief Allocate a new, empty bit set
+ *
+ * @param size Number of elements that can be stored
+ * @returns Pointer to new bit set
+ */
+BitSet* BitSet_new (int size);
+
+/**
+ * @brief Add an element to a bit set
+ */
+void BitSet_add (BitSet* set, int elem);
+
+/**
+ * @brief Remove an element from a bit set
+ */
+void BitSet_remove (BitSet* set, int elem);
+
+/**
+ * @brief Test whether a bit set contains an element
+ *
+ * Elements outside the range of the set are never contained.
+ */
+bool BitSet_contains (BitSet* set, int elem);
+
+/**
+ * @brief Remove all elements from a bit set
+ */
+void BitSet_clear (BitSet* set);
+
+/**
+ * @brief Overwrite one bit set with the contents of another (same size)
+ */
+void BitSet_copy (BitSet* dest, BitSet* src);
+
+/**
+ * @brief Add all elements of one bit set to another (same size)
+ *
+ * @returns True if and only if @c dest changed
+ */
+bool BitSet_union (BitSet* dest, BitSet* src);
+
+/**
+ * @brief Test whether two bit sets (same size) have any element in common
+ */
+bool BitSet_intersects (BitSet* a, BitSet* b);
+
+/**
+ * @brief Count the elements in a bit set
+ */
+int BitSet_count (BitSet* set);
+
+/**
+ * @brief Deallocate a bit set
+ */
+void BitSet_free (BitSet* set);
+
+/**
+ * @brief Basic block (maximal straight-line sequence of instructions)
+ *
+ * While a block is part of a CFG, its instructions form a @c NULL-terminated
+ * chain stored in @ref BasicBlock::insns; the chains are linked back together
+ * by @ref CFGList_linearize.
+ */
+typedef struct BasicBlock
+{
+    /**
+     * @brief Index of this block in @ref CFG::blocks (i.e., layout order)
+     */
+    int id;
+
+    /**
+     * @brief Instructions in this block (the list does not own them)
+     */
+    InsnList* insns;
+
+    /**
+     * @brief Successor blocks (fall-through successor, if any, is last)
+     */
+    struct BasicBlock* succ[2];
+
+    /**
+     * @brief Number of successor blocks
+     */
+    int num_succ;
+
+    /**
+     * @brief Predecessor blocks
+     *
+     * For blocks containing @c PHI instructions, operand @c i of each @c PHI
+     * is the value flowing in from @c preds[i].
+     */
+    struct BasicBlock** preds;
+
+    /**
+     * @brief Number of predecessor blocks
+     */
+    int num_preds;
+
+    /**
+     * @brief Capacity of @ref BasicBlock::preds
+     */
+    int cap_preds;
+
+    /**
+     * @brief Reachable from the function entry? (see @ref CFG_compute_edges)
+     */
+    bool reachable;
+
+    /**
+     * @brief Position in reverse postorder (see @ref CFG_compute_dominators)
+     */
+    int rpo;
+
+    /**
+     * @brief Immediate dominator (@c NULL for the entry and unreachable blocks)
+     */
+    struct BasicBlock* idom;
+
+    /**
+     * @brief Dominance frontier as a set of block IDs
+     */
+    BitSet* frontier;
+
+    /**
+     * @brief Number of loops containing this block (see @ref CFG_compute_loops)
+     */
+    int loop_depth;
+
+    /**
+     * @brief Virtual registers live on entry (see @ref CFG_compute_liveness)
+     */
+    BitSet* live_in;
+
+    /**
+     * @brief Virtual registers live on exit (see @ref CFG_compute_liveness)
+     */
+    BitSet* live_out;
+
+} BasicBlock;
+
+/**
+ * @brief Natural loop (all back edges to the same header are merged)
+ */
+typedef struct Loop
+{
+    /**
+     * @brief Loop header (dominates every block in the loop)
+     */
+    BasicBlock* header;
+
+    /**
+     * @brief Blocks in the loop (including the header) as a set of block IDs
+     */
+    BitSet* blocks;
+
+    /**
+     * @brief Nesting depth (1 for outermost loops)
+     */
+    int depth;
+
+    /**
+     * @brief Next loop (if stored in a list)
+     */
+    struct Loop* next;
+
+} Loop;
+
+DECL_LIST_TYPE(Loop, Loop*)
+
+/**
+ * @brief Control-flow graph for a single ILOC function
+ *
+ * Build with @ref CFGList_build (which splits a whole program into functions)
+ * and put the instructions back into a program with @ref CFGList_linearize.
+ *
+ * Structural changes (adding, removing, or retargeting blocks) must be
+ * followed by @ref CFG_compute_edges; the analyses must be re-run explicitly
+ * when they are needed again.
+ */
+typedef struct CFG
+{
+    /**
+     * @brief Basic blocks in layout order (block 0 is the entry)
+     */
+    BasicBlock** blocks;
+
+    /**
+     * @brief Number of basic blocks
+     */
+    int num_blocks;
+
+    /**
+     * @brief Capacity of @ref CFG::blocks
+     */
+    int cap_blocks;
+
+    /**
+     * @brief Mapping from jump label IDs to the blocks that they begin
+     */
+    BasicBlock** label_map;
+
+    /**
+     * @brief Size of @ref CFG::label_map
+     */
+    int label_map_size;
+
+    /**
+     * @brief One more than the highest virtual register ID (as of the last analysis)
+     */
+    int num_vregs;
+
+    /**
+     * @brief Natural loops, innermost first (see @ref CFG_compute_loops)
+     */
+    LoopList* loops;
+
+    /**
+     * @brief Next CFG (if stored in a list)
+     */
+    struct CFG* next;
+
+} CFG;
+
+DECL_LIST_TYPE(CFG, CFG*)
+
+/**
+ * @brief Split a program into functions and build a CFG for each
+ *
+ * Every instruction is moved out of the given list (which is left empty) and
+ * into the blocks of the new CFGs. Edges are computed for every CFG.
+ *
+ * @param list ILOC program
+ * @returns List of CFGs in program order
+ */
+CFGList* CFGList_build (InsnList* list);
+
+/**
+ * @brief Move every instruction from a list of CFGs back into a program
+ *
+ * Blocks are emitted in layout order; the CFGs are left empty and should be
+ * deallocated with @ref CFGList_free.
+ *
+ * @param cfgs List of CFGs
+ * @param list Destination (empty) instruction list
+ */
+void CFGList_linearize (CFGList* cfgs, InsnList* list);
+
+/**
+ * @brief Get the function label instruction of a CFG (or @c NULL)
+ */
+ILOCInsn* CFG_function_label (CFG* cfg);
+
+/**
+ * @brief Append a new, empty block at the given layout position
+ *
+ * @param cfg CFG to modify
+ * @param pos Index in @ref CFG::blocks for the new block
+ * @returns Pointer to the new block
+ */
+BasicBlock* CFG_insert_block (CFG* cfg, int pos);
+
+/**
+ * @brief Remove a block and deallocate it along with its instructions
+ */
+void CFG_remove_block (CFG* cfg, BasicBlock* block);
+
+/**
+ * @brief Find the "addI SP, -X => SP" local allocator instruction of a function
+ *
+ * @returns Local allocator in the function prologue (or @c NULL if the
+ * prologue is non-standard)
+ */
+ILOCInsn* CFG_local_allocator (CFG* cfg);
+
+/**
+ * @brief Find the block that begins with the given jump label (or @c NULL)
+ */
+BasicBlock* CFG_find_label (CFG* cfg, int label_id);
+
+/**
+ * @brief Recompute block IDs, the label map, edges, and reachability
+ *
+ * Predecessors that are still predecessors keep their previous order (so that
+ * @c PHI operands stay matched to them); new predecessors are appended in
+ * layout order.
+ */
+void CFG_compute_edges (CFG* cfg);
+
+/**
+ * @brief Make every control transfer explicit
+ *
+ * Afterwards, every block begins with a jump label and every block that used
+ * to fall through ends in a @c JUMP, so blocks may be freely reordered or
+ * inserted. The redundant jumps are removed by @ref CFG_eliminate_dead_code.
+ */
+void CFG_make_explicit (CFG* cfg);
+
+/**
+ * @brief Get the last instruction of a block if it is a control transfer
+ *
+ * @returns Trailing @c JUMP, @c CBR, or @c RETURN instruction (or @c NULL)
+ */
+ILOCInsn* BasicBlock_terminator (BasicBlock* block);
+
+/**
+ * @brief Get the jump label ID at the beginning of a block (or -1)
+ */
+int BasicBlock_label (BasicBlock* block);
+
+/**
+ * @brief Insert an instruction into a block
+ *
+ * @param block Block to modify
+ * @param prev Instruction to insert after (or @c NULL to insert at the beginning)
+ * @param insn Instruction to insert
+ */
+void BasicBlock_insert_after (BasicBlock* block, ILOCInsn* prev, ILOCInsn* insn);
+
+/**
+ * @brief Insert an instruction just before the terminator of a block (or at the end)
+ */
+void BasicBlock_insert_before_terminator (BasicBlock* block, ILOCInsn* insn);
+
+/**
+ * @brief Remove an instruction from a block without deallocating it
+ *
+ * @param block Block to modify
+ * @param prev Instruction preceding the one to remove (or @c NULL for the first)
+ * @returns The removed instruction (or @c NULL if there was none)
+ */
+ILOCInsn* BasicBlock_unlink_after (BasicBlock* block, ILOCInsn* prev);
+
+/**
+ * @brief Remove and deallocate an instruction from a block
+ *
+ * @param block Block to modify
+ * @param prev Instruction preceding the one to remove (or @c NULL for the first)
+ */
+void BasicBlock_remove_after (BasicBlock* block, ILOCInsn* prev);
+
+/**
+ * @brief Retarget every branch from one block to another
+ *
+ * @param from Block containing the branches
+ * @param old_label Jump label ID to replace
+ * @param new_label Replacement jump label ID
+ */
+void BasicBlock_retarget (BasicBlock* from, int old_label, int new_label);
+
+/**
+ * @brief Compute immediate dominators and dominance frontiers
+ *
+ * Uses the iterative algorithm by Cooper, Harvey, and Kennedy over a reverse
+ * postorder of the reachable blocks.
+ */
+void CFG_compute_dominators (CFG* cfg);
+
+/**
+ * @brief Test whether block @c a dominates block @c b (requires dominators)
+ */
+bool CFG_dominates (BasicBlock* a, BasicBlock* b);
+
+/**
+ * @brief Find the natural loops of a function (requires dominators)
+ *
+ * Stores the loops in @ref CFG::loops (innermost first) and sets the loop
+ * depth of every block. Block IDs in the loops become stale when blocks are
+ * added or removed, so the loops must be recomputed afterwards.
+ */
+void CFG_compute_loops (CFG* cfg);
+
+/**
+ * @brief Estimate how often a block runs per call of its function (requires loops)
+ *
+ * Every enclosing loop is assumed to iterate ten times; loops nested more than
+ * six deep count as six deep (so that estimates cannot overflow).
+ */
+long BasicBlock_frequency (BasicBlock* block);
+
+/**
+ * @brief Get (or create) the preheader of a loop
+ *
+ * The preheader is the only predecessor of the loop header from outside the
+ * loop, and it always jumps straight to the header. If the header has a single
+ * outside predecessor, the preheader takes its place in the predecessor list
+ * (so @c PHI operands still match). The CFG must already be explicit (see
+ * @ref CFG_make_explicit); edges are recomputed if a block is inserted.
+ *
+ * @param cfg CFG containing the loop
+ * @param loop Loop that needs a preheader
+ * @returns Preheader block
+ */
+BasicBlock* CFG_insert_preheader (CFG* cfg, Loop* loop);
+
+/**
+ * @brief Compute live-in and live-out sets of virtual registers for every block
+ *
+ * @c PHI operands are treated as uses at the end of the corresponding
+ * predecessor, and @c PHI results as definitions at the start of the block.
+ */
+void CFG_compute_liveness (CFG* cfg);
+
+/**
+ * @brief Deallocate a CFG, all of its blocks, and any instructions it still holds
+ */
+void CFG_free (CFG* cfg);
+
+#endif
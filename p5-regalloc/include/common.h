@@ -83,6 +83,45 @@ const char* DecafType_to_string(DecafType type);
  */
 void print_escaped_string(const char* string, FILE* output);
 
+/**
+ * @brief Hash a sequence of characters (64-bit FNV-1a)
+ *
+ * @param string Characters to hash (need not be null-terminated)
+ * @param length Number of characters
+ * @returns Hash value
+ */
+uint64_t hash_string(const char* string, size_t length);
+
+/**
+ * @brief Pool of distinct strings, indexed in order of first use
+ *
+ * Strings are not copied, so they must outlive the pool. Zero-initialize a
+ * pool before use and deallocate it with @ref StringPool_free.
+ */
+typedef struct StringPool
+{
+    const char** strings;   /**< @brief Distinct strings (in order of first use) */
+    int num_strings;
+    int cap_strings;
+    int* slots;             /**< @brief Hash table of string indices plus one (zero if empty) */
+    int cap_slots;
+    long total_size;        /**< @brief Total size in bytes (including null terminators) */
+} StringPool;
+
+/**
+ * @brief Add a string to the pool (unless an equal string is already there)
+ *
+ * @param pool String pool
+ * @param string String to add (must outlive the pool)
+ * @returns Index of the string in the pool
+ */
+int StringPool_add (StringPool* pool, const char* string);
+
+/**
+ * @brief Deallocate a pool's storage (but not the strings themselves)
+ */
+void StringPool_free (StringPool* pool);
+
 /**
  * @brief Print a Decaf string literal, inserting double escape codes as necessary.
  * 
@@ -10,6 +10,7 @@
 #define __ILOC_H
 
 #include "common.h"
+#include "writer.h"
 #include "token.h"
 #include "ast.h"
 #include "visitor.h"
@@ -150,6 +151,14 @@ Operand str_const (const char* string);
  */
 void Operand_print (Operand op, FILE* output);
 
+/**
+ * @brief Write an operand to a buffered writer (same text as @ref Operand_print)
+ *
+ * @param op Operand to write
+ * @param output Writer to write to
+ */
+void Operand_write (Operand op, Writer* output);
+
 /** 
  * @brief ILOC instruction form
  * 
@@ -222,6 +231,7 @@ typedef enum InsnForm
  *   * @ref ILOCInsn_get_operand_count
  *   * @ref ILOCInsn_get_read_registers
  *   * @ref ILOCInsn_get_write_register
+ *   * @ref ILOCInsn_get_write_index
 
  */
 typedef struct ILOCInsn
@@ -315,6 +325,14 @@ ILOCInsn* ILOCInsn_copy (ILOCInsn* insn);
  */
 void ILOCInsn_print (ILOCInsn* insn, FILE* output);
 
+/**
+ * @brief Write an instruction to a buffered writer (same text as @ref ILOCInsn_print)
+ *
+ * @param insn Instruction to write
+ * @param output Writer to write to
+ */
+void ILOCInsn_write (ILOCInsn* insn, Writer* output);
+
 /**
  * @brief Count the number of operands in an instruction
  * 
@@ -343,6 +361,18 @@ ILOCInsn* ILOCInsn_get_read_registers (ILOCInsn* insn);
  */
 Operand ILOCInsn_get_write_register (ILOCInsn* insn);
 
+/**
+ * @brief Get the index of the operand (if any) that is written to by this instruction
+ *
+ * Useful for renaming the destination of an instruction in place; the read
+ * registers returned by @ref ILOCInsn_get_read_registers are always at the
+ * same indices as in the original instruction.
+ *
+ * @param insn Instruction to examine
+ * @returns Index into @c op of the written register (or -1 if there is none)
+ */
+int ILOCInsn_get_write_index (ILOCInsn* insn);
+
 /**
  * @brief Deallocate an instruction structure
  * 
@@ -352,6 +382,17 @@ void ILOCInsn_free (ILOCInsn* insn);
 
 DECL_LIST_TYPE (Insn, ILOCInsn*)
 
+/**
+ * @brief Make sure that @ref virtual_register and @ref anonymous_label never hand
+ * out an ID that is already used in a list
+ *
+ * Needed for programs that were loaded from a file rather than generated in
+ * this process.
+ *
+ * @param list List of instructions
+ */
+void InsnList_reserve_ids (InsnList* list);
+
 /**
  * @brief Print an instruction list with proper indentation and comments
  * 
@@ -360,6 +401,64 @@ DECL_LIST_TYPE (Insn, ILOCInsn*)
  */
 void InsnList_print (InsnList* list, FILE* output);
 
+/**
+ * @brief Write an instruction list to a buffered writer (same text as @ref InsnList_print)
+ *
+ * @param list List of instructions to write
+ * @param output Writer to write to
+ */
+void InsnList_write (InsnList* list, Writer* output);
+
+/**
+ * @brief Who preserves a physical register across a procedure call
+ */
+typedef enum RegisterSaver
+{
+    CALLER_SAVED,   /**< @brief Any call may overwrite it (callers save live values) */
+    CALLEE_SAVED    /**< @brief Every function that writes it saves and restores it */
+} RegisterSaver;
+
+/**
+ * @brief Register conventions shared by the register allocator and a target
+ *
+ * Describes physical registers @c R0 to @c R(num_registers-1). Generated code
+ * passes arguments on the stack (starting at @ref PARAM_BP_OFFSET) and
+ * returns results in @c RET, so no physical register carries an argument.
+ */
+typedef struct CallingConvention
+{
+    int num_registers;                          /**< @brief Number of allocatable registers */
+    RegisterSaver saved_by[MAX_PHYSICAL_REGS];  /**< @brief Who preserves each register */
+    int num_arg_registers;                      /**< @brief Arguments passed in registers (none) */
+    Operand return_register;                    /**< @brief Register holding return values */
+} CallingConvention;
+
+/**
+ * @brief Create a calling convention
+ *
+ * The highest-numbered @p num_callee_saved registers are callee-saved and the
+ * rest are caller-saved.
+ *
+ * @param num_registers Number of allocatable registers
+ * @param num_callee_saved Number of callee-saved registers
+ * @returns Calling convention
+ */
+CallingConvention CallingConvention_new (int num_registers, int num_callee_saved);
+
+/**
+ * @brief Test whether a physical register is preserved across calls
+ */
+bool CallingConvention_is_callee_saved (const CallingConvention* convention, int pr);
+
+/**
+ * @brief Comment that marks a prologue store of a callee-saved register
+ *
+ * The simulator does not report these stores as uninitialized reads: a
+ * function saves every callee-saved register it writes, whether or not its
+ * caller ever set it. The comment survives the text and binary ILOC formats.
+ */
+#define CALLEE_SAVE_COMMENT "save callee-saved register"
+
 /**
  * @brief Create a new AST visitor that allocates addresses for all variable symbols
  *
@@ -438,4 +537,14 @@ Operand ASTNode_get_temp_reg (ASTNode* node);
  */
 long run_simulator (InsnList* program, bool print_trace);
 
+/**
+ * @brief Run ILOC simulator and count how many times each instruction executes
+ *
+ * @param program List of ILOC instructions
+ * @param print_trace Enable/disable debug tracing
+ * @param counts Destination for the execution count of each instruction, in
+ * list order (must have room for @c program->size entries; may be @c NULL)
+ */
+long run_simulator_with_profile (InsnList* program, bool print_trace, long* counts);
+
 #endif
@@ -0,0 +1,144 @@
+/**
+ * @file ilocbin.h
+ * @brief Binary ILOC container format
+ *
+ * A binary ILOC file caches the output of code generation so that register
+ * allocation, simulation, and Y86 emission can be re-run without the front
+ * end. All fields are fixed-width and stored in host byte order:
+ *
+ * | Section          | Contents                                            |
+ * |------------------|-----------------------------------------------------|
+ * | header           | @ref ILOCBinaryHeader                               |
+ * | instructions     | @c num_insns x @ref ILOCBinaryInsn                  |
+ * | function table   | @c num_functions x @ref ILOCBinaryFunction          |
+ * | string offsets   | @c num_strings x @c uint32_t (into the string data) |
+ * | string data      | @c string_bytes of null-terminated strings          |
+ *
+ * Call labels, string constants, and comments live in the string table;
+ * operands refer to them by index. Every section size is a multiple of four
+ * bytes (and the instruction array starts on an eight-byte boundary), so the
+ * reader can use a memory-mapped file in place.
+ */
+#ifndef __H_ILOCBIN
+#define __H_ILOCBIN
+
+#include "common.h"
+#include "iloc.h"
+
+/**
+ * @brief File signature ("ILOC" in little-endian order)
+ */
+#define ILOC_BINARY_MAGIC 0x434f4c49u
+
+/**
+ * @brief Current format version
+ */
+#define ILOC_BINARY_VERSION 1
+
+/**
+ * @brief Binary ILOC file header
+ */
+typedef struct ILOCBinaryHeader
+{
+    uint32_t magic;             /**< @brief Must be @ref ILOC_BINARY_MAGIC */
+    uint32_t version;           /**< @brief Must be @ref ILOC_BINARY_VERSION */
+    uint32_t num_insns;         /**< @brief Number of instructions */
+    uint32_t num_functions;     /**< @brief Number of function table entries */
+    uint32_t num_strings;       /**< @brief Number of strings */
+    uint32_t string_bytes;      /**< @brief Size of the string data (including terminators) */
+    int64_t static_size;        /**< @brief Size of global variables (for the Y86 layout) */
+} ILOCBinaryHeader;
+
+/**
+ * @brief Binary ILOC instruction (fixed-width operands)
+ */
+typedef struct ILOCBinaryInsn
+{
+    uint8_t form;               /**< @brief @ref InsnForm */
+    uint8_t type[3];            /**< @brief @ref OperandType of each operand */
+    int32_t comment;            /**< @brief String index of the comment (-1 if none) */
+    int64_t value[3];           /**< @brief Register/label ID, immediate, or string index */
+} ILOCBinaryInsn;
+
+/**
+ * @brief Binary ILOC function table entry
+ */
+typedef struct ILOCBinaryFunction
+{
+    uint32_t name;              /**< @brief String index of the function name */
+    uint32_t first_insn;        /**< @brief Index of the function's call label */
+} ILOCBinaryFunction;
+
+/**
+ * @brief Read-only view of a memory-mapped binary ILOC file
+ *
+ * All pointers refer directly into the mapping; nothing is copied.
+ */
+typedef struct ILOCImage
+{
+    void* mapping;                          /**< @brief Start of the mapping */
+    size_t size;                            /**< @brief Size of the mapping */
+    const ILOCBinaryHeader* header;         /**< @brief File header */
+    const ILOCBinaryInsn* insns;            /**< @brief Instruction array */
+    const ILOCBinaryFunction* functions;    /**< @brief Function table */
+    const uint32_t* string_offsets;         /**< @brief Offset of each string in @c strings */
+    const char* strings;                    /**< @brief String data */
+} ILOCImage;
+
+/**
+ * @brief Write an instruction list in binary form
+ *
+ * @param list ILOC program
+ * @param static_size Size of global variables (the @c staticSize attribute)
+ * @param output File stream (must be opened in binary mode)
+ * @returns True if and only if the write succeeded
+ */
+bool InsnList_write_binary (InsnList* list, long static_size, FILE* output);
+
+/**
+ * @brief Map a binary ILOC file into memory and validate it
+ *
+ * Prints an error message and returns @c NULL if the file cannot be read or
+ * is malformed.
+ *
+ * @param filename Name of file to open
+ * @returns Pointer to image (must be closed by @ref ILOCImage_close) or @c NULL
+ */
+ILOCImage* ILOCImage_open (const char* filename);
+
+/**
+ * @brief Look up a string in the image's string table
+ *
+ * @param image Binary ILOC image
+ * @param index String index (must be valid)
+ * @returns Pointer to the string inside the mapping
+ */
+const char* ILOCImage_string (ILOCImage* image, uint32_t index);
+
+/**
+ * @brief Decode an image into an instruction list
+ *
+ * The result can be handed to @ref run_simulator, @ref allocate_registers, or
+ * @ref emit_y86. IDs used by the program are reserved with
+ * @ref InsnList_reserve_ids.
+ *
+ * @param image Binary ILOC image
+ * @returns Pointer to new instruction list (must be freed by caller)
+ */
+InsnList* ILOCImage_to_insn_list (ILOCImage* image);
+
+/**
+ * @brief Unmap and deallocate an image
+ */
+void ILOCImage_close (ILOCImage* image);
+
+/**
+ * @brief Load a binary ILOC file into an instruction list
+ *
+ * @param filename Name of file to load
+ * @param static_size Size of global variables recorded in the file (may be @c NULL)
+ * @returns Pointer to new instruction list or @c NULL if there was an error
+ */
+InsnList* InsnList_load_binary (const char* filename, long* static_size);
+
+#endif
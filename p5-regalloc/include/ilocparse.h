@@ -0,0 +1,43 @@
+/**
+ * @file ilocparse.h
+ * @brief Parser for textual ILOC
+ *
+ * Reads the format produced by @ref InsnList_print back into an instruction
+ * list, so the register allocator and simulator can run on hand-written or
+ * generated @c .iloc files without the Decaf front end.
+ */
+#ifndef __H_ILOCPARSE
+#define __H_ILOCPARSE
+
+#include "common.h"
+#include "iloc.h"
+
+/**
+ * @brief Largest virtual register or jump label number accepted by
+ * @ref parse_iloc (and in binary images, see @ref ILOCImage_validate)
+ *
+ * Analyses size their tables by the largest ID in a program, so one huge
+ * number in a hand-written file would otherwise exhaust memory.
+ */
+#define ILOC_MAX_PARSED_ID 0xfffff
+
+/**
+ * @brief Convert ILOC text into an instruction list
+ *
+ * Works in a single pass directly on the given text (nothing is tokenized or
+ * copied up front). Lines that begin with whitespace are instructions, other
+ * non-blank lines are labels, and @c ';' starts a comment. Jump labels are
+ * written @c l<n>; any other label is a call label. Calls
+ * @ref Error_throw_printf if the text is malformed.
+ *
+ * Virtual registers and jump labels are limited to @ref ILOC_MAX_PARSED_ID and
+ * physical registers to @ref MAX_PHYSICAL_REGS. IDs used by the program are
+ * reserved with @ref InsnList_reserve_ids.
+ *
+ * @param text ILOC code (need not be null-terminated)
+ * @param length Number of characters in @p text
+ * @returns Newly-created instruction list
+ */
+InsnList* parse_iloc (const char* text, size_t length);
+
+#endif
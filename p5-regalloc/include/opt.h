@@ -0,0 +1,96 @@
+/**
+ * @file opt.h
+ * @brief ILOC optimization passes
+ *
+ * These passes run on virtual-register ILOC between code generation and
+ * register allocation. Each pass works one function at a time on the
+ * function's control-flow graph (see cfg.h) and reports how much it changed.
+ */
+#ifndef __OPT_H
+#define __OPT_H
+
+#include "common.h"
+#include "iloc.h"
+#include "cfg.h"
+#include "ssa.h"
+
+/**
+ * @brief Remove dead and unreachable code from a single function
+ *
+ * Repeats the following until nothing changes:
+ *   * delete blocks that are unreachable from the entry block
+ *   * thread branches through blocks that contain only a @c JUMP
+ *   * delete jumps to the next block and labels that are never targeted
+ *   * delete side-effect-free instructions whose results are never read
+ *
+ * @param cfg CFG of the function to optimize (edges are up to date afterwards)
+ * @returns Number of instructions removed
+ */
+int CFG_eliminate_dead_code (CFG* cfg);
+
+/**
+ * @brief Remove dead and unreachable code from every function in a program
+ *
+ * @param list ILOC program (modified in place)
+ * @returns Number of instructions removed
+ */
+int eliminate_dead_code (InsnList* list);
+
+/**
+ * @brief Sparse conditional constant propagation on a function in SSA form
+ *
+ * Finds the registers that always hold the same value (propagating through
+ * @c PHI instructions, but only along edges that can actually execute) and
+ * replaces their definitions with @c loadI. Conditional branches on constants
+ * become jumps, blocks that can never execute are removed, and the @c PHI
+ * instructions of their successors are updated to match. Arithmetic with a
+ * constant operand is switched to the immediate form where there is one.
+ *
+ * @param cfg CFG of the function to optimize (must be in SSA form)
+ * @returns Number of instructions folded or removed
+ */
+int CFG_propagate_constants (CFG* cfg);
+
+/**
+ * @brief Loop-invariant code motion on a function in SSA form
+ *
+ * Gives every natural loop a preheader and moves side-effect-free
+ * computations whose operands are all defined outside the loop into it,
+ * innermost loops first. Loads are only hoisted from global addresses in loops
+ * that contain no stores or calls, and divisions only by nonzero constants.
+ *
+ * @param cfg CFG of the function to optimize (must be in SSA form)
+ * @returns Number of instructions hoisted
+ */
+int CFG_hoist_loop_invariants (CFG* cfg);
+
+/**
+ * @brief Induction variable strength reduction on a function in SSA form
+ *
+ * Finds basic induction variables (header @c PHI instructions that are
+ * incremented by a constant on every iteration) and replaces multiplications
+ * of them by a constant (e.g., array index scaling) with new induction
+ * variables that are incremented instead. When the product is only used as
+ * the offset of an array access from a loop-invariant base, the new variable
+ * is the element address itself and the access uses it directly.
+ *
+ * @param cfg CFG of the function to optimize (must be in SSA form)
+ * @returns Number of multiplications removed
+ */
+int CFG_reduce_induction_vars (CFG* cfg);
+
+/**
+ * @brief Run all optimization passes on an ILOC program
+ *
+ * Each function has its scalar stack slots promoted to virtual registers, is
+ * converted to SSA form (which folds away redundant copies), has its constants
+ * propagated, its loop invariants hoisted, and its induction variables
+ * strength-reduced, is converted back out of SSA form, and then has its dead
+ * and unreachable code removed.
+ *
+ * @param list ILOC program (modified in place)
+ * @param report File stream for a summary of each pass (or @c NULL for none)
+ */
+void optimize (InsnList* list, FILE* report);
+
+#endif
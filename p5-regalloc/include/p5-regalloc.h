@@ -9,6 +9,21 @@
 #include "common.h"
 #include "iloc.h"
 
+/**
+ * @brief Counts of the code inserted by the register allocator
+ */
+typedef struct RegAllocStats
+{
+    int spill_stores;       /**< @brief Stores of registers to the stack */
+    int spill_loads;        /**< @brief Loads of spilled values back into registers */
+    int stack_slots;        /**< @brief Stack frame slots added for spilled values */
+    int rematerializations; /**< @brief Values recomputed instead of reloaded */
+    int callee_saved_registers; /**< @brief Callee-saved registers saved in function prologues */
+    int live_range_splits;  /**< @brief Values renamed inside a loop (with copies at its boundaries) */
+    long spill_cost;        /**< @brief Inserted instructions weighted by estimated block frequency */
+    int optimal_functions;  /**< @brief Functions allocated by exhaustive search (see @ref allocate_registers_optimal) */
+} RegAllocStats;
+
 /**
  * @brief Allocate registers for an ILOC program
  * 
@@ -17,4 +32,67 @@
  */
 void allocate_registers (InsnList* list, int num_physical_registers);
 
+/**
+ * @brief Allocate registers for an ILOC program and report how much spill code was needed
+ *
+ * @param list ILOC program as a list of instructions (the list is modified in place)
+ * @param num_physical_registers Maximum number of physical registers to be used
+ * @param stats Destination for the spill code counts (reset first; may be @c NULL)
+ */
+void allocate_registers_with_stats (InsnList* list, int num_physical_registers, RegAllocStats* stats);
+
+/**
+ * @brief Allocate registers for an ILOC program that follows a calling convention
+ *
+ * Values that are live across calls are kept in callee-saved registers when
+ * possible, and each function saves the callee-saved registers that it writes
+ * (in its frame, in the prologue) and restores them before every epilogue.
+ * Functions without a standard prologue and epilogue only use caller-saved
+ * registers. The other entry points treat every register as caller-saved.
+ *
+ * @param list ILOC program as a list of instructions (the list is modified in place)
+ * @param convention Registers to allocate and which of them survive calls
+ * @param stats Destination for the spill code counts (reset first; may be @c NULL)
+ */
+void allocate_registers_with_convention (InsnList* list, const CallingConvention* convention,
+                                         RegAllocStats* stats);
+
+/**
+ * @brief Allocate registers for an ILOC program, searching exhaustively in small functions
+ *
+ * The allocator keeps the values that cost the most spill code in dedicated
+ * registers and handles everything else one block at a time. In functions
+ * with at most @p max_candidates values that are live across blocks, every
+ * feasible choice of dedicated registers for those values is tried and the
+ * one with the lowest @ref RegAllocStats::spill_cost is kept (the usual
+ * choice is tried first, so the result is never worse). Larger functions are
+ * allocated as by @ref allocate_registers_with_stats. This is slow, and is
+ * meant as a baseline for the usual allocation (or for very small functions).
+ *
+ * @param list ILOC program as a list of instructions (the list is modified in place)
+ * @param num_physical_registers Maximum number of physical registers to be used
+ * @param max_candidates Largest number of values live across blocks to search over
+ * @param stats Destination for the spill code counts (reset first; may be @c NULL)
+ */
+void allocate_registers_optimal (InsnList* list, int num_physical_registers, int max_candidates,
+                                 RegAllocStats* stats);
+
+/**
+ * @brief Allocate registers for an ILOC program in SSA form
+ *
+ * An alternative to @ref allocate_registers_with_stats for comparison. Values
+ * are first spilled (furthest next use first, across the whole control flow
+ * graph) until no more of them are live at any point than there are
+ * registers. The function is then converted to SSA form, in which the
+ * interference graph is chordal: coloring the values in dominance order
+ * needs no more registers than that, so no further spilling is necessary.
+ * Finally, each @c PHI becomes a parallel copy between registers along the
+ * edges into its block. All registers are caller-saved.
+ *
+ * @param list ILOC program as a list of instructions (the list is modified in place)
+ * @param num_physical_registers Maximum number of physical registers to be used
+ * @param stats Destination for the spill code counts (reset first; may be @c NULL)
+ */
+void allocate_registers_ssa (InsnList* list, int num_physical_registers, RegAllocStats* stats);
+
 #endif
@@ -0,0 +1,57 @@
+/**
+ * @file ssa.h
+ * @brief Static single assignment (SSA) form for ILOC functions
+ *
+ * SSA construction places @c PHI instructions at the iterated dominance
+ * frontiers of each multiply-defined virtual register (pruned by liveness) and
+ * then renames every definition along the dominator tree. Because the @c PHI
+ * form only has two source operands, blocks that need a @c PHI never have more
+ * than two predecessors; larger joins are split into a chain of two-way joins
+ * first.
+ *
+ * SSA destruction replaces the @c PHI instructions of each block with a
+ * parallel copy at the end of each predecessor (splitting critical edges),
+ * which is then sequentialized into ordinary @c I2I instructions. Copies whose
+ * source and destination do not interfere are coalesced afterwards.
+ */
+#ifndef __SSA_H
+#define __SSA_H
+
+#include "common.h"
+#include "iloc.h"
+#include "cfg.h"
+
+/**
+ * @brief Promote scalar stack slots (parameters and locals) to virtual registers
+ *
+ * Every @c loadAI / @c storeAI through @c BP becomes a copy from / to a new
+ * virtual register for that slot. Parameters are loaded from the stack once on
+ * entry, and locals start out as zero. Nothing is promoted if @c BP is used in
+ * any other way besides the standard prologue and epilogue. The local
+ * allocator is removed since the frame no longer holds any locals.
+ *
+ * @param cfg CFG of the function to modify
+ * @returns Number of slots promoted
+ */
+int CFG_promote_stack_slots (CFG* cfg);
+
+/**
+ * @brief Convert a function to (pruned) SSA form
+ *
+ * Also removes unreachable blocks and makes all control transfers explicit.
+ * Copies between virtual registers are folded away during renaming.
+ *
+ * @param cfg CFG of the function to convert
+ * @returns Number of @c PHI instructions inserted
+ */
+int CFG_to_ssa (CFG* cfg);
+
+/**
+ * @brief Convert a function out of SSA form
+ *
+ * @param cfg CFG of the function to convert
+ * @returns Number of copy instructions inserted (less those coalesced)
+ */
+int CFG_from_ssa (CFG* cfg);
+
+#endif
@@ -0,0 +1,131 @@
+/**
+ * @file writer.h
+ * @brief Buffered output writer
+ *
+ * The ILOC and Y86 emitters produce many short pieces of text (mnemonics,
+ * register names, and small integers). Routing each piece through @c fprintf
+ * dominates the back end for large programs, so this writer collects text in
+ * a large user-space buffer and formats integers and strings by hand. It
+ * writes either to a @c FILE* (flushing whenever the buffer fills up) or to a
+ * growable memory buffer.
+ */
+#ifndef __H_WRITER
+#define __H_WRITER
+
+#include "common.h"
+
+/**
+ * @brief Buffer size for writers attached to a file stream
+ */
+#define WRITER_BUFFER_SIZE 65536
+
+/**
+ * @brief Buffered output destination
+ */
+typedef struct Writer
+{
+    FILE* file;         /**< @brief Destination stream (@c NULL when writing to memory) */
+    char* data;         /**< @brief Buffered (not yet flushed) text */
+    size_t length;      /**< @brief Number of buffered characters */
+    size_t capacity;    /**< @brief Size of @c data */
+    bool owns_data;     /**< @brief Should @c data be freed with the writer? */
+} Writer;
+
+/**
+ * @brief Allocate a writer that flushes to a file stream
+ *
+ * @param file Destination stream
+ * @returns Pointer to new writer (must be freed by @ref Writer_free)
+ */
+Writer* Writer_new_file (FILE* file);
+
+/**
+ * @brief Allocate a writer that collects its output in memory
+ *
+ * @returns Pointer to new writer (must be freed by @ref Writer_free)
+ */
+Writer* Writer_new_memory (void);
+
+/**
+ * @brief Initialize a writer that flushes to a file stream using caller-provided storage
+ *
+ * Useful for short-lived writers (e.g., printing a single instruction) that
+ * should not allocate. The caller must call @ref Writer_flush when done.
+ *
+ * @param writer Writer to initialize
+ * @param file Destination stream
+ * @param buffer Buffer storage
+ * @param capacity Size of @p buffer
+ */
+void Writer_init (Writer* writer, FILE* file, char* buffer, size_t capacity);
+
+/**
+ * @brief Write a sequence of characters
+ */
+void Writer_write (Writer* writer, const char* text, size_t length);
+
+/**
+ * @brief Write a single character
+ */
+void Writer_putc (Writer* writer, char c);
+
+/**
+ * @brief Write a null-terminated string
+ */
+void Writer_puts (Writer* writer, const char* text);
+
+/**
+ * @brief Write a signed integer in decimal
+ */
+void Writer_int (Writer* writer, long value);
+
+/**
+ * @brief Write an unsigned integer in hexadecimal (lowercase, no prefix)
+ */
+void Writer_hex (Writer* writer, unsigned long value);
+
+/**
+ * @brief Write a string literal, inserting escape codes as necessary
+ *
+ * Produces the same output as @ref print_escaped_string.
+ */
+void Writer_escaped (Writer* writer, const char* text);
+
+/**
+ * @brief Write formatted text
+ *
+ * Handles @c %%s, @c %%c, @c %%d, @c %%ld, @c %%x, @c %%lx, and @c %%%% directly;
+ * anything with flags, a width, or a precision goes through @c vsnprintf.
+ */
+void Writer_printf (Writer* writer, const char* format, ...);
+
+/**
+ * @brief Write formatted text (see @ref Writer_printf)
+ */
+void Writer_vprintf (Writer* writer, const char* format, va_list args);
+
+/**
+ * @brief Write all buffered text to the file stream (no effect for memory writers)
+ */
+void Writer_flush (Writer* writer);
+
+/**
+ * @brief Discard all buffered text (memory writers only)
+ */
+void Writer_reset (Writer* writer);
+
+/**
+ * @brief Access the text collected by a memory writer
+ *
+ * @returns Null-terminated text (valid until the next write)
+ */
+const char* Writer_contents (Writer* writer);
+
+/**
+ * @brief Flush and deallocate a writer
+ *
+ * Does not close the file stream.
+ */
+void Writer_free (Writer* writer);
+
+#endif
@@ -9,9 +9,125 @@
 #include "token.h"
 #include "iloc.h"
 
+/**
+ * @brief Size of the Y86 address space (64K)
+ */
+#define Y86_MEM_SIZE 65536
+
+/**
+ * @brief Default stack budget (in bytes)
+ */
+#define Y86_DEFAULT_STACK_SIZE 0x4000
+
+/**
+ * @brief Default static data reservation when the real size is unknown (the
+ * original 0x100-0x400 data region)
+ */
+#define Y86_DEFAULT_STATIC_SIZE 0x300
+
+/**
+ * @brief Alignment of the code and string sections (in bytes)
+ */
+#define Y86_SECTION_ALIGN WORD_SIZE
+
+/**
+ * @brief Maximum number of Y86 registers that can be handed to the allocator
+ */
+#define Y86_MAX_REGISTERS 9
+
+/**
+ * @brief Y86 registers available to the register allocator
+ *
+ * Physical register @c Rn is emitted as @c names[n]. Registers that serve as
+ * scratch space for the multiply/divide helper routines or for I/O are only
+ * held back if the program needs them.
+ */
+typedef struct Y86RegisterFile
+{
+    int num_registers;                      /**< @brief Number of allocatable registers */
+    const char* names[Y86_MAX_REGISTERS];   /**< @brief Y86 name of each allocatable register */
+} Y86RegisterFile;
+
+/**
+ * @brief Describe the registers that can be allocated for a program
+ *
+ * The result does not change during register allocation, so the allocator
+ * and @ref emit_y86 always agree on the mapping.
+ *
+ * @param iloc ILOC program as a list of instructions
+ * @returns Register file description
+ */
+Y86RegisterFile y86_register_file (InsnList* iloc);
+
+/**
+ * @brief Number of Y86 registers (the first ones in the register file) that
+ * are caller-saved; the rest are callee-saved
+ */
+#define Y86_CALLER_SAVED_REGISTERS 4
+
+/**
+ * @brief Describe the calling convention for the registers of a program
+ *
+ * Covers the registers of @ref y86_register_file: @c %rcx, @c %rdx, @c %r10,
+ * and @c %r11 are caller-saved, and the others are callee-saved. Arguments
+ * are passed on the stack and results are returned in @c %rax.
+ *
+ * @param iloc ILOC program as a list of instructions
+ * @returns Calling convention
+ */
+CallingConvention y86_calling_convention (InsnList* iloc);
+
+/**
+ * @brief Memory layout of a generated Y86 program
+ *
+ * Static data always starts at @ref STATIC_VAR_OFFSET because the code
+ * generator uses absolute addresses for globals. The code, string table
+ * (rodata), and stack follow it in that order, each aligned to
+ * @ref Y86_SECTION_ALIGN. The initial stack pointer is the stack budget past
+ * the end of the string table, so a program only needs as much memory as its
+ * sections. The caller provides the static data size and the stack budget;
+ * the emitter fills in the rest.
+ */
+typedef struct Y86Layout
+{
+    long static_size;       /**< @brief Size of global variables (the @c staticSize attribute) */
+    long stack_size;        /**< @brief Stack budget */
+    long code_addr;         /**< @brief Start of the code section (output) */
+    long code_size;         /**< @brief Size of the code section (output) */
+    long rodata_addr;       /**< @brief Start of the string table (output) */
+    long rodata_size;       /**< @brief Size of the string table (output) */
+    long stack_addr;        /**< @brief Initial stack pointer (output) */
+} Y86Layout;
+
+/**
+ * @brief Create a layout with the given inputs
+ *
+ * Prints an error message and exits if the static data and stack budget
+ * cannot both fit in @ref Y86_MEM_SIZE bytes.
+ *
+ * @param static_size Size of global variables in bytes
+ * @param stack_size Minimum stack space in bytes
+ * @returns Layout (outputs are zero until @ref emit_y86_with_layout fills them in)
+ */
+Y86Layout Y86Layout_new (long static_size, long stack_size);
+
+/**
+ * @brief Generate Y86 assembly from ILOC with a given memory layout
+ *
+ * Prints an error message and exits if the sections and the stack budget do
+ * not fit in @ref Y86_MEM_SIZE bytes.
+ *
+ * @param iloc ILOC program as a list of instructions
+ * @param output File stream for output
+ * @param layout Layout inputs (the section addresses and sizes are filled in)
+ */
+void emit_y86_with_layout (InsnList* iloc, FILE* output, Y86Layout* layout);
+
 /**
  * @brief Generate Y86 assembly from ILOC
  *
+ * Uses @ref Y86_DEFAULT_STATIC_SIZE and @ref Y86_DEFAULT_STACK_SIZE.
+ *
  * Some code courtesy of Kevin Kelly (honors option, Fall 2018)
  * 
  * @param iloc ILOC program as a list of instructions
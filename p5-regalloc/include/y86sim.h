@@ -0,0 +1,99 @@
+/**
+ * @file y86sim.h
+ * @brief Y86-64 assembler and simulator
+ *
+ * The assembler accepts the output of @ref emit_y86 and encodes it into a
+ * memory image using the standard CS:APP instruction formats. It adds a
+ * one-byte @c iotrap instruction (@c 0xE0 plus the trap number) for the I/O
+ * calls used by the emitter.
+ *
+ * The simulator executes one instruction at a time. It also estimates the
+ * cycle count of the five-stage PIPE implementation:
+ * - one cycle per instruction, plus four to fill the pipeline
+ * - one bubble for each load/use hazard
+ * - two cycles for each mispredicted (not taken) conditional jump
+ * - three cycles for each @c ret
+ */
+#ifndef __H_Y86SIM
+#define __H_Y86SIM
+
+#include "common.h"
+#include "iloc.h"
+#include "y86.h"
+
+/**
+ * @brief Maximum number of instructions executed before the simulator gives up
+ */
+#define Y86_MAX_STEPS 100000000L
+
+/**
+ * @brief I/O trap numbers (operand of the @c iotrap instruction)
+ */
+typedef enum Y86Trap
+{
+    CHAROUT,    /**< @brief Write the byte at address @c %rsi */
+    CHARIN,     /**< @brief Read a byte into address @c %rdi */
+    DECOUT,     /**< @brief Write the quad at address @c %rsi in decimal */
+    DECIN,      /**< @brief Read a decimal quad into address @c %rdi */
+    STROUT,     /**< @brief Write the null-terminated string at address @c %rsi */
+    FLUSH       /**< @brief Flush the output stream */
+} Y86Trap;
+
+/**
+ * @brief Execution statistics gathered by the Y86 simulator
+ */
+typedef struct Y86Stats
+{
+    long instructions;          /**< @brief Instructions executed (including @c halt) */
+    long cycles;                /**< @brief Estimated cycles on the PIPE implementation */
+    long load_use_stalls;       /**< @brief Bubbles inserted for load/use hazards */
+    long mispredictions;        /**< @brief Conditional jumps that were not taken */
+    long returns;               /**< @brief @c ret instructions executed */
+    long memory_reads;          /**< @brief Quad reads (@c mrmovq, @c popq, and @c ret) */
+    long memory_writes;         /**< @brief Quad writes (@c rmmovq, @c pushq, and @c call) */
+} Y86Stats;
+
+/**
+ * @brief Assemble Y86 source code into a memory image
+ *
+ * Prints an error message and exits if the source is malformed.
+ *
+ * @param source Y86 assembly code (null-terminated)
+ * @returns Memory image of @ref Y86_MEM_SIZE bytes (must be freed by caller)
+ */
+uint8_t* assemble_y86 (const char* source);
+
+/**
+ * @brief Run an assembled program from address zero until it halts
+ *
+ * Prints an error message and exits on an invalid instruction or address.
+ *
+ * @param memory Memory image (modified during execution)
+ * @param output File stream for I/O trap output
+ * @param stats Execution statistics (may be @c NULL)
+ * @returns Final value of @c %rax
+ */
+long simulate_y86 (uint8_t* memory, FILE* output, Y86Stats* stats);
+
+/**
+ * @brief Generate Y86 code for an (allocated) ILOC program, then assemble and run it
+ *
+ * Prints an error message and exits if the stack grows past its budget.
+ *
+ * @param iloc ILOC program with physical registers only
+ * @param layout Memory layout (@c NULL for the defaults used by @ref emit_y86)
+ * @param output File stream for I/O trap output
+ * @param stats Execution statistics (may be @c NULL)
+ * @returns Final value of @c %rax
+ */
+long run_y86 (InsnList* iloc, Y86Layout* layout, FILE* output, Y86Stats* stats);
+
+/**
+ * @brief Print execution statistics
+ *
+ * @param stats Statistics to print
+ * @param output File stream for output
+ */
+void Y86Stats_print (Y86Stats* stats, FILE* output);
+
+#endif
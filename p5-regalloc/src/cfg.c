@@ -0,0 +1,983 @@
+#include "cfg.h"
+
+/*
+ * Bit sets
+ */
+
+BitSet* BitSet_new (int size)
+{
+    BitSet* set = (BitSet*)calloc(1, sizeof(BitSet));
+    CHECK_MALLOC_PTR(set);
+    set->size = size;
+    set->num_words = (size + 63) / 64;
+    set->words = (uint64_t*)calloc(set->num_words + 1, sizeof(uint64_t));
+    CHECK_MALLOC_PTR(set->words);
+    return set;
+}
+
+void BitSet_add (BitSet* set, int elem)
+{
+    if (elem >= 0 && elem < set->size) {
+        set->words[elem / 64] |= ((uint64_t)1 << (elem % 64));
+    }
+}
+
+void BitSet_remove (BitSet* set, int elem)
+{
+    if (elem >= 0 && elem < set->size) {
+        set->words[elem / 64] &= ~((uint64_t)1 << (elem % 64));
+    }
+}
+
+bool BitSet_contains (BitSet* set, int elem)
+{
+    if (elem < 0 || elem >= set->size) {
+        return false;
+    }
+    return (set->words[elem / 64] >> (elem % 64)) & 1;
+}
+
+void BitSet_clear (BitSet* set)
+{
+    memset(set->words, 0, set->num_words * sizeof(uint64_t));
+}
+
+void BitSet_copy (BitSet* dest, BitSet* src)
+{
+    memcpy(dest->words, src->words, src->num_words * sizeof(uint64_t));
+}
+
+bool BitSet_union (BitSet* dest, BitSet* src)
+{
+    bool changed = false;
+    for (int w = 0; w < dest->num_words; w++) {
+        uint64_t merged = dest->words[w] | src->words[w];
+        if (merged != dest->words[w]) {
+            dest->words[w] = merged;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool BitSet_intersects (BitSet* a, BitSet* b)
+{
+    for (int w = 0; w < a->num_words; w++) {
+        if ((a->words[w] & b->words[w]) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int BitSet_count (BitSet* set)
+{
+    int count = 0;
+    for (int w = 0; w < set->num_words; w++) {
+        count += __builtin_popcountll(set->words[w]);
+    }
+    return count;
+}
+
+void BitSet_free (BitSet* set)
+{
+    free(set->words);
+    free(set);
+}
+
+
+/*
+ * Basic blocks
+ */
+
+BasicBlock* BasicBlock_new (void)
+{
+    BasicBlock* block = (BasicBlock*)calloc(1, sizeof(BasicBlock));
+    CHECK_MALLOC_PTR(block);
+    block->insns = InsnList_new();
+    block->cap_preds = 4;
+    block->preds = (BasicBlock**)calloc(block->cap_preds, sizeof(BasicBlock*));
+    CHECK_MALLOC_PTR(block->preds);
+    return block;
+}
+
+void BasicBlock_add_pred (BasicBlock* block, BasicBlock* pred)
+{
+    if (block->num_preds == block->cap_preds) {
+        block->cap_preds *= 2;
+        block->preds = (BasicBlock**)realloc(block->preds, block->cap_preds * sizeof(BasicBlock*));
+        CHECK_MALLOC_PTR(block->preds);
+    }
+    block->preds[block->num_preds++] = pred;
+}
+
+void BasicBlock_free_sets (BasicBlock* block)
+{
+    if (block->live_in != NULL) {
+        BitSet_free(block->live_in);
+        block->live_in = NULL;
+    }
+    if (block->live_out != NULL) {
+        BitSet_free(block->live_out);
+        block->live_out = NULL;
+    }
+}
+
+void BasicBlock_free (BasicBlock* block)
+{
+    ILOCInsn* insn = block->insns->head;
+    while (insn != NULL) {
+        ILOCInsn* next = insn->next;
+        ILOCInsn_free(insn);
+        insn = next;
+    }
+    BasicBlock_free_sets(block);
+    if (block->frontier != NULL) {
+        BitSet_free(block->frontier);
+    }
+    free(block->insns);
+    free(block->preds);
+    free(block);
+}
+
+ILOCInsn* BasicBlock_terminator (BasicBlock* block)
+{
+    ILOCInsn* last = block->insns->tail;
+    if (last != NULL && (last->form == JUMP || last->form == CBR || last->form == RETURN)) {
+        return last;
+    }
+    return NULL;
+}
+
+int BasicBlock_label (BasicBlock* block)
+{
+    ILOCInsn* first = block->insns->head;
+    if (first != NULL && first->form == LABEL && first->op[0].type == JUMP_LABEL) {
+        return first->op[0].id;
+    }
+    return -1;
+}
+
+void BasicBlock_insert_after (BasicBlock* block, ILOCInsn* prev, ILOCInsn* insn)
+{
+    if (prev == NULL) {
+        insn->next = block->insns->head;
+        block->insns->head = insn;
+    } else {
+        insn->next = prev->next;
+        prev->next = insn;
+    }
+    if (insn->next == NULL) {
+        block->insns->tail = insn;
+    }
+    block->insns->size++;
+}
+
+void BasicBlock_insert_before_terminator (BasicBlock* block, ILOCInsn* insn)
+{
+    ILOCInsn* term = BasicBlock_terminator(block);
+    if (term == NULL) {
+        BasicBlock_insert_after(block, block->insns->tail, insn);
+        return;
+    }
+    ILOCInsn* prev = NULL;
+    FOR_EACH (ILOCInsn*, i, block->insns) {
+        if (i->next == term) {
+            prev = i;
+        }
+    }
+    BasicBlock_insert_after(block, prev, insn);
+}
+
+ILOCInsn* BasicBlock_unlink_after (BasicBlock* block, ILOCInsn* prev)
+{
+    ILOCInsn* victim = (prev == NULL ? block->insns->head : prev->next);
+    if (victim == NULL) {
+        return NULL;
+    }
+    if (prev == NULL) {
+        block->insns->head = victim->next;
+    } else {
+        prev->next = victim->next;
+    }
+    if (block->insns->tail == victim) {
+        block->insns->tail = prev;
+    }
+    block->insns->size--;
+    victim->next = NULL;
+    return victim;
+}
+
+void BasicBlock_remove_after (BasicBlock* block, ILOCInsn* prev)
+{
+    ILOCInsn* victim = BasicBlock_unlink_after(block, prev);
+    if (victim != NULL) {
+        ILOCInsn_free(victim);
+    }
+}
+
+void BasicBlock_retarget (BasicBlock* from, int old_label, int new_label)
+{
+    ILOCInsn* term = BasicBlock_terminator(from);
+    if (term == NULL) {
+        return;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (term->op[i].type == JUMP_LABEL && term->op[i].id == old_label) {
+            term->op[i].id = new_label;
+        }
+    }
+}
+
+
+/*
+ * Control-flow graphs
+ */
+
+CFG* CFG_new (void)
+{
+    CFG* cfg = (CFG*)calloc(1, sizeof(CFG));
+    CHECK_MALLOC_PTR(cfg);
+    cfg->cap_blocks = 16;
+    cfg->blocks = (BasicBlock**)calloc(cfg->cap_blocks, sizeof(BasicBlock*));
+    CHECK_MALLOC_PTR(cfg->blocks);
+    return cfg;
+}
+
+/**
+ * @brief Deallocate a loop
+ */
+void Loop_free (Loop* loop)
+{
+    BitSet_free(loop->blocks);
+    free(loop);
+}
+
+DEF_LIST_IMPL(Loop, Loop*, Loop_free)
+
+void CFG_free (CFG* cfg)
+{
+    if (cfg->loops != NULL) {
+        LoopList_free(cfg->loops);
+    }
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        BasicBlock_free(cfg->blocks[b]);
+    }
+    free(cfg->blocks);
+    free(cfg->label_map);
+    free(cfg);
+}
+
+DEF_LIST_IMPL(CFG, CFG*, CFG_free)
+
+BasicBlock* CFG_insert_block (CFG* cfg, int pos)
+{
+    if (cfg->num_blocks == cfg->cap_blocks) {
+        cfg->cap_blocks *= 2;
+        cfg->blocks = (BasicBlock**)realloc(cfg->blocks, cfg->cap_blocks * sizeof(BasicBlock*));
+        CHECK_MALLOC_PTR(cfg->blocks);
+    }
+    for (int b = cfg->num_blocks; b > pos; b--) {
+        cfg->blocks[b] = cfg->blocks[b-1];
+        cfg->blocks[b]->id = b;
+    }
+    BasicBlock* block = BasicBlock_new();
+    block->id = pos;
+    cfg->blocks[pos] = block;
+    cfg->num_blocks++;
+    return block;
+}
+
+void CFG_remove_block (CFG* cfg, BasicBlock* block)
+{
+    /* drop any references to the removed block */
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        BasicBlock* other = cfg->blocks[b];
+        int count = 0;
+        for (int s = 0; s < other->num_succ; s++) {
+            if (other->succ[s] != block) {
+                other->succ[count++] = other->succ[s];
+            }
+        }
+        other->num_succ = count;
+        count = 0;
+        for (int p = 0; p < other->num_preds; p++) {
+            if (other->preds[p] != block) {
+                other->preds[count++] = other->preds[p];
+            }
+        }
+        other->num_preds = count;
+    }
+    for (int l = 0; l < cfg->label_map_size; l++) {
+        if (cfg->label_map[l] == block) {
+            cfg->label_map[l] = NULL;
+        }
+    }
+
+    int pos = block->id;
+    BasicBlock_free(block);
+    for (int b = pos; b < cfg->num_blocks - 1; b++) {
+        cfg->blocks[b] = cfg->blocks[b+1];
+        cfg->blocks[b]->id = b;
+    }
+    cfg->num_blocks--;
+}
+
+ILOCInsn* CFG_function_label (CFG* cfg)
+{
+    if (cfg->num_blocks == 0) {
+        return NULL;
+    }
+    ILOCInsn* first = cfg->blocks[0]->insns->head;
+    if (first != NULL && first->form == LABEL && first->op[0].type == CALL_LABEL) {
+        return first;
+    }
+    return NULL;
+}
+
+ILOCInsn* CFG_local_allocator (CFG* cfg)
+{
+    if (cfg->num_blocks == 0) {
+        return NULL;
+    }
+    FOR_EACH (ILOCInsn*, insn, cfg->blocks[0]->insns) {
+        if (insn->form == PUSH && insn->next != NULL && insn->next->form == I2I &&
+                insn->next->next != NULL && insn->next->next->form == ADD_I &&
+                insn->next->next->op[2].type == STACK_REG) {
+            return insn->next->next;
+        }
+    }
+    return NULL;
+}
+
+BasicBlock* CFG_find_label (CFG* cfg, int label_id)
+{
+    if (label_id < 0 || label_id >= cfg->label_map_size) {
+        return NULL;
+    }
+    return cfg->label_map[label_id];
+}
+
+/**
+ * @brief Test whether a block contains a given predecessor
+ */
+bool has_pred (BasicBlock* block, BasicBlock* pred)
+{
+    for (int p = 0; p < block->num_preds; p++) {
+        if (block->preds[p] == pred) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Test whether there is an edge from one block to another
+ */
+bool has_succ (BasicBlock* block, BasicBlock* succ)
+{
+    for (int s = 0; s < block->num_succ; s++) {
+        if (block->succ[s] == succ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Look up a branch target, aborting if it is not in this function
+ */
+BasicBlock* find_target (CFG* cfg, ILOCInsn* branch, Operand label)
+{
+    BasicBlock* target = CFG_find_label(cfg, label.id);
+    if (target == NULL) {
+        printf("ERROR: Branch target is not in the same function: ");
+        ILOCInsn_print(branch, stdout);
+        printf("\n");
+        exit(EXIT_FAILURE);
+    }
+    return target;
+}
+
+void CFG_compute_edges (CFG* cfg)
+{
+    /* renumber blocks and rebuild the label map */
+    int max_label = -1;
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        cfg->blocks[b]->id = b;
+        int label = BasicBlock_label(cfg->blocks[b]);
+        if (label > max_label) {
+            max_label = label;
+        }
+    }
+    if (max_label + 1 > cfg->label_map_size) {
+        cfg->label_map_size = max_label + 1;
+        cfg->label_map = (BasicBlock**)realloc(cfg->label_map,
+                cfg->label_map_size * sizeof(BasicBlock*));
+        CHECK_MALLOC_PTR(cfg->label_map);
+    }
+    for (int l = 0; l < cfg->label_map_size; l++) {
+        cfg->label_map[l] = NULL;
+    }
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        int label = BasicBlock_label(cfg->blocks[b]);
+        if (label >= 0) {
+            cfg->label_map[label] = cfg->blocks[b];
+        }
+    }
+
+    /* successors (from terminators and layout) */
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        BasicBlock* block = cfg->blocks[b];
+        ILOCInsn* term = BasicBlock_terminator(block);
+        block->num_succ = 0;
+        if (term == NULL) {
+            if (b + 1 < cfg->num_blocks) {
+                block->succ[block->num_succ++] = cfg->blocks[b+1];
+            }
+        } else if (term->form == JUMP) {
+            block->succ[block->num_succ++] = find_target(cfg, term, term->op[0]);
+        } else if (term->form == CBR) {
+            block->succ[block->num_succ++] = find_target(cfg, term, term->op[1]);
+            BasicBlock* other = find_target(cfg, term, term->op[2]);
+            if (other != block->succ[0]) {
+                block->succ[block->num_succ++] = other;
+            }
+        }
+    }
+
+    /* predecessors (keeping the existing order of surviving predecessors) */
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        BasicBlock* block = cfg->blocks[b];
+        int count = 0;
+        for (int p = 0; p < block->num_preds; p++) {
+            BasicBlock* pred = block->preds[p];
+            bool duplicate = false;
+            for (int q = 0; q < count; q++) {
+                duplicate |= (block->preds[q] == pred);
+            }
+            if (has_succ(pred, block) && !duplicate) {
+                block->preds[count++] = pred;
+            }
+        }
+        block->num_preds = count;
+    }
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        BasicBlock* block = cfg->blocks[b];
+        for (int s = 0; s < block->num_succ; s++) {
+            if (!has_pred(block->succ[s], block)) {
+                BasicBlock_add_pred(block->succ[s], block);
+            }
+        }
+    }
+
+    /* reachability (depth-first search from the entry block) */
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        cfg->blocks[b]->reachable = false;
+    }
+    if (cfg->num_blocks == 0) {
+        return;
+    }
+    BasicBlock** stack = (BasicBlock**)calloc(cfg->num_blocks, sizeof(BasicBlock*));
+    CHECK_MALLOC_PTR(stack);
+    int top = 0;
+    stack[top++] = cfg->blocks[0];
+    cfg->blocks[0]->reachable = true;
+    while (top > 0) {
+        BasicBlock* block = stack[--top];
+        for (int s = 0; s < block->num_succ; s++) {
+            if (!block->succ[s]->reachable) {
+                block->succ[s]->reachable = true;
+                stack[top++] = block->succ[s];
+            }
+        }
+    }
+    free(stack);
+}
+
+void CFG_make_explicit (CFG* cfg)
+{
+    /* every block except the entry gets a jump label */
+    for (int b = 1; b < cfg->num_blocks; b++) {
+        BasicBlock* block = cfg->blocks[b];
+        if (BasicBlock_label(block) < 0) {
+            BasicBlock_insert_after(block, NULL, ILOCInsn_new_1op(LABEL, anonymous_label()));
+        }
+    }
+    CFG_compute_edges(cfg);
+
+    /* fall-through edges become jumps, and branches with one target become jumps */
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        BasicBlock* block = cfg->blocks[b];
+        ILOCInsn* term = BasicBlock_terminator(block);
+        if (term == NULL && block->num_succ == 1) {
+            Operand target = { .type = JUMP_LABEL, .id = BasicBlock_label(block->succ[0]) };
+            InsnList_add(block->insns, ILOCInsn_new_1op(JUMP, target));
+        } else if (term != NULL && term->form == CBR && term->op[1].id == term->op[2].id) {
+            term->form = JUMP;
+            term->op[0] = term->op[1];
+            term->op[1] = empty_operand();
+            term->op[2] = empty_operand();
+        }
+    }
+    CFG_compute_edges(cfg);
+}
+
+/**
+ * @brief Find the common dominator of two blocks (helper for @ref CFG_compute_dominators)
+ */
+BasicBlock* intersect_dominators (BasicBlock* a, BasicBlock* b)
+{
+    while (a != b) {
+        while (a->rpo > b->rpo) {
+            a = a->idom;
+        }
+        while (b->rpo > a->rpo) {
+            b = b->idom;
+        }
+    }
+    return a;
+}
+
+void CFG_compute_dominators (CFG* cfg)
+{
+    int n = cfg->num_blocks;
+    if (n == 0) {
+        return;
+    }
+
+    /* reverse postorder of reachable blocks (iterative depth-first search) */
+    BasicBlock** order = (BasicBlock**)calloc(n, sizeof(BasicBlock*));
+    BasicBlock** stack = (BasicBlock**)calloc(n, sizeof(BasicBlock*));
+    int* next_succ = (int*)calloc(n, sizeof(int));
+    bool* visited = (bool*)calloc(n, sizeof(bool));
+    CHECK_MALLOC_PTR(order);
+    CHECK_MALLOC_PTR(stack);
+    CHECK_MALLOC_PTR(next_succ);
+    CHECK_MALLOC_PTR(visited);
+    int num_ordered = 0;
+    int top = 0;
+    stack[top++] = cfg->blocks[0];
+    visited[0] = true;
+    while (top > 0) {
+        BasicBlock* block = stack[top-1];
+        if (next_succ[block->id] < block->num_succ) {
+            BasicBlock* succ = block->succ[next_succ[block->id]++];
+            if (!visited[succ->id]) {
+                visited[succ->id] = true;
+                stack[top++] = succ;
+            }
+        } else {
+            order[num_ordered++] = block;
+            top--;
+        }
+    }
+    for (int b = 0; b < n; b++) {
+        cfg->blocks[b]->rpo = n;        /* unreachable blocks sort last */
+        cfg->blocks[b]->idom = NULL;
+    }
+    for (int i = 0; i < num_ordered; i++) {
+        order[i]->rpo = num_ordered - 1 - i;
+    }
+
+    /* iterate over blocks in reverse postorder until the dominators stabilize */
+    BasicBlock* entry = cfg->blocks[0];
+    entry->idom = entry;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = num_ordered - 2; i >= 0; i--) {
+            BasicBlock* block = order[i];
+            BasicBlock* new_idom = NULL;
+            for (int p = 0; p < block->num_preds; p++) {
+                BasicBlock* pred = block->preds[p];
+                if (pred->idom == NULL) {
+                    continue;   /* not processed yet (or unreachable) */
+                }
+                new_idom = (new_idom == NULL ? pred : intersect_dominators(pred, new_idom));
+            }
+            if (block->idom != new_idom) {
+                block->idom = new_idom;
+                changed = true;
+            }
+        }
+    }
+
+    /* dominance frontiers */
+    for (int b = 0; b < n; b++) {
+        BasicBlock* block = cfg->blocks[b];
+        if (block->frontier != NULL) {
+            BitSet_free(block->frontier);
+        }
+        block->frontier = BitSet_new(n);
+    }
+    for (int b = 0; b < n; b++) {
+        BasicBlock* block = cfg->blocks[b];
+        if (block->idom == NULL || block->num_preds < 2) {
+            continue;
+        }
+        for (int p = 0; p < block->num_preds; p++) {
+            BasicBlock* runner = block->preds[p];
+            if (runner->idom == NULL) {
+                continue;
+            }
+            while (runner != block->idom) {
+                BitSet_add(runner->frontier, block->id);
+                runner = runner->idom;
+            }
+        }
+    }
+    entry->idom = NULL;
+
+    free(order);
+    free(stack);
+    free(next_succ);
+    free(visited);
+}
+
+bool CFG_dominates (BasicBlock* a, BasicBlock* b)
+{
+    while (b != NULL) {
+        if (a == b) {
+            return true;
+        }
+        b = b->idom;
+    }
+    return false;
+}
+
+
+/*
+ * Loops
+ */
+
+/**
+ * @brief Find the loop with the given header in a list (or @c NULL)
+ */
+Loop* find_loop (LoopList* loops, BasicBlock* header)
+{
+    FOR_EACH (Loop*, loop, loops) {
+        if (loop->header == header) {
+            return loop;
+        }
+    }
+    return NULL;
+}
+
+void CFG_compute_loops (CFG* cfg)
+{
+    int n = cfg->num_blocks;
+    if (cfg->loops != NULL) {
+        LoopList_free(cfg->loops);
+    }
+    LoopList* found = LoopList_new();
+    BasicBlock** worklist = (BasicBlock**)calloc(n, sizeof(BasicBlock*));
+    CHECK_MALLOC_PTR(worklist);
+
+    /* a back edge goes to a block that dominates its source */
+    for (int b = 0; b < n; b++) {
+        BasicBlock* latch = cfg->blocks[b];
+        if (!latch->reachable) {
+            continue;
+        }
+        for (int s = 0; s < latch->num_succ; s++) {
+            BasicBlock* header = latch->succ[s];
+            if (!CFG_dominates(header, latch)) {
+                continue;
+            }
+            Loop* loop = find_loop(found, header);
+            if (loop == NULL) {
+                loop = (Loop*)calloc(1, sizeof(Loop));
+                CHECK_MALLOC_PTR(loop);
+                loop->header = header;
+                loop->blocks = BitSet_new(n);
+                BitSet_add(loop->blocks, header->id);
+                LoopList_add(found, loop);
+            }
+
+            /* everything that reaches the latch without going through the header */
+            int top = 0;
+            if (!BitSet_contains(loop->blocks, latch->id)) {
+                BitSet_add(loop->blocks, latch->id);
+                worklist[top++] = latch;
+            }
+            while (top > 0) {
+                BasicBlock* block = worklist[--top];
+                for (int p = 0; p < block->num_preds; p++) {
+                    BasicBlock* pred = block->preds[p];
+                    if (pred->reachable && !BitSet_contains(loop->blocks, pred->id)) {
+                        BitSet_add(loop->blocks, pred->id);
+                        worklist[top++] = pred;
+                    }
+                }
+            }
+        }
+    }
+
+    /* nesting depth = number of loops containing the header */
+    for (int b = 0; b < n; b++) {
+        cfg->blocks[b]->loop_depth = 0;
+    }
+    FOR_EACH (Loop*, loop, found) {
+        for (int b = 0; b < n; b++) {
+            if (BitSet_contains(loop->blocks, b)) {
+                cfg->blocks[b]->loop_depth++;
+            }
+        }
+    }
+    FOR_EACH (Loop*, loop, found) {
+        loop->depth = loop->header->loop_depth;
+    }
+
+    /* re-link the loops innermost first */
+    int num_loops = found->size;
+    Loop** sorted = (Loop**)calloc(num_loops + 1, sizeof(Loop*));
+    CHECK_MALLOC_PTR(sorted);
+    int max_depth = 0;
+    int idx = 0;
+    FOR_EACH (Loop*, loop, found) {
+        sorted[idx++] = loop;
+        max_depth = (loop->depth > max_depth ? loop->depth : max_depth);
+    }
+    cfg->loops = LoopList_new();
+    for (int depth = max_depth; depth > 0; depth--) {
+        for (int l = 0; l < num_loops; l++) {
+            if (sorted[l]->depth == depth) {
+                sorted[l]->next = NULL;
+                LoopList_add(cfg->loops, sorted[l]);
+            }
+        }
+    }
+    free(sorted);
+    free(found);
+    free(worklist);
+}
+
+long BasicBlock_frequency (BasicBlock* block)
+{
+    long frequency = 1;
+    for (int d = 0; d < block->loop_depth && d < 6; d++) {
+        frequency *= 10;
+    }
+    return frequency;
+}
+
+BasicBlock* CFG_insert_preheader (CFG* cfg, Loop* loop)
+{
+    BasicBlock* header = loop->header;
+    int num_outside = 0;
+    int outside_index = -1;
+    for (int p = 0; p < header->num_preds; p++) {
+        if (!BitSet_contains(loop->blocks, header->preds[p]->id)) {
+            num_outside++;
+            outside_index = p;
+        }
+    }
+
+    /* an existing block may already qualify */
+    if (num_outside == 1) {
+        BasicBlock* pred = header->preds[outside_index];
+        ILOCInsn* term = BasicBlock_terminator(pred);
+        if (pred->num_succ == 1 && term != NULL && term->form == JUMP) {
+            return pred;
+        }
+    }
+
+    BasicBlock* preheader = CFG_insert_block(cfg, header->id);
+    Operand preheader_label = anonymous_label();
+    Operand header_label = { .type = JUMP_LABEL, .id = BasicBlock_label(header) };
+    InsnList_add(preheader->insns, ILOCInsn_new_1op(LABEL, preheader_label));
+    InsnList_add(preheader->insns, ILOCInsn_new_1op(JUMP, header_label));
+    for (int p = 0; p < header->num_preds; p++) {
+        if (!BitSet_contains(loop->blocks, header->preds[p]->id)) {
+            BasicBlock_retarget(header->preds[p], header_label.id, preheader_label.id);
+        }
+    }
+    if (num_outside == 1) {
+        header->preds[outside_index] = preheader;
+    }
+    CFG_compute_edges(cfg);
+    return preheader;
+}
+
+/**
+ * @brief Find the highest virtual register ID in a CFG
+ */
+int max_vreg (CFG* cfg)
+{
+    int max_id = -1;
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        FOR_EACH (ILOCInsn*, insn, cfg->blocks[b]->insns) {
+            for (int i = 0; i < 3; i++) {
+                if (insn->op[i].type == VIRTUAL_REG && insn->op[i].id > max_id) {
+                    max_id = insn->op[i].id;
+                }
+            }
+        }
+    }
+    return max_id;
+}
+
+/**
+ * @brief Find the index of a predecessor in a block's predecessor list (or -1)
+ */
+int pred_index (BasicBlock* block, BasicBlock* pred)
+{
+    for (int p = 0; p < block->num_preds; p++) {
+        if (block->preds[p] == pred) {
+            return p;
+        }
+    }
+    return -1;
+}
+
+void CFG_compute_liveness (CFG* cfg)
+{
+    cfg->num_vregs = max_vreg(cfg) + 1;
+    int n = cfg->num_blocks;
+
+    /* local sets: upward-exposed uses (gen) and definitions (kill) */
+    BitSet** gen  = (BitSet**)calloc(n, sizeof(BitSet*));
+    BitSet** kill = (BitSet**)calloc(n, sizeof(BitSet*));
+    CHECK_MALLOC_PTR(gen);
+    CHECK_MALLOC_PTR(kill);
+    for (int b = 0; b < n; b++) {
+        BasicBlock* block = cfg->blocks[b];
+        BasicBlock_free_sets(block);
+        block->live_in  = BitSet_new(cfg->num_vregs);
+        block->live_out = BitSet_new(cfg->num_vregs);
+        gen[b]  = BitSet_new(cfg->num_vregs);
+        kill[b] = BitSet_new(cfg->num_vregs);
+        FOR_EACH (ILOCInsn*, insn, block->insns) {
+            if (insn->form != PHI) {
+                ILOCInsn* read_regs = ILOCInsn_get_read_registers(insn);
+                for (int i = 0; i < 3; i++) {
+                    if (read_regs->op[i].type == VIRTUAL_REG &&
+                            !BitSet_contains(kill[b], read_regs->op[i].id)) {
+                        BitSet_add(gen[b], read_regs->op[i].id);
+                    }
+                }
+                ILOCInsn_free(read_regs);
+            }
+            Operand write_reg = ILOCInsn_get_write_register(insn);
+            if (write_reg.type == VIRTUAL_REG) {
+                BitSet_add(kill[b], write_reg.id);
+            }
+        }
+    }
+
+    /* iterate backwards to a fixed point */
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = n - 1; b >= 0; b--) {
+            BasicBlock* block = cfg->blocks[b];
+
+            /* out = union of successors' in sets (plus PHI operands from this block) */
+            for (int s = 0; s < block->num_succ; s++) {
+                BasicBlock* succ = block->succ[s];
+                changed |= BitSet_union(block->live_out, succ->live_in);
+                int idx = pred_index(succ, block);
+                FOR_EACH (ILOCInsn*, insn, succ->insns) {
+                    if (insn->form == PHI && idx >= 0 && idx < 2 &&
+                            insn->op[idx].type == VIRTUAL_REG &&
+                            !BitSet_contains(block->live_out, insn->op[idx].id)) {
+                        BitSet_add(block->live_out, insn->op[idx].id);
+                        changed = true;
+                    }
+                }
+            }
+
+            /* in = gen + (out - kill) */
+            for (int w = 0; w < block->live_in->num_words; w++) {
+                uint64_t in = gen[b]->words[w] | (block->live_out->words[w] & ~kill[b]->words[w]);
+                if (in != block->live_in->words[w]) {
+                    block->live_in->words[w] = in;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    for (int b = 0; b < n; b++) {
+        BitSet_free(gen[b]);
+        BitSet_free(kill[b]);
+    }
+    free(gen);
+    free(kill);
+}
+
+
+/*
+ * Conversion between programs and CFGs
+ */
+
+/**
+ * @brief Test whether an instruction ends a basic block
+ */
+bool ends_block (ILOCInsn* insn)
+{
+    return insn->form == JUMP || insn->form == CBR || insn->form == RETURN;
+}
+
+CFGList* CFGList_build (InsnList* list)
+{
+    CFGList* cfgs = CFGList_new();
+    CFG* cfg = NULL;
+    BasicBlock* block = NULL;
+
+    ILOCInsn* insn = list->head;
+    while (insn != NULL) {
+        ILOCInsn* next = insn->next;
+        insn->next = NULL;
+
+        /* function labels begin a new CFG */
+        if (cfg == NULL || (insn->form == LABEL && insn->op[0].type == CALL_LABEL)) {
+            cfg = CFG_new();
+            CFGList_add(cfgs, cfg);
+            block = NULL;
+        }
+
+        /* jump labels and instructions after control transfers begin a new block */
+        if (block == NULL || (insn->form == LABEL && !InsnList_is_empty(block->insns)) ||
+                ends_block(block->insns->tail)) {
+            block = CFG_insert_block(cfg, cfg->num_blocks);
+        }
+        InsnList_add(block->insns, insn);
+
+        insn = next;
+    }
+
+    list->head = NULL;
+    list->tail = NULL;
+    list->size = 0;
+
+    FOR_EACH (CFG*, c, cfgs) {
+        CFG_compute_edges(c);
+    }
+    return cfgs;
+}
+
+void CFGList_linearize (CFGList* cfgs, InsnList* list)
+{
+    FOR_EACH (CFG*, cfg, cfgs) {
+        for (int b = 0; b < cfg->num_blocks; b++) {
+            InsnList* insns = cfg->blocks[b]->insns;
+            if (InsnList_is_empty(insns)) {
+                continue;
+            }
+            if (list->head == NULL) {
+                list->head = insns->head;
+            } else {
+                list->tail->next = insns->head;
+            }
+            list->tail = insns->tail;
+            list->size += insns->size;
+
+            /* the instructions now belong to the program list */
+            insns->head = NULL;
+            insns->tail = NULL;
+            insns->size = 0;
+        }
+    }
+}
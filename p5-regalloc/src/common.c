@@ -26,6 +26,60 @@ void print_escaped_string(const char* string, FILE* output)
     }
 }
 
+uint64_t hash_string(const char* string, size_t length)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)string[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * @brief Find the hash table slot for a string (either its entry or an empty slot)
+ */
+int* StringPool_find_slot (StringPool* pool, const char* string)
+{
+    int mask = pool->cap_slots - 1;
+    int s = (int)(hash_string(string, strlen(string)) & mask);
+    while (pool->slots[s] != 0 && strcmp(pool->strings[pool->slots[s] - 1], string) != 0) {
+        s = (s + 1) & mask;
+    }
+    return &pool->slots[s];
+}
+
+int StringPool_add (StringPool* pool, const char* string)
+{
+    if (2 * (pool->num_strings + 1) > pool->cap_slots) {
+        /* grow and rehash */
+        free(pool->slots);
+        pool->cap_slots = (pool->cap_slots == 0 ? 64 : pool->cap_slots * 2);
+        pool->slots = (int*)calloc(pool->cap_slots, sizeof(int));
+        CHECK_MALLOC_PTR(pool->slots);
+        for (int i = 0; i < pool->num_strings; i++) {
+            *StringPool_find_slot(pool, pool->strings[i]) = i + 1;
+        }
+    }
+    int* slot = StringPool_find_slot(pool, string);
+    if (*slot == 0) {
+        if (pool->num_strings == pool->cap_strings) {
+            pool->cap_strings = (pool->cap_strings == 0 ? 32 : pool->cap_strings * 2);
+            pool->strings = (const char**)realloc(pool->strings, sizeof(const char*) * pool->cap_strings);
+            CHECK_MALLOC_PTR(pool->strings);
+        }
+        pool->strings[pool->num_strings++] = string;
+        pool->total_size += (long)strlen(string) + 1;
+        *slot = pool->num_strings;
+    }
+    return *slot - 1;
+}
+
+void StringPool_free (StringPool* pool)
+{
+    free(pool->strings);
+    free(pool->slots);
+}
+
 void print_doubly_escaped_string(const char* string, FILE* output)
 {
     for (int i = 0; i < strlen(string); i++) {
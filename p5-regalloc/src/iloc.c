@@ -28,10 +28,13 @@ Operand return_register (void)
     return op;
 }
 
+/* next IDs handed out by virtual_register and anonymous_label */
+static int next_virtual_reg_id = 0;
+static int next_label_id = 0;
+
 Operand virtual_register (void)
 {
-    static int next_id = 0;
-    Operand op = { .type = VIRTUAL_REG, .id = next_id++ };
+    Operand op = { .type = VIRTUAL_REG, .id = next_virtual_reg_id++ };
     return op;
 }
 
@@ -43,8 +46,7 @@ Operand physical_register (int id)
 
 Operand anonymous_label (void)
 {
-    static int next_id = 0;
-    Operand op = { .type = JUMP_LABEL, .id = next_id++ };
+    Operand op = { .type = JUMP_LABEL, .id = next_label_id++ };
     return op;
 }
 
@@ -71,21 +73,39 @@ Operand str_const (const char* string)
 }
 
 void Operand_print (Operand op, FILE* output)
+{
+    char buffer[MAX_LINE_LEN * 2];
+    Writer writer;
+    Writer_init(&writer, output, buffer, sizeof(buffer));
+    Operand_write(op, &writer);
+    Writer_flush(&writer);
+}
+
+void Operand_write (Operand op, Writer* output)
 {
     switch (op.type) {
-        case EMPTY:       fprintf(output, "EMPTY");       break;
-        case STACK_REG:   fprintf(output, "SP");          break;
-        case BASE_REG:    fprintf(output, "BP");          break;
-        case RETURN_REG:  fprintf(output, "RET");         break;
-        case VIRTUAL_REG: fprintf(output, "r%d", op.id);  break;
-        case PHYSICAL_REG:fprintf(output, "R%d", op.id);  break;
-        case JUMP_LABEL:  fprintf(output, "l%d", op.id);  break;
-        case CALL_LABEL:  fprintf(output, "%s", op.str);  break;
-        case INT_CONST:   fprintf(output, "%ld", op.imm); break;
+        case EMPTY:       Writer_puts(output, "EMPTY");                       break;
+        case STACK_REG:   Writer_puts(output, "SP");                          break;
+        case BASE_REG:    Writer_puts(output, "BP");                          break;
+        case RETURN_REG:  Writer_puts(output, "RET");                         break;
+        case VIRTUAL_REG: Writer_putc(output, 'r'); Writer_int(output, op.id); break;
+        case PHYSICAL_REG:Writer_putc(output, 'R'); Writer_int(output, op.id); break;
+        case JUMP_LABEL:  Writer_putc(output, 'l'); Writer_int(output, op.id); break;
+        case CALL_LABEL:  Writer_puts(output, op.str);                        break;
+        case INT_CONST:   Writer_int(output, op.imm);                         break;
         case STR_CONST:
-            fprintf(output, "\\\"");
-            print_doubly_escaped_string(op.str, output);
-            fprintf(output, "\\\"");
+            /* doubly escaped (see print_doubly_escaped_string) */
+            Writer_puts(output, "\\\"");
+            for (const char* c = op.str; *c != '\0'; c++) {
+                switch (*c) {
+                    case '\n':  Writer_puts(output, "\\\\n");       break;
+                    case '\t':  Writer_puts(output, "\\\\t");       break;
+                    case '\"':  Writer_puts(output, "\\\\\\\"");  break;
+                    case '\\':  Writer_puts(output, "\\\\\\\\");  break;
+                    default:    Writer_putc(output, *c);          break;
+                }
+            }
+            Writer_puts(output, "\\\"");
             break;
     }
 }
@@ -140,11 +160,20 @@ ILOCInsn* ILOCInsn_copy (ILOCInsn* insn)
     return new_insn;
 }
 
-#define PRINT(S) fprintf(output, S)
-#define PRINTOP(I) Operand_print(insn->op[I], output)
-#define PRINTPLUS(I) fprintf(output, "%s", (insn->op[I].imm >= 0 ? "+" : ""))
-
 void ILOCInsn_print (ILOCInsn* insn, FILE* output)
+{
+    char buffer[MAX_LINE_LEN * 4];
+    Writer writer;
+    Writer_init(&writer, output, buffer, sizeof(buffer));
+    ILOCInsn_write(insn, &writer);
+    Writer_flush(&writer);
+}
+
+#define PRINT(S) Writer_puts(output, S)
+#define PRINTOP(I) Operand_write(insn->op[I], output)
+#define PRINTPLUS(I) if (insn->op[I].imm >= 0) { Writer_putc(output, '+'); }
+
+void ILOCInsn_write (ILOCInsn* insn, Writer* output)
 {
     switch (insn->form) {
 
@@ -271,6 +300,30 @@ Operand ILOCInsn_get_write_register (ILOCInsn* insn)
     }
 }
 
+int ILOCInsn_get_write_index (ILOCInsn* insn)
+{
+    switch (insn->form)
+    {
+        case ADD: case SUB: case MULT: case DIV: case AND: case OR:
+        case CMP_LT: case CMP_LE: case CMP_EQ: case CMP_NE: case CMP_GE: case CMP_GT:
+        case ADD_I: case MULT_I:
+        case LOAD_AI: case LOAD_AO:
+        case PHI:
+            return 2;
+
+        case LOAD: case LOAD_I:
+        case NOT: case NEG:
+        case I2I:
+            return 1;
+
+        case POP:
+            return 0;
+
+        default:
+            return -1;
+    }
+}
+
 void ILOCInsn_free (ILOCInsn* insn)
 {
     free(insn);
@@ -278,20 +331,58 @@ void ILOCInsn_free (ILOCInsn* insn)
 
 DEF_LIST_IMPL(Insn, ILOCInsn*, ILOCInsn_free)
 
+void InsnList_reserve_ids (InsnList* list)
+{
+    FOR_EACH (ILOCInsn*, insn, list) {
+        for (int i = 0; i < 3; i++) {
+            if (insn->op[i].type == VIRTUAL_REG && insn->op[i].id >= next_virtual_reg_id) {
+                next_virtual_reg_id = insn->op[i].id + 1;
+            } else if (insn->op[i].type == JUMP_LABEL && insn->op[i].id >= next_label_id) {
+                next_label_id = insn->op[i].id + 1;
+            }
+        }
+    }
+}
+
 void InsnList_print (InsnList* list, FILE* output)
+{
+    Writer* writer = Writer_new_file(output);
+    InsnList_write(list, writer);
+    Writer_free(writer);
+}
+
+void InsnList_write (InsnList* list, Writer* output)
 {
     FOR_EACH(ILOCInsn*, i, list) {
         if (i->form != LABEL) {
-            printf("  ");
+            Writer_write(output, "  ", 2);
         }
-        ILOCInsn_print(i, output);
+        ILOCInsn_write(i, output);
         if (i->comment[0] != '\0') {
-            fprintf(output, "  ; %s", i->comment);
+            Writer_write(output, "  ; ", 4);
+            Writer_puts(output, i->comment);
         }
-        fprintf(output, "\n");
+        Writer_putc(output, '\n');
     }
 }
 
+CallingConvention CallingConvention_new (int num_registers, int num_callee_saved)
+{
+    CallingConvention convention = {
+        .num_registers = num_registers, .num_arg_registers = 0,
+        .return_register = return_register()
+    };
+    for (int pr = 0; pr < num_registers; pr++) {
+        convention.saved_by[pr] = (pr >= num_registers - num_callee_saved ? CALLEE_SAVED : CALLER_SAVED);
+    }
+    return convention;
+}
+
+bool CallingConvention_is_callee_saved (const CallingConvention* convention, int pr)
+{
+    return pr >= 0 && pr < convention->num_registers && convention->saved_by[pr] == CALLEE_SAVED;
+}
+
 
 /*
  * AST VISITOR: Symbol storage/memory allocation
@@ -673,6 +764,24 @@ word_t ILOCMachine_get_reg(ILOCMachine* machine, Operand op)
     }
 }
 
+/**
+ * @brief Read the register stored by a @c storeAI instruction
+ *
+ * Functions save the callee-saved physical registers that they use whether
+ * or not the caller ever set them, so the prologue saves (marked with
+ * @ref CALLEE_SAVE_COMMENT) are not reported as uninitialized reads. Every
+ * other store, including spill stores, is checked as usual.
+ */
+word_t ILOCMachine_get_stored_reg(ILOCMachine* machine, ILOCInsn* insn)
+{
+    Operand op = insn->op[0];
+    if (op.type == PHYSICAL_REG && op.id >= 0 && op.id < MAX_PHYSICAL_REGS &&
+            strcmp(insn->comment, CALLEE_SAVE_COMMENT) == 0) {
+        return machine->pr[op.id];
+    }
+    return ILOCMachine_get_reg(machine, op);
+}
+
 void ILOCMachine_set_mem(ILOCMachine* machine, long address, word_t value)
 {
     if (address < 0 || address > MEM_SIZE - WORD_SIZE) {
@@ -948,7 +1057,28 @@ void assert_valid_insn (ILOCInsn* insn)
 
 #define TIMEOUT_NUM_INSTRUCTIONS 100000000
 
+/**
+ * @brief Position of an instruction in the program (for profiling)
+ */
+typedef struct InsnIndex
+{
+    ILOCInsn* insn;
+    int index;
+} InsnIndex;
+
+int InsnIndex_compare (const void* a, const void* b)
+{
+    uintptr_t x = (uintptr_t)((const InsnIndex*)a)->insn;
+    uintptr_t y = (uintptr_t)((const InsnIndex*)b)->insn;
+    return (x > y) - (x < y);
+}
+
 long run_simulator (InsnList* program, bool print_trace)
+{
+    return run_simulator_with_profile(program, print_trace, NULL);
+}
+
+long run_simulator_with_profile (InsnList* program, bool print_trace, long* counts)
 {
     /* initialize machine */
     ILOCMachine* machine = ILOCMachine_new();
@@ -971,6 +1101,20 @@ long run_simulator (InsnList* program, bool print_trace)
         }
     }
 
+    /* instructions sorted by address (to map the pc back to a position) */
+    int num_insns = i;
+    InsnIndex* index = NULL;
+    if (counts != NULL) {
+        index = (InsnIndex*)calloc(num_insns + 1, sizeof(InsnIndex));
+        CHECK_MALLOC_PTR(index);
+        for (int n = 0; n < num_insns; n++) {
+            index[n].insn = machine->instructions[n];
+            index[n].index = n;
+            counts[n] = 0;
+        }
+        qsort(index, num_insns, sizeof(InsnIndex), InsnIndex_compare);
+    }
+
     /* search for main and begin there */
     machine->pc = CallTargetList_find(machine->call_targets, "main")->next;
 
@@ -993,6 +1137,13 @@ long run_simulator (InsnList* program, bool print_trace)
         /* verify that current instruction is valid */
         assert_valid_insn(machine->pc);
 
+        /* count executions of each instruction if desired */
+        if (counts != NULL) {
+            InsnIndex key = { .insn = machine->pc };
+            InsnIndex* found = (InsnIndex*)bsearch(&key, index, num_insns, sizeof(InsnIndex), InsnIndex_compare);
+            counts[found->index]++;
+        }
+
         /* handle current instruction */
         switch (machine->pc->form)
         {
@@ -1001,7 +1152,8 @@ long run_simulator (InsnList* program, bool print_trace)
             case LOAD_AI:  SET_REG(OP2, GET_MEM(GET_REG(OP0) + IMMOP1));       break;
             case LOAD_AO:  SET_REG(OP2, GET_MEM(GET_REG(OP0) + GET_REG(OP1))); break;
             case STORE:    SET_MEM(GET_REG(OP1),                GET_REG(OP0)); break;
-            case STORE_AI: SET_MEM(GET_REG(OP1) + IMMOP2,       GET_REG(OP0)); break;
+            case STORE_AI: SET_MEM(GET_REG(OP1) + IMMOP2,
+                                   ILOCMachine_get_stored_reg(machine, machine->pc)); break;
             case STORE_AO: SET_MEM(GET_REG(OP1) + GET_REG(OP2), GET_REG(OP0)); break;
 
             case ADD:    SET_REG(OP2, GET_REG(OP0) +  GET_REG(OP1)); break;
@@ -1105,6 +1257,7 @@ long run_simulator (InsnList* program, bool print_trace)
     word_t return_value = machine->ret;
     CallTargetList_free(machine->call_targets);
     free(machine);
+    free(index);
 
     return (long)return_value;
 }
@@ -0,0 +1,254 @@
+/* mmap and friends are POSIX, not C11 */
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ilocbin.h"
+#include "ilocparse.h"
+
+/**
+ * @brief Does an operand's value refer to the string table?
+ */
+bool operand_has_string (OperandType type)
+{
+    return type == CALL_LABEL || type == STR_CONST;
+}
+
+bool InsnList_write_binary (InsnList* list, long static_size, FILE* output)
+{
+    /* encode instructions (collecting strings and functions along the way) */
+    StringPool pool = { .num_strings = 0 };
+    ILOCBinaryInsn* insns = (ILOCBinaryInsn*)calloc(list->size + 1, sizeof(ILOCBinaryInsn));
+    CHECK_MALLOC_PTR(insns);
+    ILOCBinaryFunction* functions = (ILOCBinaryFunction*)calloc(list->size + 1, sizeof(ILOCBinaryFunction));
+    CHECK_MALLOC_PTR(functions);
+    uint32_t num_insns = 0, num_functions = 0;
+    FOR_EACH (ILOCInsn*, insn, list) {
+        ILOCBinaryInsn* bin = &insns[num_insns];
+        bin->form = (uint8_t)insn->form;
+        bin->comment = (insn->comment[0] == '\0' ? -1 : StringPool_add(&pool, insn->comment));
+        for (int i = 0; i < 3; i++) {
+            Operand* op = &insn->op[i];
+            bin->type[i] = (uint8_t)op->type;
+            if (operand_has_string(op->type)) {
+                bin->value[i] = StringPool_add(&pool, op->str);
+            } else if (op->type == INT_CONST) {
+                bin->value[i] = op->imm;
+            } else if (op->type != EMPTY) {
+                bin->value[i] = op->id;
+            }
+        }
+        if (insn->form == LABEL && insn->op[0].type == CALL_LABEL) {
+            functions[num_functions].name = (uint32_t)bin->value[0];
+            functions[num_functions].first_insn = num_insns;
+            num_functions++;
+        }
+        num_insns++;
+    }
+
+    /* lay out the string table (padded to a multiple of four bytes) */
+    uint32_t* offsets = (uint32_t*)calloc(pool.num_strings + 1, sizeof(uint32_t));
+    CHECK_MALLOC_PTR(offsets);
+    uint32_t string_bytes = 0;
+    for (int s = 0; s < pool.num_strings; s++) {
+        offsets[s] = string_bytes;
+        string_bytes += (uint32_t)strlen(pool.strings[s]) + 1;
+    }
+    uint32_t padding = (4 - string_bytes % 4) % 4;
+
+    ILOCBinaryHeader header = {
+        .magic = ILOC_BINARY_MAGIC, .version = ILOC_BINARY_VERSION,
+        .num_insns = num_insns, .num_functions = num_functions,
+        .num_strings = (uint32_t)pool.num_strings, .string_bytes = string_bytes + padding,
+        .static_size = static_size
+    };
+    bool ok = fwrite(&header, sizeof(header), 1, output) == 1 &&
+              fwrite(insns, sizeof(ILOCBinaryInsn), num_insns, output) == num_insns &&
+              fwrite(functions, sizeof(ILOCBinaryFunction), num_functions, output) == num_functions &&
+              fwrite(offsets, sizeof(uint32_t), pool.num_strings, output) == (size_t)pool.num_strings;
+    for (int s = 0; ok && s < pool.num_strings; s++) {
+        ok = fwrite(pool.strings[s], 1, strlen(pool.strings[s]) + 1, output) == strlen(pool.strings[s]) + 1;
+    }
+    const char zeros[4] = { 0 };
+    ok = ok && fwrite(zeros, 1, padding, output) == padding;
+
+    free(offsets);
+    free(functions);
+    free(insns);
+    StringPool_free(&pool);
+    return ok;
+}
+
+/**
+ * @brief Is an operand's value in range for its type?
+ *
+ * Virtual registers and jump labels have the same limit as in ILOC text
+ * (@ref ILOC_MAX_PARSED_ID), physical registers must exist, and string
+ * operands must refer to an entry of the string table.
+ */
+bool operand_value_is_valid (OperandType type, int64_t value, uint32_t num_strings)
+{
+    switch (type) {
+        case VIRTUAL_REG:
+        case JUMP_LABEL:    return value >= 0 && value <= ILOC_MAX_PARSED_ID;
+        case PHYSICAL_REG:  return value >= 0 && value < MAX_PHYSICAL_REGS;
+        case CALL_LABEL:
+        case STR_CONST:     return value >= 0 && value < num_strings;
+        default:            return true;
+    }
+}
+
+/**
+ * @brief Check that a mapped image is well-formed (so that decoding cannot go out of bounds)
+ *
+ * @returns Error message or @c NULL if the image is valid
+ */
+const char* ILOCImage_validate (ILOCImage* image)
+{
+    const ILOCBinaryHeader* h = image->header;
+    if (image->size < sizeof(ILOCBinaryHeader) || h->magic != ILOC_BINARY_MAGIC) {
+        return "not a binary ILOC file";
+    }
+    if (h->version != ILOC_BINARY_VERSION) {
+        return "unsupported format version";
+    }
+    uint64_t expected = sizeof(ILOCBinaryHeader) +
+                        (uint64_t)h->num_insns * sizeof(ILOCBinaryInsn) +
+                        (uint64_t)h->num_functions * sizeof(ILOCBinaryFunction) +
+                        (uint64_t)h->num_strings * sizeof(uint32_t) + h->string_bytes;
+    if (expected != image->size) {
+        return "file size does not match header";
+    }
+    for (uint32_t s = 0; s < h->num_strings; s++) {
+        /* each string must be terminated within the table and fit in an operand */
+        uint32_t offset = image->string_offsets[s];
+        if (offset >= h->string_bytes) {
+            return "invalid string table entry";
+        }
+        size_t max_length = h->string_bytes - offset;
+        if (max_length > MAX_LINE_LEN) {
+            max_length = MAX_LINE_LEN;
+        }
+        if (memchr(image->strings + offset, '\0', max_length) == NULL) {
+            return "invalid string table entry";
+        }
+    }
+    for (uint32_t f = 0; f < h->num_functions; f++) {
+        if (image->functions[f].name >= h->num_strings ||
+                image->functions[f].first_insn >= h->num_insns) {
+            return "invalid function table entry";
+        }
+    }
+    for (uint32_t n = 0; n < h->num_insns; n++) {
+        const ILOCBinaryInsn* bin = &image->insns[n];
+        if (bin->form > PHI || bin->comment < -1 || bin->comment >= (int64_t)h->num_strings) {
+            return "invalid instruction";
+        }
+        for (int i = 0; i < 3; i++) {
+            if (bin->type[i] > STR_CONST ||
+                    !operand_value_is_valid((OperandType)bin->type[i], bin->value[i], h->num_strings)) {
+                return "invalid operand";
+            }
+        }
+    }
+    return NULL;
+}
+
+ILOCImage* ILOCImage_open (const char* filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        printf("ERROR: Could not open binary ILOC file '%s'\n", filename);
+        return NULL;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(ILOCBinaryHeader)) {
+        printf("ERROR: Binary ILOC file '%s' is too short\n", filename);
+        close(fd);
+        return NULL;
+    }
+    void* mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        printf("ERROR: Could not map binary ILOC file '%s'\n", filename);
+        return NULL;
+    }
+
+    /* carve the mapping into sections (only dereferenced after the size check) */
+    ILOCImage* image = (ILOCImage*)calloc(1, sizeof(ILOCImage));
+    CHECK_MALLOC_PTR(image);
+    image->mapping = mapping;
+    image->size = (size_t)info.st_size;
+    image->header = (const ILOCBinaryHeader*)mapping;
+    const char* base = (const char*)mapping;
+    size_t offset = sizeof(ILOCBinaryHeader);
+    image->insns = (const ILOCBinaryInsn*)(base + offset);
+    offset += (size_t)image->header->num_insns * sizeof(ILOCBinaryInsn);
+    image->functions = (const ILOCBinaryFunction*)(base + offset);
+    offset += (size_t)image->header->num_functions * sizeof(ILOCBinaryFunction);
+    image->string_offsets = (const uint32_t*)(base + offset);
+    offset += (size_t)image->header->num_strings * sizeof(uint32_t);
+    image->strings = base + offset;
+
+    const char* error = ILOCImage_validate(image);
+    if (error != NULL) {
+        printf("ERROR: Binary ILOC file '%s': %s\n", filename, error);
+        ILOCImage_close(image);
+        return NULL;
+    }
+    return image;
+}
+
+const char* ILOCImage_string (ILOCImage* image, uint32_t index)
+{
+    return image->strings + image->string_offsets[index];
+}
+
+InsnList* ILOCImage_to_insn_list (ILOCImage* image)
+{
+    InsnList* list = InsnList_new();
+    for (uint32_t n = 0; n < image->header->num_insns; n++) {
+        const ILOCBinaryInsn* bin = &image->insns[n];
+        ILOCInsn* insn = ILOCInsn_new_0op((InsnForm)bin->form);
+        for (int i = 0; i < 3; i++) {
+            Operand* op = &insn->op[i];
+            op->type = (OperandType)bin->type[i];
+            if (operand_has_string(op->type)) {
+                snprintf(op->str, MAX_LINE_LEN, "%s", ILOCImage_string(image, (uint32_t)bin->value[i]));
+            } else if (op->type == INT_CONST) {
+                op->imm = (long)bin->value[i];
+            } else if (op->type != EMPTY) {
+                op->id = (int)bin->value[i];
+            }
+        }
+        if (bin->comment >= 0) {
+            ILOCInsn_set_comment(insn, ILOCImage_string(image, (uint32_t)bin->comment));
+        }
+        InsnList_add(list, insn);
+    }
+    InsnList_reserve_ids(list);
+    return list;
+}
+
+void ILOCImage_close (ILOCImage* image)
+{
+    munmap(image->mapping, image->size);
+    free(image);
+}
+
+InsnList* InsnList_load_binary (const char* filename, long* static_size)
+{
+    ILOCImage* image = ILOCImage_open(filename);
+    if (image == NULL) {
+        return NULL;
+    }
+    if (static_size != NULL) {
+        *static_size = (long)image->header->static_size;
+    }
+    InsnList* list = ILOCImage_to_insn_list(image);
+    ILOCImage_close(image);
+    return list;
+}
@@ -0,0 +1,328 @@
+#include <ctype.h>
+#include "ilocparse.h"
+
+/**
+ * @brief ILOC mnemonic (as printed by @ref ILOCInsn_print)
+ */
+typedef struct ILOCMnemonic
+{
+    const char* name;
+    InsnForm form;
+    int num_operands;
+} ILOCMnemonic;
+
+static const ILOCMnemonic iloc_mnemonics[] = {
+    { "add",     ADD,      3 }, { "sub",     SUB,      3 }, { "mult",    MULT,     3 },
+    { "div",     DIV,      3 }, { "addI",    ADD_I,    3 }, { "multI",   MULT_I,   3 },
+    { "and",     AND,      3 }, { "or",      OR,       3 }, { "not",     NOT,      2 },
+    { "neg",     NEG,      2 }, { "loadI",   LOAD_I,   2 }, { "load",    LOAD,     2 },
+    { "loadAI",  LOAD_AI,  3 }, { "loadAO",  LOAD_AO,  3 }, { "store",   STORE,    2 },
+    { "storeAI", STORE_AI, 3 }, { "storeAO", STORE_AO, 3 }, { "i2i",     I2I,      2 },
+    { "push",    PUSH,     1 }, { "pop",     POP,      1 }, { "jump",    JUMP,     1 },
+    { "call",    CALL,     1 }, { "return",  RETURN,   0 }, { "cbr",     CBR,      3 },
+    { "phi",     PHI,      3 }, { "cmp_LT",  CMP_LT,   3 }, { "cmp_LE",  CMP_LE,   3 },
+    { "cmp_EQ",  CMP_EQ,   3 }, { "cmp_GE",  CMP_GE,   3 }, { "cmp_GT",  CMP_GT,   3 },
+    { "cmp_NE",  CMP_NE,   3 }, { "nop",     NOP,      0 }, { "print",   PRINT,    1 },
+};
+
+#define NUM_MNEMONICS ((int)(sizeof(iloc_mnemonics) / sizeof(ILOCMnemonic)))
+
+/**
+ * @brief Parser state (a cursor into the original text)
+ */
+typedef struct ILOCParser
+{
+    const char* pos;    /**< @brief Next character to read */
+    const char* end;    /**< @brief End of the text */
+    int line;           /**< @brief Current line number (for error messages) */
+} ILOCParser;
+
+/**
+ * @brief Is the cursor at the end of the current line (or the text)?
+ */
+bool at_line_end (ILOCParser* p)
+{
+    return p->pos >= p->end || *p->pos == '\n' || *p->pos == '\r';
+}
+
+/**
+ * @brief Does the text at the cursor start with a given string?
+ */
+bool looking_at (ILOCParser* p, const char* prefix)
+{
+    size_t length = strlen(prefix);
+    return (size_t)(p->end - p->pos) >= length && strncmp(p->pos, prefix, length) == 0;
+}
+
+void skip_spaces (ILOCParser* p)
+{
+    while (p->pos < p->end && (*p->pos == ' ' || *p->pos == '\t')) {
+        p->pos++;
+    }
+}
+
+/**
+ * @brief Skip whitespace and the punctuation between operands (",", "=>", "[", "]", and "+")
+ */
+void skip_separators (ILOCParser* p)
+{
+    while (p->pos < p->end) {
+        char c = *p->pos;
+        if (c == ' ' || c == '\t' || c == ',' || c == '[' || c == ']' || c == '+') {
+            p->pos++;
+        } else if (looking_at(p, "=>")) {
+            p->pos += 2;
+        } else {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Length of the identifier at the cursor (zero if there is none)
+ */
+size_t identifier_length (ILOCParser* p)
+{
+    const char* c = p->pos;
+    if (c < p->end && (isalpha((unsigned char)*c) || *c == '_')) {
+        while (c < p->end && (isalnum((unsigned char)*c) || *c == '_')) {
+            c++;
+        }
+    }
+    return c - p->pos;
+}
+
+/**
+ * @brief Is the given word a prefix letter followed only by decimal digits (e.g., "r12")?
+ */
+bool numbered_name (const char* word, size_t length, char prefix)
+{
+    if (length < 2 || word[0] != prefix) {
+        return false;
+    }
+    for (size_t i = 1; i < length; i++) {
+        if (!isdigit((unsigned char)word[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Convert the number in a register or label name (digits already
+ * checked) to an ID, which must be at most @p max_id
+ */
+int name_id (ILOCParser* p, const char* word, size_t length, int max_id)
+{
+    long value = 0;
+    for (size_t i = 1; i < length; i++) {
+        value = value * 10 + (word[i] - '0');
+        if (value > max_id) {
+            Error_throw_printf("Invalid ILOC on line %d: '%.*s' is out of range (limit is %d)\n",
+                    p->line, (int)length, word, max_id);
+        }
+    }
+    return (int)value;
+}
+
+/**
+ * @brief Convert a word to a label operand (numbered jump label or named call label)
+ */
+Operand label_operand (ILOCParser* p, const char* word, size_t length)
+{
+    if (numbered_name(word, length, 'l')) {
+        Operand op = { .type = JUMP_LABEL, .id = name_id(p, word, length, ILOC_MAX_PARSED_ID) };
+        return op;
+    }
+    if (length >= MAX_LINE_LEN) {
+        Error_throw_printf("Invalid ILOC on line %d: label is too long\n", p->line);
+    }
+    Operand op = { .type = CALL_LABEL };
+    memcpy(op.str, word, length);
+    op.str[length] = '\0';
+    return op;
+}
+
+/**
+ * @brief Parse a doubly-escaped string constant (see @ref print_doubly_escaped_string)
+ */
+Operand parse_string_operand (ILOCParser* p)
+{
+    Operand op = { .type = STR_CONST };
+    size_t length = 0;
+    p->pos += 2;    /* opening \" */
+    while (!looking_at(p, "\\\"")) {
+        if (at_line_end(p) || length + 1 >= MAX_LINE_LEN) {
+            Error_throw_printf("Invalid ILOC on line %d: unterminated string\n", p->line);
+        }
+        char c = *p->pos++;
+        if (c == '\\' && looking_at(p, "\\\\\\")) {
+            c = '\\';
+            p->pos += 3;
+        } else if (c == '\\' && looking_at(p, "\\\\\"")) {
+            c = '\"';
+            p->pos += 3;
+        } else if (c == '\\' && looking_at(p, "\\n")) {
+            c = '\n';
+            p->pos += 2;
+        } else if (c == '\\' && looking_at(p, "\\t")) {
+            c = '\t';
+            p->pos += 2;
+        }
+        op.str[length++] = c;
+    }
+    p->pos += 2;    /* closing \" */
+    op.str[length] = '\0';
+    return op;
+}
+
+/**
+ * @brief Parse one operand at the cursor
+ */
+Operand parse_operand (ILOCParser* p)
+{
+    const char* word = p->pos;
+    if (looking_at(p, "\\\"")) {
+        return parse_string_operand(p);
+    }
+    if (isdigit((unsigned char)*word) || *word == '-') {
+        /* integer (accumulated in unsigned arithmetic so that INT64_MIN round-trips) */
+        bool negative = (*word == '-');
+        p->pos += (negative ? 1 : 0);
+        if (at_line_end(p) || !isdigit((unsigned char)*p->pos)) {
+            Error_throw_printf("Invalid ILOC on line %d: bad integer\n", p->line);
+        }
+        unsigned long value = 0;
+        while (p->pos < p->end && isdigit((unsigned char)*p->pos)) {
+            value = value * 10 + (unsigned long)(*p->pos++ - '0');
+        }
+        return int_const(negative ? (long)(0ul - value) : (long)value);
+    }
+    size_t length = identifier_length(p);
+    if (length == 0) {
+        Error_throw_printf("Invalid ILOC on line %d: unexpected character '%c'\n", p->line, *word);
+    }
+    p->pos += length;
+    if (length == 2 && strncmp(word, "SP", 2) == 0) {
+        return stack_register();
+    } else if (length == 2 && strncmp(word, "BP", 2) == 0) {
+        return base_register();
+    } else if (length == 3 && strncmp(word, "RET", 3) == 0) {
+        return return_register();
+    } else if (length == 5 && strncmp(word, "EMPTY", 5) == 0) {
+        return empty_operand();
+    } else if (numbered_name(word, length, 'r')) {
+        Operand op = { .type = VIRTUAL_REG, .id = name_id(p, word, length, ILOC_MAX_PARSED_ID) };
+        return op;
+    } else if (numbered_name(word, length, 'R')) {
+        return physical_register(name_id(p, word, length, MAX_PHYSICAL_REGS - 1));
+    }
+    return label_operand(p, word, length);
+}
+
+/**
+ * @brief Attach a trailing "; comment" (if any) and check that the line is finished
+ */
+void parse_line_end (ILOCParser* p, ILOCInsn* insn)
+{
+    skip_spaces(p);
+    if (p->pos < p->end && *p->pos == ';') {
+        /* InsnList_print writes "  ; " before the comment */
+        p->pos++;
+        if (p->pos < p->end && *p->pos == ' ') {
+            p->pos++;
+        }
+        const char* start = p->pos;
+        while (!at_line_end(p)) {
+            p->pos++;
+        }
+        size_t length = p->pos - start;
+        if (length >= MAX_LINE_LEN) {
+            length = MAX_LINE_LEN - 1;
+        }
+        memcpy(insn->comment, start, length);
+        insn->comment[length] = '\0';
+    }
+    if (!at_line_end(p)) {
+        Error_throw_printf("Invalid ILOC on line %d: unexpected text at end of line\n", p->line);
+    }
+}
+
+/**
+ * @brief Parse an instruction (the cursor is at its mnemonic)
+ */
+ILOCInsn* parse_instruction (ILOCParser* p)
+{
+    size_t length = identifier_length(p);
+    const ILOCMnemonic* mnemonic = NULL;
+    for (int m = 0; m < NUM_MNEMONICS && mnemonic == NULL; m++) {
+        if (strlen(iloc_mnemonics[m].name) == length &&
+                strncmp(iloc_mnemonics[m].name, p->pos, length) == 0) {
+            mnemonic = &iloc_mnemonics[m];
+        }
+    }
+    if (mnemonic == NULL) {
+        Error_throw_printf("Invalid ILOC on line %d: unknown instruction '%.*s'\n",
+                p->line, (int)(length > 0 ? length : 1), p->pos);
+    }
+    p->pos += length;
+
+    ILOCInsn* insn = ILOCInsn_new_0op(mnemonic->form);
+    for (int i = 0; i < mnemonic->num_operands; i++) {
+        skip_separators(p);
+        if (at_line_end(p) || *p->pos == ';') {
+            ILOCInsn_free(insn);
+            Error_throw_printf("Invalid ILOC on line %d: '%s' expects %d operands\n",
+                    p->line, mnemonic->name, mnemonic->num_operands);
+        }
+        insn->op[i] = parse_operand(p);
+    }
+    skip_separators(p);
+    return insn;
+}
+
+InsnList* parse_iloc (const char* text, size_t length)
+{
+    ILOCParser parser = { .pos = text, .end = text + length, .line = 1 };
+    ILOCParser* p = &parser;
+    InsnList* list = InsnList_new();
+
+    while (p->pos < p->end) {
+        ILOCInsn* insn = NULL;
+        if (*p->pos == ' ' || *p->pos == '\t') {
+            /* instruction (or blank/comment-only line) */
+            skip_spaces(p);
+            if (!at_line_end(p) && *p->pos != ';') {
+                insn = parse_instruction(p);
+            }
+        } else if (!at_line_end(p) && *p->pos != ';') {
+            /* label */
+            size_t label_length = identifier_length(p);
+            if (label_length == 0 || p->pos + label_length >= p->end || p->pos[label_length] != ':') {
+                Error_throw_printf("Invalid ILOC on line %d: expected a label\n", p->line);
+            }
+            insn = ILOCInsn_new_1op(LABEL, label_operand(p, p->pos, label_length));
+            p->pos += label_length + 1;
+        }
+
+        if (insn != NULL) {
+            parse_line_end(p, insn);
+            InsnList_add(list, insn);
+        }
+
+        /* skip the rest of a comment-only line, then the newline */
+        while (!at_line_end(p)) {
+            p->pos++;
+        }
+        if (p->pos < p->end && *p->pos == '\r') {
+            p->pos++;
+        }
+        if (p->pos < p->end && *p->pos == '\n') {
+            p->pos++;
+        }
+        p->line++;
+    }
+
+    InsnList_reserve_ids(list);
+    return list;
+}
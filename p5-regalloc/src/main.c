@@ -9,7 +9,11 @@
 #include "p4-codegen.h"
 #include "p5-regalloc.h"
 
+#include "opt.h"
 #include "y86.h"
+#include "y86sim.h"
+#include "ilocbin.h"
+#include "ilocparse.h"
 
 /**
  * @brief Error message buffer
@@ -67,23 +71,16 @@ bool read_file(const char *filename, char *text)
 }
 
 /**
- * @brief Compiler entry point
+ * @brief Run the front end and code generation on a Decaf source file
  *
- * @param argc Number of command-line arguments
- * @param argv Array of command-line argument strings
- * @returns @c EXIT_SUCCESS if the compilation succeeds and @c EXIT_FAILURE
- * otherwise
+ * Prints any errors and exits if compilation fails.
+ *
+ * @param filename Name of Decaf source file
+ * @param static_size Destination for the size of global variables
+ * @returns Generated ILOC program
  */
-int main(int argc, char **argv)
+InsnList *compile_decaf(const char *filename, long *static_size)
 {
-    /* check for filename */
-    if (argc != 2)
-    {
-        fprintf(stderr, "Usage: %s <decaf-filename>\n", argv[0]);
-        return EXIT_FAILURE;
-    }
-    char *filename = argv[argc - 1];
-
     /* read file */
     char text[MAX_FILE_SIZE];
     if (!read_file(filename, text))
@@ -160,13 +157,183 @@ int main(int argc, char **argv)
 
     /* PROJECT 4: code gen */
     InsnList *iloc = generate_code(tree);
+    *static_size = ASTNode_get_int_attribute(tree, "staticSize");
 
     /* clean up syntax tree (no longer needed) */
     ASTNode_free(tree);
     tree = NULL;
 
-    /* PROJECT 5: register allocation */
-    allocate_registers(iloc, 4);
+    return iloc;
+}
+
+/**
+ * @brief Parse a textual ILOC file (which may be larger than #MAX_FILE_SIZE)
+ *
+ * Prints any errors and exits if the file cannot be read or parsed.
+ *
+ * @param filename Name of ILOC file
+ * @returns Parsed ILOC program
+ */
+InsnList *load_iloc_text(const char *filename)
+{
+    FILE *input = fopen(filename, "r");
+    if (input == NULL)
+    {
+        fprintf(stderr, "Could not read file: %s", filename);
+        exit(EXIT_FAILURE);
+    }
+    size_t capacity = MAX_FILE_SIZE;
+    size_t length = 0;
+    char *text = (char *)malloc(capacity);
+    CHECK_MALLOC_PTR(text);
+    size_t nread;
+    while ((nread = fread(text + length, 1, capacity - length, input)) > 0)
+    {
+        length += nread;
+        if (length == capacity)
+        {
+            capacity *= 2;
+            text = (char *)realloc(text, capacity);
+            CHECK_MALLOC_PTR(text);
+        }
+    }
+    fclose(input);
+
+    InsnList *iloc = NULL;
+    if (setjmp(decaf_error) == 0)
+    {
+        iloc = parse_iloc(text, length);
+    }
+    else
+    {
+        fprintf(stderr, "%s", decaf_error_msg);
+        free(text);
+        exit(EXIT_FAILURE);
+    }
+    free(text);
+    return iloc;
+}
+
+/**
+ * @brief Check whether a filename has a given extension
+ */
+bool has_extension(const char *filename, const char *extension)
+{
+    size_t name_len = strlen(filename);
+    size_t ext_len = strlen(extension);
+    return name_len > ext_len && strcmp(filename + name_len - ext_len, extension) == 0;
+}
+
+/**
+ * @brief Compiler entry point
+ *
+ * @param argc Number of command-line arguments
+ * @param argv Array of command-line argument strings
+ * @returns @c EXIT_SUCCESS if the compilation succeeds and @c EXIT_FAILURE
+ * otherwise
+ */
+int main(int argc, char **argv)
+{
+    /* check for options and filename */
+    bool optimize_iloc = false;
+    bool run_y86_backend = false;
+    bool save_binary = false;
+    long y86_stack_size = Y86_DEFAULT_STACK_SIZE;
+    char *filename = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-O") == 0)
+        {
+            optimize_iloc = true;
+        }
+        else if (strcmp(argv[i], "-Y") == 0)
+        {
+            run_y86_backend = true;
+        }
+        else if (strcmp(argv[i], "-B") == 0)
+        {
+            save_binary = true;
+        }
+        else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc && atol(argv[i + 1]) > 0 &&
+                 atol(argv[i + 1]) <= Y86_MEM_SIZE - STATIC_VAR_OFFSET)
+        {
+            y86_stack_size = atol(argv[++i]);
+        }
+        else if (argv[i][0] != '-' && filename == NULL)
+        {
+            filename = argv[i];
+        }
+        else
+        {
+            filename = NULL;
+            break;
+        }
+    }
+    if (filename == NULL)
+    {
+        fprintf(stderr, "Usage: %s [-O] [-Y] [-B] [-S <bytes>] <decaf-filename | iloc-filename | ilocb-filename>\n", argv[0]);
+        fprintf(stderr, "  -O  optimize ILOC before register allocation\n");
+        fprintf(stderr, "  -Y  also generate Y86 (program.ys) and run it in the Y86 simulator\n");
+        fprintf(stderr, "      (allocating every spare Y86 register instead of four)\n");
+        fprintf(stderr, "  -B  save generated ILOC in binary form (program.ilocb)\n");
+        fprintf(stderr, "  -S  Y86 stack space in bytes (default %d, at most %d)\n",
+                Y86_DEFAULT_STACK_SIZE, Y86_MEM_SIZE - STATIC_VAR_OFFSET);
+        return EXIT_FAILURE;
+    }
+
+    /* FRONT END, MIDDLE END, and PROJECT 4: code gen (unless loading cached ILOC) */
+    InsnList *iloc = NULL;
+    long static_size = 0;
+    if (has_extension(filename, ".ilocb"))
+    {
+        iloc = InsnList_load_binary(filename, &static_size);
+        if (iloc == NULL)
+        {
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (has_extension(filename, ".iloc"))
+    {
+        /* globals are not declared in ILOC, so keep the default Y86 data reservation */
+        iloc = load_iloc_text(filename);
+        static_size = Y86_DEFAULT_STATIC_SIZE;
+    }
+    else
+    {
+        iloc = compile_decaf(filename, &static_size);
+    }
+
+    /* optional cache of code generation output (for re-running later stages) */
+    if (save_binary)
+    {
+        FILE *binary_file = fopen("program.ilocb", "wb");
+        if (binary_file == NULL || !InsnList_write_binary(iloc, static_size, binary_file))
+        {
+            fprintf(stderr, "Could not write program.ilocb\n");
+        }
+        if (binary_file != NULL)
+        {
+            fclose(binary_file);
+        }
+    }
+
+    /* optional ILOC optimizations (reported on stderr) */
+    if (optimize_iloc)
+    {
+        optimize(iloc, stderr);
+    }
+
+    /* PROJECT 5: register allocation (four registers, or for the Y86 back end
+     * as many as the target can spare, following its calling convention) */
+    if (run_y86_backend)
+    {
+        CallingConvention convention = y86_calling_convention(iloc);
+        allocate_registers_with_convention(iloc, &convention, NULL);
+    }
+    else
+    {
+        allocate_registers(iloc, 4);
+    }
 
     /* print ILOC */
     InsnList_print(iloc, stdout);
@@ -175,14 +342,21 @@ int main(int argc, char **argv)
     int return_value = run_simulator(iloc, true);
     printf("RETURN VALUE = %d\n", return_value);
 
-    /* enable this to generate Y86 (requires a functional P5 solution first) */
-    /*
-     *FILE* y86_file = fopen("program.ys", "w");
-     *if (y86_file != NULL) {
-     *    emit_y86(iloc, y86_file);
-     *    fclose(y86_file);
-     *}
-     */
+    /* optional Y86 back end: save the assembly, then assemble and simulate it */
+    if (run_y86_backend)
+    {
+        Y86Layout layout = Y86Layout_new(static_size, y86_stack_size);
+        FILE *y86_file = fopen("program.ys", "w");
+        if (y86_file != NULL)
+        {
+            emit_y86_with_layout(iloc, y86_file, &layout);
+            fclose(y86_file);
+        }
+        Y86Stats stats;
+        long y86_value = run_y86(iloc, &layout, stdout, &stats);
+        printf("\nY86 RETURN VALUE = %ld\n", y86_value);
+        Y86Stats_print(&stats, stdout);
+    }
 
     /* clean up ILOC code (no longer needed) */
     InsnList_free(iloc);
@@ -0,0 +1,1364 @@
+#include "opt.h"
+
+/**
+ * @brief Test whether an instruction form has no effect other than writing its result
+ *
+ * Such instructions can be deleted if their result is never read.
+ */
+bool is_side_effect_free (InsnForm form)
+{
+    switch (form) {
+        case STORE: case STORE_AI: case STORE_AO:
+        case CALL: case PRINT: case PUSH: case POP: case RETURN:
+        case JUMP: case CBR: case LABEL: case NOP:
+            return false;
+        default:
+            return true;
+    }
+}
+
+
+/*
+ * Dead and unreachable code elimination
+ */
+
+/**
+ * @brief Delete blocks that cannot be reached from the entry block
+ *
+ * @returns Number of instructions removed
+ */
+int remove_unreachable_blocks (CFG* cfg)
+{
+    int removed = 0;
+    for (int b = cfg->num_blocks - 1; b > 0; b--) {
+        BasicBlock* block = cfg->blocks[b];
+        if (!block->reachable) {
+            removed += block->insns->size;
+            CFG_remove_block(cfg, block);
+        }
+    }
+    return removed;
+}
+
+/**
+ * @brief Follow a chain of blocks that contain only a label and a jump
+ *
+ * @returns Final destination label of a branch to the given label
+ */
+int final_jump_target (CFG* cfg, int label)
+{
+    for (int steps = 0; steps < cfg->num_blocks; steps++) {
+        BasicBlock* target = CFG_find_label(cfg, label);
+        if (target == NULL || target->insns->size != 2 ||
+                target->insns->tail->form != JUMP ||
+                target->insns->tail->op[0].id == label) {
+            break;
+        }
+        label = target->insns->tail->op[0].id;
+    }
+    return label;
+}
+
+/**
+ * @brief Retarget branches that lead to a block containing only a jump
+ *
+ * Also turns conditional branches with identical targets into jumps.
+ *
+ * @returns True if any branch was changed
+ */
+bool thread_jumps (CFG* cfg)
+{
+    bool changed = false;
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        ILOCInsn* term = BasicBlock_terminator(cfg->blocks[b]);
+        if (term == NULL || term->form == RETURN) {
+            continue;
+        }
+        for (int i = 0; i < 3; i++) {
+            if (term->op[i].type == JUMP_LABEL) {
+                int target = final_jump_target(cfg, term->op[i].id);
+                if (target != term->op[i].id) {
+                    term->op[i].id = target;
+                    changed = true;
+                }
+            }
+        }
+        if (term->form == CBR && term->op[1].id == term->op[2].id) {
+            term->form = JUMP;
+            term->op[0] = term->op[1];
+            term->op[1] = empty_operand();
+            term->op[2] = empty_operand();
+            changed = true;
+        }
+    }
+    if (changed) {
+        CFG_compute_edges(cfg);
+    }
+    return changed;
+}
+
+/**
+ * @brief Delete jumps to the immediately following block
+ *
+ * @returns Number of instructions removed
+ */
+int remove_jumps_to_next (CFG* cfg)
+{
+    int removed = 0;
+    for (int b = 0; b + 1 < cfg->num_blocks; b++) {
+        BasicBlock* block = cfg->blocks[b];
+        ILOCInsn* term = BasicBlock_terminator(block);
+        if (term != NULL && term->form == JUMP &&
+                term->op[0].id == BasicBlock_label(cfg->blocks[b+1])) {
+            ILOCInsn* prev = NULL;
+            FOR_EACH (ILOCInsn*, insn, block->insns) {
+                if (insn->next == term) {
+                    prev = insn;
+                }
+            }
+            BasicBlock_remove_after(block, prev);
+            removed++;
+        }
+    }
+    return removed;
+}
+
+/**
+ * @brief Delete jump labels that are not the target of any branch
+ *
+ * @returns Number of instructions removed
+ */
+int remove_unused_labels (CFG* cfg)
+{
+    bool* used = (bool*)calloc(cfg->label_map_size + 1, sizeof(bool));
+    CHECK_MALLOC_PTR(used);
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        ILOCInsn* term = BasicBlock_terminator(cfg->blocks[b]);
+        if (term == NULL) {
+            continue;
+        }
+        for (int i = 0; i < 3; i++) {
+            if (term->op[i].type == JUMP_LABEL && term->op[i].id < cfg->label_map_size) {
+                used[term->op[i].id] = true;
+            }
+        }
+    }
+    int removed = 0;
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        int label = BasicBlock_label(cfg->blocks[b]);
+        if (label >= 0 && !used[label]) {
+            BasicBlock_remove_after(cfg->blocks[b], NULL);
+            removed++;
+        }
+    }
+    free(used);
+    return removed;
+}
+
+/**
+ * @brief Delete side-effect-free instructions whose results are never read
+ *
+ * Works backwards through each block, starting from the live-out set.
+ *
+ * @returns Number of instructions removed
+ */
+int remove_dead_definitions (CFG* cfg)
+{
+    CFG_compute_liveness(cfg);
+    BitSet* live = BitSet_new(cfg->num_vregs);
+    int removed = 0;
+
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        BasicBlock* block = cfg->blocks[b];
+        int n = block->insns->size;
+        if (n == 0) {
+            continue;
+        }
+
+        /* singly-linked instructions, so walk backwards using an array */
+        ILOCInsn** insns = (ILOCInsn**)calloc(n, sizeof(ILOCInsn*));
+        bool* dead = (bool*)calloc(n, sizeof(bool));
+        CHECK_MALLOC_PTR(insns);
+        CHECK_MALLOC_PTR(dead);
+        int idx = 0;
+        FOR_EACH (ILOCInsn*, insn, block->insns) {
+            insns[idx++] = insn;
+        }
+
+        BitSet_copy(live, block->live_out);
+        for (int i = n - 1; i >= 0; i--) {
+            Operand write_reg = ILOCInsn_get_write_register(insns[i]);
+            if (write_reg.type == VIRTUAL_REG) {
+                if (!BitSet_contains(live, write_reg.id) && is_side_effect_free(insns[i]->form)) {
+                    dead[i] = true;
+                    continue;
+                }
+                BitSet_remove(live, write_reg.id);
+            }
+            if (insns[i]->form != PHI) {
+                ILOCInsn* read_regs = ILOCInsn_get_read_registers(insns[i]);
+                for (int r = 0; r < 3; r++) {
+                    if (read_regs->op[r].type == VIRTUAL_REG) {
+                        BitSet_add(live, read_regs->op[r].id);
+                    }
+                }
+                ILOCInsn_free(read_regs);
+            }
+        }
+
+        /* unlink dead instructions */
+        ILOCInsn* prev = NULL;
+        for (int i = 0; i < n; i++) {
+            if (dead[i]) {
+                BasicBlock_remove_after(block, prev);
+                removed++;
+            } else {
+                prev = insns[i];
+            }
+        }
+        free(insns);
+        free(dead);
+    }
+
+    BitSet_free(live);
+    return removed;
+}
+
+int CFG_eliminate_dead_code (CFG* cfg)
+{
+    int removed = 0;
+    bool changed = true;
+    while (changed) {
+        int before = removed;
+        CFG_compute_edges(cfg);
+        removed += remove_unreachable_blocks(cfg);
+        CFG_compute_edges(cfg);
+        changed = thread_jumps(cfg);
+        removed += remove_jumps_to_next(cfg);
+        removed += remove_unused_labels(cfg);
+        CFG_compute_edges(cfg);
+        removed += remove_dead_definitions(cfg);
+        changed |= (removed != before);
+    }
+    return removed;
+}
+
+int eliminate_dead_code (InsnList* list)
+{
+    CFGList* cfgs = CFGList_build(list);
+    int removed = 0;
+    FOR_EACH (CFG*, cfg, cfgs) {
+        removed += CFG_eliminate_dead_code(cfg);
+    }
+    CFGList_linearize(cfgs, list);
+    CFGList_free(cfgs);
+    return removed;
+}
+
+
+/*
+ * Sparse conditional constant propagation
+ */
+
+/**
+ * @brief Constant propagation lattice level
+ */
+typedef enum ConstLevel
+{
+    UNDEFINED,      /**< @brief No definition has been found to execute yet */
+    CONSTANT,       /**< @brief Always the same known value */
+    VARYING         /**< @brief Not a compile-time constant */
+} ConstLevel;
+
+/**
+ * @brief Constant propagation lattice value
+ */
+typedef struct ConstValue
+{
+    ConstLevel level;   /**< @brief Lattice level */
+    long value;         /**< @brief Known value (only if level is @c CONSTANT) */
+} ConstValue;
+
+/**
+ * @brief State for sparse conditional constant propagation over a single function
+ */
+typedef struct SCCPState
+{
+    /**
+     * @brief Lattice value of each virtual register
+     */
+    ConstValue* values;
+
+    /**
+     * @brief Number of virtual registers
+     */
+    int num_vregs;
+
+    /**
+     * @brief Has each block been found to execute?
+     */
+    bool* block_exec;
+
+    /**
+     * @brief Has each outgoing edge (block ID, successor index) been found to execute?
+     */
+    bool (*edge_exec)[2];
+
+    /**
+     * @brief Is each outgoing edge (block ID, successor index) on the flow worklist?
+     */
+    bool (*edge_queued)[2];
+
+    /**
+     * @brief Flow worklist: edges that were found to execute (block ID times two
+     * plus successor index)
+     */
+    int* flow_list;
+
+    /**
+     * @brief Number of edges on the flow worklist
+     */
+    int num_flow;
+
+    /**
+     * @brief SSA worklist: registers whose lattice value changed
+     */
+    int* ssa_list;
+
+    /**
+     * @brief Number of registers on the SSA worklist
+     */
+    int num_ssa;
+
+    /**
+     * @brief Start of each register's uses in @ref SCCPState::use_insns (the
+     * uses of register @c r are entries @c use_start[r] to @c use_start[r+1]-1)
+     */
+    int* use_start;
+
+    /**
+     * @brief Instructions that read each register (grouped by register)
+     */
+    ILOCInsn** use_insns;
+
+    /**
+     * @brief Block containing each instruction in @ref SCCPState::use_insns
+     */
+    BasicBlock** use_blocks;
+
+} SCCPState;
+
+/**
+ * @brief Combine two lattice values (meet)
+ */
+ConstValue meet (ConstValue a, ConstValue b)
+{
+    if (a.level == UNDEFINED) {
+        return b;
+    } else if (b.level == UNDEFINED) {
+        return a;
+    } else if (a.level == CONSTANT && b.level == CONSTANT && a.value == b.value) {
+        return a;
+    }
+    return (ConstValue){ .level = VARYING, .value = 0 };
+}
+
+/**
+ * @brief Get the lattice value of an operand
+ *
+ * Only virtual registers and integer constants are tracked; everything else
+ * (e.g., @c BP or @c RET) is varying.
+ */
+ConstValue operand_value (SCCPState* state, Operand op)
+{
+    if (op.type == VIRTUAL_REG && op.id < state->num_vregs) {
+        return state->values[op.id];
+    } else if (op.type == INT_CONST) {
+        return (ConstValue){ .level = CONSTANT, .value = op.imm };
+    }
+    return (ConstValue){ .level = VARYING, .value = 0 };
+}
+
+/**
+ * @brief Evaluate an arithmetic, logical, or comparison operation on constants
+ *
+ * Uses the simulator's 64-bit wrap-around semantics.
+ *
+ * @param form Instruction form
+ * @param a First operand
+ * @param b Second operand (ignored for unary forms)
+ * @param result Output: result of the operation
+ * @returns True if the operation could be evaluated (e.g., not a division by zero)
+ */
+bool fold_operation (InsnForm form, long a, long b, long* result)
+{
+    uint64_t ua = (uint64_t)a, ub = (uint64_t)b;
+    switch (form) {
+        case ADD: case ADD_I:   *result = (long)(ua + ub);  return true;
+        case SUB:               *result = (long)(ua - ub);  return true;
+        case MULT: case MULT_I: *result = (long)(ua * ub);  return true;
+        case DIV:
+            if (b == 0 || (a == INT64_MIN && b == -1)) {
+                return false;
+            }
+            *result = a / b;
+            return true;
+        case AND:       *result = a & b;            return true;
+        case OR:        *result = a | b;            return true;
+        case CMP_LT:    *result = (a <  b);         return true;
+        case CMP_LE:    *result = (a <= b);         return true;
+        case CMP_EQ:    *result = (a == b);         return true;
+        case CMP_GE:    *result = (a >= b);         return true;
+        case CMP_GT:    *result = (a >  b);         return true;
+        case CMP_NE:    *result = (a != b);         return true;
+        case NOT:       *result = (~a) & 1;         return true;
+        case NEG:       *result = (long)(0 - ua);   return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Compute the lattice value of the result of an instruction
+ */
+ConstValue evaluate (SCCPState* state, BasicBlock* block, ILOCInsn* insn)
+{
+    ConstValue varying = { .level = VARYING, .value = 0 };
+    ConstValue result = { .level = UNDEFINED, .value = 0 };
+
+    switch (insn->form) {
+        case LOAD_I:
+            return operand_value(state, insn->op[0]);
+
+        case I2I:
+            return operand_value(state, insn->op[0]);
+
+        case PHI:
+            /* only values flowing along executable edges count */
+            for (int p = 0; p < block->num_preds && p < 2; p++) {
+                BasicBlock* pred = block->preds[p];
+                for (int s = 0; s < pred->num_succ; s++) {
+                    if (pred->succ[s] == block && state->edge_exec[pred->id][s]) {
+                        result = meet(result, operand_value(state, insn->op[p]));
+                    }
+                }
+            }
+            return result;
+
+        case NOT: case NEG: {
+            ConstValue a = operand_value(state, insn->op[0]);
+            if (a.level != CONSTANT) {
+                return a;
+            }
+            fold_operation(insn->form, a.value, 0, &result.value);
+            result.level = CONSTANT;
+            return result;
+        }
+
+        case ADD: case SUB: case MULT: case DIV: case AND: case OR:
+        case CMP_LT: case CMP_LE: case CMP_EQ: case CMP_GE: case CMP_GT: case CMP_NE:
+        case ADD_I: case MULT_I: {
+            ConstValue a = operand_value(state, insn->op[0]);
+            ConstValue b = operand_value(state, insn->op[1]);
+
+            /* some results do not depend on a varying operand */
+            if ((insn->form == MULT || insn->form == MULT_I || insn->form == AND) &&
+                    ((a.level == CONSTANT && a.value == 0) || (b.level == CONSTANT && b.value == 0))) {
+                return (ConstValue){ .level = CONSTANT, .value = 0 };
+            }
+
+            if (a.level == VARYING || b.level == VARYING) {
+                return varying;
+            } else if (a.level == UNDEFINED || b.level == UNDEFINED) {
+                return result;
+            } else if (fold_operation(insn->form, a.value, b.value, &result.value)) {
+                result.level = CONSTANT;
+                return result;
+            }
+            return varying;
+        }
+
+        default:
+            /* memory, stack, and call results are never known */
+            return varying;
+    }
+}
+
+/**
+ * @brief Put an edge on the flow worklist (unless it is already executable or queued)
+ */
+void queue_edge (SCCPState* state, BasicBlock* block, int succ_index)
+{
+    if (state->edge_exec[block->id][succ_index] || state->edge_queued[block->id][succ_index]) {
+        return;
+    }
+    state->edge_queued[block->id][succ_index] = true;
+    state->flow_list[state->num_flow++] = block->id * 2 + succ_index;
+}
+
+/**
+ * @brief Queue the outgoing edges of an executable block that may be taken
+ * (only the taken side of a branch on a constant)
+ */
+void visit_terminator (SCCPState* state, BasicBlock* block)
+{
+    ILOCInsn* term = BasicBlock_terminator(block);
+    for (int s = 0; s < block->num_succ; s++) {
+        if (term != NULL && term->form == CBR) {
+            ConstValue cond = operand_value(state, term->op[0]);
+            if (cond.level == UNDEFINED ||
+                    (cond.level == CONSTANT &&
+                     BasicBlock_label(block->succ[s]) != term->op[cond.value ? 1 : 2].id)) {
+                continue;
+            }
+        }
+        queue_edge(state, block, s);
+    }
+}
+
+/**
+ * @brief Lower the lattice value of an instruction's result (queueing its
+ * uses if it changed)
+ */
+void visit_instruction (SCCPState* state, BasicBlock* block, ILOCInsn* insn)
+{
+    Operand write_reg = ILOCInsn_get_write_register(insn);
+    if (write_reg.type != VIRTUAL_REG || write_reg.id >= state->num_vregs) {
+        return;
+    }
+    ConstValue old_value = state->values[write_reg.id];
+    ConstValue new_value = meet(old_value, evaluate(state, block, insn));
+    if (new_value.level != old_value.level || new_value.value != old_value.value) {
+        state->values[write_reg.id] = new_value;
+        state->ssa_list[state->num_ssa++] = write_reg.id;
+    }
+}
+
+/**
+ * @brief Find the instructions that read each register (see @ref SCCPState::use_start)
+ */
+void find_uses (SCCPState* state, CFG* cfg)
+{
+    int num_vregs = state->num_vregs;
+    state->use_start = (int*)calloc(num_vregs + 2, sizeof(int));
+    CHECK_MALLOC_PTR(state->use_start);
+    for (int pass = 0; pass < 2; pass++) {
+        for (int b = 0; b < cfg->num_blocks; b++) {
+            FOR_EACH (ILOCInsn*, insn, cfg->blocks[b]->insns) {
+                ILOCInsn* read_regs = ILOCInsn_get_read_registers(insn);
+                for (int i = 0; i < 3; i++) {
+                    int vr = read_regs->op[i].id;
+                    if (read_regs->op[i].type != VIRTUAL_REG || vr >= num_vregs ||
+                            (i > 0 && read_regs->op[i-1].type == VIRTUAL_REG && read_regs->op[i-1].id == vr) ||
+                            (i > 1 && read_regs->op[0].type == VIRTUAL_REG && read_regs->op[0].id == vr)) {
+                        continue;
+                    }
+                    if (pass == 0) {
+                        state->use_start[vr + 1]++;
+                    } else {
+                        int u = state->use_start[vr]++;
+                        state->use_insns[u] = insn;
+                        state->use_blocks[u] = cfg->blocks[b];
+                    }
+                }
+                ILOCInsn_free(read_regs);
+            }
+        }
+        if (pass == 0) {
+            for (int vr = 0; vr < num_vregs; vr++) {
+                state->use_start[vr + 1] += state->use_start[vr];
+            }
+            state->use_insns = (ILOCInsn**)calloc(state->use_start[num_vregs] + 1, sizeof(ILOCInsn*));
+            state->use_blocks = (BasicBlock**)calloc(state->use_start[num_vregs] + 1, sizeof(BasicBlock*));
+            CHECK_MALLOC_PTR(state->use_insns);
+            CHECK_MALLOC_PTR(state->use_blocks);
+        }
+    }
+    /* filling advanced each start to the next register's start */
+    for (int vr = num_vregs; vr > 0; vr--) {
+        state->use_start[vr] = state->use_start[vr - 1];
+    }
+    state->use_start[0] = 0;
+}
+
+/**
+ * @brief Find the lattice values of all registers and the executable edges
+ *
+ * Two worklists drive the propagation: the flow worklist holds edges that
+ * were just found to execute, and the SSA worklist holds registers whose
+ * value just changed. The first time a block executes, all of its
+ * instructions are evaluated; after that, a new incoming edge only
+ * re-evaluates its PHIs, and a changed register only re-evaluates its uses
+ * in executable blocks. Values only move down the lattice (at most twice
+ * each) and edges only become executable once, so each instruction is
+ * evaluated a bounded number of times.
+ */
+void propagate_constants (SCCPState* state, CFG* cfg)
+{
+    state->block_exec[0] = true;
+    FOR_EACH (ILOCInsn*, insn, cfg->blocks[0]->insns) {
+        visit_instruction(state, cfg->blocks[0], insn);
+    }
+    visit_terminator(state, cfg->blocks[0]);
+
+    while (state->num_flow > 0 || state->num_ssa > 0) {
+        if (state->num_flow > 0) {
+            int edge = state->flow_list[--state->num_flow];
+            BasicBlock* block = cfg->blocks[edge / 2];
+            BasicBlock* succ = block->succ[edge % 2];
+            state->edge_queued[block->id][edge % 2] = false;
+            state->edge_exec[block->id][edge % 2] = true;
+
+            bool first_visit = !state->block_exec[succ->id];
+            state->block_exec[succ->id] = true;
+            FOR_EACH (ILOCInsn*, insn, succ->insns) {
+                if (first_visit || insn->form == PHI) {
+                    visit_instruction(state, succ, insn);
+                }
+            }
+            if (first_visit) {
+                visit_terminator(state, succ);
+            }
+            continue;
+        }
+
+        int vr = state->ssa_list[--state->num_ssa];
+        for (int u = state->use_start[vr]; u < state->use_start[vr + 1]; u++) {
+            BasicBlock* block = state->use_blocks[u];
+            if (!state->block_exec[block->id]) {
+                continue;
+            }
+            if (state->use_insns[u]->form == CBR) {
+                visit_terminator(state, block);
+            } else {
+                visit_instruction(state, block, state->use_insns[u]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Rewrite the PHI instructions of a block after some of its predecessors went away
+ *
+ * PHI operands are reordered to match the new predecessor list. If only one
+ * predecessor is left, the PHI is deleted and its result is recorded in
+ * @c replace so that uses can be renamed to the remaining operand.
+ *
+ * @param block Block whose PHIs should be updated
+ * @param old_preds Predecessor list before the change
+ * @param num_old_preds Number of previous predecessors
+ * @param replace Replacement register for each deleted PHI result (or -1)
+ * @returns Number of instructions removed
+ */
+int remap_phis (BasicBlock* block, BasicBlock** old_preds, int num_old_preds, int* replace)
+{
+    int removed = 0;
+    ILOCInsn* prev = NULL;
+    ILOCInsn* insn = block->insns->head;
+    while (insn != NULL) {
+        ILOCInsn* next = insn->next;
+        if (insn->form == PHI) {
+            Operand ops[2] = { insn->op[0], insn->op[1] };
+            for (int p = 0; p < block->num_preds && p < 2; p++) {
+                for (int q = 0; q < num_old_preds && q < 2; q++) {
+                    if (old_preds[q] == block->preds[p]) {
+                        insn->op[p] = ops[q];
+                    }
+                }
+            }
+            if (block->num_preds <= 1) {
+                replace[insn->op[2].id] = insn->op[0].id;
+                BasicBlock_remove_after(block, prev);
+                removed++;
+                insn = next;
+                continue;
+            }
+        }
+        prev = insn;
+        insn = next;
+    }
+    return removed;
+}
+
+/**
+ * @brief Rename every use of a register that was recorded in @c replace
+ */
+void replace_uses (CFG* cfg, int* replace, int num_vregs)
+{
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        FOR_EACH (ILOCInsn*, insn, cfg->blocks[b]->insns) {
+            int w = ILOCInsn_get_write_index(insn);
+            for (int i = 0; i < 3; i++) {
+                if (i == w || insn->op[i].type != VIRTUAL_REG) {
+                    continue;
+                }
+                int vr = insn->op[i].id;
+                while (vr < num_vregs && replace[vr] >= 0) {
+                    vr = replace[vr];
+                }
+                insn->op[i].id = vr;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Switch a register/register instruction with a constant operand to its immediate form
+ *
+ * @returns True if the instruction was changed
+ */
+bool use_immediate_form (SCCPState* state, ILOCInsn* insn)
+{
+    ConstValue a = operand_value(state, insn->op[0]);
+    ConstValue b = operand_value(state, insn->op[1]);
+    InsnForm imm_form = (insn->form == MULT ? MULT_I : ADD_I);
+    if (insn->form != ADD && insn->form != SUB && insn->form != MULT) {
+        return false;
+    }
+    if (b.level == CONSTANT) {
+        insn->op[1] = int_const(insn->form == SUB ? (long)(0 - (uint64_t)b.value) : b.value);
+    } else if (a.level == CONSTANT && insn->form != SUB) {
+        insn->op[0] = insn->op[1];
+        insn->op[1] = int_const(a.value);
+    } else {
+        return false;
+    }
+    insn->form = imm_form;
+    return true;
+}
+
+int CFG_propagate_constants (CFG* cfg)
+{
+    CFG_compute_edges(cfg);
+    CFG_compute_liveness(cfg);
+    int n = cfg->num_blocks;
+    int num_vregs = cfg->num_vregs;
+
+    SCCPState state;
+    state.num_vregs = num_vregs;
+    state.values = (ConstValue*)calloc(num_vregs + 1, sizeof(ConstValue));
+    state.block_exec = (bool*)calloc(n, sizeof(bool));
+    state.edge_exec = calloc(n, sizeof(bool[2]));
+    state.edge_queued = calloc(n, sizeof(bool[2]));
+    state.flow_list = (int*)calloc(2 * n + 1, sizeof(int));
+    state.ssa_list = (int*)calloc(2 * num_vregs + 1, sizeof(int));
+    state.num_flow = state.num_ssa = 0;
+    CHECK_MALLOC_PTR(state.values);
+    CHECK_MALLOC_PTR(state.block_exec);
+    CHECK_MALLOC_PTR(state.edge_exec);
+    CHECK_MALLOC_PTR(state.edge_queued);
+    CHECK_MALLOC_PTR(state.flow_list);
+    CHECK_MALLOC_PTR(state.ssa_list);
+    find_uses(&state, cfg);
+
+    /* registers read before they are written are unknown */
+    for (int vr = 0; vr < num_vregs; vr++) {
+        if (BitSet_contains(cfg->blocks[0]->live_in, vr)) {
+            state.values[vr].level = VARYING;
+        }
+    }
+    propagate_constants(&state, cfg);
+
+    int folded = 0;
+    for (int b = 0; b < n; b++) {
+        BasicBlock* block = cfg->blocks[b];
+        if (!state.block_exec[b]) {
+            continue;
+        }
+        FOR_EACH (ILOCInsn*, insn, block->insns) {
+            /* constant results become immediate loads */
+            Operand write_reg = ILOCInsn_get_write_register(insn);
+            if (write_reg.type == VIRTUAL_REG && insn->form != LOAD_I && insn->form != PHI &&
+                    is_side_effect_free(insn->form) && state.values[write_reg.id].level == CONSTANT) {
+                long value = state.values[write_reg.id].value;
+                insn->form = LOAD_I;
+                insn->op[0] = int_const(value);
+                insn->op[1] = write_reg;
+                insn->op[2] = empty_operand();
+                folded++;
+            } else if (use_immediate_form(&state, insn)) {
+                folded++;
+            }
+
+            /* branches on constants become jumps */
+            if (insn->form == CBR && operand_value(&state, insn->op[0]).level == CONSTANT) {
+                insn->form = JUMP;
+                insn->op[0] = insn->op[operand_value(&state, insn->op[0]).value ? 1 : 2];
+                insn->op[1] = empty_operand();
+                insn->op[2] = empty_operand();
+                folded++;
+            }
+        }
+    }
+
+    /* remember predecessor lists so that PHI operands can be matched up again */
+    BasicBlock*** old_preds = (BasicBlock***)calloc(n, sizeof(BasicBlock**));
+    int* num_old_preds = (int*)calloc(n, sizeof(int));
+    BasicBlock** blocks = (BasicBlock**)calloc(n, sizeof(BasicBlock*));
+    CHECK_MALLOC_PTR(old_preds);
+    CHECK_MALLOC_PTR(num_old_preds);
+    CHECK_MALLOC_PTR(blocks);
+    for (int b = 0; b < n; b++) {
+        BasicBlock* block = cfg->blocks[b];
+        blocks[b] = block;
+        num_old_preds[b] = block->num_preds;
+        old_preds[b] = (BasicBlock**)calloc(block->num_preds + 1, sizeof(BasicBlock*));
+        CHECK_MALLOC_PTR(old_preds[b]);
+        memcpy(old_preds[b], block->preds, block->num_preds * sizeof(BasicBlock*));
+    }
+
+    /* prune blocks that never execute */
+    for (int b = n - 1; b > 0; b--) {
+        if (!state.block_exec[b]) {
+            folded += blocks[b]->insns->size;
+            CFG_remove_block(cfg, blocks[b]);
+            blocks[b] = NULL;
+        }
+    }
+    CFG_compute_edges(cfg);
+
+    int* replace = (int*)calloc(num_vregs + 1, sizeof(int));
+    CHECK_MALLOC_PTR(replace);
+    for (int vr = 0; vr < num_vregs; vr++) {
+        replace[vr] = -1;
+    }
+    for (int b = 0; b < n; b++) {
+        if (blocks[b] != NULL && blocks[b]->num_preds < num_old_preds[b]) {
+            folded += remap_phis(blocks[b], old_preds[b], num_old_preds[b], replace);
+        }
+        free(old_preds[b]);
+    }
+    replace_uses(cfg, replace, num_vregs);
+
+    free(replace);
+    free(old_preds);
+    free(num_old_preds);
+    free(blocks);
+    free(state.values);
+    free(state.block_exec);
+    free(state.edge_exec);
+    free(state.edge_queued);
+    free(state.flow_list);
+    free(state.ssa_list);
+    free(state.use_start);
+    free(state.use_insns);
+    free(state.use_blocks);
+    return folded;
+}
+
+
+/*
+ * Loop-invariant code motion
+ */
+
+/**
+ * @brief Test whether an instruction form may be moved out of a loop
+ *
+ * These forms only compute a result from their operands; loads and divisions
+ * are allowed here but need the additional checks in @ref is_loop_invariant.
+ */
+bool is_hoistable_form (InsnForm form)
+{
+    switch (form) {
+        case LOAD_I: case I2I: case NOT: case NEG:
+        case ADD: case SUB: case MULT: case DIV: case AND: case OR:
+        case CMP_LT: case CMP_LE: case CMP_EQ: case CMP_GE: case CMP_GT: case CMP_NE:
+        case ADD_I: case MULT_I:
+        case LOAD: case LOAD_AI:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Test whether an instruction in a loop computes the same value on every iteration
+ *
+ * Hoisted instructions also execute when the loop body does not, so loads are
+ * only hoisted from fixed (global) addresses in loops without stores or calls,
+ * and divisions only by nonzero constants.
+ *
+ * @param insn Instruction to test
+ * @param def_insn Defining instruction of each virtual register (SSA form)
+ * @param in_loop Is each virtual register defined inside the loop?
+ * @param writes_memory Does the loop contain any stores or calls?
+ */
+bool is_loop_invariant (ILOCInsn* insn, ILOCInsn** def_insn, bool* in_loop, bool writes_memory)
+{
+    Operand write_reg = ILOCInsn_get_write_register(insn);
+    if (!is_hoistable_form(insn->form) || write_reg.type != VIRTUAL_REG) {
+        return false;
+    }
+
+    bool invariant = true;
+    ILOCInsn* read_regs = ILOCInsn_get_read_registers(insn);
+    for (int i = 0; i < 3; i++) {
+        Operand op = read_regs->op[i];
+        if (op.type == VIRTUAL_REG) {
+            invariant &= !in_loop[op.id];
+        } else if (op.type != EMPTY && op.type != INT_CONST &&
+                   op.type != STR_CONST && op.type != JUMP_LABEL) {
+            invariant = false;      /* e.g., RET, SP, or BP */
+        }
+    }
+    ILOCInsn_free(read_regs);
+    if (!invariant) {
+        return false;
+    }
+
+    if (insn->form == LOAD || insn->form == LOAD_AI) {
+        ILOCInsn* base = def_insn[insn->op[0].id];
+        return !writes_memory && base != NULL && base->form == LOAD_I;
+    }
+    if (insn->form == DIV) {
+        ILOCInsn* divisor = def_insn[insn->op[1].id];
+        return divisor != NULL && divisor->form == LOAD_I &&
+               divisor->op[0].imm != 0 && divisor->op[0].imm != -1;
+    }
+    return true;
+}
+
+/**
+ * @brief Move the invariant computations of a loop into its preheader
+ *
+ * @returns Number of instructions hoisted
+ */
+int hoist_loop_invariants (CFG* cfg, Loop* loop, BasicBlock* preheader)
+{
+    int num_vregs = cfg->num_vregs;
+    ILOCInsn** def_insn = (ILOCInsn**)calloc(num_vregs + 1, sizeof(ILOCInsn*));
+    bool* in_loop = (bool*)calloc(num_vregs + 1, sizeof(bool));
+    CHECK_MALLOC_PTR(def_insn);
+    CHECK_MALLOC_PTR(in_loop);
+
+    bool writes_memory = false;
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        bool inside = BitSet_contains(loop->blocks, b);
+        FOR_EACH (ILOCInsn*, insn, cfg->blocks[b]->insns) {
+            Operand write_reg = ILOCInsn_get_write_register(insn);
+            if (write_reg.type == VIRTUAL_REG && write_reg.id < num_vregs) {
+                def_insn[write_reg.id] = insn;
+                in_loop[write_reg.id] = inside;
+            }
+            if (inside) {
+                writes_memory |= (insn->form == STORE || insn->form == STORE_AI ||
+                                  insn->form == STORE_AO || insn->form == CALL);
+            }
+        }
+    }
+
+    /* repeat until nothing moves, so chains of invariant computations are hoisted in order */
+    int hoisted = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = 0; b < cfg->num_blocks; b++) {
+            if (!BitSet_contains(loop->blocks, b)) {
+                continue;
+            }
+            BasicBlock* block = cfg->blocks[b];
+            ILOCInsn* prev = NULL;
+            ILOCInsn* insn = block->insns->head;
+            while (insn != NULL) {
+                ILOCInsn* next = insn->next;
+                if (is_loop_invariant(insn, def_insn, in_loop, writes_memory)) {
+                    BasicBlock_unlink_after(block, prev);
+                    BasicBlock_insert_before_terminator(preheader, insn);
+                    in_loop[ILOCInsn_get_write_register(insn).id] = false;
+                    hoisted++;
+                    changed = true;
+                } else {
+                    prev = insn;
+                }
+                insn = next;
+            }
+        }
+    }
+
+    free(def_insn);
+    free(in_loop);
+    return hoisted;
+}
+
+/**
+ * @brief Give every loop a preheader (and leave the loops up to date)
+ */
+void insert_preheaders (CFG* cfg)
+{
+    /* each new block invalidates the loop sets */
+    bool inserted = true;
+    while (inserted) {
+        inserted = false;
+        CFG_compute_edges(cfg);
+        CFG_compute_dominators(cfg);
+        CFG_compute_loops(cfg);
+        FOR_EACH (Loop*, loop, cfg->loops) {
+            int num_blocks = cfg->num_blocks;
+            CFG_insert_preheader(cfg, loop);
+            if (cfg->num_blocks != num_blocks) {
+                inserted = true;
+                break;
+            }
+        }
+    }
+}
+
+int CFG_hoist_loop_invariants (CFG* cfg)
+{
+    insert_preheaders(cfg);
+
+    /* innermost loops first, so their invariants can keep moving outwards */
+    CFG_compute_liveness(cfg);
+    int hoisted = 0;
+    FOR_EACH (Loop*, loop, cfg->loops) {
+        hoisted += hoist_loop_invariants(cfg, loop, CFG_insert_preheader(cfg, loop));
+    }
+    return hoisted;
+}
+
+
+/*
+ * Induction variable strength reduction
+ */
+
+/**
+ * @brief Basic induction variable of a loop
+ *
+ * A @c PHI at the loop header "i1 = phi(i0, i2)" where "i2 = i1 + step" is
+ * computed inside the loop.
+ */
+typedef struct InductionVar
+{
+    int current;                /**< @brief Value at the top of the loop body (i1) */
+    int init;                   /**< @brief Value on entry to the loop (i0) */
+    int next;                   /**< @brief Value for the next iteration (i2) */
+    long step;                  /**< @brief Constant increment per iteration */
+    ILOCInsn* update;           /**< @brief Instruction that computes the next value */
+    BasicBlock* update_block;   /**< @brief Block containing the update */
+} InductionVar;
+
+/**
+ * @brief Strength-reduced induction variable "base + i * scale"
+ *
+ * Replaces a multiplication of a basic induction variable (and optionally the
+ * base address that it is added to) with a new induction variable that is
+ * incremented by "step * scale" on every iteration.
+ */
+typedef struct ReducedVar
+{
+    int iv;             /**< @brief Index of the underlying basic induction variable */
+    long scale;         /**< @brief Constant multiplier */
+    bool has_base;      /**< @brief Is a base address included? */
+    bool const_base;    /**< @brief Is the base a constant (e.g., a global array address)? */
+    long base_key;      /**< @brief Base address (if constant) or its register ID */
+    int base_reg;       /**< @brief Register holding the base address */
+    int current;        /**< @brief New variable matching @ref InductionVar::current */
+    int next;           /**< @brief New variable matching @ref InductionVar::next */
+} ReducedVar;
+
+/**
+ * @brief Find the basic induction variables of a loop (in SSA form)
+ *
+ * @param loop Loop to search
+ * @param def_insn Defining instruction of each virtual register
+ * @param def_block Defining block of each virtual register
+ * @param ivs Output: basic induction variables (room for every header instruction)
+ * @returns Number of induction variables found
+ */
+int find_induction_vars (Loop* loop, ILOCInsn** def_insn, BasicBlock** def_block, InductionVar* ivs)
+{
+    BasicBlock* header = loop->header;
+    if (header->num_preds != 2) {
+        return 0;
+    }
+    int outside = (BitSet_contains(loop->blocks, header->preds[0]->id) ? 1 : 0);
+    int latch = 1 - outside;
+    if (BitSet_contains(loop->blocks, header->preds[outside]->id) ||
+            !BitSet_contains(loop->blocks, header->preds[latch]->id)) {
+        return 0;
+    }
+
+    int num_ivs = 0;
+    FOR_EACH (ILOCInsn*, phi, header->insns) {
+        if (phi->form != PHI || phi->op[latch].type != VIRTUAL_REG) {
+            continue;
+        }
+        ILOCInsn* update = def_insn[phi->op[latch].id];
+        BasicBlock* update_block = def_block[phi->op[latch].id];
+        if (update != NULL && update->form == ADD_I && update->op[0].type == VIRTUAL_REG &&
+                update->op[0].id == phi->op[2].id &&
+                BitSet_contains(loop->blocks, update_block->id)) {
+            ivs[num_ivs].current = phi->op[2].id;
+            ivs[num_ivs].init = phi->op[outside].id;
+            ivs[num_ivs].next = phi->op[latch].id;
+            ivs[num_ivs].step = update->op[1].imm;
+            ivs[num_ivs].update = update;
+            ivs[num_ivs].update_block = update_block;
+            num_ivs++;
+        }
+    }
+    return num_ivs;
+}
+
+/**
+ * @brief Create the instructions that maintain a new reduced induction variable
+ *
+ * Initializes it in the preheader, merges it with a @c PHI at the loop header,
+ * and increments it right after the underlying induction variable.
+ */
+void create_reduced_var (Loop* loop, BasicBlock* preheader, InductionVar* iv,
+        ReducedVar* rv, ILOCInsn** def_insn)
+{
+    BasicBlock* header = loop->header;
+    int outside = (BitSet_contains(loop->blocks, header->preds[0]->id) ? 1 : 0);
+    Operand current = virtual_register();
+    Operand next = virtual_register();
+    Operand init = virtual_register();
+    rv->current = current.id;
+    rv->next = next.id;
+
+    /* initial value: base + i0 * scale (folded if everything is constant) */
+    ILOCInsn* init_def = def_insn[iv->init];
+    Operand i0 = { .type = VIRTUAL_REG, .id = iv->init };
+    Operand base = { .type = VIRTUAL_REG, .id = rv->base_reg };
+    if (init_def != NULL && init_def->form == LOAD_I && (!rv->has_base || rv->const_base)) {
+        long value = (long)((uint64_t)init_def->op[0].imm * (uint64_t)rv->scale) +
+                     (rv->has_base ? rv->base_key : 0);
+        BasicBlock_insert_before_terminator(preheader, ILOCInsn_new_2op(LOAD_I, int_const(value), init));
+    } else if (rv->has_base) {
+        Operand offset = virtual_register();
+        BasicBlock_insert_before_terminator(preheader,
+                ILOCInsn_new_3op(MULT_I, i0, int_const(rv->scale), offset));
+        BasicBlock_insert_before_terminator(preheader, ILOCInsn_new_3op(ADD, base, offset, init));
+    } else {
+        BasicBlock_insert_before_terminator(preheader,
+                ILOCInsn_new_3op(MULT_I, i0, int_const(rv->scale), init));
+    }
+
+    /* merge at the header and step along with the original variable */
+    Operand ops[2];
+    ops[outside] = init;
+    ops[1 - outside] = next;
+    ILOCInsn* label = header->insns->head;
+    BasicBlock_insert_after(header, (label != NULL && label->form == LABEL ? label : NULL),
+            ILOCInsn_new_3op(PHI, ops[0], ops[1], current));
+    BasicBlock_insert_after(iv->update_block, iv->update,
+            ILOCInsn_new_3op(ADD_I, current, int_const((long)((uint64_t)iv->step * (uint64_t)rv->scale)), next));
+}
+
+/**
+ * @brief Replace multiplications of induction variables in a loop with new induction variables
+ *
+ * A multiplication whose only use is as the offset of an array access from a
+ * loop-invariant base becomes a pointer that is dereferenced directly;
+ * otherwise the product itself becomes the new induction variable.
+ *
+ * @returns Number of multiplications removed
+ */
+int reduce_loop (CFG* cfg, Loop* loop, BasicBlock* preheader)
+{
+    int num_vregs = cfg->num_vregs;
+    ILOCInsn** def_insn = (ILOCInsn**)calloc(num_vregs + 1, sizeof(ILOCInsn*));
+    BasicBlock** def_block = (BasicBlock**)calloc(num_vregs + 1, sizeof(BasicBlock*));
+    ILOCInsn** use_insn = (ILOCInsn**)calloc(num_vregs + 1, sizeof(ILOCInsn*));
+    int* use_count = (int*)calloc(num_vregs + 1, sizeof(int));
+    CHECK_MALLOC_PTR(def_insn);
+    CHECK_MALLOC_PTR(def_block);
+    CHECK_MALLOC_PTR(use_insn);
+    CHECK_MALLOC_PTR(use_count);
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        FOR_EACH (ILOCInsn*, insn, cfg->blocks[b]->insns) {
+            int w = ILOCInsn_get_write_index(insn);
+            for (int i = 0; i < 3; i++) {
+                int vr = insn->op[i].id;
+                if (insn->op[i].type != VIRTUAL_REG || vr >= num_vregs) {
+                    continue;
+                } else if (i == w) {
+                    def_insn[vr] = insn;
+                    def_block[vr] = cfg->blocks[b];
+                } else {
+                    use_insn[vr] = insn;
+                    use_count[vr]++;
+                }
+            }
+        }
+    }
+
+    InductionVar* ivs = (InductionVar*)calloc(loop->header->insns->size, sizeof(InductionVar));
+    CHECK_MALLOC_PTR(ivs);
+    int num_ivs = find_induction_vars(loop, def_insn, def_block, ivs);
+
+    /* candidates: multiplications of an induction variable by a constant */
+    int max_candidates = 0;
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        if (BitSet_contains(loop->blocks, b)) {
+            max_candidates += cfg->blocks[b]->insns->size;
+        }
+    }
+    ILOCInsn** removed = (ILOCInsn**)calloc(max_candidates + 1, sizeof(ILOCInsn*));
+    ReducedVar* rvs = (ReducedVar*)calloc(max_candidates + 1, sizeof(ReducedVar));
+    int* replace = (int*)calloc(num_vregs + 1, sizeof(int));
+    CHECK_MALLOC_PTR(removed);
+    CHECK_MALLOC_PTR(rvs);
+    CHECK_MALLOC_PTR(replace);
+    for (int vr = 0; vr < num_vregs; vr++) {
+        replace[vr] = -1;
+    }
+    int num_removed = 0;
+    int num_rvs = 0;
+
+    for (int b = 0; b < cfg->num_blocks && num_ivs > 0; b++) {
+        if (!BitSet_contains(loop->blocks, b)) {
+            continue;
+        }
+        FOR_EACH (ILOCInsn*, insn, cfg->blocks[b]->insns) {
+            if (insn->form != MULT_I || insn->op[0].type != VIRTUAL_REG ||
+                    insn->op[2].type != VIRTUAL_REG || insn->op[2].id >= num_vregs) {
+                continue;
+            }
+            int iv = -1;
+            bool after_update = false;
+            for (int v = 0; v < num_ivs; v++) {
+                if (insn->op[0].id == ivs[v].current || insn->op[0].id == ivs[v].next) {
+                    iv = v;
+                    after_update = (insn->op[0].id == ivs[v].next);
+                }
+            }
+            if (iv < 0) {
+                continue;
+            }
+
+            /* is the product only used to index an array with a loop-invariant base? */
+            int product = insn->op[2].id;
+            ILOCInsn* use = use_insn[product];
+            int base = -1;
+            if (use_count[product] == 1 && use->form == LOAD_AO &&
+                    use->op[0].type == VIRTUAL_REG && use->op[1].type == VIRTUAL_REG &&
+                    use->op[1].id == product && use->op[0].id != product) {
+                base = use->op[0].id;
+            } else if (use_count[product] == 1 && use->form == STORE_AO &&
+                    use->op[1].type == VIRTUAL_REG && use->op[2].type == VIRTUAL_REG &&
+                    use->op[2].id == product && use->op[1].id != product &&
+                    !(use->op[0].type == VIRTUAL_REG && use->op[0].id == product)) {
+                base = use->op[1].id;
+            }
+            if (base >= 0 && (base >= num_vregs || def_block[base] == NULL ||
+                    BitSet_contains(loop->blocks, def_block[base]->id))) {
+                base = -1;
+            }
+
+            ReducedVar key = { .iv = iv, .scale = insn->op[1].imm, .has_base = (base >= 0),
+                               .const_base = false, .base_key = base, .base_reg = base };
+            if (base >= 0 && def_insn[base]->form == LOAD_I) {
+                key.const_base = true;
+                key.base_key = def_insn[base]->op[0].imm;
+            }
+
+            /* share the new variable with identical computations */
+            ReducedVar* rv = NULL;
+            for (int r = 0; r < num_rvs; r++) {
+                if (rvs[r].iv == key.iv && rvs[r].scale == key.scale &&
+                        rvs[r].has_base == key.has_base && rvs[r].const_base == key.const_base &&
+                        (!key.has_base || rvs[r].base_key == key.base_key)) {
+                    rv = &rvs[r];
+                }
+            }
+            if (rv == NULL) {
+                rv = &rvs[num_rvs++];
+                *rv = key;
+                create_reduced_var(loop, preheader, &ivs[iv], rv, def_insn);
+            }
+            int reduced = (after_update ? rv->next : rv->current);
+
+            if (key.has_base && use->form == LOAD_AO) {
+                use->form = LOAD_AI;
+                use->op[0] = (Operand){ .type = VIRTUAL_REG, .id = reduced };
+                use->op[1] = int_const(0);
+            } else if (key.has_base) {
+                use->form = STORE_AI;
+                use->op[1] = (Operand){ .type = VIRTUAL_REG, .id = reduced };
+                use->op[2] = int_const(0);
+            } else {
+                replace[product] = reduced;
+            }
+            removed[num_removed++] = insn;
+        }
+    }
+
+    /* delete the multiplications */
+    for (int b = 0; b < cfg->num_blocks && num_removed > 0; b++) {
+        BasicBlock* block = cfg->blocks[b];
+        ILOCInsn* prev = NULL;
+        ILOCInsn* insn = block->insns->head;
+        while (insn != NULL) {
+            ILOCInsn* next = insn->next;
+            bool found = false;
+            for (int r = 0; r < num_removed; r++) {
+                found |= (removed[r] == insn);
+            }
+            if (found) {
+                BasicBlock_remove_after(block, prev);
+            } else {
+                prev = insn;
+            }
+            insn = next;
+        }
+    }
+    replace_uses(cfg, replace, num_vregs);
+
+    free(def_insn);
+    free(def_block);
+    free(use_insn);
+    free(use_count);
+    free(ivs);
+    free(removed);
+    free(rvs);
+    free(replace);
+    return num_removed;
+}
+
+int CFG_reduce_induction_vars (CFG* cfg)
+{
+    insert_preheaders(cfg);
+    int reduced = 0;
+    FOR_EACH (Loop*, loop, cfg->loops) {
+        CFG_compute_liveness(cfg);
+        reduced += reduce_loop(cfg, loop, CFG_insert_preheader(cfg, loop));
+    }
+    return reduced;
+}
+
+
+/*
+ * Optimization pipeline
+ */
+
+void optimize (InsnList* list, FILE* report)
+{
+    int promoted = 0, phis = 0, folded = 0, hoisted = 0, reduced = 0, copies = 0, dead = 0;
+
+    CFGList* cfgs = CFGList_build(list);
+    FOR_EACH (CFG*, cfg, cfgs) {
+        promoted += CFG_promote_stack_slots(cfg);
+        phis += CFG_to_ssa(cfg);
+        folded += CFG_propagate_constants(cfg);
+        hoisted += CFG_hoist_loop_invariants(cfg);
+        reduced += CFG_reduce_induction_vars(cfg);
+        copies += CFG_from_ssa(cfg);
+
+        /* DCE is not PHI-aware, so it runs after SSA destruction */
+        dead += CFG_eliminate_dead_code(cfg);
+    }
+    CFGList_linearize(cfgs, list);
+    CFGList_free(cfgs);
+
+    if (report != NULL) {
+        fprintf(report, "stack slot promotion: %d slots promoted\n", promoted);
+        fprintf(report, "SSA construction: %d phi instructions inserted\n", phis);
+        fprintf(report, "constant propagation: %d instructions folded\n", folded);
+        fprintf(report, "loop-invariant code motion: %d instructions hoisted\n", hoisted);
+        fprintf(report, "strength reduction: %d multiplications removed\n", reduced);
+        fprintf(report, "SSA destruction: %d copies inserted\n", copies);
+        fprintf(report, "dead code elimination: %d instructions removed\n", dead);
+    }
+}
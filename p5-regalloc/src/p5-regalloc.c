@@ -2,8 +2,261 @@
  * @file p5-regalloc.c
  * @brief Compiler phase 5: register allocation
  */
+#include <limits.h>
+
 #include "p5-regalloc.h"
+#include "cfg.h"
+#include "ssa.h"
+
+/**
+ * @brief Next-use distance of a value that is dead
+ */
+#define NO_NEXT_USE (1 << 30)
+
+/**
+ * @brief Next-use distance added for leaving a loop (so that a value used in
+ * the next iteration is always nearer than one only used after the loop)
+ */
+#define LOOP_EXIT_DISTANCE 100000
+
+/**
+ * @brief Distances for a set of virtual registers (sorted by register ID, so
+ * that lookups are a binary search)
+ */
+typedef struct DistanceMap
+{
+    int size;           /**< @brief Number of entries */
+    int *vregs;         /**< @brief Virtual registers in increasing order */
+    int *distances;     /**< @brief Distance for each entry of @ref DistanceMap::vregs */
+} DistanceMap;
+
+/**
+ * @brief Next instruction of a block that refers to a value
+ */
+typedef struct NextRef
+{
+    int position;       /**< @brief Position in the block (past the end if there is none) */
+    bool is_read;       /**< @brief Is the value read there? (otherwise it is overwritten first) */
+} NextRef;
+
+/**
+ * @brief Range of program points over which a value is live (empty if
+ * @c start is greater than @c end)
+ */
+typedef struct LiveInterval
+{
+    int start;          /**< @brief First point */
+    int end;            /**< @brief Last point */
+} LiveInterval;
+
+/**
+ * @brief End point of a live interval, for sorting (see @ref place_stack_slots)
+ */
+typedef struct IntervalPoint
+{
+    int point;          /**< @brief Start or end of the interval */
+    int value;          /**< @brief Value whose interval it is */
+} IntervalPoint;
+
+/**
+ * @brief Register allocator state for the basic block being allocated
+ *
+ * Registers are allocated one block at a time (bottom-up, furthest next use
+ * is spilled first). Virtual registers that are live across block boundaries
+ * have a fixed "home" slot on the stack: they are loaded from it on demand and
+ * written back to it at the end of every block that they are live out of.
+ *
+ * The values that cause the most spill code in loops (weighted by estimated
+ * block frequency) are instead "pinned" to a dedicated physical register in
+ * every block where they are live, so that loops do not have to reload and
+ * write them back on every iteration. Pinned values only go to their home slot
+ * around procedure calls: they are saved before a call only if they are used
+ * after it, and restored at their first use after the call (or at the end of
+ * the block if they are live out of it).
+ *
+ * Values that are cheap to recompute (constants and BP-relative addresses
+ * with a single definition) never go to the stack at all: they are
+ * rematerialized wherever they are needed again.
+ *
+ * A register is "clean" when its value is known to be in its stack slot
+ * already (it was just reloaded or stored); clean values are evicted and
+ * written back without a store.
+ *
+ * Each spilled value has one stack slot for the whole function. Slots are
+ * only placed in the frame after the function is allocated: values that are
+ * never live at the same time share a slot, so the frame grows with the
+ * number of simultaneously live spilled values rather than with the number
+ * of spills.
+ *
+ * Registers follow a calling convention: caller-saved registers may be
+ * overwritten by any call, while callee-saved registers survive calls because
+ * every function that writes one saves it in its prologue and restores it in
+ * its epilogue. Values that are live across a call inside a loop go to
+ * callee-saved registers when possible (so they are not saved and restored on
+ * every iteration), and other values go to caller-saved registers (saving
+ * them around a call that runs once costs no more than saving a callee-saved
+ * register on every entry to the function).
+ */
+typedef struct RegAllocState
+{
+    /**
+     * @brief Number of physical registers available
+     */
+    int num_physical_registers;
+
+    /**
+     * @brief Calling convention (which registers survive procedure calls)
+     */
+    const CallingConvention *convention;
+
+    /**
+     * @brief May callee-saved registers be used? (only if the function has a
+     * standard prologue and epilogue in which to save them)
+     */
+    bool can_save;
+
+    /**
+     * @brief Is each virtual register live across a procedure call inside a loop?
+     */
+    bool *crosses_loop_call;
+
+    /**
+     * @brief Has each physical register been used in the function yet? (the
+     * function must save the callee-saved ones)
+     */
+    bool *saved;
+
+    /**
+     * @brief Is the function the program's entry point? (it has no caller
+     * whose registers need to be preserved)
+     */
+    bool is_entry;
+
+    /**
+     * @brief Distance from the end of each block to the next use of each
+     * value that is live there (indexed by block ID; values that are not live
+     * have no next use; see @ref find_next_uses)
+     */
+    DistanceMap *next_use_out;
+
+    /**
+     * @brief Number of virtual registers in the function
+     */
+    int num_vregs;
+
+    /**
+     * @brief Number of instructions in the block being allocated (not
+     * counting inserted spill code)
+     */
+    int block_length;
+
+    /**
+     * @brief Position of the instruction being allocated in its block
+     * (starting at one)
+     */
+    int position;
+
+    /**
+     * @brief Next reference after each operand of each instruction of the
+     * block, indexed by @c 3*(position-1)+operand (see @ref find_block_refs)
+     */
+    NextRef *next_refs;
+
+    /**
+     * @brief Capacity of @ref RegAllocState::next_refs
+     */
+    int next_refs_capacity;
+
+    /**
+     * @brief First reference of each virtual register in the block (only
+     * valid if @ref RegAllocState::ref_block holds the block's ID)
+     */
+    NextRef *first_ref;
+
+    /**
+     * @brief Last block in which each virtual register was referenced
+     */
+    int *ref_block;
+
+    /**
+     * @brief Next reference of the value held in each physical register
+     */
+    NextRef *held_next;
+
+    /**
+     * @brief Virtual register held by each physical register (or -1 if free)
+     */
+    int *phys_reg_map;
 
+    /**
+     * @brief Does each virtual register have a stack slot?
+     */
+    bool *has_slot;
+
+    /**
+     * @brief Spill and reload instructions (their offsets hold the virtual
+     * register until slots are placed in the frame)
+     */
+    ILOCInsn **slot_insns;
+
+    /**
+     * @brief Number of instructions in @ref RegAllocState::slot_insns
+     */
+    int num_slot_insns;
+
+    /**
+     * @brief Capacity of @ref RegAllocState::slot_insns
+     */
+    int slot_insns_capacity;
+
+    /**
+     * @brief Single definition of each rematerializable virtual register (or @c NULL)
+     */
+    ILOCInsn **remat;
+
+    /**
+     * @brief Dedicated physical register of each virtual register (or -1)
+     */
+    int *pinned;
+
+    /**
+     * @brief Is each physical register reserved for a pinned value in this block?
+     */
+    bool *reserved;
+
+    /**
+     * @brief Does each physical register hold the same value as its virtual
+     * register's stack slot?
+     */
+    bool *clean;
+
+    /**
+     * @brief Was each (pinned) physical register clobbered by a call and not
+     * yet restored?
+     */
+    bool *stale;
+
+    /**
+     * @brief Local frame allocator instruction of the current function
+     */
+    ILOCInsn *local_allocator;
+
+    /**
+     * @brief Block being allocated
+     */
+    BasicBlock *block;
+
+    /**
+     * @brief New instructions are inserted after this one (@c NULL for block start)
+     */
+    ILOCInsn *cursor;
+
+    /**
+     * @brief Spill code counts (or @c NULL if not requested)
+     */
+    RegAllocStats *stats;
+
+} RegAllocState;
 
 /**
  * @brief Replace a virtual register id with a physical register id
@@ -28,226 +281,3794 @@ void replace_register(int vr, int pr, ILOCInsn *insn)
 }
 
 /**
- * @brief Insert a store instruction to spill a register to the stack
+ * @brief Insert an instruction at the current insertion point
  *
- * We need to allocate a new slot in the stack from for the current
- * function, so we need a reference to the local allocator instruction.
- * This instruction will always be the third instruction in a function
- * and will be of the form "add SP, -X => SP" where X is the current
- * stack frame size.
+ * Consecutive insertions appear in the order they were made.
  *
- * @param pr Physical register id that should be spilled
- * @param prev_insn Reference to an instruction; the new instruction will be
- * inserted directly after this one
- * @param local_allocator Reference to the local frame allocator instruction
- * @returns BP-based offset where the register was spilled
+ * @param state Allocator state
+ * @param new_insn Instruction to insert
  */
-int insert_spill(int pr, ILOCInsn *prev_insn, ILOCInsn *local_allocator)
+void insert_insn(RegAllocState *state, ILOCInsn *new_insn)
 {
-    /* adjust stack frame size to add new spill slot */
-
-    int bp_offset = local_allocator->op[1].imm - WORD_SIZE;
-    local_allocator->op[1].imm = bp_offset;
-
-    /* create store instruction */
-    ILOCInsn *new_insn = ILOCInsn_new_3op(STORE_AI,
-                                          physical_register(pr), base_register(), int_const(bp_offset));
+    BasicBlock_insert_after(state->block, state->cursor, new_insn);
+    state->cursor = new_insn;
+}
 
-    /* insert into code */
-    new_insn->next = prev_insn->next;
-    prev_insn->next = new_insn;
+/**
+ * @brief Insert a spill or reload instruction and remember it (so that its
+ * offset can be set once the slot is placed in the frame)
+ */
+void insert_slot_insn(RegAllocState *state, ILOCInsn *new_insn)
+{
+    if (state->num_slot_insns == state->slot_insns_capacity)
+    {
+        state->slot_insns_capacity = (state->slot_insns_capacity == 0 ? 16 : state->slot_insns_capacity * 2);
+        state->slot_insns = (ILOCInsn **)realloc(state->slot_insns,
+                                                 state->slot_insns_capacity * sizeof(ILOCInsn *));
+        CHECK_MALLOC_PTR(state->slot_insns);
+    }
+    state->slot_insns[state->num_slot_insns++] = new_insn;
+    insert_insn(state, new_insn);
+}
 
-    return bp_offset;
+/**
+ * @brief Insert a store instruction to spill a register to the stack
+ *
+ * @param state Allocator state
+ * @param pr Physical register id that should be spilled
+ * @param vr Virtual register whose slot the value should be stored in
+ */
+void insert_spill(RegAllocState *state, int pr, int vr)
+{
+    state->has_slot[vr] = true;
+    state->clean[pr] = true;
+    insert_slot_insn(state, ILOCInsn_new_3op(STORE_AI,
+                                             physical_register(pr), base_register(), int_const(vr)));
+    if (state->stats != NULL)
+    {
+        state->stats->spill_stores++;
+        state->stats->spill_cost += BasicBlock_frequency(state->block);
+    }
 }
 
 /**
  * @brief Insert a load instruction to load a spilled register
  *
- * @param bp_offset BP-based offset where the register value is spilled
+ * @param state Allocator state
+ * @param vr Virtual register whose slot holds the value
  * @param pr Physical register where the value should be loaded
- * @param prev_insn Reference to an instruction; the new instruction will be
- * inserted directly after this one
  */
-void insert_load(int bp_offset, int pr, ILOCInsn *prev_insn)
+void insert_load(RegAllocState *state, int vr, int pr)
 {
-    /* create load instruction */
-    ILOCInsn *new_insn = ILOCInsn_new_3op(LOAD_AI,
-                                          base_register(), int_const(bp_offset), physical_register(pr));
-
-    /* insert into code */
-    new_insn->next = prev_insn->next;
-    prev_insn->next = new_insn;
+    state->clean[pr] = true;
+    insert_slot_insn(state, ILOCInsn_new_3op(LOAD_AI,
+                                             base_register(), int_const(vr), physical_register(pr)));
+    if (state->stats != NULL)
+    {
+        state->stats->spill_loads++;
+        state->stats->spill_cost += BasicBlock_frequency(state->block);
+    }
 }
 
-void spill(int pr, ILOCInsn *prev_insn, ILOCInsn *local_allocator, int *offset_arr, int *phys_reg_map)
+/**
+ * @brief Insert a copy of a value's definition to recompute it into a register
+ *
+ * @param state Allocator state
+ * @param vr Rematerializable virtual register
+ * @param pr Physical register where the value should be recomputed
+ */
+void insert_remat(RegAllocState *state, int vr, int pr)
 {
+    ILOCInsn *def = ILOCInsn_copy(state->remat[vr]);
+    def->op[ILOCInsn_get_write_index(def)] = physical_register(pr);
+    insert_insn(state, def);
+    if (state->stats != NULL)
+    {
+        state->stats->rematerializations++;
+        state->stats->spill_cost += BasicBlock_frequency(state->block);
+    }
+}
 
-    //if (offset_arr[phys_reg_map[pr]] != -1)
-    int offset = insert_spill(pr, prev_insn, local_allocator);
-    offset_arr[phys_reg_map[pr]] = offset;//-word_size?
-    phys_reg_map[pr] = -1;
+/**
+ * @brief Bring a value that is not in a register back from its slot (or recompute it)
+ */
+void insert_restore(RegAllocState *state, int vr, int pr)
+{
+    if (state->remat[vr] != NULL)
+    {
+        insert_remat(state, vr, pr);
+    }
+    else if (state->has_slot[vr])
+    {
+        insert_load(state, vr, pr);
+    }
 }
 
-int dist(int vr, ILOCInsn *current_insn)
+/**
+ * @brief Spill a physical register and mark it as free
+ *
+ * Rematerializable and clean values are simply dropped.
+ */
+void spill(RegAllocState *state, int pr)
 {
-    ILOCInsn *search_insn = current_insn->next;
-    int dist = 1;
+    int vr = state->phys_reg_map[pr];
+    state->phys_reg_map[pr] = -1;
+    if (state->remat[vr] != NULL || state->clean[pr])
+    {
+        return;
+    }
+    insert_spill(state, pr, vr);
+}
 
-    while (search_insn)
+/**
+ * @brief Test whether any operand of an instruction is the given virtual register
+ */
+bool has_register_operand(int vr, ILOCInsn *insn)
+{
+    for (int i = 0; i < 3; i++)
     {
-        ILOCInsn *read_regs = ILOCInsn_get_read_registers(search_insn);
-        for (int i = 0; i < 3; i++)
+        if (insn->op[i].type == VIRTUAL_REG && insn->op[i].id == vr)
         {
-            if (read_regs->op[i].type == VIRTUAL_REG && read_regs->op[i].id == vr)
-            {
-                ILOCInsn_free(read_regs);
-                return dist;
-            }
+            return true;
         }
+    }
+    return false;
+}
 
-        ILOCInsn_free(read_regs);
-        search_insn = search_insn->next;
-        dist++;
+/**
+ * @brief Add two next-use distances (the sum stays below @ref NO_NEXT_USE
+ * unless one of them is @ref NO_NEXT_USE)
+ */
+int add_distance(int a, int b)
+{
+    if (a == NO_NEXT_USE || b == NO_NEXT_USE)
+    {
+        return NO_NEXT_USE;
     }
-    return MAX_VIRTUAL_REGS;
+    return (a + b >= NO_NEXT_USE || a + b < 0) ? NO_NEXT_USE - 1 : a + b;
 }
 
-int allocate(int *phys_reg_map, int num_physical_registers, int vr, ILOCInsn *current_insn, ILOCInsn *local_allocator_insn, int *offset_arr, ILOCInsn *prev_insn)
+/**
+ * @brief Create a distance map for the members of a set (all at the same
+ * initial distance)
+ */
+DistanceMap DistanceMap_from_set(BitSet *set, int distance)
 {
-    for (int i = 0; i < num_physical_registers; i++)
+    DistanceMap map = {.size = 0};
+    int count = BitSet_count(set);
+    map.vregs = (int *)malloc((count + 1) * sizeof(int));
+    map.distances = (int *)malloc((count + 1) * sizeof(int));
+    CHECK_MALLOC_PTR(map.vregs);
+    CHECK_MALLOC_PTR(map.distances);
+    for (int w = 0; w < set->num_words; w++)
     {
-        if (phys_reg_map[i] == -1)
+        for (uint64_t bits = set->words[w]; bits != 0; bits &= bits - 1)
         {
-            phys_reg_map[i] = vr;
-            return i;
+            map.vregs[map.size] = w * 64 + __builtin_ctzll(bits);
+            map.distances[map.size] = distance;
+            map.size++;
         }
     }
-    // spill case, for loops could be combined but makes code cleaner
-    // find pr that maximizes dist(name[pr])
-    int max_pr = -1;
-    int max_pr_dist = -1;
-    for (int i = 0; i < num_physical_registers; i++)
+    return map;
+}
+
+/**
+ * @brief Find the entry of a virtual register in a distance map
+ *
+ * @returns Index of the entry (or -1 if the register is not in the map)
+ */
+int DistanceMap_find(DistanceMap *map, int vr)
+{
+    int low = 0;
+    int high = map->size - 1;
+    while (low <= high)
     {
-        int vr = phys_reg_map[i];
-        int current_dist = dist(vr, current_insn);
-        if (current_dist > max_pr_dist)
+        int mid = low + (high - low) / 2;
+        if (map->vregs[mid] == vr)
         {
-            max_pr = i;
-            max_pr_dist = current_dist;
+            return mid;
+        }
+        else if (map->vregs[mid] < vr)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid - 1;
         }
     }
-    spill(max_pr, prev_insn, local_allocator_insn, offset_arr, phys_reg_map);
-    phys_reg_map[max_pr] = vr;
-    return max_pr;
+    return -1;
 }
 
-int ensure(int *phys_reg_map, int num_physical_registers, int vr, ILOCInsn *current_insn, ILOCInsn *local_allocator_insn, int *offset_arr, ILOCInsn *prev_insn)
+/**
+ * @brief Look up the distance of a virtual register in a distance map
+ *
+ * @returns Distance of the register (or @p missing if it is not in the map)
+ */
+int DistanceMap_get(DistanceMap *map, int vr, int missing)
 {
-    for (int i = 0; i < num_physical_registers; i++)
+    int index = DistanceMap_find(map, vr);
+    return (index == -1 ? missing : map->distances[index]);
+}
+
+/**
+ * @brief Deallocate the entries of a distance map
+ */
+void DistanceMap_free(DistanceMap *map)
+{
+    free(map->vregs);
+    free(map->distances);
+}
+
+/**
+ * @brief Find the references of each value in a block, walking backwards
+ * once from its end
+ *
+ * Afterwards, @ref RegAllocState::next_refs holds the next reference after
+ * every operand, and @ref RegAllocState::first_ref the first reference of
+ * every value that the block refers to. An instruction that reads and writes
+ * the same value counts as a read.
+ */
+void find_block_refs(RegAllocState *state, BasicBlock *block)
+{
+    int n = block->insns->size;
+    if (3 * n > state->next_refs_capacity)
     {
-        if (phys_reg_map[i] == vr)
+        state->next_refs_capacity = 3 * n;
+        state->next_refs = (NextRef *)realloc(state->next_refs, state->next_refs_capacity * sizeof(NextRef));
+        CHECK_MALLOC_PTR(state->next_refs);
+    }
+    state->block_length = n;
+    ILOCInsn *insns[n + 1];
+    int i = 0;
+    FOR_EACH(ILOCInsn *, insn, block->insns)
+    {
+        insns[i++] = insn;
+    }
+    NextRef none = {.position = n + 1, .is_read = false};
+    for (i = n - 1; i >= 0; i--)
+    {
+        for (int r = 0; r < 3; r++)
         {
-            return i;
+            int vr = insns[i]->op[r].id;
+            if (insns[i]->op[r].type == VIRTUAL_REG)
+            {
+                state->next_refs[3 * i + r] = (state->ref_block[vr] == block->id ? state->first_ref[vr] : none);
+            }
+        }
+        Operand write_reg = ILOCInsn_get_write_register(insns[i]);
+        if (write_reg.type == VIRTUAL_REG)
+        {
+            state->ref_block[write_reg.id] = block->id;
+            state->first_ref[write_reg.id] = (NextRef){.position = i + 1, .is_read = false};
+        }
+        ILOCInsn *read_regs = ILOCInsn_get_read_registers(insns[i]);
+        for (int r = 0; r < 3; r++)
+        {
+            if (read_regs->op[r].type == VIRTUAL_REG)
+            {
+                state->ref_block[read_regs->op[r].id] = block->id;
+                state->first_ref[read_regs->op[r].id] = (NextRef){.position = i + 1, .is_read = true};
+            }
         }
+        ILOCInsn_free(read_regs);
     }
-    int pr = allocate(phys_reg_map, num_physical_registers, vr, current_insn, local_allocator_insn, offset_arr, prev_insn);
-    
-    if (offset_arr[vr] != -1)
+}
+
+/**
+ * @brief Find the first reference of a virtual register in the current block
+ * (see @ref find_block_refs)
+ */
+NextRef first_ref_in_block(RegAllocState *state, int vr)
+{
+    if (state->ref_block[vr] == state->block->id)
     {
-        insert_load(offset_arr[vr], pr, prev_insn);
+        return state->first_ref[vr];
     }
-    return pr;
+    return (NextRef){.position = state->block_length + 1, .is_read = false};
 }
 
-void allocate_registers(InsnList *list, int num_physical_registers)
+/**
+ * @brief Find the distance from the current instruction to the next use of a
+ * value, given its next reference in the block
+ *
+ * The distance follows the instructions of the block and then the
+ * precomputed distances from the end of the block (see @ref find_next_uses),
+ * so it follows the control flow rather than the layout. A value that is
+ * written again before it is read is dead (@ref NO_NEXT_USE).
+ */
+int ref_distance(RegAllocState *state, int vr, NextRef ref)
 {
-    //BIggest issue is “I’m treating the wrong addI SP, imm => SP as the stack allocator inside fib.”
-    if (num_physical_registers <= 0) {
-        fprintf(stderr, "Error: no physical registers available for allocation\n");
-    exit(1);
+    if (ref.position <= state->block_length)
+    {
+        return ref.is_read ? ref.position - state->position : NO_NEXT_USE;
     }
+    return add_distance(state->block_length - state->position,
+                        DistanceMap_get(&state->next_use_out[state->block->id], vr, NO_NEXT_USE));
+}
 
-    if (!list)
+/**
+ * @brief Find the distance to the next use of an operand of the current instruction
+ */
+int operand_distance(RegAllocState *state, int vr, int operand)
+{
+    return ref_distance(state, vr, state->next_refs[3 * (state->position - 1) + operand]);
+}
+
+/**
+ * @brief Record that a physical register holds the value of an operand of
+ * the current instruction
+ */
+void hold_operand(RegAllocState *state, int pr, int operand)
+{
+    state->held_next[pr] = state->next_refs[3 * (state->position - 1) + operand];
+}
+
+/**
+ * @brief Test whether a physical register survives procedure calls
+ */
+bool is_callee_saved(RegAllocState *state, int pr)
+{
+    return CallingConvention_is_callee_saved(state->convention, pr);
+}
+
+/**
+ * @brief Test whether a physical register may be used in the current function
+ */
+bool is_usable(RegAllocState *state, int pr)
+{
+    return state->can_save || !is_callee_saved(state, pr);
+}
+
+/**
+ * @brief Rank a physical register for holding a virtual register (lower is better)
+ *
+ * Values that are live across a call in a loop belong in callee-saved
+ * registers. Any other value belongs in a register that costs nothing to use:
+ * a caller-saved one, or a callee-saved one that the function saves anyway.
+ */
+int register_rank(RegAllocState *state, int vr, int pr)
+{
+    if (state->crosses_loop_call[vr])
     {
-        return;
+        return is_callee_saved(state, pr) ? 0 : 1;
     }
+    return (is_callee_saved(state, pr) && !state->saved[pr]) ? 1 : 0;
+}
 
-    // define and set physical registers to -1
-    int phys_reg_map[num_physical_registers];
-    for (int i = 0; i < num_physical_registers; i++)
+/**
+ * @brief Find a physical register for a virtual register, spilling if necessary
+ *
+ * Free registers that match the value are preferred: callee-saved ones for
+ * values that are live across a call in a loop, caller-saved ones for
+ * everything else. A callee-saved register that the function does not use
+ * yet is only taken for other values if no value can be evicted for free
+ * instead (one that is not read again in the block).
+ *
+ * Dead values are evicted first. Otherwise the victim is the value whose next
+ * use is furthest away relative to the cost of bringing it back: a dirty
+ * value costs a store and a reload, a clean one only the reload, and
+ * rematerializing costs one instruction and no memory traffic. A value whose
+ * next use is in another block costs nothing extra: it would be written back
+ * at the end of the block and reloaded in the next one anyway, so evicting it
+ * only moves the store earlier.
+ *
+ * @param state Allocator state
+ * @param vr Virtual register that needs a physical register
+ * @param protected_regs Virtual registers that must not be spilled (read
+ * registers of the current instruction, or @c NULL)
+ * @returns Physical register id
+ */
+int allocate(RegAllocState *state, int vr, ILOCInsn *protected_regs)
+{
+    int *phys_reg_map = state->phys_reg_map;
+    for (int i = 0; i < state->num_physical_registers; i++)
+    {
+        if (phys_reg_map[i] == vr)
+        {
+            return i;
+        }
+    }
+    int free_pr = -1;
+    for (int i = 0; i < state->num_physical_registers; i++)
     {
-        phys_reg_map[i] = -1;
+        if (phys_reg_map[i] == -1 && is_usable(state, i) &&
+            (free_pr == -1 || register_rank(state, vr, i) < register_rank(state, vr, free_pr)))
+        {
+            free_pr = i;
+        }
     }
-
-    // offset array TODO determine if there is a better way to set size
-    //Is this True?  No virtual registers are live across function boundaries. 
-    //that would mean we have to reset offsets at each function and same for phys reg map
-    int offset_arr[MAX_VIRTUAL_REGS];
-    for (int i = 0; i < MAX_VIRTUAL_REGS; i++)
+    bool fresh = (free_pr != -1 && is_callee_saved(state, free_pr) && !state->saved[free_pr]);
+    if (free_pr != -1 && (!fresh || state->crosses_loop_call[vr]))
     {
-        // set as invalid
-        offset_arr[i] = -1;
+        phys_reg_map[free_pr] = vr;
+        state->clean[free_pr] = false;
+        state->saved[free_pr] = true;
+        return free_pr;
     }
-
-    // save previous instruction
-    ILOCInsn *local_allocator_insn = NULL;
-    ILOCInsn *last_processed_insn = NULL;
-
-    FOR_EACH(ILOCInsn *, insn, list)
+    // spill case, for loops could be combined but makes code cleaner
+    // find pr that maximizes dist(name[pr]) / cost(name[pr])
+    int max_pr = -1;
+    int max_pr_cost = 1;
+    int max_pr_dist = -1;
+    int free_victim_pr = -1; // value that can be evicted without adding any code
+    for (int i = 0; i < state->num_physical_registers; i++)
     {
-        // save reference to stack allocator instruction if i is a call label
-        //Save local allocator when the first instruction after a PUSH is an I2I and the next is an ADD_I
-        if(insn->form == PUSH && insn->next != NULL && insn->next->form == I2I && insn->next->next != NULL && insn->next->next->form == ADD_I) {
-            local_allocator_insn = insn->next->next;
+        if (phys_reg_map[i] == -1 || !is_usable(state, i) || state->reserved[i] ||
+            (protected_regs != NULL && has_register_operand(phys_reg_map[i], protected_regs)))
+        {
+            continue;
         }
-        ILOCInsn *read_regs = ILOCInsn_get_read_registers(insn);
-        // for each read vr in insn:
-        for (int i = 0; i < 3; i++)
+        // the next reference of each value is known, so nothing is searched
+        int current_dist = ref_distance(state, phys_reg_map[i], state->held_next[i]);
+        bool read_later = (state->held_next[i].position <= state->block_length && state->held_next[i].is_read);
+        int current_cost = (!read_later || state->remat[phys_reg_map[i]] != NULL ? 1 : (state->clean[i] ? 2 : 3));
+        long current_score = (long)current_dist * max_pr_cost;
+        long max_score = (long)max_pr_dist * current_cost;
+        if (current_score > max_score || (current_score == max_score && current_dist > max_pr_dist))
         {
-            if (read_regs->op[i].type == VIRTUAL_REG)
-            {
-                int vr = read_regs->op[i].id;
-
-                // make sure vr is in a phys reg
-                int pr = ensure(phys_reg_map, num_physical_registers, vr, insn, local_allocator_insn, offset_arr, last_processed_insn);
-                replace_register(vr, pr, insn); // change register id
-
-                // if dist(vr) == INFINITY:            // if no future use
-                //         name[pr] = INVALID              // then free pr
-                // Using max virtual regs for infinity
-                if (dist(vr, insn) == MAX_VIRTUAL_REGS)
-                {
-                    phys_reg_map[pr] = -1;
-                }
-            }
+            max_pr = i;
+            max_pr_cost = current_cost;
+            max_pr_dist = current_dist;
         }
-        ILOCInsn_free(read_regs);
-
-        Operand write_reg = ILOCInsn_get_write_register(insn);
-        if (write_reg.type == VIRTUAL_REG)
+        if (!read_later)
         {
-            int vr = write_reg.id;
-
-            // TODO: pr = allocate(vr)                   // make sure phys reg is available
-            int pr = allocate(phys_reg_map, num_physical_registers, vr, insn, local_allocator_insn, offset_arr, last_processed_insn);
-            replace_register(vr, pr, insn); // change register id and type
+            free_victim_pr = i;
         }
+    }
+    // the first use of a callee-saved register costs a save and a restore
+    // in the function, which is only worth avoiding if a value can be
+    // evicted for free
+    if (free_pr != -1)
+    {
+        if (free_victim_pr == -1)
+        {
+            phys_reg_map[free_pr] = vr;
+            state->clean[free_pr] = false;
+            state->saved[free_pr] = true;
+            return free_pr;
+        }
+        max_pr = free_victim_pr;
+        max_pr_dist = ref_distance(state, phys_reg_map[max_pr], state->held_next[max_pr]);
+    }
+    if (max_pr == -1)
+    {
+        fprintf(stderr, "Error: not enough physical registers for the operands of an instruction\n");
+        exit(1);
+    }
+    if (max_pr_dist != NO_NEXT_USE)
+    {
+        spill(state, max_pr); // dead values are dropped (their slot may be shared)
+    }
+    phys_reg_map[max_pr] = vr;
+    state->clean[max_pr] = false;
+    return max_pr;
+}
 
-        // spill any live registers before procedure calls
-        if (insn->form == CALL)
+/**
+ * @brief Make sure a virtual register that is about to be read is in a physical register
+ *
+ * @param state Allocator state
+ * @param vr Virtual register to be read
+ * @param read_regs Read registers of the current instruction (not spilled)
+ * @returns Physical register id
+ */
+int ensure(RegAllocState *state, int vr, ILOCInsn *read_regs)
+{
+    for (int i = 0; i < state->num_physical_registers; i++)
+    {
+        if (state->phys_reg_map[i] == vr)
+        {
+            if (state->stale[i])
+            {
+                insert_restore(state, vr, i);
+                state->stale[i] = false;
+            }
+            return i;
+        }
+    }
+    int pr = allocate(state, vr, read_regs);
+    insert_restore(state, vr, pr);
+    return pr;
+}
+
+/**
+ * @brief Store registers holding values that are live out of the block to their home slots
+ *
+ * Pinned values that are live out must be in their registers again, so any
+ * that were clobbered by a call are restored instead.
+ */
+void store_live_out(RegAllocState *state)
+{
+    for (int i = 0; i < state->num_physical_registers; i++)
+    {
+        int vr = state->phys_reg_map[i];
+        if (state->stale[i] && BitSet_contains(state->block->live_out, vr))
+        {
+            insert_restore(state, vr, i);
+            state->stale[i] = false;
+        }
+        if (vr != -1 && !state->reserved[i] && state->remat[vr] == NULL && !state->clean[i] &&
+            BitSet_contains(state->block->live_out, vr))
+        {
+            insert_spill(state, i, vr);
+        }
+    }
+}
+
+/**
+ * @brief Test whether any instruction in a block reads or writes a virtual register
+ */
+bool block_uses_register(BasicBlock *block, int vr)
+{
+    FOR_EACH(ILOCInsn *, insn, block->insns)
+    {
+        if (has_register_operand(vr, insn))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Find the largest number of registers that the values of a block need
+ * at once
+ *
+ * A value needs a register from its first reference in the block to its last
+ * read in the block (values that are only live through the block, or not read
+ * again, stay in their slots for free).
+ *
+ * @param block Block to check
+ * @param num_vregs Number of virtual registers in the function
+ * @param pinned Dedicated register of each virtual register (these are not
+ * counted), or @c NULL to count every value
+ * @param also_pinned Virtual register that is not counted either (or -1)
+ */
+int block_pressure(BasicBlock *block, int num_vregs, int *pinned, int also_pinned)
+{
+    int n = block->insns->size;
+    ILOCInsn *insns[n + 1];
+    int first_refs[n + 1][3]; // values first referenced by each instruction
+    BitSet *seen = BitSet_new(num_vregs);
+    BitSet *read_later = BitSet_new(num_vregs);
+    int i = 0;
+    FOR_EACH(ILOCInsn *, insn, block->insns)
+    {
+        insns[i] = insn;
+        for (int r = 0; r < 3; r++)
+        {
+            first_refs[i][r] = -1;
+            int vr = insn->op[r].id;
+            if (insn->op[r].type == VIRTUAL_REG && vr != also_pinned &&
+                (pinned == NULL || pinned[vr] == -1) && !BitSet_contains(seen, vr))
+            {
+                BitSet_add(seen, vr);
+                first_refs[i][r] = vr;
+            }
+        }
+        i++;
+    }
+
+    // walk backwards from the end of the block, counting the values that have
+    // been referenced already and are read later
+    int count = 0;
+    int max_count = 0;
+    for (i = n - 1; i >= 0; i--)
+    {
+        Operand write_reg = ILOCInsn_get_write_register(insns[i]);
+        if (write_reg.type == VIRTUAL_REG && BitSet_contains(seen, write_reg.id))
+        {
+            if (BitSet_contains(read_later, write_reg.id))
+            {
+                BitSet_remove(read_later, write_reg.id);
+                count--;
+            }
+            else
+            {
+                max_count = (count + 1 > max_count ? count + 1 : max_count);
+            }
+        }
+        ILOCInsn *read_regs = ILOCInsn_get_read_registers(insns[i]);
+        for (int r = 0; r < 3; r++)
+        {
+            int vr = read_regs->op[r].id;
+            if (read_regs->op[r].type == VIRTUAL_REG && BitSet_contains(seen, vr) &&
+                !BitSet_contains(read_later, vr))
+            {
+                BitSet_add(read_later, vr);
+                count++;
+            }
+        }
+        ILOCInsn_free(read_regs);
+        max_count = (count > max_count ? count : max_count);
+        for (int r = 0; r < 3; r++)
+        {
+            int vr = first_refs[i][r];
+            if (vr != -1)
+            {
+                BitSet_remove(seen, vr);
+                if (BitSet_contains(read_later, vr))
+                {
+                    BitSet_remove(read_later, vr);
+                    count--;
+                }
+            }
+        }
+    }
+    BitSet_free(seen);
+    BitSet_free(read_later);
+    return max_count;
+}
+
+/**
+ * @brief Value that may be kept in a dedicated register (see @ref pin_loop_values)
+ */
+typedef struct PinCandidate
+{
+    long score;     /**< @brief Spill code removed by pinning the value */
+    int vr;         /**< @brief Virtual register */
+} PinCandidate;
+
+/**
+ * @brief Order pin candidates by decreasing score, then by value (for @c qsort)
+ */
+int compare_pin_candidates(const void *a, const void *b)
+{
+    const PinCandidate *x = (const PinCandidate *)a;
+    const PinCandidate *y = (const PinCandidate *)b;
+    if (x->score != y->score)
+    {
+        return (x->score < y->score) - (x->score > y->score);
+    }
+    return (x->vr > y->vr) - (x->vr < y->vr);
+}
+
+/**
+ * @brief Choose values that are live across loop blocks to keep in dedicated registers
+ *
+ * Candidates are values that would otherwise pass through their home slot at
+ * the boundaries of blocks inside loops: invariants (reloaded at their first
+ * use in every block) and loop-carried values such as induction variables
+ * (also written back at the end of every block that writes them). They are
+ * ranked by the spill code that pinning removes, weighted by the estimated
+ * frequency of each block (see @ref BasicBlock_frequency), so that spill code
+ * stays out of loops and out of inner loops in particular.
+ *
+ * Values that are never live in the same block can share a register. A value
+ * is only pinned if every block where it is live keeps enough registers for
+ * the values that are not pinned (see @ref block_pressure), so a value that
+ * is live through a block with high register pressure is left unpinned
+ * (@ref split_live_ranges gives such values a separate name inside loops,
+ * which may be pinned on its own).
+ */
+void pin_loop_values(RegAllocState *state, CFG *cfg)
+{
+    int num_vregs = cfg->num_vregs;
+    int num_usable = 0;
+    for (int pr = 0; pr < state->num_physical_registers; pr++)
+    {
+        num_usable += (is_usable(state, pr) ? 1 : 0);
+    }
+    if (num_usable < 2 || num_vregs == 0)
+    {
+        return;
+    }
+
+    // costs match allocate(): a reload is a load (or a recomputation, which is
+    // cheaper), and a write-back is one more store
+    long *score = (long *)calloc(num_vregs, sizeof(long));
+    int *reloaded_in = (int *)malloc(num_vregs * sizeof(int));
+    int *written_in = (int *)malloc(num_vregs * sizeof(int));
+    CHECK_MALLOC_PTR(score);
+    CHECK_MALLOC_PTR(reloaded_in);
+    CHECK_MALLOC_PTR(written_in);
+    for (int vr = 0; vr < num_vregs; vr++)
+    {
+        reloaded_in[vr] = written_in[vr] = -1;
+    }
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        BasicBlock *block = cfg->blocks[b];
+        if (block->loop_depth == 0)
+        {
+            continue;
+        }
+        long frequency = BasicBlock_frequency(block);
+        FOR_EACH(ILOCInsn *, insn, block->insns)
+        {
+            ILOCInsn *read_regs = ILOCInsn_get_read_registers(insn);
+            for (int i = 0; i < 3; i++)
+            {
+                int vr = read_regs->op[i].id;
+                if (read_regs->op[i].type == VIRTUAL_REG && reloaded_in[vr] != b &&
+                    written_in[vr] != b && BitSet_contains(block->live_in, vr))
+                {
+                    score[vr] += frequency * (state->remat[vr] != NULL ? 1 : 2);
+                    reloaded_in[vr] = b;
+                }
+            }
+            ILOCInsn_free(read_regs);
+            Operand write_reg = ILOCInsn_get_write_register(insn);
+            if (write_reg.type == VIRTUAL_REG)
+            {
+                written_in[write_reg.id] = b;
+            }
+        }
+        for (int w = 0; w < block->live_out->num_words; w++)
+        {
+            for (uint64_t bits = block->live_out->words[w]; bits != 0; bits &= bits - 1)
+            {
+                int vr = w * 64 + __builtin_ctzll(bits);
+                if (written_in[vr] == b && state->remat[vr] == NULL)
+                {
+                    score[vr] += frequency;
+                }
+            }
+        }
+    }
+
+    // rank the candidates, and find the blocks where each one is live or
+    // referenced (once, rather than for every candidate and block)
+    int num_candidates = 0;
+    int *candidate_of = (int *)malloc(num_vregs * sizeof(int));
+    CHECK_MALLOC_PTR(candidate_of);
+    for (int vr = 0; vr < num_vregs; vr++)
+    {
+        candidate_of[vr] = (score[vr] > 0 ? num_candidates++ : -1);
+    }
+    PinCandidate *candidates = (PinCandidate *)malloc((num_candidates + 1) * sizeof(PinCandidate));
+    BitSet **spans = (BitSet **)malloc((num_candidates + 1) * sizeof(BitSet *));
+    CHECK_MALLOC_PTR(candidates);
+    CHECK_MALLOC_PTR(spans);
+    for (int vr = 0; vr < num_vregs; vr++)
+    {
+        if (candidate_of[vr] != -1)
         {
-            if (last_processed_insn != NULL)
+            candidates[candidate_of[vr]] = (PinCandidate){.score = score[vr], .vr = vr};
+            spans[candidate_of[vr]] = BitSet_new(cfg->num_blocks);
+        }
+    }
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        BasicBlock *block = cfg->blocks[b];
+        BitSet *sets[] = {block->live_in, block->live_out};
+        for (int s = 0; s < 2; s++)
+        {
+            for (int w = 0; w < sets[s]->num_words; w++)
+            {
+                for (uint64_t bits = sets[s]->words[w]; bits != 0; bits &= bits - 1)
+                {
+                    int c = candidate_of[w * 64 + __builtin_ctzll(bits)];
+                    if (c != -1)
+                    {
+                        BitSet_add(spans[c], b);
+                    }
+                }
+            }
+        }
+        FOR_EACH(ILOCInsn *, insn, block->insns)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                if (insn->op[i].type == VIRTUAL_REG && candidate_of[insn->op[i].id] != -1)
+                {
+                    BitSet_add(spans[candidate_of[insn->op[i].id]], b);
+                }
+            }
+        }
+    }
+    qsort(candidates, num_candidates, sizeof(PinCandidate), compare_pin_candidates);
+
+    // pressure of the values that are not pinned yet, in every block; only
+    // the blocks of a newly pinned value change
+    int *need = (int *)malloc((cfg->num_blocks + 1) * sizeof(int));
+    CHECK_MALLOC_PTR(need);
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        need[b] = block_pressure(cfg->blocks[b], num_vregs, state->pinned, -1);
+    }
+
+    // highest scores are pinned first, to the best-ranked register that no
+    // other pinned value holds in any block where this one is live (reusing
+    // registers that are already pinned on a tie)
+    BitSet *occupied[MAX_PHYSICAL_REGS] = {NULL};
+    int *num_pinned_in = (int *)calloc(cfg->num_blocks + 1, sizeof(int));
+    CHECK_MALLOC_PTR(num_pinned_in);
+    for (int c = 0; c < num_candidates; c++)
+    {
+        int best = candidates[c].vr;
+        BitSet *blocks = spans[candidate_of[best]];
+        bool fits = true;
+        for (int b = 0; b < cfg->num_blocks && fits; b++)
+        {
+            if (!BitSet_contains(blocks, b))
+            {
+                continue;
+            }
+            // not counting the candidate lowers the pressure by at most one,
+            // so only a block that is exactly full needs another look
+            int spare = num_usable - num_pinned_in[b] - need[b];
+            if (spare == 0)
+            {
+                spare = num_usable - num_pinned_in[b] - 1 -
+                        block_pressure(cfg->blocks[b], num_vregs, state->pinned, best);
+            }
+            else
+            {
+                spare--;
+            }
+            fits = spare >= 0;
+        }
+        int pr = -1;
+        for (int i = state->num_physical_registers - 1; i >= 0 && fits; i--)
+        {
+            if (!is_usable(state, i) || (occupied[i] != NULL && BitSet_intersects(occupied[i], blocks)))
+            {
+                continue;
+            }
+            if (pr == -1 || register_rank(state, best, i) < register_rank(state, best, pr) ||
+                (register_rank(state, best, i) == register_rank(state, best, pr) &&
+                 occupied[i] != NULL && occupied[pr] == NULL))
+            {
+                pr = i;
+            }
+        }
+        if (pr == -1)
+        {
+            continue;
+        }
+        if (occupied[pr] == NULL)
+        {
+            occupied[pr] = BitSet_new(cfg->num_blocks);
+        }
+        BitSet_union(occupied[pr], blocks);
+        state->saved[pr] = true;
+        state->pinned[best] = pr;
+        for (int b = 0; b < cfg->num_blocks; b++)
+        {
+            if (BitSet_contains(blocks, b))
+            {
+                num_pinned_in[b]++;
+                need[b] = block_pressure(cfg->blocks[b], num_vregs, state->pinned, -1);
+            }
+        }
+    }
+    free(num_pinned_in);
+    free(need);
+    for (int c = 0; c < num_candidates; c++)
+    {
+        BitSet_free(spans[c]);
+    }
+    free(spans);
+    free(candidates);
+    free(candidate_of);
+    for (int i = 0; i < MAX_PHYSICAL_REGS; i++)
+    {
+        if (occupied[i] != NULL)
+        {
+            BitSet_free(occupied[i]);
+        }
+    }
+
+    free(score);
+    free(reloaded_in);
+    free(written_in);
+}
+
+/**
+ * @brief Put a pinned value in its register for the current block (if it is pinned)
+ */
+void reserve_pinned(RegAllocState *state, int vr)
+{
+    int pr = state->pinned[vr];
+    if (pr != -1 && !state->reserved[pr])
+    {
+        state->phys_reg_map[pr] = vr;
+        state->reserved[pr] = true;
+        state->held_next[pr] = first_ref_in_block(state, vr);
+    }
+}
+
+/**
+ * @brief Put the pinned members of a set in their registers for the current block
+ */
+void reserve_pinned_in_set(RegAllocState *state, BitSet *set)
+{
+    for (int w = 0; w < set->num_words; w++)
+    {
+        for (uint64_t bits = set->words[w]; bits != 0; bits &= bits - 1)
+        {
+            reserve_pinned(state, w * 64 + __builtin_ctzll(bits));
+        }
+    }
+}
+
+/**
+ * @brief Allocate registers for a single basic block
+ */
+void allocate_block(RegAllocState *state, BasicBlock *block)
+{
+    state->block = block;
+    for (int i = 0; i < state->num_physical_registers; i++)
+    {
+        state->phys_reg_map[i] = -1;
+        state->reserved[i] = false;
+        state->clean[i] = false;
+        state->stale[i] = false;
+    }
+
+    // pinned values stay in their registers wherever they are live
+    find_block_refs(state, block);
+    reserve_pinned_in_set(state, block->live_in);
+    reserve_pinned_in_set(state, block->live_out);
+    FOR_EACH(ILOCInsn *, insn, block->insns)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            if (insn->op[i].type == VIRTUAL_REG)
+            {
+                reserve_pinned(state, insn->op[i].id);
+            }
+        }
+    }
+
+    ILOCInsn *prev_insn = NULL;
+    ILOCInsn *insn = block->insns->head;
+    state->position = 0;
+    while (insn != NULL)
+    {
+        state->cursor = prev_insn;
+        state->position++;
+
+        // (replacing a read register also replaces the same virtual register
+        // as the destination, so find the destination first)
+        Operand write_reg = ILOCInsn_get_write_register(insn);
+
+        // make sure every read vr is in a phys reg
+        ILOCInsn *read_regs = ILOCInsn_get_read_registers(insn);
+        for (int i = 0; i < 3; i++)
+        {
+            if (read_regs->op[i].type == VIRTUAL_REG)
+            {
+                int vr = read_regs->op[i].id;
+                int pr = ensure(state, vr, read_regs);
+                replace_register(vr, pr, insn); // change register id
+                hold_operand(state, pr, i);
+            }
+        }
+
+        // then free the ones with no future use
+        for (int i = 0; i < 3; i++)
+        {
+            int vr = read_regs->op[i].id;
+            if (read_regs->op[i].type == VIRTUAL_REG && operand_distance(state, vr, i) == NO_NEXT_USE)
+            {
+                for (int pr = 0; pr < state->num_physical_registers; pr++)
+                {
+                    if (state->phys_reg_map[pr] == vr && !state->reserved[pr])
+                    {
+                        state->phys_reg_map[pr] = -1;
+                    }
+                }
+            }
+        }
+        ILOCInsn_free(read_regs);
+
+        if (write_reg.type == VIRTUAL_REG)
+        {
+            int vr = write_reg.id;
+            int pr = allocate(state, vr, NULL);         // make sure phys reg is available
+            replace_register(vr, pr, insn);            // change register id and type
+            hold_operand(state, pr, ILOCInsn_get_write_index(insn));
+            state->clean[pr] = false;                  // slot (if any) is out of date
+            state->stale[pr] = false;
+            if (ref_distance(state, vr, state->held_next[pr]) == NO_NEXT_USE && !state->reserved[pr])
+            {
+                state->phys_reg_map[pr] = -1;
+            }
+        }
+
+        // save caller-saved registers that are live after procedure calls;
+        // everything is reloaded lazily, and pinned values that are dead
+        // after the call are not saved at all
+        if (insn->form == CALL && prev_insn != NULL)
+        {
+            for (int i = 0; i < state->num_physical_registers; i++)
             {
-                for (int i = 0; i < num_physical_registers; i++)
+                int vr = state->phys_reg_map[i];
+                if (vr == -1 || is_callee_saved(state, i))
+                {
+                    continue;
+                }
+                bool live_after = ref_distance(state, vr, state->held_next[i]) != NO_NEXT_USE;
+                if (state->reserved[i])
                 {
-                    if (phys_reg_map[i] != -1)
+                    if (live_after && !state->stale[i] && state->remat[vr] == NULL && !state->clean[i])
                     {
-                        spill(i, last_processed_insn, local_allocator_insn, offset_arr, phys_reg_map);
+                        insert_spill(state, i, vr);
                     }
+                    state->stale[i] = true;
+                }
+                else
+                {
+                    if (live_after)
+                    {
+                        spill(state, i);
+                    }
+                    state->phys_reg_map[i] = -1;
                 }
             }
         }
 
-        last_processed_insn = insn;
+        // write back values that are live into other blocks
+        if (insn->next == NULL)
+        {
+            if (BasicBlock_terminator(block) != insn)
+            {
+                state->cursor = insn;
+            }
+            store_live_out(state);
+            break;
+        }
+
+        prev_insn = insn;
+        insn = insn->next;
+    }
+}
+
+/**
+ * @brief Find the values that can be recomputed instead of spilled
+ *
+ * These are virtual registers with exactly one definition in the function,
+ * which is either a constant load (@c loadI) or a BP-relative address
+ * (@c addI BP). Their value is the same wherever they are live.
+ */
+void find_rematerializable(RegAllocState *state, CFG *cfg)
+{
+    int *num_defs = (int *)calloc(cfg->num_vregs + 1, sizeof(int));
+    CHECK_MALLOC_PTR(num_defs);
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        FOR_EACH(ILOCInsn *, insn, cfg->blocks[b]->insns)
+        {
+            Operand write_reg = ILOCInsn_get_write_register(insn);
+            if (write_reg.type != VIRTUAL_REG)
+            {
+                continue;
+            }
+            num_defs[write_reg.id]++;
+            if (insn->form == LOAD_I || (insn->form == ADD_I && insn->op[0].type == BASE_REG))
+            {
+                state->remat[write_reg.id] = insn;
+            }
+        }
+    }
+    for (int vr = 0; vr < cfg->num_vregs; vr++)
+    {
+        if (num_defs[vr] != 1)
+        {
+            state->remat[vr] = NULL;
+        }
+    }
+    free(num_defs);
+}
+
+/**
+ * @brief Count the loops that an edge leaves
+ */
+int loops_exited(CFG *cfg, BasicBlock *from, BasicBlock *to)
+{
+    int count = 0;
+    FOR_EACH(Loop *, loop, cfg->loops)
+    {
+        if (BitSet_contains(loop->blocks, from->id) && !BitSet_contains(loop->blocks, to->id))
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Find the distance from the end of every block to the next use of
+ * every value along the control flow
+ *
+ * The distance at the end of a block is the minimum over its successors, and
+ * every loop that an edge leaves adds @ref LOOP_EXIT_DISTANCE. Within a block,
+ * the distance is the position of the first read, or the length of the block
+ * plus the distance at its end if the value is neither read nor written there.
+ * Back edges make these equations cyclic, so they are solved by iterating
+ * until nothing changes (distances only ever decrease).
+ *
+ * Only values that are live at a block boundary have a next use there, so
+ * distances are stored for the members of each block's live-in and live-out
+ * sets rather than for every virtual register. Free the result with
+ * @ref free_next_uses.
+ */
+void find_next_uses(RegAllocState *state, CFG *cfg)
+{
+    int num_blocks = cfg->num_blocks;
+
+    // distance from the start of each block to the first read of each live-in
+    // value (or -1 if the value passes through)
+    DistanceMap *local = (DistanceMap *)calloc(num_blocks + 1, sizeof(DistanceMap));
+    int *seen = (int *)malloc((state->num_vregs + 1) * sizeof(int));
+    state->next_use_out = (DistanceMap *)calloc(num_blocks + 1, sizeof(DistanceMap));
+    CHECK_MALLOC_PTR(local);
+    CHECK_MALLOC_PTR(seen);
+    CHECK_MALLOC_PTR(state->next_use_out);
+    for (int vr = 0; vr < state->num_vregs; vr++)
+    {
+        seen[vr] = -1;
+    }
+    for (int b = 0; b < num_blocks; b++)
+    {
+        BasicBlock *block = cfg->blocks[b];
+        local[b] = DistanceMap_from_set(block->live_in, -1);
+        state->next_use_out[b] = DistanceMap_from_set(block->live_out, NO_NEXT_USE);
+        int position = 0;
+        FOR_EACH(ILOCInsn *, insn, block->insns)
+        {
+            position++;
+            ILOCInsn *read_regs = ILOCInsn_get_read_registers(insn);
+            for (int i = 0; i < 3; i++)
+            {
+                int vr = read_regs->op[i].id;
+                if (read_regs->op[i].type == VIRTUAL_REG && seen[vr] != b)
+                {
+                    seen[vr] = b;
+                    int index = DistanceMap_find(&local[b], vr);
+                    if (index != -1)
+                    {
+                        local[b].distances[index] = position;
+                    }
+                }
+            }
+            ILOCInsn_free(read_regs);
+            Operand write_reg = ILOCInsn_get_write_register(insn);
+            if (write_reg.type == VIRTUAL_REG)
+            {
+                seen[write_reg.id] = b;
+            }
+        }
+    }
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int b = num_blocks - 1; b >= 0; b--)
+        {
+            BasicBlock *block = cfg->blocks[b];
+            DistanceMap *out = &state->next_use_out[b];
+            for (int s = 0; s < block->num_succ; s++)
+            {
+                BasicBlock *succ = block->succ[s];
+                int exit_distance = loops_exited(cfg, block, succ) * LOOP_EXIT_DISTANCE;
+                DistanceMap *succ_local = &local[succ->id];
+                DistanceMap *succ_out = &state->next_use_out[succ->id];
+                int succ_length = succ->insns->size;
+                for (int e = 0; e < out->size; e++)
+                {
+                    int in = DistanceMap_get(succ_local, out->vregs[e], NO_NEXT_USE);
+                    if (in == -1)
+                    {
+                        in = add_distance(succ_length, DistanceMap_get(succ_out, out->vregs[e], NO_NEXT_USE));
+                    }
+                    int distance = add_distance(exit_distance, in);
+                    if (distance < out->distances[e])
+                    {
+                        out->distances[e] = distance;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+    for (int b = 0; b < num_blocks; b++)
+    {
+        DistanceMap_free(&local[b]);
+    }
+    free(local);
+    free(seen);
+}
+
+/**
+ * @brief Deallocate the distances found by @ref find_next_uses
+ */
+void free_next_uses(RegAllocState *state, CFG *cfg)
+{
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        DistanceMap_free(&state->next_use_out[b]);
+    }
+    free(state->next_use_out);
+}
+
+/**
+ * @brief Find the values that are live across a procedure call inside a loop
+ */
+void find_loop_call_crossing(RegAllocState *state, CFG *cfg)
+{
+    BitSet *live = BitSet_new(cfg->num_vregs);
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        BasicBlock *block = cfg->blocks[b];
+        if (block->loop_depth == 0)
+        {
+            continue;
+        }
+        int n = block->insns->size;
+        ILOCInsn *insns[n + 1];
+        int i = 0;
+        FOR_EACH(ILOCInsn *, insn, block->insns)
+        {
+            insns[i++] = insn;
+        }
+
+        // walk backwards from the end of the block
+        BitSet_copy(live, block->live_out);
+        for (i = n - 1; i >= 0; i--)
+        {
+            if (insns[i]->form == CALL)
+            {
+                for (int vr = 0; vr < cfg->num_vregs; vr++)
+                {
+                    state->crosses_loop_call[vr] |= BitSet_contains(live, vr);
+                }
+            }
+            Operand write_reg = ILOCInsn_get_write_register(insns[i]);
+            if (write_reg.type == VIRTUAL_REG)
+            {
+                BitSet_remove(live, write_reg.id);
+            }
+            ILOCInsn *read_regs = ILOCInsn_get_read_registers(insns[i]);
+            for (int r = 0; r < 3; r++)
+            {
+                if (read_regs->op[r].type == VIRTUAL_REG)
+                {
+                    BitSet_add(live, read_regs->op[r].id);
+                }
+            }
+            ILOCInsn_free(read_regs);
+        }
+    }
+    BitSet_free(live);
+}
+
+/**
+ * @brief Find the start of the standard epilogue ("i2i BP => SP", "pop BP")
+ * of a return instruction
+ *
+ * @param block Block that contains the return instruction
+ * @param ret Return instruction
+ * @param prev Destination for the instruction before the epilogue (@c NULL if
+ * the epilogue starts the block)
+ * @returns True if the return has a standard epilogue
+ */
+bool find_epilogue(BasicBlock *block, ILOCInsn *ret, ILOCInsn **prev)
+{
+    ILOCInsn *window[3] = {NULL, NULL, NULL}; // the three instructions before "ret"
+    FOR_EACH(ILOCInsn *, insn, block->insns)
+    {
+        if (insn == ret)
+        {
+            break;
+        }
+        window[0] = window[1];
+        window[1] = window[2];
+        window[2] = insn;
+    }
+    ILOCInsn *restore_sp = window[1];
+    ILOCInsn *pop_bp = window[2];
+    if (restore_sp == NULL || restore_sp->form != I2I || restore_sp->op[0].type != BASE_REG ||
+        restore_sp->op[1].type != STACK_REG || pop_bp->form != POP || pop_bp->op[0].type != BASE_REG)
+    {
+        return false;
+    }
+    *prev = window[0];
+    return true;
+}
+
+/**
+ * @brief Test whether callee-saved registers can be saved in a function
+ *
+ * This requires a standard prologue (with a local allocator to make room for
+ * the saved values) and a standard epilogue before every return.
+ */
+bool can_save_registers(RegAllocState *state, CFG *cfg)
+{
+    if (state->local_allocator == NULL)
+    {
+        return false;
+    }
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        FOR_EACH(ILOCInsn *, insn, cfg->blocks[b]->insns)
+        {
+            ILOCInsn *prev;
+            if (insn->form == RETURN && !find_epilogue(cfg->blocks[b], insn, &prev))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Save the callee-saved registers that a function writes
+ *
+ * Each one is stored to a new frame slot right after the local allocator and
+ * loaded back before every epilogue. The stores are marked with
+ * @ref CALLEE_SAVE_COMMENT so the simulator does not flag them.
+ */
+void save_callee_saved_registers(RegAllocState *state, CFG *cfg)
+{
+    if (state->is_entry)
+    {
+        return;
+    }
+    bool used[MAX_PHYSICAL_REGS] = {false};
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        FOR_EACH(ILOCInsn *, insn, cfg->blocks[b]->insns)
+        {
+            Operand write_reg = ILOCInsn_get_write_register(insn);
+            if (write_reg.type == PHYSICAL_REG && is_callee_saved(state, write_reg.id))
+            {
+                used[write_reg.id] = true;
+            }
+        }
+    }
+
+    ILOCInsn *local_allocator = state->local_allocator;
+    ILOCInsn *cursor = local_allocator;
+    for (int pr = 0; pr < state->num_physical_registers; pr++)
+    {
+        if (!used[pr])
+        {
+            continue;
+        }
+        local_allocator->op[1].imm -= WORD_SIZE;
+        int offset = local_allocator->op[1].imm;
+        ILOCInsn *save = ILOCInsn_new_3op(STORE_AI, physical_register(pr), base_register(), int_const(offset));
+        ILOCInsn_set_comment(save, CALLEE_SAVE_COMMENT);
+        BasicBlock_insert_after(cfg->blocks[0], cursor, save);
+        cursor = save;
+        if (state->stats != NULL)
+        {
+            state->stats->spill_cost += BasicBlock_frequency(cfg->blocks[0]);
+        }
+        for (int b = 0; b < cfg->num_blocks; b++)
+        {
+            FOR_EACH(ILOCInsn *, insn, cfg->blocks[b]->insns)
+            {
+                ILOCInsn *prev;
+                if (insn->form == RETURN && find_epilogue(cfg->blocks[b], insn, &prev))
+                {
+                    BasicBlock_insert_after(cfg->blocks[b], prev,
+                                            ILOCInsn_new_3op(LOAD_AI, base_register(), int_const(offset),
+                                                             physical_register(pr)));
+                    if (state->stats != NULL)
+                    {
+                        state->stats->spill_cost += BasicBlock_frequency(cfg->blocks[b]);
+                    }
+                }
+            }
+        }
+        if (state->stats != NULL)
+        {
+            state->stats->callee_saved_registers++;
+        }
+    }
+}
+
+/**
+ * @brief Test whether two loops share no blocks
+ */
+bool loops_disjoint(Loop *a, Loop *b)
+{
+    return !BitSet_intersects(a->blocks, b->blocks);
+}
+
+/**
+ * @brief Find the only block outside a loop that enters it (@c NULL if there is
+ * more than one, or if it can also go elsewhere)
+ */
+BasicBlock *find_loop_entry(Loop *loop)
+{
+    BasicBlock *entry = NULL;
+    BasicBlock *header = loop->header;
+    for (int p = 0; p < header->num_preds; p++)
+    {
+        BasicBlock *pred = header->preds[p];
+        if (!BitSet_contains(loop->blocks, pred->id))
+        {
+            if (entry != NULL)
+            {
+                return NULL;
+            }
+            entry = pred;
+        }
+    }
+    return (entry != NULL && entry->num_succ == 1 ? entry : NULL);
+}
+
+/**
+ * @brief Test whether a value can be given its own name inside a loop
+ *
+ * If the loop writes the value, the outside name must be updated on the way
+ * out, so every exit that the value is live into must be entered only from
+ * the loop (the copy back goes at its start).
+ */
+bool can_split_at_loop(CFG *cfg, Loop *loop, int vr, bool written)
+{
+    if (!written)
+    {
+        return true;
+    }
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        BasicBlock *block = cfg->blocks[b];
+        if (BitSet_contains(loop->blocks, b) || !BitSet_contains(block->live_in, vr))
+        {
+            continue;
+        }
+        int num_inside = 0;
+        for (int p = 0; p < block->num_preds; p++)
+        {
+            num_inside += (BitSet_contains(loop->blocks, block->preds[p]->id) ? 1 : 0);
+        }
+        if (num_inside > 0 && num_inside < block->num_preds)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Give a value a new name inside a loop
+ *
+ * The new name is copied from the old one at the end of the loop's entry
+ * block and, if the loop writes it, back at the start of every exit where the
+ * value is live.
+ */
+void split_at_loop(CFG *cfg, Loop *loop, BasicBlock *entry, int vr, bool written)
+{
+    Operand outside = {.type = VIRTUAL_REG, .id = vr};
+    Operand inside = virtual_register();
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        BasicBlock *block = cfg->blocks[b];
+        if (BitSet_contains(loop->blocks, b))
+        {
+            FOR_EACH(ILOCInsn *, insn, block->insns)
+            {
+                for (int i = 0; i < 3; i++)
+                {
+                    if (insn->op[i].type == VIRTUAL_REG && insn->op[i].id == vr)
+                    {
+                        insn->op[i].id = inside.id;
+                    }
+                }
+            }
+        }
+        else if (written && BitSet_contains(block->live_in, vr) &&
+                 block->num_preds > 0 && BitSet_contains(loop->blocks, block->preds[0]->id))
+        {
+            ILOCInsn *first = block->insns->head;
+            BasicBlock_insert_after(block, (first != NULL && first->form == LABEL ? first : NULL),
+                                    ILOCInsn_new_2op(I2I, inside, outside));
+        }
+    }
+    BasicBlock_insert_before_terminator(entry, ILOCInsn_new_2op(I2I, outside, inside));
+}
+
+/**
+ * @brief Split live ranges at loop boundaries
+ *
+ * A value that is live through a loop and used in it is renamed inside the
+ * loop (with copies on the way in and out), so that the loop's piece and the
+ * rest of the range can be allocated separately: the piece can stay in a
+ * register in the loop while the rest stays in memory across high-pressure
+ * code elsewhere. Only innermost loops with a single entry block are split,
+ * and only for values that are also live in another loop or in a block that
+ * needs more registers than there are; the values used most often in each
+ * loop (weighted by block frequency) are split first, up to three fewer than
+ * the number of registers (the rest of the loop needs at least three). Values
+ * that are cheaper to recompute than to copy are never split.
+ *
+ * The pieces are ordinary virtual registers, so this works with any
+ * allocator; liveness must be recomputed afterwards.
+ *
+ * @param cfg Function to modify
+ * @param num_registers Number of physical registers available
+ * @returns Number of live ranges split
+ */
+int split_live_ranges(CFG *cfg, int num_registers)
+{
+    int max_pieces = num_registers - 3;
+    if (max_pieces <= 0)
+    {
+        return 0;
+    }
+    CFG_compute_liveness(cfg);
+    CFG_compute_dominators(cfg);
+    CFG_compute_loops(cfg);
+    int num_vregs = cfg->num_vregs;
+    int num_blocks = cfg->num_blocks;
+    if (num_vregs == 0 || cfg->loops->size == 0)
+    {
+        return 0;
+    }
+
+    // values that are recomputed rather than reloaded (see find_rematerializable)
+    int *num_defs = (int *)calloc(num_vregs, sizeof(int));
+    bool *remat = (bool *)calloc(num_vregs, sizeof(bool));
+    bool *high_pressure = (bool *)calloc(num_blocks, sizeof(bool));
+    long *score = (long *)calloc(num_vregs, sizeof(long));
+    bool *written = (bool *)calloc(num_vregs, sizeof(bool));
+    CHECK_MALLOC_PTR(num_defs);
+    CHECK_MALLOC_PTR(remat);
+    CHECK_MALLOC_PTR(high_pressure);
+    CHECK_MALLOC_PTR(score);
+    CHECK_MALLOC_PTR(written);
+    for (int b = 0; b < num_blocks; b++)
+    {
+        high_pressure[b] = block_pressure(cfg->blocks[b], num_vregs, NULL, -1) > num_registers;
+        FOR_EACH(ILOCInsn *, insn, cfg->blocks[b]->insns)
+        {
+            Operand write_reg = ILOCInsn_get_write_register(insn);
+            if (write_reg.type == VIRTUAL_REG)
+            {
+                num_defs[write_reg.id]++;
+                remat[write_reg.id] = (insn->form == LOAD_I ||
+                                       (insn->form == ADD_I && insn->op[0].type == BASE_REG));
+            }
+        }
+    }
+
+    int num_split = 0;
+    FOR_EACH(Loop *, loop, cfg->loops)
+    {
+        bool innermost = true;
+        FOR_EACH(Loop *, other, cfg->loops)
+        {
+            innermost &= (other == loop || !BitSet_contains(loop->blocks, other->header->id));
+        }
+        BasicBlock *entry = find_loop_entry(loop);
+        if (!innermost || entry == NULL)
+        {
+            continue;
+        }
+
+        // score the values that are live through the loop by their uses in it
+        for (int vr = 0; vr < num_vregs; vr++)
+        {
+            score[vr] = 0;
+            written[vr] = false;
+        }
+        for (int b = 0; b < num_blocks; b++)
+        {
+            if (!BitSet_contains(loop->blocks, b))
+            {
+                continue;
+            }
+            long frequency = BasicBlock_frequency(cfg->blocks[b]);
+            FOR_EACH(ILOCInsn *, insn, cfg->blocks[b]->insns)
+            {
+                for (int i = 0; i < 3; i++)
+                {
+                    if (insn->op[i].type == VIRTUAL_REG)
+                    {
+                        score[insn->op[i].id] += frequency;
+                    }
+                }
+                Operand write_reg = ILOCInsn_get_write_register(insn);
+                if (write_reg.type == VIRTUAL_REG)
+                {
+                    written[write_reg.id] = true;
+                }
+            }
+        }
+
+        // only values that compete for registers outside the loop are split
+        for (int vr = 0; vr < num_vregs; vr++)
+        {
+            if (score[vr] == 0 || !BitSet_contains(loop->header->live_in, vr) ||
+                (num_defs[vr] == 1 && remat[vr]) || !can_split_at_loop(cfg, loop, vr, written[vr]))
+            {
+                score[vr] = 0;
+                continue;
+            }
+            bool competes = false;
+            for (int b = 0; b < num_blocks && !competes; b++)
+            {
+                BasicBlock *block = cfg->blocks[b];
+                if (BitSet_contains(loop->blocks, b) || block == entry ||
+                    !(BitSet_contains(block->live_in, vr) || BitSet_contains(block->live_out, vr)))
+                {
+                    continue;
+                }
+                competes = high_pressure[b];
+                FOR_EACH(Loop *, other, cfg->loops)
+                {
+                    competes |= (loops_disjoint(loop, other) && BitSet_contains(other->blocks, b));
+                }
+            }
+            if (!competes)
+            {
+                score[vr] = 0;
+            }
+        }
+
+        for (int n = 0; n < max_pieces; n++)
+        {
+            int best = -1;
+            for (int vr = 0; vr < num_vregs; vr++)
+            {
+                if (score[vr] > 0 && (best == -1 || score[vr] > score[best]))
+                {
+                    best = vr;
+                }
+            }
+            if (best == -1)
+            {
+                break;
+            }
+            split_at_loop(cfg, loop, entry, best, written[best]);
+            score[best] = 0;
+            num_split++;
+        }
+    }
+
+    free(num_defs);
+    free(remat);
+    free(high_pressure);
+    free(score);
+    free(written);
+    return num_split;
+}
+
+/**
+ * @brief Extend a live interval to cover a program point
+ */
+void LiveInterval_add(LiveInterval *interval, int point)
+{
+    interval->start = (point < interval->start ? point : interval->start);
+    interval->end = (point > interval->end ? point : interval->end);
+}
+
+/**
+ * @brief Extend the live intervals of the members of a set to cover a program point
+ */
+void LiveInterval_add_set(LiveInterval *intervals, BitSet *set, int point)
+{
+    for (int w = 0; w < set->num_words; w++)
+    {
+        for (uint64_t bits = set->words[w]; bits != 0; bits &= bits - 1)
+        {
+            LiveInterval_add(&intervals[w * 64 + __builtin_ctzll(bits)], point);
+        }
+    }
+}
+
+/**
+ * @brief Create an empty live interval for each of a number of values
+ */
+LiveInterval *LiveInterval_new_array(int num_values)
+{
+    LiveInterval *intervals = (LiveInterval *)malloc((num_values + 1) * sizeof(LiveInterval));
+    CHECK_MALLOC_PTR(intervals);
+    for (int v = 0; v < num_values; v++)
+    {
+        intervals[v].start = INT_MAX;
+        intervals[v].end = -1;
+    }
+    return intervals;
+}
+
+/**
+ * @brief Find the range of program points over which each virtual register is live
+ *
+ * Every block has one point for its entry and one for each instruction. A
+ * register is live at an instruction if it is written there or live right
+ * after it, so it is live from the entry of a block that it is live into,
+ * from each write, and up to the point before each read and to the last point
+ * of a block that it is live out of. A spilled value's slot is only read or
+ * written at points where the value is live, so values whose ranges do not
+ * overlap can share a slot.
+ *
+ * @returns Array of intervals indexed by virtual register
+ */
+LiveInterval *find_live_intervals(CFG *cfg)
+{
+    LiveInterval *intervals = LiveInterval_new_array(cfg->num_vregs);
+    int point = 0;
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        BasicBlock *block = cfg->blocks[b];
+        int n = block->insns->size;
+        LiveInterval_add_set(intervals, block->live_in, point);
+        LiveInterval_add_set(intervals, block->live_out, point + n);
+
+        // point + 1 + i is instruction i
+        int i = 0;
+        FOR_EACH(ILOCInsn *, insn, block->insns)
+        {
+            ILOCInsn *read_regs = ILOCInsn_get_read_registers(insn);
+            for (int r = 0; r < 3; r++)
+            {
+                if (read_regs->op[r].type == VIRTUAL_REG)
+                {
+                    LiveInterval_add(&intervals[read_regs->op[r].id], point + i);
+                }
+            }
+            ILOCInsn_free(read_regs);
+            Operand write_reg = ILOCInsn_get_write_register(insn);
+            if (write_reg.type == VIRTUAL_REG)
+            {
+                LiveInterval_add(&intervals[write_reg.id], point + i + 1);
+            }
+            i++;
+        }
+        point += n + 1;
+    }
+    return intervals;
+}
+
+/**
+ * @brief Order interval end points by position, then by value (for @c qsort)
+ */
+int compare_interval_points(const void *a, const void *b)
+{
+    const IntervalPoint *x = (const IntervalPoint *)a;
+    const IntervalPoint *y = (const IntervalPoint *)b;
+    if (x->point != y->point)
+    {
+        return (x->point > y->point) - (x->point < y->point);
+    }
+    return (x->value > y->value) - (x->value < y->value);
+}
+
+/**
+ * @brief Add a slot to the set of free slots (a binary min-heap)
+ */
+void free_slots_push(int *heap, int *size, int slot)
+{
+    int i = (*size)++;
+    while (i > 0 && heap[(i - 1) / 2] > slot)
+    {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = slot;
+}
+
+/**
+ * @brief Remove and return the lowest-numbered free slot
+ */
+int free_slots_pop(int *heap, int *size)
+{
+    int lowest = heap[0];
+    int last = heap[--(*size)];
+    int i = 0;
+    while (2 * i + 1 < *size)
+    {
+        int child = 2 * i + 1;
+        if (child + 1 < *size && heap[child + 1] < heap[child])
+        {
+            child++;
+        }
+        if (heap[child] >= last)
+        {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return lowest;
+}
+
+/**
+ * @brief Place the stack slots of a function in its frame
+ *
+ * Slots are assigned by a linear scan over the live intervals in order of
+ * their start: the slots of values whose intervals ended before the start
+ * are released first, and the value gets the lowest-numbered free slot (or a
+ * new one). Values whose slot is never accessed (e.g., pinned values in
+ * functions without calls) get none. The spill and reload instructions are
+ * then pointed at the BP-based offsets of their slots, and the local
+ * allocator instruction (of the form "add SP, -X => SP", where X is the frame
+ * size) is adjusted to make room for them.
+ *
+ * @param state Allocator state (with the spill and reload instructions)
+ * @param intervals Live interval of each slot's value
+ * @param num_values Number of values that may have a slot
+ */
+void place_stack_slots(RegAllocState *state, LiveInterval *intervals, int num_values)
+{
+    int *color = (int *)calloc(num_values + 1, sizeof(int));
+    bool *accessed = (bool *)calloc(num_values + 1, sizeof(bool));
+    CHECK_MALLOC_PTR(color);
+    CHECK_MALLOC_PTR(accessed);
+    for (int i = 0; i < state->num_slot_insns; i++)
+    {
+        ILOCInsn *insn = state->slot_insns[i];
+        accessed[insn->op[insn->form == STORE_AI ? 2 : 1].imm] = true;
+    }
+
+    // values that are never live overlap nothing, so they can all use slot 0
+    int num_colors = 0;
+    int num_sorted = 0;
+    IntervalPoint *starts = (IntervalPoint *)malloc((num_values + 1) * sizeof(IntervalPoint));
+    IntervalPoint *ends = (IntervalPoint *)malloc((num_values + 1) * sizeof(IntervalPoint));
+    int *free_slots = (int *)malloc((num_values + 1) * sizeof(int));
+    CHECK_MALLOC_PTR(starts);
+    CHECK_MALLOC_PTR(ends);
+    CHECK_MALLOC_PTR(free_slots);
+    for (int vr = 0; vr < num_values; vr++)
+    {
+        if (accessed[vr] && intervals[vr].start <= intervals[vr].end)
+        {
+            starts[num_sorted] = (IntervalPoint){.point = intervals[vr].start, .value = vr};
+            ends[num_sorted] = (IntervalPoint){.point = intervals[vr].end, .value = vr};
+            num_sorted++;
+        }
+        else if (accessed[vr])
+        {
+            num_colors = 1;
+        }
+    }
+    qsort(starts, num_sorted, sizeof(IntervalPoint), compare_interval_points);
+    qsort(ends, num_sorted, sizeof(IntervalPoint), compare_interval_points);
+
+    // an interval that ends before another starts has already been colored
+    int num_free = 0;
+    for (int c = 0; c < num_colors; c++)
+    {
+        free_slots_push(free_slots, &num_free, c);
+    }
+    int expired = 0;
+    for (int i = 0; i < num_sorted; i++)
+    {
+        while (ends[expired].point < starts[i].point)
+        {
+            free_slots_push(free_slots, &num_free, color[ends[expired].value]);
+            expired++;
+        }
+        color[starts[i].value] = (num_free > 0 ? free_slots_pop(free_slots, &num_free) : num_colors++);
+    }
+    free(starts);
+    free(ends);
+    free(free_slots);
+
+    if (num_colors > 0)
+    {
+        ILOCInsn *local_allocator = state->local_allocator;
+        if (local_allocator == NULL)
+        {
+            fprintf(stderr, "Error: cannot spill registers in a function without a standard prologue\n");
+            exit(1);
+        }
+        int frame_offset = local_allocator->op[1].imm;
+        for (int i = 0; i < state->num_slot_insns; i++)
+        {
+            Operand *offset = &state->slot_insns[i]->op[state->slot_insns[i]->form == STORE_AI ? 2 : 1];
+            offset->imm = frame_offset - WORD_SIZE * (color[offset->imm] + 1);
+        }
+        local_allocator->op[1].imm = frame_offset - WORD_SIZE * num_colors;
+        if (state->stats != NULL)
+        {
+            state->stats->stack_slots += num_colors;
+        }
+    }
+    free(color);
+    free(accessed);
+}
+
+/**
+ * @brief Allocate registers for a single function
+ *
+ * @param cfg Function to allocate
+ * @param convention Registers to allocate and which of them survive calls
+ * @param is_entry Is the function the program's entry point?
+ * @param pins Dedicated physical register of each virtual register (or -1),
+ * or @c NULL to choose them with @ref pin_loop_values
+ * @param stats Destination for the spill code counts (or @c NULL)
+ */
+void allocate_function(CFG *cfg, const CallingConvention *convention, bool is_entry, const int *pins,
+                       RegAllocStats *stats)
+{
+    CFG_compute_liveness(cfg);
+
+    int num_physical_registers = convention->num_registers;
+    int phys_reg_map[num_physical_registers];
+    bool reserved[num_physical_registers];
+    bool clean[num_physical_registers];
+    bool stale[num_physical_registers];
+    bool saved[num_physical_registers];
+    NextRef held_next[num_physical_registers];
+    RegAllocState state;
+    state.num_physical_registers = num_physical_registers;
+    state.convention = convention;
+    state.crosses_loop_call = (bool *)calloc(cfg->num_vregs + 1, sizeof(bool));
+    CHECK_MALLOC_PTR(state.crosses_loop_call);
+    state.num_vregs = cfg->num_vregs;
+    state.phys_reg_map = phys_reg_map;
+    state.has_slot = (bool *)calloc(cfg->num_vregs + 1, sizeof(bool));
+    CHECK_MALLOC_PTR(state.has_slot);
+    state.slot_insns = NULL;
+    state.num_slot_insns = state.slot_insns_capacity = 0;
+    state.remat = (ILOCInsn **)calloc(cfg->num_vregs + 1, sizeof(ILOCInsn *));
+    CHECK_MALLOC_PTR(state.remat);
+    state.pinned = (int *)calloc(cfg->num_vregs + 1, sizeof(int));
+    CHECK_MALLOC_PTR(state.pinned);
+    state.reserved = reserved;
+    state.saved = saved;
+    state.clean = clean;
+    state.stale = stale;
+    state.local_allocator = CFG_local_allocator(cfg);
+    state.can_save = can_save_registers(&state, cfg);
+    state.is_entry = is_entry;
+    state.stats = stats;
+    state.held_next = held_next;
+    state.next_refs = NULL;
+    state.next_refs_capacity = 0;
+    state.first_ref = (NextRef *)calloc(cfg->num_vregs + 1, sizeof(NextRef));
+    CHECK_MALLOC_PTR(state.first_ref);
+    state.ref_block = (int *)malloc((cfg->num_vregs + 1) * sizeof(int));
+    CHECK_MALLOC_PTR(state.ref_block);
+
+    // set as invalid
+    for (int i = 0; i < cfg->num_vregs; i++)
+    {
+        state.pinned[i] = -1;
+    }
+    for (int i = 0; i <= cfg->num_vregs; i++)
+    {
+        state.ref_block[i] = -1;
+    }
+    for (int i = 0; i < num_physical_registers; i++)
+    {
+        saved[i] = is_entry; // the entry point does not save anything
+    }
+
+    CFG_compute_dominators(cfg);
+    CFG_compute_loops(cfg);
+    find_rematerializable(&state, cfg);
+    find_loop_call_crossing(&state, cfg);
+    find_next_uses(&state, cfg);
+
+    // values live across block boundaries get a fixed home slot (unless they
+    // can be recomputed)
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        BitSet *live_in = cfg->blocks[b]->live_in;
+        for (int w = 0; w < live_in->num_words; w++)
+        {
+            for (uint64_t bits = live_in->words[w]; bits != 0; bits &= bits - 1)
+            {
+                int vr = w * 64 + __builtin_ctzll(bits);
+                if (state.remat[vr] == NULL)
+                {
+                    state.has_slot[vr] = true;
+                }
+            }
+        }
+    }
+
+    if (pins == NULL)
+    {
+        pin_loop_values(&state, cfg);
+    }
+    else
+    {
+        for (int vr = 0; vr < cfg->num_vregs; vr++)
+        {
+            state.pinned[vr] = pins[vr];
+            if (pins[vr] != -1)
+            {
+                saved[pins[vr]] = true;
+            }
+        }
+    }
+
+    LiveInterval *intervals = find_live_intervals(cfg);
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        allocate_block(&state, cfg->blocks[b]);
+    }
+    place_stack_slots(&state, intervals, cfg->num_vregs);
+    if (state.can_save)
+    {
+        save_callee_saved_registers(&state, cfg);
+    }
+
+    free(intervals);
+    free(state.has_slot);
+    free(state.crosses_loop_call);
+    free_next_uses(&state, cfg);
+    free(state.slot_insns);
+    free(state.next_refs);
+    free(state.first_ref);
+    free(state.ref_block);
+    free(state.pinned);
+    free(state.remat);
+}
+
+/**
+ * @brief Exhaustive search for the dedicated registers of a small function
+ * (see @ref allocate_registers_optimal)
+ */
+typedef struct PinSearch
+{
+    /**
+     * @brief Function being allocated
+     */
+    CFG *cfg;
+
+    /**
+     * @brief Registers to allocate and which of them survive calls
+     */
+    const CallingConvention *convention;
+
+    /**
+     * @brief Is the function the program's entry point?
+     */
+    bool is_entry;
+
+    /**
+     * @brief May each physical register be used in the function?
+     */
+    bool usable[MAX_PHYSICAL_REGS];
+
+    /**
+     * @brief Number of physical registers that may be used in the function
+     */
+    int num_usable;
+
+    /**
+     * @brief Values that may be pinned (those live across blocks)
+     */
+    int *candidates;
+
+    /**
+     * @brief Number of values in @ref PinSearch::candidates
+     */
+    int num_candidates;
+
+    /**
+     * @brief Blocks in which each candidate would reserve its register
+     */
+    BitSet **blocks;
+
+    /**
+     * @brief Blocks in which each physical register is reserved by the current choice
+     */
+    BitSet *occupied[MAX_PHYSICAL_REGS];
+
+    /**
+     * @brief Number of values pinned to each physical register by the current choice
+     */
+    int num_pinned_to[MAX_PHYSICAL_REGS];
+
+    /**
+     * @brief Number of registers reserved in each block by the current choice
+     */
+    int *num_pinned_in;
+
+    /**
+     * @brief Current choice: dedicated register of each virtual register (or -1)
+     */
+    int *pins;
+
+    /**
+     * @brief Best choice so far (@c NULL while the one made by @ref pin_loop_values is best)
+     */
+    int *best_pins;
+
+    /**
+     * @brief Spill cost of the best choice so far
+     */
+    long best_cost;
+
+    /**
+     * @brief Spill code counts of the best choice so far
+     */
+    RegAllocStats best_stats;
+
+} PinSearch;
+
+/**
+ * @brief Test whether every block keeps enough registers for the operands of
+ * its instructions that are not pinned
+ */
+bool pins_fit(PinSearch *search)
+{
+    CFG *cfg = search->cfg;
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        int need = 0;
+        FOR_EACH(ILOCInsn *, insn, cfg->blocks[b]->insns)
+        {
+            ILOCInsn *read_regs = ILOCInsn_get_read_registers(insn);
+            int num_reads = 0;
+            for (int i = 0; i < 3; i++)
+            {
+                int vr = read_regs->op[i].id;
+                if (read_regs->op[i].type == VIRTUAL_REG && search->pins[vr] == -1)
+                {
+                    bool repeated = false;
+                    for (int j = 0; j < i; j++)
+                    {
+                        repeated |= (read_regs->op[j].type == VIRTUAL_REG && read_regs->op[j].id == vr);
+                    }
+                    num_reads += (repeated ? 0 : 1);
+                }
+            }
+            ILOCInsn_free(read_regs);
+            Operand write_reg = ILOCInsn_get_write_register(insn);
+            int num_writes = (write_reg.type == VIRTUAL_REG && search->pins[write_reg.id] == -1 ? 1 : 0);
+            need = (num_reads > need ? num_reads : need);
+            need = (num_writes > need ? num_writes : need);
+        }
+        if (search->num_pinned_in[b] + need > search->num_usable)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Allocate a copy of the function with the given dedicated registers
+ *
+ * @param search Search state
+ * @param pins Dedicated register of each virtual register (or -1), or @c NULL
+ * to let @ref pin_loop_values choose them
+ * @param stats Destination for the spill code counts of the copy
+ */
+void try_pins(PinSearch *search, const int *pins, RegAllocStats *stats)
+{
+    InsnList *copy = InsnList_new();
+    for (int b = 0; b < search->cfg->num_blocks; b++)
+    {
+        FOR_EACH(ILOCInsn *, insn, search->cfg->blocks[b]->insns)
+        {
+            InsnList_add(copy, ILOCInsn_copy(insn));
+        }
+    }
+    CFGList *cfgs = CFGList_build(copy);
+    memset(stats, 0, sizeof(RegAllocStats));
+    allocate_function(cfgs->head, search->convention, search->is_entry, pins, stats);
+    CFGList_free(cfgs);
+    InsnList_free(copy);
+}
+
+/**
+ * @brief Try every feasible dedicated register for the remaining candidates
+ *
+ * Physical registers that no value is pinned to yet are interchangeable
+ * (unless only one of them survives calls), so only the first unused one of
+ * each kind is tried.
+ *
+ * @param search Search state
+ * @param next Index of the next candidate to decide
+ */
+void search_pins(PinSearch *search, int next)
+{
+    if (next == search->num_candidates)
+    {
+        if (!pins_fit(search))
+        {
+            return;
+        }
+        RegAllocStats stats;
+        try_pins(search, search->pins, &stats);
+        if (stats.spill_cost < search->best_cost)
+        {
+            if (search->best_pins == NULL)
+            {
+                search->best_pins = (int *)malloc((search->cfg->num_vregs + 1) * sizeof(int));
+                CHECK_MALLOC_PTR(search->best_pins);
+            }
+            memcpy(search->best_pins, search->pins, search->cfg->num_vregs * sizeof(int));
+            search->best_cost = stats.spill_cost;
+            search->best_stats = stats;
+        }
+        return;
+    }
+
+    // leave the value unpinned
+    search_pins(search, next + 1);
+
+    // every block where it would be pinned must keep a register for the rest
+    int vr = search->candidates[next];
+    BitSet *blocks = search->blocks[next];
+    for (int b = 0; b < search->cfg->num_blocks; b++)
+    {
+        if (BitSet_contains(blocks, b) && search->num_pinned_in[b] + 1 >= search->num_usable)
+        {
+            return;
+        }
+    }
+
+    bool tried_unused[2] = {false, false};
+    for (int pr = 0; pr < search->convention->num_registers; pr++)
+    {
+        if (!search->usable[pr])
+        {
+            continue;
+        }
+        if (search->num_pinned_to[pr] == 0)
+        {
+            int kind = (CallingConvention_is_callee_saved(search->convention, pr) ? 1 : 0);
+            if (tried_unused[kind])
+            {
+                continue;
+            }
+            tried_unused[kind] = true;
+        }
+        else if (BitSet_intersects(search->occupied[pr], blocks))
+        {
+            continue;
+        }
+
+        search->pins[vr] = pr;
+        search->num_pinned_to[pr]++;
+        BitSet_union(search->occupied[pr], blocks);
+        for (int b = 0; b < search->cfg->num_blocks; b++)
+        {
+            search->num_pinned_in[b] += (BitSet_contains(blocks, b) ? 1 : 0);
+        }
+        search_pins(search, next + 1);
+        for (int b = 0; b < search->cfg->num_blocks; b++)
+        {
+            if (BitSet_contains(blocks, b))
+            {
+                search->num_pinned_in[b]--;
+                BitSet_remove(search->occupied[pr], b);
+            }
+        }
+        search->num_pinned_to[pr]--;
+        search->pins[vr] = -1;
+    }
+}
+
+/**
+ * @brief Allocate registers for a single function, searching for the best
+ * dedicated registers
+ *
+ * Every value that is live across blocks may be pinned to any register that
+ * no other value holds in the blocks where it is live (as long as every block
+ * keeps enough registers for its other operands). The choice made by
+ * @ref pin_loop_values is tried first, then every other one, on copies of the
+ * function; the function itself is allocated with the cheapest.
+ *
+ * @returns False (and does nothing) if the function has more than
+ * @p max_candidates values that are live across blocks, or has no standard
+ * prologue to make room for spilled values in
+ */
+bool allocate_function_optimal(CFG *cfg, const CallingConvention *convention, bool is_entry,
+                               int max_candidates, RegAllocStats *stats)
+{
+    RegAllocState probe;
+    probe.convention = convention;
+    probe.local_allocator = CFG_local_allocator(cfg);
+    if (probe.local_allocator == NULL)
+    {
+        return false;
+    }
+    probe.can_save = can_save_registers(&probe, cfg);
+
+    CFG_compute_liveness(cfg);
+    int num_vregs = cfg->num_vregs;
+    int num_candidates = 0;
+    int *candidates = (int *)malloc((num_vregs + 1) * sizeof(int));
+    CHECK_MALLOC_PTR(candidates);
+    for (int vr = 0; vr < num_vregs; vr++)
+    {
+        bool live_across = false;
+        for (int b = 0; b < cfg->num_blocks && !live_across; b++)
+        {
+            live_across = BitSet_contains(cfg->blocks[b]->live_in, vr);
+        }
+        if (live_across)
+        {
+            candidates[num_candidates++] = vr;
+        }
+    }
+    if (num_candidates > max_candidates)
+    {
+        free(candidates);
+        return false;
+    }
+
+    PinSearch search;
+    search.cfg = cfg;
+    search.convention = convention;
+    search.is_entry = is_entry;
+    search.num_usable = 0;
+    for (int pr = 0; pr < MAX_PHYSICAL_REGS; pr++)
+    {
+        search.usable[pr] = (pr < convention->num_registers && is_usable(&probe, pr));
+        search.num_usable += (search.usable[pr] ? 1 : 0);
+        search.occupied[pr] = BitSet_new(cfg->num_blocks);
+        search.num_pinned_to[pr] = 0;
+    }
+    search.candidates = candidates;
+    search.num_candidates = num_candidates;
+    search.blocks = (BitSet **)calloc(num_candidates + 1, sizeof(BitSet *));
+    search.num_pinned_in = (int *)calloc(cfg->num_blocks + 1, sizeof(int));
+    search.pins = (int *)malloc((num_vregs + 1) * sizeof(int));
+    CHECK_MALLOC_PTR(search.blocks);
+    CHECK_MALLOC_PTR(search.num_pinned_in);
+    CHECK_MALLOC_PTR(search.pins);
+    for (int vr = 0; vr < num_vregs; vr++)
+    {
+        search.pins[vr] = -1;
+    }
+    for (int c = 0; c < num_candidates; c++)
+    {
+        search.blocks[c] = BitSet_new(cfg->num_blocks);
+        for (int b = 0; b < cfg->num_blocks; b++)
+        {
+            BasicBlock *block = cfg->blocks[b];
+            if (BitSet_contains(block->live_in, candidates[c]) ||
+                BitSet_contains(block->live_out, candidates[c]) || block_uses_register(block, candidates[c]))
+            {
+                BitSet_add(search.blocks[c], b);
+            }
+        }
+    }
+
+    search.best_pins = NULL;
+    try_pins(&search, NULL, &search.best_stats);
+    search.best_cost = search.best_stats.spill_cost;
+    search_pins(&search, 0);
+
+    // allocate the function itself with the cheapest choice
+    allocate_function(cfg, convention, is_entry, search.best_pins, stats);
+    if (stats != NULL)
+    {
+        stats->optimal_functions++;
+    }
+
+    for (int c = 0; c < num_candidates; c++)
+    {
+        BitSet_free(search.blocks[c]);
+    }
+    for (int pr = 0; pr < MAX_PHYSICAL_REGS; pr++)
+    {
+        BitSet_free(search.occupied[pr]);
+    }
+    free(search.blocks);
+    free(search.num_pinned_in);
+    free(search.pins);
+    free(search.best_pins);
+    free(candidates);
+    return true;
+}
+
+/*
+ * SSA-based allocation (see allocate_registers_ssa)
+ */
+
+/**
+ * @brief Code to insert along a control flow edge (reloads of the values
+ * that the target expects in registers, or the copies of its @c PHI
+ * instructions)
+ */
+typedef struct EdgeCode
+{
+    /**
+     * @brief Source of the edge
+     */
+    BasicBlock *pred;
+
+    /**
+     * @brief Target of the edge
+     */
+    BasicBlock *block;
+
+    /**
+     * @brief Values to reload (or @c NULL)
+     */
+    BitSet *reloads;
+
+    /**
+     * @brief Destination registers of the copies
+     */
+    int *dest;
+
+    /**
+     * @brief Source registers of the copies
+     */
+    int *src;
+
+    /**
+     * @brief Number of copies
+     */
+    int num_copies;
+
+    /**
+     * @brief Register that is free along the edge (or -1)
+     */
+    int free_register;
+
+} EdgeCode;
+
+/**
+ * @brief Move the insertion point to the start of a block (after its label)
+ */
+void move_to_block_start(RegAllocState *state, BasicBlock *block)
+{
+    state->block = block;
+    state->cursor = NULL;
+    if (block->insns->head != NULL && block->insns->head->form == LABEL)
+    {
+        state->cursor = block->insns->head;
+    }
+}
+
+/**
+ * @brief Move the insertion point to the end of a block (before its terminator)
+ */
+void move_to_block_end(RegAllocState *state, BasicBlock *block)
+{
+    ILOCInsn *terminator = BasicBlock_terminator(block);
+    state->block = block;
+    state->cursor = NULL;
+    FOR_EACH(ILOCInsn *, insn, block->insns)
+    {
+        if (insn == terminator)
+        {
+            break;
+        }
+        state->cursor = insn;
+    }
+}
+
+/**
+ * @brief Move the insertion point to a place where code only runs along a
+ * control flow edge (splitting the edge if there is no such place)
+ *
+ * @param state Allocator state
+ * @param cfg Function containing the edge
+ * @param pred Source of the edge
+ * @param block Target of the edge
+ */
+void move_to_edge(RegAllocState *state, CFG *cfg, BasicBlock *pred, BasicBlock *block)
+{
+    if (block->num_preds == 1 && block != cfg->blocks[0])
+    {
+        move_to_block_start(state, block);
+    }
+    else if (pred->num_succ == 1)
+    {
+        move_to_block_end(state, pred);
+    }
+    else
+    {
+        BasicBlock *split = CFG_insert_block(cfg, block->id);
+        Operand split_label = anonymous_label();
+        Operand block_label = {.type = JUMP_LABEL, .id = BasicBlock_label(block)};
+        InsnList_add(split->insns, ILOCInsn_new_1op(LABEL, split_label));
+        InsnList_add(split->insns, ILOCInsn_new_1op(JUMP, block_label));
+        BasicBlock_retarget(pred, block_label.id, split_label.id);
+        CFG_compute_edges(cfg);
+        split->loop_depth = (pred->loop_depth < block->loop_depth ? pred->loop_depth : block->loop_depth);
+        move_to_block_start(state, split);
+    }
+}
+
+/**
+ * @brief Insert a reload (or a copy of the definition of a rematerializable
+ * value) that redefines a virtual register at the current insertion point
+ */
+void insert_reload(RegAllocState *state, int vr)
+{
+    Operand reg = {.type = VIRTUAL_REG, .id = vr};
+    if (state->remat[vr] != NULL)
+    {
+        ILOCInsn *def = ILOCInsn_copy(state->remat[vr]);
+        def->op[ILOCInsn_get_write_index(def)] = reg;
+        insert_insn(state, def);
+        if (state->stats != NULL)
+        {
+            state->stats->rematerializations++;
+            state->stats->spill_cost += BasicBlock_frequency(state->block);
+        }
+        return;
+    }
+    state->has_slot[vr] = true;
+    insert_slot_insn(state, ILOCInsn_new_3op(LOAD_AI, base_register(), int_const(vr), reg));
+    if (state->stats != NULL)
+    {
+        state->stats->spill_loads++;
+        state->stats->spill_cost += BasicBlock_frequency(state->block);
+    }
+}
+
+/**
+ * @brief Values in registers, ordered by next use (a binary max-heap with the
+ * position of each value, so that its next use can change)
+ */
+typedef struct RegisterQueue
+{
+    int *vregs;     /**< @brief Heap of values, furthest next use first */
+    int *keys;      /**< @brief Next use of each value (see @ref next_use_key) */
+    int *index;     /**< @brief Position of each value in the heap (or -1) */
+    int size;       /**< @brief Number of values in the heap */
+} RegisterQueue;
+
+/**
+ * @brief Allocate an empty queue for the values of a function
+ */
+void RegisterQueue_init(RegisterQueue *queue, int num_vregs)
+{
+    queue->vregs = (int *)malloc((num_vregs + 1) * sizeof(int));
+    queue->keys = (int *)malloc((num_vregs + 1) * sizeof(int));
+    queue->index = (int *)malloc((num_vregs + 1) * sizeof(int));
+    CHECK_MALLOC_PTR(queue->vregs);
+    CHECK_MALLOC_PTR(queue->keys);
+    CHECK_MALLOC_PTR(queue->index);
+    for (int vr = 0; vr <= num_vregs; vr++)
+    {
+        queue->index[vr] = -1;
+    }
+    queue->size = 0;
+}
+
+/**
+ * @brief Deallocate a queue
+ */
+void RegisterQueue_free(RegisterQueue *queue)
+{
+    free(queue->vregs);
+    free(queue->keys);
+    free(queue->index);
+}
+
+/**
+ * @brief Test whether a value should be evicted before another (furthest
+ * next use first, then lowest virtual register)
+ */
+bool RegisterQueue_before(RegisterQueue *queue, int a, int b)
+{
+    return queue->keys[a] > queue->keys[b] || (queue->keys[a] == queue->keys[b] && a < b);
+}
+
+/**
+ * @brief Put a value in its place in the heap
+ */
+void RegisterQueue_sift(RegisterQueue *queue, int i)
+{
+    int vr = queue->vregs[i];
+    while (i > 0 && RegisterQueue_before(queue, vr, queue->vregs[(i - 1) / 2]))
+    {
+        queue->vregs[i] = queue->vregs[(i - 1) / 2];
+        queue->index[queue->vregs[i]] = i;
+        i = (i - 1) / 2;
+    }
+    while (2 * i + 1 < queue->size)
+    {
+        int child = 2 * i + 1;
+        if (child + 1 < queue->size && RegisterQueue_before(queue, queue->vregs[child + 1], queue->vregs[child]))
+        {
+            child++;
+        }
+        if (!RegisterQueue_before(queue, queue->vregs[child], vr))
+        {
+            break;
+        }
+        queue->vregs[i] = queue->vregs[child];
+        queue->index[queue->vregs[i]] = i;
+        i = child;
+    }
+    queue->vregs[i] = vr;
+    queue->index[vr] = i;
+}
+
+/**
+ * @brief Add a value to a queue, or change its next use if it is there already
+ */
+void RegisterQueue_update(RegisterQueue *queue, int vr, int key)
+{
+    if (queue->index[vr] == -1)
+    {
+        queue->vregs[queue->size] = vr;
+        queue->index[vr] = queue->size++;
+    }
+    queue->keys[vr] = key;
+    RegisterQueue_sift(queue, queue->index[vr]);
+}
+
+/**
+ * @brief Remove a value from a queue (if it is there)
+ */
+void RegisterQueue_remove(RegisterQueue *queue, int vr)
+{
+    int i = queue->index[vr];
+    if (i == -1)
+    {
+        return;
+    }
+    queue->index[vr] = -1;
+    queue->size--;
+    if (i < queue->size)
+    {
+        queue->vregs[i] = queue->vregs[queue->size];
+        queue->index[queue->vregs[i]] = i;
+        RegisterQueue_sift(queue, i);
+    }
+}
+
+/**
+ * @brief Remove every value from a queue
+ */
+void RegisterQueue_clear(RegisterQueue *queue)
+{
+    for (int i = 0; i < queue->size; i++)
+    {
+        queue->index[queue->vregs[i]] = -1;
+    }
+    queue->size = 0;
+}
+
+/**
+ * @brief Find the next use of a value in the current block, given its next
+ * reference, counting from the start of the block
+ *
+ * Subtracting the position of an instruction gives the distance from there
+ * (see @ref ref_distance), so these compare the same way as distances.
+ */
+int next_use_key(RegAllocState *state, int vr, NextRef ref)
+{
+    if (ref.position <= state->block_length)
+    {
+        return ref.is_read ? ref.position : NO_NEXT_USE;
+    }
+    return add_distance(state->block_length,
+                        DistanceMap_get(&state->next_use_out[state->block->id], vr, NO_NEXT_USE));
+}
+
+/**
+ * @brief Evict the values whose next use is furthest away until few enough
+ * values are in registers
+ *
+ * @param queue Values in registers, by next use (modified)
+ * @param in_regs Values in registers (modified)
+ * @param limit Maximum number of values to keep
+ * @param protected_regs Registers that must stay (or @c NULL)
+ * @param protected_vr Another virtual register that must stay (or -1)
+ */
+void limit_registers(RegisterQueue *queue, BitSet *in_regs, int limit,
+                     ILOCInsn *protected_regs, int protected_vr)
+{
+    // protected values are set aside and put back afterwards (there are at
+    // most three of them, the operands of one instruction)
+    int kept[4];
+    int kept_keys[4];
+    int num_kept = 0;
+    while (queue->size > limit)
+    {
+        if (queue->size == 0)
+        {
+            fprintf(stderr, "Error: not enough physical registers for the operands of an instruction\n");
+            exit(1);
+        }
+        int victim = queue->vregs[0];
+        kept_keys[num_kept] = queue->keys[victim];
+        RegisterQueue_remove(queue, victim);
+        if (victim == protected_vr || (protected_regs != NULL && has_register_operand(victim, protected_regs)))
+        {
+            kept[num_kept++] = victim;
+            limit--;
+            continue;
+        }
+        BitSet_remove(in_regs, victim);
+    }
+    for (int k = 0; k < num_kept; k++)
+    {
+        RegisterQueue_update(queue, kept[k], kept_keys[k]);
+    }
+}
+
+/**
+ * @brief Choose the values that are in registers at the start of a block
+ *
+ * At a loop header (a block with a predecessor that has not been visited
+ * yet), these are the live values that are used in the loop, nearest next
+ * use first. Elsewhere, values that are in registers at the end of every
+ * predecessor come first, then those that are in registers at the end of
+ * some predecessor (again nearest next use first).
+ *
+ * @param state Allocator state (the current block is the one to start)
+ * @param exit_regs Values in registers at the end of each visited block
+ * (@c NULL for the others)
+ * @param in_regs Output: values in registers at the start of the block
+ */
+void choose_entry_registers(RegAllocState *state, BitSet **exit_regs, BitSet *in_regs)
+{
+    BasicBlock *block = state->block;
+    bool is_header = false;
+    for (int p = 0; p < block->num_preds; p++)
+    {
+        is_header |= (exit_regs[block->preds[p]->id] == NULL);
+    }
+
+    // candidates are ranked by whether every predecessor has them, then by distance
+    int num_candidates = 0;
+    int candidates[state->num_vregs + 1];
+    int misses[state->num_vregs + 1];
+    int distances[state->num_vregs + 1];
+    for (int vr = 0; vr < state->num_vregs; vr++)
+    {
+        if (!BitSet_contains(block->live_in, vr))
+        {
+            continue;
+        }
+        int d = ref_distance(state, vr, first_ref_in_block(state, vr));
+        int missing = 0;
+        for (int p = 0; p < block->num_preds && !is_header; p++)
+        {
+            missing += !BitSet_contains(exit_regs[block->preds[p]->id], vr);
+        }
+        if ((is_header && d < LOOP_EXIT_DISTANCE) ||
+            (!is_header && (missing < block->num_preds || block->num_preds == 0)))
+        {
+            candidates[num_candidates] = vr;
+            misses[num_candidates] = (missing == 0 ? 0 : 1);
+            distances[num_candidates] = d;
+            num_candidates++;
+        }
+    }
+
+    BitSet_clear(in_regs);
+    for (int n = 0; n < state->num_physical_registers && n < num_candidates; n++)
+    {
+        int best = -1;
+        for (int c = 0; c < num_candidates; c++)
+        {
+            if (!BitSet_contains(in_regs, candidates[c]) &&
+                (best == -1 || misses[c] < misses[best] ||
+                 (misses[c] == misses[best] && distances[c] < distances[best])))
+            {
+                best = c;
+            }
+        }
+        BitSet_add(in_regs, candidates[best]);
+    }
+}
+
+/**
+ * @brief Spill values in a block so that no more of them are live at once
+ * than there are registers
+ *
+ * Values that are not in a register are reloaded right before they are read,
+ * and the value with the furthest next use is evicted whenever there are too
+ * many. Nothing stays in a register across a procedure call.
+ *
+ * @param state Allocator state (the current block is the one to spill, with
+ * its references found by @ref find_block_refs)
+ * @param queue Space for the values in registers, ordered by next use
+ * @param in_regs Values in registers (at the start of the block on entry and
+ * at its end on exit)
+ */
+void spill_block(RegAllocState *state, RegisterQueue *queue, BitSet *in_regs)
+{
+    int num_registers = state->num_physical_registers;
+    RegisterQueue_clear(queue);
+    for (int w = 0; w < in_regs->num_words; w++)
+    {
+        for (uint64_t bits = in_regs->words[w]; bits != 0; bits &= bits - 1)
+        {
+            int vr = w * 64 + __builtin_ctzll(bits);
+            RegisterQueue_update(queue, vr, next_use_key(state, vr, first_ref_in_block(state, vr)));
+        }
+    }
+
+    ILOCInsn *prev_insn = NULL;
+    ILOCInsn *insn = state->block->insns->head;
+    state->position = 0;
+    while (insn != NULL)
+    {
+        state->cursor = prev_insn;
+        state->position++;
+        ILOCInsn *read_regs = ILOCInsn_get_read_registers(insn);
+        for (int i = 0; i < 3; i++)
+        {
+            int vr = read_regs->op[i].id;
+            if (read_regs->op[i].type == VIRTUAL_REG && !BitSet_contains(in_regs, vr))
+            {
+                limit_registers(queue, in_regs, num_registers - 1, read_regs, -1);
+                insert_reload(state, vr);
+                BitSet_add(in_regs, vr);
+                RegisterQueue_update(queue, vr, state->position);
+            }
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            int vr = read_regs->op[i].id;
+            if (read_regs->op[i].type != VIRTUAL_REG)
+            {
+                continue;
+            }
+            NextRef next = state->next_refs[3 * (state->position - 1) + i];
+            if (ref_distance(state, vr, next) == NO_NEXT_USE)
+            {
+                BitSet_remove(in_regs, vr);
+                RegisterQueue_remove(queue, vr);
+            }
+            else
+            {
+                RegisterQueue_update(queue, vr, next_use_key(state, vr, next));
+            }
+        }
+        ILOCInsn_free(read_regs);
+
+        Operand write_reg = ILOCInsn_get_write_register(insn);
+        if (write_reg.type == VIRTUAL_REG)
+        {
+            NextRef next = state->next_refs[3 * (state->position - 1) + ILOCInsn_get_write_index(insn)];
+            BitSet_add(in_regs, write_reg.id);
+            RegisterQueue_update(queue, write_reg.id, next_use_key(state, write_reg.id, next));
+            limit_registers(queue, in_regs, num_registers, NULL, write_reg.id);
+            if (ref_distance(state, write_reg.id, next) == NO_NEXT_USE)
+            {
+                BitSet_remove(in_regs, write_reg.id);
+                RegisterQueue_remove(queue, write_reg.id);
+            }
+        }
+        if (insn->form == CALL)
+        {
+            BitSet_clear(in_regs);
+            RegisterQueue_clear(queue);
+        }
+        prev_insn = insn;
+        insn = insn->next;
+    }
+}
+
+/**
+ * @brief Spill values until no more of them are live at any point than there
+ * are registers (furthest next use first, extended to the whole CFG)
+ *
+ * Blocks are visited in reverse postorder, each starting with the values
+ * chosen by @ref choose_entry_registers. Reloads redefine the value, so a
+ * value is not live while it is only in its slot. Values that a block
+ * expects in registers but that a predecessor does not leave there are
+ * reloaded along that edge, and every value that is reloaded anywhere is
+ * stored right after each of its original definitions.
+ *
+ * @param state Allocator state (with next-use distances)
+ * @param cfg Function to spill
+ */
+void spill_to_registers(RegAllocState *state, CFG *cfg)
+{
+    int num_blocks = cfg->num_blocks;
+    BasicBlock *order[num_blocks + 1];
+    int num_ordered = 0;
+    for (int b = 0; b < num_blocks; b++)
+    {
+        if (cfg->blocks[b]->rpo < num_blocks)
+        {
+            order[cfg->blocks[b]->rpo] = cfg->blocks[b];
+            num_ordered++;
+        }
+    }
+
+    // original definitions (the stores go after them)
+    int num_defs = 0;
+    for (int b = 0; b < num_blocks; b++)
+    {
+        num_defs += cfg->blocks[b]->insns->size;
+    }
+    BasicBlock **def_blocks = (BasicBlock **)calloc(num_defs + 1, sizeof(BasicBlock *));
+    ILOCInsn **defs = (ILOCInsn **)calloc(num_defs + 1, sizeof(ILOCInsn *));
+    CHECK_MALLOC_PTR(def_blocks);
+    CHECK_MALLOC_PTR(defs);
+    num_defs = 0;
+    for (int b = 0; b < num_blocks; b++)
+    {
+        FOR_EACH(ILOCInsn *, insn, cfg->blocks[b]->insns)
+        {
+            if (ILOCInsn_get_write_register(insn).type == VIRTUAL_REG)
+            {
+                def_blocks[num_defs] = cfg->blocks[b];
+                defs[num_defs++] = insn;
+            }
+        }
+    }
+
+    BitSet **entry_regs = (BitSet **)calloc(num_blocks + 1, sizeof(BitSet *));
+    BitSet **exit_regs = (BitSet **)calloc(num_blocks + 1, sizeof(BitSet *));
+    CHECK_MALLOC_PTR(entry_regs);
+    CHECK_MALLOC_PTR(exit_regs);
+    RegisterQueue queue;
+    RegisterQueue_init(&queue, state->num_vregs);
+    for (int i = 0; i < num_ordered; i++)
+    {
+        BasicBlock *block = order[i];
+        BitSet *in_regs = BitSet_new(state->num_vregs);
+        state->block = block;
+        find_block_refs(state, block);
+        state->position = 0;
+        choose_entry_registers(state, exit_regs, in_regs);
+        entry_regs[block->id] = BitSet_new(state->num_vregs);
+        BitSet_copy(entry_regs[block->id], in_regs);
+        spill_block(state, &queue, in_regs);
+        exit_regs[block->id] = in_regs;
+    }
+    RegisterQueue_free(&queue);
+
+    // collect the reloads for each edge before splitting any (which renumbers the blocks)
+    int num_edges = 0;
+    EdgeCode *edges = (EdgeCode *)calloc(2 * num_blocks + 1, sizeof(EdgeCode));
+    CHECK_MALLOC_PTR(edges);
+    for (int i = 0; i < num_ordered; i++)
+    {
+        BasicBlock *block = order[i];
+        for (int p = 0; p < block->num_preds; p++)
+        {
+            BitSet *reloads = BitSet_new(state->num_vregs);
+            BitSet_copy(reloads, entry_regs[block->id]);
+            for (int w = 0; w < reloads->num_words; w++)
+            {
+                reloads->words[w] &= ~exit_regs[block->preds[p]->id]->words[w];
+            }
+            if (BitSet_count(reloads) == 0)
+            {
+                BitSet_free(reloads);
+                continue;
+            }
+            EdgeCode edge = {.pred = block->preds[p], .block = block, .reloads = reloads};
+            edges[num_edges++] = edge;
+        }
+    }
+    for (int b = 0; b < num_blocks; b++)
+    {
+        if (entry_regs[b] != NULL)
+        {
+            BitSet_free(entry_regs[b]);
+            BitSet_free(exit_regs[b]);
+        }
+    }
+    free(entry_regs);
+    free(exit_regs);
+
+    for (int e = 0; e < num_edges; e++)
+    {
+        move_to_edge(state, cfg, edges[e].pred, edges[e].block);
+        BitSet *reloads = edges[e].reloads;
+        for (int vr = 0; vr < state->num_vregs; vr++)
+        {
+            if (BitSet_contains(reloads, vr))
+            {
+                insert_reload(state, vr);
+            }
+        }
+        BitSet_free(reloads);
+    }
+    free(edges);
+
+    for (int d = 0; d < num_defs; d++)
+    {
+        int vr = ILOCInsn_get_write_register(defs[d]).id;
+        if (state->has_slot[vr] && state->remat[vr] == NULL)
+        {
+            state->block = def_blocks[d];
+            state->cursor = defs[d];
+            insert_slot_insn(state, ILOCInsn_new_3op(STORE_AI, ILOCInsn_get_write_register(defs[d]),
+                                                     base_register(), int_const(vr)));
+            if (state->stats != NULL)
+            {
+                state->stats->spill_stores++;
+                state->stats->spill_cost += BasicBlock_frequency(state->block);
+            }
+        }
+    }
+    free(def_blocks);
+    free(defs);
+}
+
+/**
+ * @brief Pick a free physical register, preferring a given one
+ */
+int choose_color(bool *used, int num_registers, int preferred)
+{
+    if (preferred >= 0 && !used[preferred])
+    {
+        return preferred;
+    }
+    for (int pr = 0; pr < num_registers; pr++)
+    {
+        if (!used[pr])
+        {
+            return pr;
+        }
+    }
+    fprintf(stderr, "Error: not enough physical registers for the values live at once\n");
+    exit(1);
+}
+
+/**
+ * @brief Assign physical registers to the values defined in a block and in
+ * the blocks that it dominates
+ *
+ * In an SSA program, every value is defined before the values that are live
+ * at its definition, so visiting the definitions in dominance order is a
+ * perfect elimination order of the (chordal) interference graph: giving each
+ * value a register that no live value uses never needs more registers than
+ * there are values live at once. A value prefers the register of the value
+ * it is copied from or of the @c PHI that it flows into.
+ *
+ * @param block Block to color (its live-in values are already colored)
+ * @param children Blocks immediately dominated by each block
+ * @param num_children Number of blocks immediately dominated by each block
+ * @param color Register of each virtual register (or -1; modified)
+ * @param hint Preferred register of each virtual register (or -1; modified)
+ * @param num_registers Number of physical registers
+ */
+void color_block(BasicBlock *block, BasicBlock ***children, int *num_children, int *color, int *hint,
+                 int num_registers)
+{
+    bool used[num_registers];
+    for (int pr = 0; pr < num_registers; pr++)
+    {
+        used[pr] = false;
+    }
+    for (int w = 0; w < block->live_in->num_words; w++)
+    {
+        for (uint64_t bits = block->live_in->words[w]; bits != 0; bits &= bits - 1)
+        {
+            int vr = w * 64 + __builtin_ctzll(bits);
+            if (color[vr] == -1)
+            {
+                // used before it is defined
+                color[vr] = choose_color(used, num_registers, hint[vr]);
+            }
+            used[color[vr]] = true;
+        }
+    }
+
+    // find the reads that end a value's life (backwards from the end of the block)
+    int n = block->insns->size;
+    ILOCInsn *insns[n + 1];
+    int dying[n + 1][3];
+    bool dead_def[n + 1];
+    int i = 0;
+    FOR_EACH(ILOCInsn *, insn, block->insns)
+    {
+        insns[i++] = insn;
+    }
+    BitSet *live = BitSet_new(block->live_out->size);
+    BitSet_copy(live, block->live_out);
+    for (i = n - 1; i >= 0; i--)
+    {
+        dying[i][0] = dying[i][1] = dying[i][2] = -1;
+        dead_def[i] = false;
+        if (insns[i]->form == PHI)
+        {
+            continue;
+        }
+        Operand write_reg = ILOCInsn_get_write_register(insns[i]);
+        if (write_reg.type == VIRTUAL_REG)
+        {
+            dead_def[i] = !BitSet_contains(live, write_reg.id);
+            BitSet_remove(live, write_reg.id);
+        }
+        ILOCInsn *read_regs = ILOCInsn_get_read_registers(insns[i]);
+        for (int r = 0; r < 3; r++)
+        {
+            if (read_regs->op[r].type == VIRTUAL_REG && !BitSet_contains(live, read_regs->op[r].id))
+            {
+                dying[i][r] = read_regs->op[r].id;
+                BitSet_add(live, read_regs->op[r].id);
+            }
+        }
+        ILOCInsn_free(read_regs);
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        ILOCInsn *insn = insns[i];
+        if (insn->form == PHI)
+        {
+            int result = insn->op[2].id;
+            int preferred = hint[result];
+            for (int p = 0; p < 2 && preferred == -1; p++)
+            {
+                if (insn->op[p].type == VIRTUAL_REG && color[insn->op[p].id] != -1 &&
+                    !used[color[insn->op[p].id]])
+                {
+                    preferred = color[insn->op[p].id];
+                }
+            }
+            color[result] = choose_color(used, num_registers, preferred);
+            used[color[result]] = true;
+            for (int p = 0; p < 2; p++)
+            {
+                if (insn->op[p].type == VIRTUAL_REG && hint[insn->op[p].id] == -1)
+                {
+                    hint[insn->op[p].id] = color[result];
+                }
+            }
+            continue;
+        }
+        if (i == 0 || insns[i - 1]->form == PHI)
+        {
+            // results of PHIs that are never used (live holds the values live after the PHIs)
+            for (int j = 0; j < i; j++)
+            {
+                if (insns[j]->form == PHI && !BitSet_contains(live, insns[j]->op[2].id))
+                {
+                    used[color[insns[j]->op[2].id]] = false;
+                }
+            }
+        }
+
+        for (int r = 0; r < 3; r++)
+        {
+            if (dying[i][r] != -1)
+            {
+                used[color[dying[i][r]]] = false;
+            }
+        }
+        Operand write_reg = ILOCInsn_get_write_register(insn);
+        if (write_reg.type == VIRTUAL_REG)
+        {
+            int preferred = hint[write_reg.id];
+            if (insn->form == I2I && insn->op[0].type == VIRTUAL_REG && color[insn->op[0].id] != -1)
+            {
+                preferred = color[insn->op[0].id];
+            }
+            color[write_reg.id] = choose_color(used, num_registers, preferred);
+            used[color[write_reg.id]] = !dead_def[i];
+        }
+    }
+    BitSet_free(live);
+
+    for (int c = 0; c < num_children[block->id]; c++)
+    {
+        color_block(children[block->id][c], children, num_children, color, hint, num_registers);
+    }
+}
+
+/**
+ * @brief Insert a parallel copy between physical registers at the current
+ * insertion point
+ *
+ * Copies whose destination is not needed as a source go first. A remaining
+ * cycle is broken by moving one of its registers to a free register, or to a
+ * scratch stack slot if there is none.
+ *
+ * @param state Allocator state
+ * @param dest Destination registers (modified)
+ * @param src Source registers (modified)
+ * @param n Number of copies
+ * @param free_register Register that is not live across the copy (or -1)
+ * @param scratch_slot Stack slot used to break cycles (-1 until one is needed)
+ */
+void insert_parallel_copy(RegAllocState *state, int *dest, int *src, int n, int free_register, int *scratch_slot)
+{
+    const int in_scratch_slot = -2;
+    while (n > 0)
+    {
+        int ready = -1;
+        for (int k = 0; k < n && ready < 0; k++)
+        {
+            bool needed = false;
+            for (int j = 0; j < n; j++)
+            {
+                needed |= (j != k && src[j] == dest[k]);
+            }
+            if (!needed || src[k] == dest[k])
+            {
+                ready = k;
+            }
+        }
+
+        if (ready < 0)
+        {
+            // every destination is still needed: move one of them out of the way
+            int saved = in_scratch_slot;
+            bool register_free = (free_register != -1);
+            for (int j = 0; j < n; j++)
+            {
+                register_free &= (src[j] != free_register);
+            }
+            if (register_free)
+            {
+                saved = free_register;
+                insert_insn(state, ILOCInsn_new_2op(I2I, physical_register(dest[0]), physical_register(saved)));
+            }
+            else
+            {
+                if (*scratch_slot == -1)
+                {
+                    *scratch_slot = virtual_register().id;
+                }
+                insert_slot_insn(state, ILOCInsn_new_3op(STORE_AI, physical_register(dest[0]),
+                                                         base_register(), int_const(*scratch_slot)));
+                if (state->stats != NULL)
+                {
+                    state->stats->spill_stores++;
+                    state->stats->spill_cost += BasicBlock_frequency(state->block);
+                }
+            }
+            for (int j = 0; j < n; j++)
+            {
+                if (src[j] == dest[0])
+                {
+                    src[j] = saved;
+                }
+            }
+            ready = 0;
+        }
+
+        if (src[ready] == in_scratch_slot)
+        {
+            insert_slot_insn(state, ILOCInsn_new_3op(LOAD_AI, base_register(), int_const(*scratch_slot),
+                                                     physical_register(dest[ready])));
+            if (state->stats != NULL)
+            {
+                state->stats->spill_loads++;
+                state->stats->spill_cost += BasicBlock_frequency(state->block);
+            }
+        }
+        else if (src[ready] != dest[ready])
+        {
+            insert_insn(state, ILOCInsn_new_2op(I2I, physical_register(src[ready]),
+                                                physical_register(dest[ready])));
+        }
+        dest[ready] = dest[n - 1];
+        src[ready] = src[n - 1];
+        n--;
+    }
+}
+
+/**
+ * @brief Replace the @c PHI instructions of a colored function with parallel
+ * copies along the edges into their blocks
+ *
+ * @param state Allocator state
+ * @param cfg Function (in SSA form, with liveness)
+ * @param color Physical register of each virtual register
+ */
+void remove_phis(RegAllocState *state, CFG *cfg, int *color)
+{
+    int num_registers = state->num_physical_registers;
+    int num_edges = 0;
+    EdgeCode *edges = (EdgeCode *)calloc(2 * cfg->num_blocks + 1, sizeof(EdgeCode));
+    CHECK_MALLOC_PTR(edges);
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        BasicBlock *block = cfg->blocks[b];
+        int num_phis = 0;
+        FOR_EACH(ILOCInsn *, insn, block->insns)
+        {
+            num_phis += (insn->form == PHI);
+        }
+        if (num_phis == 0)
+        {
+            continue;
+        }
+        for (int p = 0; p < block->num_preds && p < 2; p++)
+        {
+            EdgeCode edge = {.pred = block->preds[p], .block = block};
+            edge.dest = (int *)calloc(num_phis, sizeof(int));
+            edge.src = (int *)calloc(num_phis, sizeof(int));
+            CHECK_MALLOC_PTR(edge.dest);
+            CHECK_MALLOC_PTR(edge.src);
+            bool used[num_registers];
+            for (int pr = 0; pr < num_registers; pr++)
+            {
+                used[pr] = false;
+            }
+            for (int vr = 0; vr < cfg->num_vregs; vr++)
+            {
+                if (BitSet_contains(block->live_in, vr))
+                {
+                    used[color[vr]] = true;
+                }
+            }
+            FOR_EACH(ILOCInsn *, insn, block->insns)
+            {
+                if (insn->form == PHI && insn->op[p].type == VIRTUAL_REG)
+                {
+                    edge.dest[edge.num_copies] = color[insn->op[2].id];
+                    edge.src[edge.num_copies] = color[insn->op[p].id];
+                    used[color[insn->op[2].id]] = used[color[insn->op[p].id]] = true;
+                    edge.num_copies++;
+                }
+            }
+            edge.free_register = -1;
+            for (int pr = num_registers - 1; pr >= 0; pr--)
+            {
+                if (!used[pr])
+                {
+                    edge.free_register = pr;
+                }
+            }
+            edges[num_edges++] = edge;
+        }
+    }
+
+    int scratch_slot = -1;
+    for (int e = 0; e < num_edges; e++)
+    {
+        move_to_edge(state, cfg, edges[e].pred, edges[e].block);
+        insert_parallel_copy(state, edges[e].dest, edges[e].src, edges[e].num_copies,
+                             edges[e].free_register, &scratch_slot);
+        free(edges[e].dest);
+        free(edges[e].src);
+    }
+    free(edges);
+
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        BasicBlock *block = cfg->blocks[b];
+        ILOCInsn *prev = NULL;
+        ILOCInsn *insn = block->insns->head;
+        while (insn != NULL)
+        {
+            ILOCInsn *next = insn->next;
+            if (insn->form == PHI)
+            {
+                BasicBlock_remove_after(block, prev);
+            }
+            else
+            {
+                prev = insn;
+            }
+            insn = next;
+        }
+    }
+}
+
+/**
+ * @brief Find the stack slot accessed by an instruction (or -1 if it is not a
+ * spill or reload)
+ *
+ * @param sorted_slot_insns Spill and reload instructions sorted by address
+ * @param num_slot_insns Number of spill and reload instructions
+ * @param insn Instruction to look up
+ */
+int slot_accessed(ILOCInsn **sorted_slot_insns, int num_slot_insns, ILOCInsn *insn)
+{
+    int low = 0;
+    int high = num_slot_insns - 1;
+    while (low <= high)
+    {
+        int mid = (low + high) / 2;
+        if ((uintptr_t)sorted_slot_insns[mid] < (uintptr_t)insn)
+        {
+            low = mid + 1;
+        }
+        else if ((uintptr_t)sorted_slot_insns[mid] > (uintptr_t)insn)
+        {
+            high = mid - 1;
+        }
+        else
+        {
+            return (int)insn->op[insn->form == STORE_AI ? 2 : 1].imm;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Order instructions by address (for @c qsort)
+ */
+int compare_insn_addresses(const void *a, const void *b)
+{
+    uintptr_t x = (uintptr_t) * (ILOCInsn *const *)a;
+    uintptr_t y = (uintptr_t) * (ILOCInsn *const *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Find the range of program points over which each stack slot holds
+ * a value that may still be reloaded (the same points as
+ * @ref find_live_intervals, but for slots: a store writes a slot and a
+ * reload reads it)
+ *
+ * @param state Allocator state (with the spill and reload instructions)
+ * @param cfg Function
+ * @param num_values Number of slots
+ * @returns Array of intervals indexed by slot
+ */
+LiveInterval *find_slot_live_intervals(RegAllocState *state, CFG *cfg, int num_values)
+{
+    ILOCInsn **sorted = (ILOCInsn **)malloc((state->num_slot_insns + 1) * sizeof(ILOCInsn *));
+    CHECK_MALLOC_PTR(sorted);
+    memcpy(sorted, state->slot_insns, state->num_slot_insns * sizeof(ILOCInsn *));
+    qsort(sorted, state->num_slot_insns, sizeof(ILOCInsn *), compare_insn_addresses);
+
+    LiveInterval *intervals = LiveInterval_new_array(num_values);
+    BitSet **live_in = (BitSet **)calloc(cfg->num_blocks + 1, sizeof(BitSet *));
+    CHECK_MALLOC_PTR(live_in);
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        live_in[b] = BitSet_new(num_values);
+    }
+
+    // slots live into each block (sets only grow, so iterate until none does)
+    BitSet *live = BitSet_new(num_values);
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int b = cfg->num_blocks - 1; b >= 0; b--)
+        {
+            BasicBlock *block = cfg->blocks[b];
+            int n = block->insns->size;
+            ILOCInsn *insns[n + 1];
+            int i = 0;
+            FOR_EACH(ILOCInsn *, insn, block->insns)
+            {
+                insns[i++] = insn;
+            }
+            BitSet_clear(live);
+            for (int s = 0; s < block->num_succ; s++)
+            {
+                BitSet_union(live, live_in[block->succ[s]->id]);
+            }
+            for (i = n - 1; i >= 0; i--)
+            {
+                int slot = slot_accessed(sorted, state->num_slot_insns, insns[i]);
+                if (slot != -1 && insns[i]->form == STORE_AI)
+                {
+                    BitSet_remove(live, slot);
+                }
+                else if (slot != -1)
+                {
+                    BitSet_add(live, slot);
+                }
+            }
+            changed |= BitSet_union(live_in[b], live);
+        }
+    }
+
+    int point = 0;
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        BasicBlock *block = cfg->blocks[b];
+        int n = block->insns->size;
+        LiveInterval_add_set(intervals, live_in[b], point);
+        for (int s = 0; s < block->num_succ; s++)
+        {
+            LiveInterval_add_set(intervals, live_in[block->succ[s]->id], point + n);
+        }
+
+        // point + 1 + i is instruction i
+        int i = 0;
+        FOR_EACH(ILOCInsn *, insn, block->insns)
+        {
+            int slot = slot_accessed(sorted, state->num_slot_insns, insn);
+            if (slot != -1)
+            {
+                LiveInterval_add(&intervals[slot], point + i + (insn->form == STORE_AI ? 1 : 0));
+            }
+            i++;
+        }
+        point += n + 1;
+    }
+
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        BitSet_free(live_in[b]);
+    }
+    free(live_in);
+    BitSet_free(live);
+    free(sorted);
+    return intervals;
+}
+
+/**
+ * @brief Allocate registers for a single function in SSA form (see
+ * @ref allocate_registers_ssa)
+ *
+ * @param cfg Function to allocate
+ * @param num_physical_registers Number of (caller-saved) physical registers
+ * @param stats Destination for the spill code counts (or @c NULL)
+ */
+void allocate_function_ssa(CFG *cfg, int num_physical_registers, RegAllocStats *stats)
+{
+    // a round trip through SSA form splits unrelated uses of the same virtual
+    // register and removes unreachable blocks
+    CFG_to_ssa(cfg);
+    CFG_from_ssa(cfg);
+    CFG_compute_liveness(cfg);
+    CFG_compute_dominators(cfg);
+    CFG_compute_loops(cfg);
+
+    RegAllocState state = {
+        .num_physical_registers = num_physical_registers,
+        .num_vregs = cfg->num_vregs,
+        .local_allocator = CFG_local_allocator(cfg),
+        .stats = stats
+    };
+    state.has_slot = (bool *)calloc(cfg->num_vregs + 1, sizeof(bool));
+    state.remat = (ILOCInsn **)calloc(cfg->num_vregs + 1, sizeof(ILOCInsn *));
+    state.first_ref = (NextRef *)calloc(cfg->num_vregs + 1, sizeof(NextRef));
+    state.ref_block = (int *)malloc((cfg->num_vregs + 1) * sizeof(int));
+    CHECK_MALLOC_PTR(state.has_slot);
+    CHECK_MALLOC_PTR(state.remat);
+    CHECK_MALLOC_PTR(state.first_ref);
+    CHECK_MALLOC_PTR(state.ref_block);
+    for (int i = 0; i <= cfg->num_vregs; i++)
+    {
+        state.ref_block[i] = -1;
+    }
+    find_rematerializable(&state, cfg);
+    find_next_uses(&state, cfg);
+    spill_to_registers(&state, cfg);
+    free_next_uses(&state, cfg);
+    free(state.next_refs);
+    free(state.first_ref);
+    free(state.ref_block);
+    free(state.has_slot);
+    free(state.remat);
+
+    // reloads are new definitions, so SSA construction gives them new names
+    CFG_to_ssa(cfg);
+    CFG_compute_liveness(cfg);
+    CFG_compute_dominators(cfg);
+
+    int num_blocks = cfg->num_blocks;
+    int num_vregs = cfg->num_vregs;
+    int *color = (int *)malloc((num_vregs + 1) * sizeof(int));
+    int *hint = (int *)malloc((num_vregs + 1) * sizeof(int));
+    int *num_children = (int *)calloc(num_blocks + 1, sizeof(int));
+    BasicBlock ***children = (BasicBlock ***)calloc(num_blocks + 1, sizeof(BasicBlock **));
+    CHECK_MALLOC_PTR(color);
+    CHECK_MALLOC_PTR(hint);
+    CHECK_MALLOC_PTR(num_children);
+    CHECK_MALLOC_PTR(children);
+    for (int vr = 0; vr < num_vregs; vr++)
+    {
+        color[vr] = hint[vr] = -1;
+    }
+    for (int b = 1; b < num_blocks; b++)
+    {
+        BasicBlock *idom = cfg->blocks[b]->idom;
+        if (idom != NULL)
+        {
+            children[idom->id] = (BasicBlock **)realloc(children[idom->id],
+                                                        (num_children[idom->id] + 1) * sizeof(BasicBlock *));
+            CHECK_MALLOC_PTR(children[idom->id]);
+            children[idom->id][num_children[idom->id]++] = cfg->blocks[b];
+        }
+    }
+    color_block(cfg->blocks[0], children, num_children, color, hint, num_physical_registers);
+    for (int b = 0; b < num_blocks; b++)
+    {
+        free(children[b]);
+    }
+    free(children);
+    free(num_children);
+    free(hint);
+
+    remove_phis(&state, cfg, color);
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        FOR_EACH(ILOCInsn *, insn, cfg->blocks[b]->insns)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                if (insn->op[i].type == VIRTUAL_REG)
+                {
+                    replace_register(insn->op[i].id, color[insn->op[i].id], insn);
+                }
+            }
+        }
+    }
+    free(color);
+
+    int num_values = 0;
+    for (int i = 0; i < state.num_slot_insns; i++)
+    {
+        ILOCInsn *insn = state.slot_insns[i];
+        int slot = (int)insn->op[insn->form == STORE_AI ? 2 : 1].imm;
+        num_values = (slot + 1 > num_values ? slot + 1 : num_values);
+    }
+    if (num_values > 0)
+    {
+        LiveInterval *intervals = find_slot_live_intervals(&state, cfg, num_values);
+        place_stack_slots(&state, intervals, num_values);
+        free(intervals);
+    }
+    free(state.slot_insns);
+}
+
+/**
+ * @brief Give a function with a standard prologue but no local allocator (such
+ * as one whose locals were promoted to registers) an empty one to spill into
+ *
+ * @param cfg Function to allocate
+ * @returns The new local allocator (or @c NULL if none was added)
+ */
+ILOCInsn *add_local_allocator(CFG *cfg)
+{
+    if (cfg->num_blocks == 0 || CFG_local_allocator(cfg) != NULL)
+    {
+        return NULL;
+    }
+    BasicBlock *entry = cfg->blocks[0];
+    FOR_EACH(ILOCInsn *, insn, entry->insns)
+    {
+        ILOCInsn *next = insn->next;
+        if (insn->form == PUSH && next != NULL && next->form == I2I &&
+            next->op[0].type == STACK_REG && next->op[1].type == BASE_REG)
+        {
+            ILOCInsn *local_allocator = ILOCInsn_new_3op(ADD_I, stack_register(), int_const(0), stack_register());
+            BasicBlock_insert_after(entry, next, local_allocator);
+            return local_allocator;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Remove instructions that allocation left doing nothing: copies from a
+ * physical register to itself and a local allocator from
+ * @ref add_local_allocator that nothing was spilled into
+ *
+ * @param cfg Function after allocation
+ * @param added_allocator Result of @ref add_local_allocator
+ */
+void remove_allocation_no_ops(CFG *cfg, ILOCInsn *added_allocator)
+{
+    for (int b = 0; b < cfg->num_blocks; b++)
+    {
+        BasicBlock *block = cfg->blocks[b];
+        ILOCInsn *prev = NULL;
+        ILOCInsn *insn = block->insns->head;
+        while (insn != NULL)
+        {
+            ILOCInsn *next = insn->next;
+            bool self_copy = insn->form == I2I && insn->op[0].type == PHYSICAL_REG &&
+                             insn->op[1].type == PHYSICAL_REG && insn->op[0].id == insn->op[1].id;
+            bool empty_frame = insn == added_allocator && insn->op[1].imm == 0;
+            if (self_copy || empty_frame)
+            {
+                BasicBlock_remove_after(block, prev);
+            }
+            else
+            {
+                prev = insn;
+            }
+            insn = next;
+        }
+    }
+}
+
+/**
+ * @brief Allocate registers for every function of a program
+ *
+ * @param list ILOC program (modified in place)
+ * @param convention Registers to allocate and which of them survive calls
+ * @param max_candidates Functions with at most this many values live across
+ * blocks are allocated by exhaustive search (-1 for none)
+ * @param stats Destination for the spill code counts (reset first; may be @c NULL)
+ */
+void allocate_program(InsnList *list, const CallingConvention *convention, int max_candidates,
+                      RegAllocStats *stats)
+{
+    if (stats != NULL)
+    {
+        memset(stats, 0, sizeof(RegAllocStats));
+    }
+
+    if (convention->num_registers <= 0 || convention->num_registers > MAX_PHYSICAL_REGS) {
+        fprintf(stderr, "Error: a calling convention must describe 1 to %d registers\n", MAX_PHYSICAL_REGS);
+        exit(1);
+    }
+
+    if (!list)
+    {
+        return;
+    }
+
+    // main is the entry point unless the program calls it
+    bool main_called = false;
+    FOR_EACH(ILOCInsn *, insn, list)
+    {
+        main_called |= (insn->form == CALL && strcmp(insn->op[0].str, "main") == 0);
+    }
+
+    // No virtual registers are live across function boundaries, so each
+    // function (and its spill slots) is allocated separately
+    CFGList *cfgs = CFGList_build(list);
+    FOR_EACH(CFG *, cfg, cfgs)
+    {
+        ILOCInsn *label = CFG_function_label(cfg);
+        bool is_entry = !main_called && label != NULL && strcmp(label->op[0].str, "main") == 0;
+        ILOCInsn *added_allocator = add_local_allocator(cfg);
+        int num_split = split_live_ranges(cfg, convention->num_registers);
+        if (stats != NULL)
+        {
+            stats->live_range_splits += num_split;
+        }
+        if (max_candidates < 0 ||
+            !allocate_function_optimal(cfg, convention, is_entry, max_candidates, stats))
+        {
+            allocate_function(cfg, convention, is_entry, NULL, stats);
+        }
+        remove_allocation_no_ops(cfg, added_allocator);
+    }
+    CFGList_linearize(cfgs, list);
+    CFGList_free(cfgs);
+}
+
+/**
+ * @brief Describe a set of registers that are all caller-saved (exits if the
+ * number is invalid)
+ */
+CallingConvention caller_saved_convention(int num_physical_registers)
+{
+    if (num_physical_registers <= 0) {
+        fprintf(stderr, "Error: no physical registers available for allocation\n");
+    exit(1);
+    }
+    if (num_physical_registers > MAX_PHYSICAL_REGS) {
+        fprintf(stderr, "Error: at most %d physical registers can be allocated\n", MAX_PHYSICAL_REGS);
+        exit(1);
+    }
+    return CallingConvention_new(num_physical_registers, 0);
+}
+
+void allocate_registers(InsnList *list, int num_physical_registers)
+{
+    allocate_registers_with_stats(list, num_physical_registers, NULL);
+}
+
+void allocate_registers_with_stats(InsnList *list, int num_physical_registers, RegAllocStats *stats)
+{
+    // all registers are caller-saved
+    CallingConvention convention = caller_saved_convention(num_physical_registers);
+    allocate_program(list, &convention, -1, stats);
+}
+
+void allocate_registers_with_convention(InsnList *list, const CallingConvention *convention, RegAllocStats *stats)
+{
+    allocate_program(list, convention, -1, stats);
+}
+
+void allocate_registers_optimal(InsnList *list, int num_physical_registers, int max_candidates,
+                                RegAllocStats *stats)
+{
+    CallingConvention convention = caller_saved_convention(num_physical_registers);
+    allocate_program(list, &convention, max_candidates, stats);
+}
+
+void allocate_registers_ssa(InsnList *list, int num_physical_registers, RegAllocStats *stats)
+{
+    CallingConvention convention = caller_saved_convention(num_physical_registers);
+    if (stats != NULL)
+    {
+        memset(stats, 0, sizeof(RegAllocStats));
+    }
+    if (!list)
+    {
+        return;
+    }
+
+    CFGList *cfgs = CFGList_build(list);
+    FOR_EACH(CFG *, cfg, cfgs)
+    {
+        ILOCInsn *added_allocator = add_local_allocator(cfg);
+        allocate_function_ssa(cfg, convention.num_registers, stats);
+        remove_allocation_no_ops(cfg, added_allocator);
     }
+    CFGList_linearize(cfgs, list);
+    CFGList_free(cfgs);
 }
@@ -0,0 +1,789 @@
+#include "ssa.h"
+
+/*
+ * Stack slot promotion
+ */
+
+/**
+ * @brief Test whether a use of BP is one that stack slot promotion understands
+ */
+bool is_promotable_bp_use (ILOCInsn* insn)
+{
+    switch (insn->form) {
+        case PUSH: case POP:
+            return true;
+        case I2I:       /* prologue and epilogue */
+            return (insn->op[0].type == BASE_REG && insn->op[1].type == STACK_REG) ||
+                   (insn->op[0].type == STACK_REG && insn->op[1].type == BASE_REG);
+        case LOAD_AI:
+            return insn->op[1].type == INT_CONST && insn->op[2].type != BASE_REG;
+        case STORE_AI:
+            return insn->op[0].type != BASE_REG && insn->op[2].type == INT_CONST;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Stack slot and the virtual register it was promoted to
+ */
+typedef struct PromotedSlot
+{
+    long offset;    /**< @brief BP-based offset of the slot */
+    int vreg;       /**< @brief Virtual register holding the slot's value */
+} PromotedSlot;
+
+/**
+ * @brief Find (or add) the promoted virtual register for a stack slot
+ */
+int promoted_slot_vreg (PromotedSlot* slots, int* num_slots, long offset)
+{
+    for (int s = 0; s < *num_slots; s++) {
+        if (slots[s].offset == offset) {
+            return slots[s].vreg;
+        }
+    }
+    slots[*num_slots].offset = offset;
+    slots[*num_slots].vreg = virtual_register().id;
+    return slots[(*num_slots)++].vreg;
+}
+
+int CFG_promote_stack_slots (CFG* cfg)
+{
+    ILOCInsn* local_allocator = CFG_local_allocator(cfg);
+    if (local_allocator == NULL) {
+        return 0;
+    }
+
+    /* make sure every use of BP is a simple slot access (or the prologue/epilogue) */
+    int num_accesses = 0;
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        FOR_EACH (ILOCInsn*, insn, cfg->blocks[b]->insns) {
+            bool uses_bp = false;
+            for (int i = 0; i < 3; i++) {
+                uses_bp |= (insn->op[i].type == BASE_REG);
+            }
+            if (uses_bp && !is_promotable_bp_use(insn)) {
+                return 0;
+            }
+            if (uses_bp && (insn->form == LOAD_AI || insn->form == STORE_AI)) {
+                num_accesses++;
+            }
+        }
+    }
+    if (num_accesses == 0) {
+        return 0;
+    }
+
+    /* replace slot accesses with copies */
+    PromotedSlot* slots = (PromotedSlot*)calloc(num_accesses, sizeof(PromotedSlot));
+    CHECK_MALLOC_PTR(slots);
+    int num_slots = 0;
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        FOR_EACH (ILOCInsn*, insn, cfg->blocks[b]->insns) {
+            if (insn->form == LOAD_AI && insn->op[0].type == BASE_REG) {
+                Operand var = { .type = VIRTUAL_REG,
+                    .id = promoted_slot_vreg(slots, &num_slots, insn->op[1].imm) };
+                insn->form = I2I;
+                insn->op[0] = var;
+                insn->op[1] = insn->op[2];
+                insn->op[2] = empty_operand();
+            } else if (insn->form == STORE_AI && insn->op[1].type == BASE_REG) {
+                Operand var = { .type = VIRTUAL_REG,
+                    .id = promoted_slot_vreg(slots, &num_slots, insn->op[2].imm) };
+                insn->form = I2I;
+                insn->op[1] = var;
+                insn->op[2] = empty_operand();
+            }
+        }
+    }
+
+    /* initialize the new registers on entry: parameters from the stack, locals to zero */
+    ILOCInsn* prev = local_allocator;
+    for (int s = 0; s < num_slots; s++) {
+        Operand var = { .type = VIRTUAL_REG, .id = slots[s].vreg };
+        ILOCInsn* init;
+        if (slots[s].offset > 0) {
+            init = ILOCInsn_new_3op(LOAD_AI, base_register(), int_const(slots[s].offset), var);
+        } else {
+            init = ILOCInsn_new_2op(LOAD_I, int_const(0), var);
+        }
+        BasicBlock_insert_after(cfg->blocks[0], prev, init);
+        prev = init;
+    }
+
+    /* locals no longer live on the stack (register allocation adds a new
+     * allocator if it needs to spill) */
+    ILOCInsn* before = NULL;
+    for (ILOCInsn* insn = cfg->blocks[0]->insns->head; insn != local_allocator; insn = insn->next) {
+        before = insn;
+    }
+    BasicBlock_remove_after(cfg->blocks[0], before);
+
+    free(slots);
+    return num_slots;
+}
+
+
+/*
+ * SSA construction
+ */
+
+/**
+ * @brief State for SSA renaming
+ */
+typedef struct SSARenamer
+{
+    /**
+     * @brief Current SSA name for each original virtual register (-1 if undefined)
+     */
+    int* current;
+
+    /**
+     * @brief Number of original virtual registers
+     */
+    int num_vregs;
+
+    /**
+     * @brief Original virtual registers with more than one definition
+     */
+    BitSet* multi_def;
+
+    /**
+     * @brief Undo log of (register, previous name) pairs for leaving a subtree
+     */
+    int* log;
+
+    /**
+     * @brief Number of entries (pairs) in the undo log
+     */
+    int log_size;
+
+    /**
+     * @brief Capacity (in pairs) of the undo log
+     */
+    int log_cap;
+
+    /**
+     * @brief Dominator tree children of each block
+     */
+    BasicBlock*** children;
+
+    /**
+     * @brief Number of dominator tree children of each block
+     */
+    int* num_children;
+
+} SSARenamer;
+
+/**
+ * @brief Change the current SSA name of an original register (recording the old one)
+ */
+void SSARenamer_set (SSARenamer* r, int vreg, int name)
+{
+    if (r->log_size == r->log_cap) {
+        r->log_cap *= 2;
+        r->log = (int*)realloc(r->log, 2 * r->log_cap * sizeof(int));
+        CHECK_MALLOC_PTR(r->log);
+    }
+    r->log[2 * r->log_size]     = vreg;
+    r->log[2 * r->log_size + 1] = r->current[vreg];
+    r->log_size++;
+    r->current[vreg] = name;
+}
+
+/**
+ * @brief Test whether an instruction is a @c PHI
+ */
+bool is_phi (ILOCInsn* insn)
+{
+    return insn != NULL && insn->form == PHI;
+}
+
+/**
+ * @brief Get the last instruction before any @c PHI instructions in a block
+ *
+ * @returns The block's label (or @c NULL if there is none)
+ */
+ILOCInsn* phi_insertion_point (BasicBlock* block)
+{
+    ILOCInsn* first = block->insns->head;
+    return (first != NULL && first->form == LABEL) ? first : NULL;
+}
+
+/**
+ * @brief Rename all registers in a block and its dominator tree descendants
+ */
+void rename_block (SSARenamer* r, BasicBlock* block)
+{
+    int saved_log_size = r->log_size;
+
+    ILOCInsn* prev = NULL;
+    ILOCInsn* insn = block->insns->head;
+    while (insn != NULL) {
+        ILOCInsn* next = insn->next;
+
+        /* uses (PHI operands are filled in from the predecessors) */
+        if (insn->form != PHI) {
+            ILOCInsn* read_regs = ILOCInsn_get_read_registers(insn);
+            for (int i = 0; i < 3; i++) {
+                int vr = read_regs->op[i].id;
+                if (read_regs->op[i].type == VIRTUAL_REG && vr < r->num_vregs && r->current[vr] >= 0) {
+                    insn->op[i].id = r->current[vr];
+                }
+            }
+            ILOCInsn_free(read_regs);
+        }
+
+        /* definitions */
+        int w = ILOCInsn_get_write_index(insn);
+        if (w >= 0 && insn->op[w].type == VIRTUAL_REG && insn->op[w].id < r->num_vregs) {
+            int vr = insn->op[w].id;
+            if (insn->form == I2I && insn->op[0].type == VIRTUAL_REG) {
+                /* fold copies: the destination is just another name for the source */
+                SSARenamer_set(r, vr, insn->op[0].id);
+                BasicBlock_remove_after(block, prev);
+                insn = next;
+                continue;
+            } else if (BitSet_contains(r->multi_def, vr)) {
+                insn->op[w].id = virtual_register().id;
+                SSARenamer_set(r, vr, insn->op[w].id);
+            } else {
+                SSARenamer_set(r, vr, vr);
+            }
+        }
+
+        prev = insn;
+        insn = next;
+    }
+
+    /* fill in PHI operands of successors */
+    for (int s = 0; s < block->num_succ; s++) {
+        BasicBlock* succ = block->succ[s];
+        int idx = -1;
+        for (int p = 0; p < succ->num_preds && p < 2; p++) {
+            if (succ->preds[p] == block) {
+                idx = p;
+            }
+        }
+        if (idx < 0) {
+            continue;
+        }
+        FOR_EACH (ILOCInsn*, phi, succ->insns) {
+            if (phi->form == PHI) {
+                int vr = phi->op[idx].id;
+                if (vr < r->num_vregs && r->current[vr] >= 0) {
+                    phi->op[idx].id = r->current[vr];
+                }
+            }
+        }
+    }
+
+    for (int c = 0; c < r->num_children[block->id]; c++) {
+        rename_block(r, r->children[block->id][c]);
+    }
+
+    /* restore names from before this block */
+    while (r->log_size > saved_log_size) {
+        r->log_size--;
+        r->current[r->log[2 * r->log_size]] = r->log[2 * r->log_size + 1];
+    }
+}
+
+/**
+ * @brief Split a join block so that it has at most two predecessors
+ *
+ * Each new block merges the first two predecessors and jumps to the original.
+ */
+void split_join_block (CFG* cfg, BasicBlock* block)
+{
+    while (block->num_preds > 2) {
+        BasicBlock* join = CFG_insert_block(cfg, block->id);
+        Operand join_label = anonymous_label();
+        Operand block_label = { .type = JUMP_LABEL, .id = BasicBlock_label(block) };
+        InsnList_add(join->insns, ILOCInsn_new_1op(LABEL, join_label));
+        InsnList_add(join->insns, ILOCInsn_new_1op(JUMP, block_label));
+        BasicBlock_retarget(block->preds[0], block_label.id, join_label.id);
+        BasicBlock_retarget(block->preds[1], block_label.id, join_label.id);
+        CFG_compute_edges(cfg);
+    }
+}
+
+/**
+ * @brief Find the blocks that need a @c PHI for each multiply-defined register
+ *
+ * @param cfg CFG (with up-to-date dominators and liveness)
+ * @param multi_def Registers that need PHIs
+ * @param needs_phi Output: one set of block IDs for each register
+ * @returns True if every block that needs a @c PHI has at most two predecessors
+ */
+bool place_phis (CFG* cfg, BitSet* multi_def, BitSet** needs_phi)
+{
+    int n = cfg->num_blocks;
+    BasicBlock** worklist = (BasicBlock**)calloc(n, sizeof(BasicBlock*));
+    BitSet* queued = BitSet_new(n);
+    CHECK_MALLOC_PTR(worklist);
+    bool ok = true;
+
+    for (int vr = 0; vr < multi_def->size; vr++) {
+        if (!BitSet_contains(multi_def, vr)) {
+            continue;
+        }
+        needs_phi[vr] = BitSet_new(n);
+
+        /* start from every block that defines the register */
+        int top = 0;
+        BitSet_clear(queued);
+        for (int b = 0; b < n; b++) {
+            FOR_EACH (ILOCInsn*, insn, cfg->blocks[b]->insns) {
+                Operand write_reg = ILOCInsn_get_write_register(insn);
+                if (write_reg.type == VIRTUAL_REG && write_reg.id == vr &&
+                        !BitSet_contains(queued, b)) {
+                    BitSet_add(queued, b);
+                    worklist[top++] = cfg->blocks[b];
+                }
+            }
+        }
+
+        /* iterated dominance frontier, pruned by liveness */
+        while (top > 0) {
+            BasicBlock* block = worklist[--top];
+            for (int f = 0; f < n; f++) {
+                BasicBlock* frontier = cfg->blocks[f];
+                if (!BitSet_contains(block->frontier, f) || BitSet_contains(needs_phi[vr], f) ||
+                        !BitSet_contains(frontier->live_in, vr)) {
+                    continue;
+                }
+                BitSet_add(needs_phi[vr], f);
+                ok &= (frontier->num_preds <= 2);
+                if (!BitSet_contains(queued, f)) {
+                    BitSet_add(queued, f);
+                    worklist[top++] = frontier;
+                }
+            }
+        }
+    }
+
+    free(worklist);
+    BitSet_free(queued);
+    return ok;
+}
+
+int CFG_to_ssa (CFG* cfg)
+{
+    /* unreachable blocks have no dominators */
+    CFG_compute_edges(cfg);
+    for (int b = cfg->num_blocks - 1; b > 0; b--) {
+        if (!cfg->blocks[b]->reachable) {
+            CFG_remove_block(cfg, cfg->blocks[b]);
+        }
+    }
+    CFG_make_explicit(cfg);
+
+    /* registers that are defined more than once need renaming (and maybe PHIs) */
+    CFG_compute_liveness(cfg);
+    int num_vregs = cfg->num_vregs;
+    BitSet* defined = BitSet_new(num_vregs);
+    BitSet* multi_def = BitSet_new(num_vregs);
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        FOR_EACH (ILOCInsn*, insn, cfg->blocks[b]->insns) {
+            Operand write_reg = ILOCInsn_get_write_register(insn);
+            if (write_reg.type == VIRTUAL_REG) {
+                if (BitSet_contains(defined, write_reg.id)) {
+                    BitSet_add(multi_def, write_reg.id);
+                }
+                BitSet_add(defined, write_reg.id);
+            }
+        }
+    }
+    BitSet_free(defined);
+
+    /* find PHI locations, splitting joins with too many predecessors as needed */
+    BitSet** needs_phi = (BitSet**)calloc(num_vregs, sizeof(BitSet*));
+    CHECK_MALLOC_PTR(needs_phi);
+    while (true) {
+        CFG_compute_dominators(cfg);
+        if (place_phis(cfg, multi_def, needs_phi)) {
+            break;
+        }
+        for (int vr = 0; vr < num_vregs; vr++) {
+            if (needs_phi[vr] == NULL) {
+                continue;
+            }
+            for (int b = 0; b < cfg->num_blocks; b++) {
+                if (BitSet_contains(needs_phi[vr], b) && cfg->blocks[b]->num_preds > 2) {
+                    split_join_block(cfg, cfg->blocks[b]);
+                }
+            }
+            BitSet_free(needs_phi[vr]);
+            needs_phi[vr] = NULL;
+        }
+        for (int vr = 0; vr < num_vregs; vr++) {
+            if (needs_phi[vr] != NULL) {
+                BitSet_free(needs_phi[vr]);
+                needs_phi[vr] = NULL;
+            }
+        }
+        CFG_compute_liveness(cfg);
+    }
+
+    /* insert PHIs (all operands name the original register until renaming) */
+    int num_phis = 0;
+    for (int vr = 0; vr < num_vregs; vr++) {
+        if (needs_phi[vr] == NULL) {
+            continue;
+        }
+        Operand var = { .type = VIRTUAL_REG, .id = vr };
+        for (int b = 0; b < cfg->num_blocks; b++) {
+            if (BitSet_contains(needs_phi[vr], b)) {
+                BasicBlock* block = cfg->blocks[b];
+                BasicBlock_insert_after(block, phi_insertion_point(block),
+                        ILOCInsn_new_3op(PHI, var, var, var));
+                num_phis++;
+            }
+        }
+        BitSet_free(needs_phi[vr]);
+    }
+    free(needs_phi);
+
+    /* rename along the dominator tree */
+    SSARenamer r;
+    r.num_vregs = num_vregs;
+    r.multi_def = multi_def;
+    r.current = (int*)calloc(num_vregs + 1, sizeof(int));
+    r.log_cap = 64;
+    r.log_size = 0;
+    r.log = (int*)calloc(2 * r.log_cap, sizeof(int));
+    r.children = (BasicBlock***)calloc(cfg->num_blocks, sizeof(BasicBlock**));
+    r.num_children = (int*)calloc(cfg->num_blocks, sizeof(int));
+    CHECK_MALLOC_PTR(r.current);
+    CHECK_MALLOC_PTR(r.log);
+    CHECK_MALLOC_PTR(r.children);
+    CHECK_MALLOC_PTR(r.num_children);
+    for (int vr = 0; vr < num_vregs; vr++) {
+        r.current[vr] = -1;
+    }
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        r.children[b] = (BasicBlock**)calloc(cfg->num_blocks, sizeof(BasicBlock*));
+        CHECK_MALLOC_PTR(r.children[b]);
+    }
+    for (int b = 1; b < cfg->num_blocks; b++) {
+        BasicBlock* idom = cfg->blocks[b]->idom;
+        if (idom != NULL) {
+            r.children[idom->id][r.num_children[idom->id]++] = cfg->blocks[b];
+        }
+    }
+    rename_block(&r, cfg->blocks[0]);
+
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        free(r.children[b]);
+    }
+    free(r.children);
+    free(r.num_children);
+    free(r.current);
+    free(r.log);
+    BitSet_free(multi_def);
+    return num_phis;
+}
+
+
+/*
+ * SSA destruction
+ */
+
+/**
+ * @brief Emit a parallel copy as a sequence of ordinary copies
+ *
+ * Copies whose destination is not needed as a source are emitted first; any
+ * remaining cycle is broken by saving one destination in a new register.
+ *
+ * @param block Block to insert the copies into (before its terminator)
+ * @param dest Destination registers (modified)
+ * @param src Source registers (modified)
+ * @param n Number of copies
+ * @returns Number of instructions emitted
+ */
+int sequentialize_copies (BasicBlock* block, int* dest, int* src, int n)
+{
+    int emitted = 0;
+
+    /* drop copies that do nothing */
+    int count = 0;
+    for (int k = 0; k < n; k++) {
+        if (dest[k] != src[k]) {
+            dest[count] = dest[k];
+            src[count] = src[k];
+            count++;
+        }
+    }
+    n = count;
+
+    while (n > 0) {
+        int ready = -1;
+        for (int k = 0; k < n && ready < 0; k++) {
+            bool needed = false;
+            for (int j = 0; j < n; j++) {
+                needed |= (j != k && src[j] == dest[k]);
+            }
+            if (!needed) {
+                ready = k;
+            }
+        }
+
+        if (ready < 0) {
+            /* every destination is still needed: save one in a temporary */
+            Operand tmp = virtual_register();
+            Operand saved = { .type = VIRTUAL_REG, .id = dest[0] };
+            BasicBlock_insert_before_terminator(block, ILOCInsn_new_2op(I2I, saved, tmp));
+            emitted++;
+            for (int j = 0; j < n; j++) {
+                if (src[j] == dest[0]) {
+                    src[j] = tmp.id;
+                }
+            }
+            ready = 0;
+        }
+
+        Operand s = { .type = VIRTUAL_REG, .id = src[ready] };
+        Operand d = { .type = VIRTUAL_REG, .id = dest[ready] };
+        BasicBlock_insert_before_terminator(block, ILOCInsn_new_2op(I2I, s, d));
+        emitted++;
+        dest[ready] = dest[n-1];
+        src[ready] = src[n-1];
+        n--;
+    }
+    return emitted;
+}
+
+/**
+ * @brief Test whether an instruction copies one virtual register to another
+ */
+bool is_vreg_copy (ILOCInsn* insn)
+{
+    return insn->form == I2I && insn->op[0].type == VIRTUAL_REG &&
+           insn->op[1].type == VIRTUAL_REG && insn->op[0].id != insn->op[1].id;
+}
+
+/**
+ * @brief Merge one round of copy-related virtual registers that do not interfere
+ *
+ * Two registers interfere if one of them is live where the other is defined
+ * (except at a copy between them, which leaves both holding the same value).
+ * Each register is merged at most once per round, so the interference found
+ * for the other copies stays valid.
+ *
+ * @returns Number of copy instructions removed
+ */
+int coalesce_copies_once (CFG* cfg)
+{
+    CFG_compute_liveness(cfg);
+    int num_vregs = cfg->num_vregs;
+
+    /* candidate copies, with a chain of the candidates touching each register
+     * (entry 2*c is in the chain of the source of copy c, 2*c+1 of the destination) */
+    int num_cands = 0, max_insns = 0;
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        int length = 0;
+        FOR_EACH (ILOCInsn*, insn, cfg->blocks[b]->insns) {
+            num_cands += is_vreg_copy(insn);
+            length++;
+        }
+        max_insns = (length > max_insns ? length : max_insns);
+    }
+    if (num_cands == 0) {
+        return 0;
+    }
+    int* src = (int*)calloc(num_cands, sizeof(int));
+    int* dest = (int*)calloc(num_cands, sizeof(int));
+    bool* interferes = (bool*)calloc(num_cands, sizeof(bool));
+    int* chain = (int*)calloc(2 * num_cands, sizeof(int));
+    int* head = (int*)calloc(num_vregs, sizeof(int));
+    ILOCInsn** insns = (ILOCInsn**)calloc(max_insns, sizeof(ILOCInsn*));
+    CHECK_MALLOC_PTR(src);
+    CHECK_MALLOC_PTR(dest);
+    CHECK_MALLOC_PTR(interferes);
+    CHECK_MALLOC_PTR(chain);
+    CHECK_MALLOC_PTR(head);
+    CHECK_MALLOC_PTR(insns);
+    for (int vr = 0; vr < num_vregs; vr++) {
+        head[vr] = -1;
+    }
+    int c = 0;
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        FOR_EACH (ILOCInsn*, insn, cfg->blocks[b]->insns) {
+            if (is_vreg_copy(insn)) {
+                src[c] = insn->op[0].id;
+                dest[c] = insn->op[1].id;
+                chain[2 * c] = head[src[c]];
+                head[src[c]] = 2 * c;
+                chain[2 * c + 1] = head[dest[c]];
+                head[dest[c]] = 2 * c + 1;
+                c++;
+            }
+        }
+    }
+
+    /* walk each block backwards, checking the candidates at every definition */
+    BitSet* live = BitSet_new(num_vregs);
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        BasicBlock* block = cfg->blocks[b];
+        int n = 0;
+        FOR_EACH (ILOCInsn*, insn, block->insns) {
+            insns[n++] = insn;
+        }
+        BitSet_copy(live, block->live_out);
+        for (int i = n - 1; i >= 0; i--) {
+            ILOCInsn* insn = insns[i];
+            Operand write_reg = ILOCInsn_get_write_register(insn);
+            if (write_reg.type == VIRTUAL_REG) {
+                int copied = (insn->form == I2I && insn->op[0].type == VIRTUAL_REG) ? insn->op[0].id : -1;
+                for (int e = head[write_reg.id]; e >= 0; e = chain[e]) {
+                    int other = (e % 2 == 0) ? dest[e / 2] : src[e / 2];
+                    if (other != copied && BitSet_contains(live, other)) {
+                        interferes[e / 2] = true;
+                    }
+                }
+                BitSet_remove(live, write_reg.id);
+            }
+            ILOCInsn* read_regs = ILOCInsn_get_read_registers(insn);
+            for (int r = 0; r < 3; r++) {
+                if (read_regs->op[r].type == VIRTUAL_REG) {
+                    BitSet_add(live, read_regs->op[r].id);
+                }
+            }
+            ILOCInsn_free(read_regs);
+        }
+    }
+    BitSet_free(live);
+
+    /* merge each destination into its source */
+    int* rename = (int*)calloc(num_vregs, sizeof(int));
+    bool* merged = (bool*)calloc(num_vregs, sizeof(bool));
+    CHECK_MALLOC_PTR(rename);
+    CHECK_MALLOC_PTR(merged);
+    for (int vr = 0; vr < num_vregs; vr++) {
+        rename[vr] = vr;
+    }
+    for (c = 0; c < num_cands; c++) {
+        if (!interferes[c] && !merged[src[c]] && !merged[dest[c]]) {
+            rename[dest[c]] = src[c];
+            merged[src[c]] = merged[dest[c]] = true;
+        }
+    }
+
+    int removed = 0;
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        BasicBlock* block = cfg->blocks[b];
+        ILOCInsn* prev = NULL;
+        ILOCInsn* insn = block->insns->head;
+        while (insn != NULL) {
+            ILOCInsn* next = insn->next;
+            for (int i = 0; i < 3; i++) {
+                if (insn->op[i].type == VIRTUAL_REG) {
+                    insn->op[i].id = rename[insn->op[i].id];
+                }
+            }
+            if (insn->form == I2I && insn->op[0].type == VIRTUAL_REG &&
+                    insn->op[1].type == VIRTUAL_REG && insn->op[0].id == insn->op[1].id) {
+                BasicBlock_remove_after(block, prev);
+                removed++;
+            } else {
+                prev = insn;
+            }
+            insn = next;
+        }
+    }
+
+    free(rename);
+    free(merged);
+    free(insns);
+    free(head);
+    free(chain);
+    free(interferes);
+    free(dest);
+    free(src);
+    return removed;
+}
+
+int CFG_from_ssa (CFG* cfg)
+{
+    CFG_compute_edges(cfg);
+    int num_copies = 0;
+
+    /* snapshot the blocks with PHIs (edge splitting adds blocks) */
+    int num_joins = 0;
+    BasicBlock** joins = (BasicBlock**)calloc(cfg->num_blocks + 1, sizeof(BasicBlock*));
+    CHECK_MALLOC_PTR(joins);
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        ILOCInsn* first = cfg->blocks[b]->insns->head;
+        if (is_phi(first) || (first != NULL && is_phi(first->next))) {
+            joins[num_joins++] = cfg->blocks[b];
+        }
+    }
+
+    for (int j = 0; j < num_joins; j++) {
+        BasicBlock* block = joins[j];
+        int num_phis = 0;
+        FOR_EACH (ILOCInsn*, insn, block->insns) {
+            num_phis += (insn->form == PHI);
+        }
+        int* dest = (int*)calloc(num_phis, sizeof(int));
+        int* src  = (int*)calloc(num_phis, sizeof(int));
+        CHECK_MALLOC_PTR(dest);
+        CHECK_MALLOC_PTR(src);
+
+        for (int p = 0; p < block->num_preds && p < 2; p++) {
+            BasicBlock* pred = block->preds[p];
+
+            /* split critical edges so the copies only run along this edge */
+            if (pred->num_succ > 1) {
+                BasicBlock* split = CFG_insert_block(cfg, block->id);
+                Operand split_label = anonymous_label();
+                Operand block_label = { .type = JUMP_LABEL, .id = BasicBlock_label(block) };
+                InsnList_add(split->insns, ILOCInsn_new_1op(LABEL, split_label));
+                InsnList_add(split->insns, ILOCInsn_new_1op(JUMP, block_label));
+                BasicBlock_retarget(pred, block_label.id, split_label.id);
+                block->preds[p] = split;
+                CFG_compute_edges(cfg);
+                pred = split;
+            }
+
+            int n = 0;
+            FOR_EACH (ILOCInsn*, insn, block->insns) {
+                if (insn->form == PHI && insn->op[p].type == VIRTUAL_REG) {
+                    dest[n] = insn->op[2].id;
+                    src[n] = insn->op[p].id;
+                    n++;
+                }
+            }
+            num_copies += sequentialize_copies(pred, dest, src, n);
+        }
+
+        /* remove the PHIs themselves */
+        ILOCInsn* prev = NULL;
+        ILOCInsn* insn = block->insns->head;
+        while (insn != NULL) {
+            ILOCInsn* next = insn->next;
+            if (insn->form == PHI) {
+                BasicBlock_remove_after(block, prev);
+            } else {
+                prev = insn;
+            }
+            insn = next;
+        }
+
+        free(dest);
+        free(src);
+    }
+
+    free(joins);
+    CFG_compute_edges(cfg);
+
+    /* most copies join values whose live ranges never overlap */
+    int removed;
+    do {
+        removed = coalesce_copies_once(cfg);
+        num_copies -= removed;
+    } while (removed > 0);
+    return num_copies;
+}
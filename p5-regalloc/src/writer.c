@@ -0,0 +1,228 @@
+#include "writer.h"
+
+Writer* Writer_new_file (FILE* file)
+{
+    Writer* writer = (Writer*)calloc(1, sizeof(Writer));
+    CHECK_MALLOC_PTR(writer);
+    char* buffer = (char*)malloc(WRITER_BUFFER_SIZE);
+    CHECK_MALLOC_PTR(buffer);
+    Writer_init(writer, file, buffer, WRITER_BUFFER_SIZE);
+    writer->owns_data = true;
+    return writer;
+}
+
+Writer* Writer_new_memory (void)
+{
+    Writer* writer = (Writer*)calloc(1, sizeof(Writer));
+    CHECK_MALLOC_PTR(writer);
+    writer->file = NULL;
+    writer->capacity = 256;
+    writer->data = (char*)malloc(writer->capacity);
+    CHECK_MALLOC_PTR(writer->data);
+    writer->length = 0;
+    writer->owns_data = true;
+    return writer;
+}
+
+void Writer_init (Writer* writer, FILE* file, char* buffer, size_t capacity)
+{
+    writer->file = file;
+    writer->data = buffer;
+    writer->length = 0;
+    writer->capacity = capacity;
+    writer->owns_data = false;
+}
+
+/**
+ * @brief Make room for at least @p extra more characters (plus a null terminator for
+ * memory writers)
+ *
+ * @returns False if the text should bypass the buffer (file writers only)
+ */
+bool Writer_reserve (Writer* writer, size_t extra)
+{
+    if (writer->length + extra < writer->capacity) {
+        return true;
+    }
+    if (writer->file != NULL) {
+        Writer_flush(writer);
+        return extra < writer->capacity;
+    }
+    while (writer->length + extra >= writer->capacity) {
+        writer->capacity *= 2;
+    }
+    writer->data = (char*)realloc(writer->data, writer->capacity);
+    CHECK_MALLOC_PTR(writer->data);
+    return true;
+}
+
+void Writer_write (Writer* writer, const char* text, size_t length)
+{
+    if (Writer_reserve(writer, length)) {
+        memcpy(writer->data + writer->length, text, length);
+        writer->length += length;
+    } else {
+        /* too big to buffer; write it directly */
+        fwrite(text, 1, length, writer->file);
+    }
+}
+
+void Writer_putc (Writer* writer, char c)
+{
+    if (writer->length + 1 >= writer->capacity) {
+        Writer_reserve(writer, 1);
+    }
+    writer->data[writer->length++] = c;
+}
+
+void Writer_puts (Writer* writer, const char* text)
+{
+    Writer_write(writer, text, strlen(text));
+}
+
+void Writer_int (Writer* writer, long value)
+{
+    /* build the digits backwards (negate in unsigned arithmetic to handle LONG_MIN) */
+    char digits[24];
+    int pos = sizeof(digits);
+    unsigned long magnitude = (value < 0 ? 0ul - (unsigned long)value : (unsigned long)value);
+    do {
+        digits[--pos] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) {
+        digits[--pos] = '-';
+    }
+    Writer_write(writer, digits + pos, sizeof(digits) - pos);
+}
+
+void Writer_hex (Writer* writer, unsigned long value)
+{
+    char digits[20];
+    int pos = sizeof(digits);
+    do {
+        digits[--pos] = "0123456789abcdef"[value & 0xf];
+        value >>= 4;
+    } while (value != 0);
+    Writer_write(writer, digits + pos, sizeof(digits) - pos);
+}
+
+void Writer_escaped (Writer* writer, const char* text)
+{
+    for (const char* c = text; *c != '\0'; c++) {
+        /* escape special characters */
+        switch (*c) {
+            case '\n':  Writer_write(writer, "\\n", 2);  break;
+            case '\t':  Writer_write(writer, "\\t", 2);  break;
+            case '\"':  Writer_write(writer, "\\\"", 2); break;
+            case '\\':  Writer_write(writer, "\\\\", 2); break;
+            default:    Writer_putc(writer, *c);         break;
+        }
+    }
+}
+
+void Writer_printf (Writer* writer, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    Writer_vprintf(writer, format, args);
+    va_end(args);
+}
+
+void Writer_vprintf (Writer* writer, const char* format, va_list args)
+{
+    const char* p = format;
+    while (*p != '\0') {
+
+        /* copy literal text up to the next directive */
+        const char* start = p;
+        while (*p != '\0' && *p != '%') {
+            p++;
+        }
+        if (p > start) {
+            Writer_write(writer, start, p - start);
+        }
+        if (*p == '\0') {
+            break;
+        }
+
+        /* fast paths for the directives used by the emitters */
+        const char* directive = p++;
+        bool is_long = (*p == 'l');
+        if (is_long) {
+            p++;
+        }
+        switch (*p) {
+            case 's': Writer_puts(writer, va_arg(args, const char*)); p++; continue;
+            case 'c': Writer_putc(writer, (char)va_arg(args, int));   p++; continue;
+            case 'd': Writer_int(writer, is_long ? va_arg(args, long) : va_arg(args, int)); p++; continue;
+            case 'x': Writer_hex(writer, is_long ? va_arg(args, unsigned long)
+                                                 : va_arg(args, unsigned int));   p++; continue;
+            case '%': Writer_putc(writer, '%');                       p++; continue;
+            default:  break;
+        }
+
+        /* anything else (flags, width, etc.) goes through the C library one directive
+         * at a time (only string and integer conversions are supported) */
+        p = directive + 1;
+        while (*p != '\0' && strchr("-+ #0123456789.", *p) != NULL) {
+            p++;
+        }
+        is_long = (*p == 'l');
+        if (is_long) {
+            p++;
+        }
+        char spec[32];
+        char text[MAX_LINE_LEN];
+        int spec_len = (int)(p - directive) + 1;
+        if (*p == '\0' || spec_len >= (int)sizeof(spec)) {
+            Writer_puts(writer, directive);
+            break;
+        }
+        snprintf(spec, spec_len + 1, "%s", directive);
+        switch (*p) {
+            case 's': snprintf(text, MAX_LINE_LEN, spec, va_arg(args, const char*)); break;
+            case 'c': case 'd': case 'i': case 'x': case 'X': case 'u':
+                if (is_long) {
+                    snprintf(text, MAX_LINE_LEN, spec, va_arg(args, long));
+                } else {
+                    snprintf(text, MAX_LINE_LEN, spec, va_arg(args, int));
+                }
+                break;
+            default:
+                snprintf(text, MAX_LINE_LEN, "%s", spec);
+                break;
+        }
+        Writer_puts(writer, text);
+        p++;
+    }
+}
+
+void Writer_flush (Writer* writer)
+{
+    if (writer->file != NULL && writer->length > 0) {
+        fwrite(writer->data, 1, writer->length, writer->file);
+        writer->length = 0;
+    }
+}
+
+void Writer_reset (Writer* writer)
+{
+    writer->length = 0;
+}
+
+const char* Writer_contents (Writer* writer)
+{
+    Writer_reserve(writer, 0);
+    writer->data[writer->length] = '\0';
+    return writer->data;
+}
+
+void Writer_free (Writer* writer)
+{
+    Writer_flush(writer);
+    if (writer->owns_data) {
+        free(writer->data);
+    }
+    free(writer);
+}
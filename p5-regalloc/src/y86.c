@@ -1,6 +1,8 @@
 #include "y86.h"
 
-static FILE* out = NULL;
+static Writer* out = NULL;     /* assembly output */
+static Writer* scratch = NULL; /* scratch space for formatting a single line */
+static Writer* line_store = NULL;   /* text of the buffered lines (see Y86Line) */
 
 #define ONE "%rbx"
 #define RSP "%rsp"
@@ -18,21 +20,92 @@ static FILE* out = NULL;
  * For reference:
  *
  * rax - return register (RET)
- * rcx - r0
- * rdx - r1
  * rbx - literal 1
  * rsp - stack pointer (SP)
  * rbp - base pointer (BP)
- * rsi - I/O source
- * rdi - I/O destination
  * r8  - reserved
  * r9  - reserved
- * r10 - r2
- * r11 - r3
- * r12 - reserved
- * r13 - reserved
- * r14 - reserved (currently unused)
+ *
+ * rcx, rdx, r10, r11 and rdi are always allocatable; r12-r14 (helper routine
+ * scratch space) and rsi (I/O source) are allocatable unless the program needs
+ * them for that purpose (see y86_register_file). rcx, rdx, r10 and r11 are
+ * caller-saved; the other allocatable registers are callee-saved.
+ */
+
+/* register file and calling convention of the program currently being emitted */
+static Y86RegisterFile regfile;
+static CallingConvention convention;
+
+/* inline multiplications by constants that take at most this many instructions
+ * (a call to the helper routine takes four, plus its loop) */
+#define MAX_INLINE_MULT_INSNS 12
+
+/**
+ * @brief Check whether a multiplication by a constant can be done inline
+ *
+ * Counts every instruction @c emit_mult_imm would emit (the copy of the
+ * source, one doubling per bit below the top one, one addition per set bit
+ * below it, and the negation), so long strings of doublings for large powers
+ * of two go to the helper routine too.
+ *
+ * @param c Constant multiplier
+ * @returns True if @c emit_mult_imm can handle the constant without a call
  */
+bool mult_imm_inlinable (long c)
+{
+    unsigned long mag = (c < 0 ? -(unsigned long)c : (unsigned long)c);
+    if (mag == 0) {
+        return true;
+    }
+    int top = 63;
+    while (!(mag & (1ul << top))) {
+        top--;
+    }
+    int insns = 1 + top + (c < 0 ? 3 : 0);
+    for (int b = 0; b < top; b++) {
+        if (mag & (1ul << b)) {
+            insns++;
+        }
+    }
+    return insns <= MAX_INLINE_MULT_INSNS;
+}
+
+Y86RegisterFile y86_register_file (InsnList* iloc)
+{
+    bool uses_helpers = false;
+    bool uses_io = false;
+    FOR_EACH (ILOCInsn*, i, iloc) {
+        if (i->form == MULT || i->form == DIV ||
+                (i->form == MULT_I && !mult_imm_inlinable(i->op[1].imm))) {
+            uses_helpers = true;
+        } else if (i->form == PRINT) {
+            uses_io = true;
+        }
+    }
+
+    Y86RegisterFile file = { .num_registers = 0 };
+    file.names[file.num_registers++] = "%rcx";
+    file.names[file.num_registers++] = "%rdx";
+    file.names[file.num_registers++] = "%r10";
+    file.names[file.num_registers++] = "%r11";
+    file.names[file.num_registers++] = IODST;
+    if (!uses_helpers) {
+        file.names[file.num_registers++] = TMP3;
+        file.names[file.num_registers++] = TMP4;
+        file.names[file.num_registers++] = TMP5;
+    }
+    if (!uses_io) {
+        file.names[file.num_registers++] = IOSRC;
+    }
+    return file;
+}
+
+CallingConvention y86_calling_convention (InsnList* iloc)
+{
+    int num_registers = y86_register_file(iloc).num_registers;
+    return CallingConvention_new(num_registers, num_registers - Y86_CALLER_SAVED_REGISTERS);
+}
+
 const char* reg_name(Operand op)
 {
     const char* reg = "INVALID";
@@ -41,18 +114,14 @@ const char* reg_name(Operand op)
         case STACK_REG:  reg = "%rsp"; break;   // SP
         case RETURN_REG: reg = "%rax"; break;   // RET
         case PHYSICAL_REG:
-            if (op.id >= 4) {
+            if (op.id < 0 || op.id >= regfile.num_registers) {
                 fprintf(stderr, "Invalid register: ");
                 Operand_print(op, stderr);
-                fprintf(stderr, " (must be R0-R3 for translation to physical register)\n");
+                fprintf(stderr, " (must be R0-R%d for translation to physical register)\n",
+                        regfile.num_registers - 1);
                 exit(EXIT_FAILURE);
             }
-            switch (op.id) {
-                case 0: reg = "%rcx"; break;    // R0
-                case 1: reg = "%rdx"; break;    // R1
-                case 2: reg = "%r10"; break;    // R2
-                case 3: reg = "%r11"; break;    // R3
-            }
+            reg = regfile.names[op.id];
             break;
         default:
             break;
@@ -60,37 +129,129 @@ const char* reg_name(Operand op)
     return reg;
 }
 
+/**
+ * @brief Kinds of buffered assembly lines
+ */
+typedef enum Y86LineKind {
+    Y86_INSN,       /**< @brief Instruction (eligible for peephole optimization) */
+    Y86_LABEL,      /**< @brief Call or jump label */
+    Y86_OTHER       /**< @brief Directive, comment, or blank line */
+} Y86LineKind;
+
+/**
+ * @brief Buffered line of assembly output
+ *
+ * The text lives in @c line_store (null-terminated, so it can be used as a C
+ * string); lines only keep its position because the store may move as it grows.
+ */
+typedef struct Y86Line {
+    Y86LineKind kind;
+    bool deleted;
+    size_t offset;      /**< @brief Start of the text in @c line_store */
+    size_t length;      /**< @brief Length of the text (not counting the terminator) */
+} Y86Line;
+
+/* buffered output (flushed by flush_lines) */
+static Y86Line* lines = NULL;
+static int num_lines = 0;
+static int cap_lines = 0;
+
+/**
+ * @brief Access the text of a buffered line (valid until the next line is stored)
+ */
+const char* line_text (int l)
+{
+    return line_store->data + lines[l].offset;
+}
+
+/**
+ * @brief Store new text for a buffered line
+ */
+void set_line_text (int l, const char* text, size_t length)
+{
+    lines[l].offset = line_store->length;
+    lines[l].length = length;
+    Writer_write(line_store, text, length);
+    Writer_putc(line_store, '\0');
+}
+
+void buffer_line (Y86LineKind kind, const char* text)
+{
+    if (num_lines == cap_lines) {
+        cap_lines = (cap_lines == 0 ? 256 : cap_lines * 2);
+        lines = (Y86Line*)realloc(lines, sizeof(Y86Line) * cap_lines);
+        CHECK_MALLOC_PTR(lines);
+    }
+    int l = num_lines++;
+    lines[l].kind = kind;
+    lines[l].deleted = false;
+    set_line_text(l, text, strlen(text));
+}
+
+void flush_lines (void)
+{
+    for (int l = 0; l < num_lines; l++) {
+        if (lines[l].deleted) {
+            continue;
+        }
+        if (lines[l].kind == Y86_LABEL) {
+            Writer_write(out, line_text(l), lines[l].length);
+            Writer_write(out, ":\n", 2);
+        } else if (lines[l].length == 0) {
+            Writer_putc(out, '\n');
+        } else {
+            Writer_write(out, "    ", 4);
+            Writer_write(out, line_text(l), lines[l].length);
+            Writer_putc(out, '\n');
+        }
+    }
+    free(lines);
+    lines = NULL;
+    num_lines = 0;
+    cap_lines = 0;
+    Writer_reset(line_store);
+}
+
 void emit_call_label (const char* text)
 {
-    fprintf(out, "%s:\n", text);
+    buffer_line(Y86_LABEL, text);
 }
 
 void emit_jump_label (int id)
 {
-    fprintf(out, "l%d:\n", id);
+    Writer_reset(scratch);
+    Writer_putc(scratch, 'l');
+    Writer_int(scratch, id);
+    buffer_line(Y86_LABEL, Writer_contents(scratch));
 }
 
 void emit (const char* text)
 {
-    fprintf(out, "    %s\n", text);
+    buffer_line((text[0] == '\0' || text[0] == '.') ? Y86_OTHER : Y86_INSN, text);
 }
 
 void emit_w_comment (const char* text, const char* comment)
 {
-    fprintf(out, "    %-40s# %s\n", text, comment);
+    Writer_reset(scratch);
+    Writer_puts(scratch, text);
+    for (size_t pad = strlen(text); pad < 40; pad++) {
+        Writer_putc(scratch, ' ');
+    }
+    Writer_write(scratch, "# ", 2);
+    Writer_puts(scratch, comment);
+    buffer_line(Y86_OTHER, Writer_contents(scratch));
 }
 
 void emitf (const char* format, ...)
 {
-    char buffer[MAX_LINE_LEN];
-
-    /* delegate to vsnprintf */
+    /* format into the scratch writer (no C library formatting for the common directives) */
+    Writer_reset(scratch);
     va_list args;
     va_start(args, format);
-    vsnprintf(buffer, MAX_LINE_LEN, format, args);
+    Writer_vprintf(scratch, format, args);
     va_end(args);
 
-    emit(buffer);
+    emit(Writer_contents(scratch));
 }
 
 void emit_bin_op (const char* opcode, Operand op0, Operand op1, Operand op2)
@@ -98,9 +259,14 @@ void emit_bin_op (const char* opcode, Operand op0, Operand op1, Operand op2)
     if (op0.id == op2.id) {
         /* first operand is also the output; overwrite it */
         emitf("%s %s, %s", opcode, reg_name(op1), reg_name(op0));
-    } else if (op1.id == op2.id) {
-        /* second operand is also the output; overwrite it */
+    } else if (op1.id == op2.id && strcmp(opcode, "subq") != 0) {
+        /* second operand is also the output; overwrite it (commutative only) */
         emitf("%s %s, %s", opcode, reg_name(op0), reg_name(op1));
+    } else if (op1.id == op2.id) {
+        /* second operand is also the output, but order matters; use a temporary */
+        emitf("rrmovq %s, %s", reg_name(op0), TMP1);
+        emitf("%s %s, %s", opcode, reg_name(op1), TMP1);
+        emitf("rrmovq %s, %s", TMP1, reg_name(op2));
     } else {
         /* no operands duplicated; use an extra move instruction */
         emitf("rrmovq %s, %s", reg_name(op0), reg_name(op2));
@@ -108,13 +274,394 @@ void emit_bin_op (const char* opcode, Operand op0, Operand op1, Operand op2)
     }
 }
 
-void emit_cmp (const char* opcode, Operand op0, Operand op1, Operand op2)
+/* branch targets (indexed by label id) for the compare-and-branch liveness check */
+static ILOCInsn** label_insns = NULL;
+static int num_label_insns = 0;
+
+void index_labels (InsnList* iloc)
+{
+    num_label_insns = 0;
+    FOR_EACH (ILOCInsn*, i, iloc) {
+        if (i->form == LABEL && i->op[0].type == JUMP_LABEL && i->op[0].id >= num_label_insns) {
+            num_label_insns = i->op[0].id + 1;
+        }
+    }
+    label_insns = (ILOCInsn**)calloc(num_label_insns + 1, sizeof(ILOCInsn*));
+    CHECK_MALLOC_PTR(label_insns);
+    FOR_EACH (ILOCInsn*, i, iloc) {
+        if (i->form == LABEL && i->op[0].type == JUMP_LABEL) {
+            label_insns[i->op[0].id] = i;
+        }
+    }
+}
+
+ILOCInsn* label_target (Operand label)
+{
+    if (label.type != JUMP_LABEL || label.id < 0 || label.id >= num_label_insns) {
+        return NULL;
+    }
+    return label_insns[label.id];
+}
+
+bool same_register (Operand a, Operand b)
+{
+    return a.type == PHYSICAL_REG && b.type == PHYSICAL_REG && a.id == b.id;
+}
+
+/* maximum number of instructions examined by register_dead_at */
+#define MAX_DEAD_SCAN 64
+
+/**
+ * @brief Conservatively check whether a physical register is dead at an instruction
+ *
+ * Scans forward (following jumps and both arms of branches) until the register
+ * is read (live) or overwritten (dead). Calls end the lifetime of
+ * caller-saved registers, and returns end the lifetime of every register
+ * except the callee-saved ones (which hold the caller's values by then).
+ * Gives up (live) once @p budget instructions have been examined.
+ *
+ * @param insn First instruction to examine
+ * @param reg Physical register
+ * @param budget Remaining number of instructions to examine
+ * @returns True if the current value of @p reg can never be read
+ */
+bool register_dead_at (ILOCInsn* insn, Operand reg, int* budget)
+{
+    for (; insn != NULL; insn = insn->next) {
+        if (--(*budget) < 0) {
+            return false;
+        }
+        ILOCInsn* read_regs = ILOCInsn_get_read_registers(insn);
+        bool read = false;
+        for (int r = 0; r < 3; r++) {
+            read |= same_register(read_regs->op[r], reg);
+        }
+        ILOCInsn_free(read_regs);
+        if (read) {
+            return false;
+        }
+        if (same_register(ILOCInsn_get_write_register(insn), reg)) {
+            return true;
+        }
+        switch (insn->form) {
+            case CALL:
+                if (!CallingConvention_is_callee_saved(&convention, reg.id)) {
+                    return true;
+                }
+                break;
+            case RETURN:
+                return !CallingConvention_is_callee_saved(&convention, reg.id);
+            case JUMP:
+                return label_target(insn->op[0]) != NULL &&
+                       register_dead_at(label_target(insn->op[0]), reg, budget);
+            case CBR:
+                return label_target(insn->op[1]) != NULL &&
+                       label_target(insn->op[2]) != NULL &&
+                       register_dead_at(label_target(insn->op[1]), reg, budget) &&
+                       register_dead_at(label_target(insn->op[2]), reg, budget);
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Find the branch (if any) that consumes the result of a comparison
+ *
+ * Only instructions that are lowered to plain moves (which leave the condition
+ * codes alone) may appear between the comparison and the @c CBR.
+ *
+ * @param cmp Comparison instruction
+ * @param result_read Set to true if an intervening instruction reads the result
+ * @returns Branch instruction or @c NULL
+ */
+ILOCInsn* find_fused_branch (ILOCInsn* cmp, bool* result_read)
+{
+    *result_read = false;
+    for (ILOCInsn* i = cmp->next; i != NULL; i = i->next) {
+        switch (i->form) {
+            case CBR:
+                return same_register(i->op[0], cmp->op[2]) ? i : NULL;
+            case I2I: case LOAD_I: case LOAD: case LOAD_AI: case STORE: case STORE_AI:
+                if (same_register(ILOCInsn_get_write_register(i), cmp->op[2])) {
+                    return NULL;
+                }
+                for (int r = 0; r < 2; r++) {
+                    *result_read |= same_register(i->op[r], cmp->op[2]);
+                }
+                break;
+            default:
+                return NULL;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Emit a comparison
+ *
+ * If the result only feeds a nearby @c CBR, the branch can test the condition
+ * codes of the subtraction directly, and the 0/1 result is only materialized
+ * if the register is still live afterwards.
+ *
+ * @param opcode Condition code suffix (e.g., "l" or "ge")
+ * @param i Comparison instruction
+ * @returns Condition code suffix for the branch, or @c NULL if the result is
+ * not consumed by a fused branch
+ */
+const char* emit_cmp (const char* opcode, ILOCInsn* i)
+{
+    Operand op0 = i->op[0], op1 = i->op[1], op2 = i->op[2];
+    bool result_read;
+    ILOCInsn* branch = find_fused_branch(i, &result_read);
+    int budget = MAX_DEAD_SCAN;
+
+    if (branch != NULL && !result_read &&
+            label_target(branch->op[1]) != NULL && label_target(branch->op[2]) != NULL &&
+            register_dead_at(label_target(branch->op[1]), op2, &budget) &&
+            register_dead_at(label_target(branch->op[2]), op2, &budget)) {
+        emitf("rrmovq %s, %s", reg_name(op0), TMP2);
+        emitf("subq %s, %s", reg_name(op1), TMP2);
+    } else {
+        emitf("xorq %s, %s", TMP1, TMP1);
+        emitf("rrmovq %s, %s", reg_name(op0), TMP2);
+        emitf("subq %s, %s", reg_name(op1), TMP2);
+        emitf("cmov%s %s, %s", opcode, ONE, TMP1);
+        emitf("rrmovq %s, %s", TMP1, reg_name(op2));
+    }
+    return (branch != NULL ? opcode : NULL);
+}
+
+/**
+ * @brief Multiply a register by a constant using an inline add/shift sequence
+ *
+ * The constant's bits are scanned from the most significant one down (Horner's
+ * rule): the product is doubled for every bit and the source is added in for
+ * every set bit, so powers of two become a string of self-additions.
+ *
+ * @param src Source register
+ * @param c Constant multiplier
+ * @param dst Destination register (may be the same as @p src)
+ * @returns False (and emits nothing) if the sequence would be too long
+ */
+bool emit_mult_imm (Operand src, long c, Operand dst)
+{
+    unsigned long mag = (c < 0 ? -(unsigned long)c : (unsigned long)c);
+
+    if (!mult_imm_inlinable(c)) {
+        return false;
+    }
+    if (mag == 0) {
+        emitf("xorq %s, %s", reg_name(dst), reg_name(dst));
+        return true;
+    }
+
+    int top = 63;
+    while (!(mag & (1ul << top))) {
+        top--;
+    }
+    bool is_power_of_two = (mag == (1ul << top));
+
+    /* the source must survive if it is added back in after a doubling */
+    const char* addend = reg_name(src);
+    if (src.id == dst.id && !is_power_of_two) {
+        emitf("rrmovq %s, %s", reg_name(src), TMP1);
+        addend = TMP1;
+    } else if (src.id != dst.id) {
+        emitf("rrmovq %s, %s", reg_name(src), reg_name(dst));
+    }
+    for (int b = top - 1; b >= 0; b--) {
+        emitf("addq %s, %s", reg_name(dst), reg_name(dst));
+        if (mag & (1ul << b)) {
+            emitf("addq %s, %s", addend, reg_name(dst));
+        }
+    }
+
+    if (c < 0) {
+        emitf("xorq %s, %s", TMP1, TMP1);
+        emitf("subq %s, %s", reg_name(dst), TMP1);
+        emitf("rrmovq %s, %s", TMP1, reg_name(dst));
+    }
+    return true;
+}
+
+/**
+ * @brief Find the next buffered line that has not been deleted
+ *
+ * @param l Index of the current line
+ * @returns Index of the next line (or @c num_lines if there is none)
+ */
+int next_line (int l)
+{
+    do {
+        l++;
+    } while (l < num_lines && lines[l].deleted);
+    return l;
+}
+
+/**
+ * @brief Check whether control falls through from a line to a label
+ *
+ * @param l Index of the current line
+ * @param label Label name
+ * @returns True if only labels and blank lines lie between line @p l and
+ * @p label
+ */
+bool falls_through_to (int l, const char* label)
+{
+    for (l = next_line(l); l < num_lines; l = next_line(l)) {
+        if (lines[l].kind == Y86_LABEL) {
+            if (strcmp(line_text(l), label) == 0) {
+                return true;
+            }
+        } else if (lines[l].kind == Y86_INSN || lines[l].length > 0) {
+            return false;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Split a buffered instruction into its opcode and (up to two) operands
+ */
+void parse_insn (const char* text, char* opcode, char* src, char* dst)
+{
+    opcode[0] = src[0] = dst[0] = '\0';
+    sscanf(text, "%15s %63[^,], %63s", opcode, src, dst);
+}
+
+/**
+ * @brief Return the inverse of a condition code suffix (e.g., "l" -> "ge")
+ */
+const char* inverse_condition (const char* cond)
+{
+    static const char* pairs[][2] = {
+        { "e", "ne" }, { "ne", "e" }, { "l", "ge" }, { "ge", "l" }, { "le", "g" }, { "g", "le" }
+    };
+    for (int p = 0; p < 6; p++) {
+        if (strcmp(cond, pairs[p][0]) == 0) {
+            return pairs[p][1];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Run peephole optimizations over the buffered instructions
+ *
+ * Handles redundant moves (self-moves, moves that are immediately reversed,
+ * and moves whose destination is overwritten by the next instruction), jumps
+ * to the immediately following label, and conditional jumps over an
+ * unconditional jump (which are inverted). Labels end the window for the move
+ * rules, so no rule ever looks across a basic block boundary.
+ *
+ * @returns Number of instructions removed
+ */
+int peephole_y86 (void)
 {
-    emitf("xorq %s, %s", TMP1, TMP1);
-    emitf("rrmovq %s, %s", reg_name(op0), TMP2);
-    emitf("subq %s, %s", reg_name(op1), TMP2);
-    emitf("cmov%s %s, %s", opcode, ONE, TMP1);
-    emitf("rrmovq %s, %s", TMP1, reg_name(op2));
+    int removed = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int l = 0; l < num_lines; l = next_line(l)) {
+            if (lines[l].deleted || lines[l].kind != Y86_INSN) {
+                continue;
+            }
+            char op[16], src[64], dst[64];
+            parse_insn(line_text(l), op, src, dst);
+            int n = next_line(l);
+            char nop[16] = "", nsrc[64] = "", ndst[64] = "";
+            if (n < num_lines && lines[n].kind == Y86_INSN) {
+                parse_insn(line_text(n), nop, nsrc, ndst);
+            }
+
+            if (strcmp(op, "rrmovq") == 0) {
+                if (strcmp(src, dst) == 0) {
+                    /* rrmovq A, A */
+                    lines[l].deleted = true;
+                } else if (strcmp(nop, "rrmovq") == 0 &&
+                        strcmp(nsrc, dst) == 0 && strcmp(ndst, src) == 0) {
+                    /* rrmovq A, B; rrmovq B, A */
+                    lines[n].deleted = true;
+                } else if (((strcmp(nop, "rrmovq") == 0 || strcmp(nop, "irmovq") == 0 ||
+                             strcmp(nop, "mrmovq") == 0) &&
+                            strcmp(ndst, dst) == 0 && strstr(nsrc, dst) == NULL) ||
+                           (strcmp(nop, "popq") == 0 && strcmp(nsrc, dst) == 0)) {
+                    /* rrmovq A, B; (B overwritten without being read) */
+                    lines[l].deleted = true;
+                }
+            } else if (op[0] == 'j') {
+                if (falls_through_to(l, src)) {
+                    /* jXX L; L: */
+                    lines[l].deleted = true;
+                } else if (strcmp(op, "jmp") != 0 && strcmp(nop, "jmp") == 0 &&
+                        falls_through_to(n, src)) {
+                    /* jXX T; jmp F; T: => j(!XX) F; T: */
+                    Writer_reset(scratch);
+                    Writer_printf(scratch, "j%s %s", inverse_condition(op + 1), nsrc);
+                    set_line_text(l, Writer_contents(scratch), scratch->length);
+                    lines[n].deleted = true;
+                }
+            }
+
+            if (lines[l].deleted || (n < num_lines && lines[n].deleted)) {
+                removed++;
+                changed = true;
+            }
+        }
+    }
+    return removed;
+}
+
+/**
+ * @brief Encoded size of a Y86 instruction
+ */
+int insn_size (const char* text)
+{
+    switch (text[0]) {
+        case 'h': case 'n': case 'r':                   /* halt, nop, ret/rrmovq/rmmovq */
+            if (strncmp(text, "rrmovq", 6) == 0) {
+                return 2;
+            }
+            return (strncmp(text, "rmmovq", 6) == 0 ? 10 : 1);
+        case 'c':                                       /* call, cmovXX */
+            return (strncmp(text, "call", 4) == 0 ? 9 : 2);
+        case 'i':                                       /* irmovq, iotrap */
+            return (strncmp(text, "irmovq", 6) == 0 ? 10 : 1);
+        case 'm':                                       /* mrmovq */
+            return 10;
+        case 'j':                                       /* jXX */
+            return 9;
+        default:                                        /* OPq, pushq, popq */
+            return 2;
+    }
+}
+
+/* round up to a multiple of the (power-of-two) alignment */
+#define ALIGN_UP(X,A) (((X) + (A) - 1) & ~((unsigned long)(A) - 1))
+
+/**
+ * @brief Compute the address just past the buffered code (following @c .pos directives)
+ */
+unsigned long buffer_end_address (void)
+{
+    unsigned long addr = 0;
+    for (int l = 0; l < num_lines; l++) {
+        const char* text = line_text(l);
+        if (lines[l].deleted) {
+            continue;
+        } else if (lines[l].kind == Y86_INSN) {
+            addr += insn_size(text);
+        } else if (strncmp(text, ".pos", 4) == 0) {
+            addr = strtoul(text + 4, NULL, 0);
+        } else if (strncmp(text, ".quad", 5) == 0) {
+            addr += WORD_SIZE;
+        } else if (strncmp(text, ".align", 6) == 0) {
+            addr = ALIGN_UP(addr, strtoul(text + 6, NULL, 0));
+        }
+    }
+    return addr;
 }
 
 #define OP0 (i->op[0])
@@ -124,29 +671,54 @@ void emit_cmp (const char* opcode, Operand op0, Operand op1, Operand op2)
 #define REG1 reg_name(OP1)
 #define REG2 reg_name(OP2)
 
-#define MAX_STRINGS 256
+Y86Layout Y86Layout_new (long static_size, long stack_size)
+{
+    if (static_size < 0 || stack_size < 0 ||
+            STATIC_VAR_OFFSET + static_size + stack_size > Y86_MEM_SIZE) {
+        fprintf(stderr, "Y86 layout does not fit in memory: %ld bytes of static data "
+                "and %ld bytes of stack (at most %d bytes available)\n",
+                static_size, stack_size, Y86_MEM_SIZE - STATIC_VAR_OFFSET);
+        exit(EXIT_FAILURE);
+    }
+    Y86Layout layout = { .static_size = static_size, .stack_size = stack_size };
+    return layout;
+}
 
 void emit_y86 (InsnList* iloc, FILE* output)
 {
-    const char* strings[MAX_STRINGS];
-    int num_strings = 0;
+    Y86Layout layout = Y86Layout_new(Y86_DEFAULT_STATIC_SIZE, Y86_DEFAULT_STACK_SIZE);
+    emit_y86_with_layout(iloc, output, &layout);
+}
+
+void emit_y86_with_layout (InsnList* iloc, FILE* output, Y86Layout* layout)
+{
+    StringPool pool = { .num_strings = 0 };
     bool need_mult = false;
     bool need_div = false;
+    const char* branch_cond = NULL;
 
-    out = output;
+    out = Writer_new_file(output);
+    scratch = Writer_new_memory();
+    line_store = Writer_new_memory();
+    regfile = y86_register_file(iloc);
+    convention = y86_calling_convention(iloc);
+    index_labels(iloc);
 
     /* address zero boilerplate (for compatibility with CS:APP simulator) */
     emit(".pos 0 code");
     emit("jmp _start");
     emit("");
 
-    /* static data (not really necessary b/c Decaf has no initialized data region) */
-    emit(".pos 0x100 data");
-    /* TODO: detect static size and emit ".quad" directives? */
+    /* static data (zero-initialized; globals are addressed absolutely by the ILOC) */
+    emitf(".pos 0x%x data", STATIC_VAR_OFFSET);
+    for (long offset = 0; offset < layout->static_size; offset += WORD_SIZE) {
+        emit(".quad 0");
+    }
     emit("");
 
     /* entry point boilerplate (for compatibility with CS 261 projects) */
-    emit(".pos 0x400 code");
+    layout->code_addr = ALIGN_UP(STATIC_VAR_OFFSET + layout->static_size, Y86_SECTION_ALIGN);
+    emitf(".pos 0x%lx code", layout->code_addr);
     emit_call_label("_start");
     emitf("irmovq $1, %s", ONE);
     emit("irmovq _stack, %rsp");
@@ -163,14 +735,14 @@ void emit_y86 (InsnList* iloc, FILE* output)
             case I2I:       emitf("rrmovq %s, %s", REG0, REG1);                 break;
             case PUSH:      emitf("pushq %s", REG0);                            break;
             case POP:       emitf("popq %s", REG0);                             break;
-            case LOAD_I:    emitf("irmovq $%d, %s", OP0.imm, REG1);             break;
+            case LOAD_I:    emitf("irmovq $%ld, %s", OP0.imm, REG1);            break;
             case LOAD:      emitf("mrmovq (%s), %s", REG0, REG1);               break;
-            case LOAD_AI:   emitf("mrmovq $%d(%s), %s", OP1.imm, REG0, REG2);   break;
+            case LOAD_AI:   emitf("mrmovq $%ld(%s), %s", OP1.imm, REG0, REG2);  break;
             case LOAD_AO:   emitf("rrmovq %s, %s", REG0, TMP1);
                             emitf("addq %s, %s", REG1, TMP1);
                             emitf("mrmovq (%s), %s", TMP1, REG2);               break;
             case STORE:     emitf("rmmovq %s, (%s)", REG0, REG1);               break;
-            case STORE_AI:  emitf("rmmovq %s, $%d(%s)", REG0, OP2.imm, REG1);   break;
+            case STORE_AI:  emitf("rmmovq %s, $%ld(%s)", REG0, OP2.imm, REG1);  break;
             case STORE_AO:  emitf("rrmovq %s, %s", REG1, TMP1);
                             emitf("addq %s, %s", REG2, TMP1);
                             emitf("rmmovq %s, (%s)", REG0, TMP1);               break;
@@ -181,11 +753,17 @@ void emit_y86 (InsnList* iloc, FILE* output)
             case SUB:       emit_bin_op("subq", OP0, OP1, OP2); break;
             case AND:       emit_bin_op("andq", OP0, OP1, OP2); break;
 
-            case ADD_I:     emitf("irmovq $%d, %s", OP1.imm, TMP1);
-                            if (OP0.id != OP2.id) {
+            case ADD_I:     if (OP0.id != OP2.id) {
                                 emitf("rrmovq %s, %s", REG0, REG2);
                             }
-                            emitf("addq %s, %s", TMP1, REG2);
+                            if (OP1.imm == 1) {
+                                emitf("addq %s, %s", ONE, REG2);
+                            } else if (OP1.imm == -1) {
+                                emitf("subq %s, %s", ONE, REG2);
+                            } else if (OP1.imm != 0) {
+                                emitf("irmovq $%ld, %s", OP1.imm, TMP1);
+                                emitf("addq %s, %s", TMP1, REG2);
+                            }
                             break;
 
             case MULT:      emitf("rrmovq %s, %s", REG0, TMP1);
@@ -195,8 +773,11 @@ void emit_y86 (InsnList* iloc, FILE* output)
                             need_mult = true;
                             break;
 
-            case MULT_I:    emitf("rrmovq %s, %s", REG0, TMP1);
-                            emitf("irmovq $%d, %s", OP1.imm, TMP2);
+            case MULT_I:    if (emit_mult_imm(OP0, OP1.imm, OP2)) {
+                                break;
+                            }
+                            emitf("irmovq $%ld, %s", OP1.imm, TMP1);
+                            emitf("rrmovq %s, %s", REG0, TMP2);
                             emitf("call _builtin_mult");
                             emitf("rrmovq %s, %s", TMP3, REG2);
                             need_mult = true;
@@ -232,14 +813,14 @@ void emit_y86 (InsnList* iloc, FILE* output)
                             break;
 
 
-            /* comparisons -- delegate to helper method that uses cmov */
+            /* comparisons -- delegate to helper method that uses cmov (or fuses with a branch) */
 
-            case CMP_GT: emit_cmp("g",  OP0, OP1, OP2); break;
-            case CMP_GE: emit_cmp("ge", OP0, OP1, OP2); break;
-            case CMP_LT: emit_cmp("l",  OP0, OP1, OP2); break;
-            case CMP_LE: emit_cmp("le", OP0, OP1, OP2); break;
-            case CMP_EQ: emit_cmp("e",  OP0, OP1, OP2); break;
-            case CMP_NE: emit_cmp("ne", OP0, OP1, OP2); break;
+            case CMP_GT: branch_cond = emit_cmp("g",  i); break;
+            case CMP_GE: branch_cond = emit_cmp("ge", i); break;
+            case CMP_LT: branch_cond = emit_cmp("l",  i); break;
+            case CMP_LE: branch_cond = emit_cmp("le", i); break;
+            case CMP_EQ: branch_cond = emit_cmp("e",  i); break;
+            case CMP_NE: branch_cond = emit_cmp("ne", i); break;
 
             /* control flow handlers (relatively straightforward conversions) */
 
@@ -256,9 +837,14 @@ void emit_y86 (InsnList* iloc, FILE* output)
                 break;
 
             case CBR:
-                emitf("andq %s, %s", REG0, REG0);
-                emitf("jne l%d", OP1.id); /* true */
-                emitf("jmp l%d", OP2.id); /* false */
+                if (branch_cond != NULL) {
+                    emitf("j%s l%d", branch_cond, OP1.id);  /* true */
+                    branch_cond = NULL;
+                } else {
+                    emitf("andq %s, %s", REG0, REG0);
+                    emitf("jne l%d", OP1.id);               /* true */
+                }
+                emitf("jmp l%d", OP2.id);                   /* false */
                 break;
 
             case CALL:
@@ -285,16 +871,7 @@ void emit_y86 (InsnList* iloc, FILE* output)
 
                     case STR_CONST:
                     {
-                        int sidx = num_strings;
-                        for (int s = 0; s < num_strings; s++) {
-                            if (token_str_eq(strings[s], OP0.str)) {
-                                sidx = s;
-                            }
-                        }
-                        if (sidx == num_strings) {
-                            strings[num_strings] = (const char*)&(OP0.str);
-                            num_strings++;
-                        }
+                        int sidx = StringPool_add(&pool, OP0.str);
                         emitf("irmovq _str%d, %s", sidx, IOSRC);
                         emit("iotrap 4");   /* STROUT */
                         emit("iotrap 5");   /* FLUSH */
@@ -302,9 +879,9 @@ void emit_y86 (InsnList* iloc, FILE* output)
                     }
 
                     default:
-                        printf("Unsupported instruction: ");
-                        ILOCInsn_print(i, output);
-                        printf("\n");
+                        fprintf(stderr, "Unsupported instruction: ");
+                        ILOCInsn_print(i, stderr);
+                        fprintf(stderr, "\n");
                         break;
                 }
                 break;
@@ -319,59 +896,145 @@ void emit_y86 (InsnList* iloc, FILE* output)
                 break;
 
             default:
-                printf("Unsupported instruction: ");
-                ILOCInsn_print(i, output);
-                printf("\n");
+                fprintf(stderr, "Unsupported instruction: ");
+                ILOCInsn_print(i, stderr);
+                fprintf(stderr, "\n");
                 break;
         }
     }
 
     if (need_mult) {
-        /* TODO: handle negative numbers */
+        /*
+         * shift-and-add: add y into the product for each set bit of x, doubling
+         * y as the bit mask moves up (at most 64 iterations, fewer for small
+         * |x|); negating both operands first keeps x small without changing
+         * the product, which is exact modulo 2^64 for any signs
+         */
         emit("");
         emit_call_label("_builtin_mult");   /* x in TMP1, y in TMP2 */
+        emitf("andq %s, %s", TMP1, TMP1);
+        emitf("jge _mul_start");            /* if (x < 0): */
+        emitf("xorq %s, %s", TMP3, TMP3);
+        emitf("subq %s, %s", TMP1, TMP3);
+        emitf("rrmovq %s, %s", TMP3, TMP1); /*   x = -x */
+        emitf("xorq %s, %s", TMP3, TMP3);
+        emitf("subq %s, %s", TMP2, TMP3);
+        emitf("rrmovq %s, %s", TMP3, TMP2); /*   y = -y */
+        emit_call_label("_mul_start");
         emitf("xorq %s, %s", TMP3, TMP3);   /* prod = 0 */
+        emitf("rrmovq %s, %s", ONE, TMP4);  /* mask = 1 */
         emit_call_label("_mul_loop");
         emitf("andq %s, %s", TMP1, TMP1);
         emitf("je _mul_done");              /* while (x != 0): */
-        emitf("addq %s, %s", TMP2, TMP3);   /*   prod += y */
-        emitf("subq %s, %s", ONE, TMP1);    /*   x = x - 1 */
+        emitf("rrmovq %s, %s", TMP1, TMP5);
+        emitf("andq %s, %s", TMP4, TMP5);
+        emitf("je _mul_next");              /*   if (x & mask): */
+        emitf("addq %s, %s", TMP2, TMP3);   /*     prod += y */
+        emitf("xorq %s, %s", TMP4, TMP1);   /*     x ^= mask */
+        emit_call_label("_mul_next");
+        emitf("addq %s, %s", TMP2, TMP2);   /*   y <<= 1 */
+        emitf("addq %s, %s", TMP4, TMP4);   /*   mask <<= 1 */
         emitf("jmp _mul_loop");
         emit_call_label("_mul_done");
         emit("ret");                        /* return prod in TMP3 */
     }
 
     if (need_div) {
-        /* TODO: handle negative numbers */
+        /*
+         * restoring long division on the magnitudes (64 iterations), then the
+         * quotient is negated if the signs differ (truncating toward zero);
+         * r - d is never compared directly, because r < 2d guarantees that the
+         * difference is non-negative exactly when r >= d (even for |INT64_MIN|)
+         */
         emit("");
         emit_call_label("_builtin_div");    /* x in TMP1, y in TMP2 */
-        emitf("xorq %s, %s", TMP3, TMP3);   /* div = 0 */
+        emitf("rrmovq %s, %s", TMP1, TMP3);
+        emitf("xorq %s, %s", TMP2, TMP3);
+        emitf("pushq %s", TMP3);            /* save sign of x ^ y */
+        emitf("andq %s, %s", TMP1, TMP1);
+        emitf("jge _div_xpos");             /* x = |x| */
+        emitf("xorq %s, %s", TMP3, TMP3);
+        emitf("subq %s, %s", TMP1, TMP3);
+        emitf("rrmovq %s, %s", TMP3, TMP1);
+        emit_call_label("_div_xpos");
+        emitf("andq %s, %s", TMP2, TMP2);
+        emitf("jge _div_ypos");             /* y = |y| */
+        emitf("xorq %s, %s", TMP3, TMP3);
+        emitf("subq %s, %s", TMP2, TMP3);
+        emitf("rrmovq %s, %s", TMP3, TMP2);
+        emit_call_label("_div_ypos");
+        emitf("xorq %s, %s", TMP3, TMP3);   /* quot = 0 */
+        emitf("xorq %s, %s", TMP4, TMP4);   /* rem = 0 */
+        emitf("irmovq $64, %s", TMP5);      /* 64 bits to go */
         emit_call_label("_div_loop");
+        emitf("addq %s, %s", TMP3, TMP3);   /* quot <<= 1 */
+        emitf("addq %s, %s", TMP4, TMP4);   /* rem <<= 1 */
+        emitf("andq %s, %s", TMP1, TMP1);
+        emitf("jge _div_shift");            /* if (top bit of x): */
+        emitf("addq %s, %s", ONE, TMP4);    /*   rem += 1 */
+        emit_call_label("_div_shift");
+        emitf("addq %s, %s", TMP1, TMP1);   /* x <<= 1 */
+        emitf("subq %s, %s", TMP2, TMP4);   /* rem -= y */
+        emitf("andq %s, %s", TMP4, TMP4);
+        emitf("jge _div_keep");             /* if (rem < 0): */
+        emitf("addq %s, %s", TMP2, TMP4);   /*   restore rem */
+        emitf("jmp _div_next");
+        emit_call_label("_div_keep");       /* else: */
+        emitf("addq %s, %s", ONE, TMP3);    /*   quot += 1 */
+        emit_call_label("_div_next");
+        emitf("subq %s, %s", ONE, TMP5);
+        emitf("jne _div_loop");
+        emitf("popq %s", TMP5);
+        emitf("andq %s, %s", TMP5, TMP5);
+        emitf("jge _div_done");             /* if signs differ: */
         emitf("xorq %s, %s", TMP4, TMP4);
-        emitf("subq %s, %s", TMP1, TMP4);
-        emitf("jge _div_done");             /* while (0 < x): */
-        emitf("subq %s, %s", TMP2, TMP1);   /*   x -= y */
-        emitf("addq %s, %s", ONE, TMP3);    /*   div = div + 1 */
-        emitf("jmp _div_loop");
+        emitf("subq %s, %s", TMP3, TMP4);
+        emitf("rrmovq %s, %s", TMP4, TMP3); /*   quot = -quot */
         emit_call_label("_div_done");
-        emit("ret");                        /* return div in TMP3 */
+        emit("ret");                        /* return quot in TMP3 */
+    }
+
+    /* clean up the code before it is written out */
+    peephole_y86();
+    unsigned long code_end = buffer_end_address();
+    layout->code_size = code_end - layout->code_addr;
+    layout->rodata_addr = ALIGN_UP(code_end, Y86_SECTION_ALIGN);
+    layout->rodata_size = pool.total_size;
+    layout->stack_addr = ALIGN_UP(layout->rodata_addr + layout->rodata_size, Y86_SECTION_ALIGN) +
+                         layout->stack_size;
+    if (layout->stack_addr > Y86_MEM_SIZE) {
+        fprintf(stderr, "Y86 program does not fit in memory: %ld bytes free for the stack "
+                "(budget is %ld bytes)\n",
+                Y86_MEM_SIZE - (layout->stack_addr - layout->stack_size), layout->stack_size);
+        exit(EXIT_FAILURE);
     }
+    flush_lines();
+    free(label_insns);
+    label_insns = NULL;
 
-    /* emit string table if needed */
-    if (num_strings > 0) {
+    /* emit string table (right after the code) if needed */
+    if (pool.num_strings > 0) {
         emit("");
-        emit(".pos 0xa00 rodata");
-        for (int s = 0; s < num_strings; s++) {
-            fprintf(out, "_str%d:\n", s);
-            fprintf(out, "    .string \"");
-            print_escaped_string(strings[s], out);
-            fprintf(out, "\"\n");
+        emitf(".pos 0x%lx rodata", layout->rodata_addr);
+        flush_lines();
+        for (int s = 0; s < pool.num_strings; s++) {
+            Writer_printf(out, "_str%d:\n    .string \"", s);
+            Writer_escaped(out, pool.strings[s]);
+            Writer_write(out, "\"\n", 2);
         }
     }
+    StringPool_free(&pool);
 
-    /* emit stack location marker */
+    /* emit stack location marker (the budget past the string table; the stack grows down toward it) */
     emit("");
-    emit(".pos 0xf00 stack");
+    emitf(".pos 0x%lx stack", layout->stack_addr);
     emit_call_label("_stack");
     emit("");
+    flush_lines();
+    Writer_free(line_store);
+    Writer_free(scratch);
+    Writer_free(out);
+    line_store = NULL;
+    scratch = NULL;
+    out = NULL;
 }
@@ -0,0 +1,811 @@
+#include <ctype.h>
+#include "y86sim.h"
+#include "y86.h"
+
+/**
+ * @brief Y86 register identifiers (as encoded in instructions)
+ */
+typedef enum Y86Register
+{
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14,
+    RNONE
+} Y86Register;
+
+static const char* y86_reg_names[] = {
+    "%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi",
+    "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14"
+};
+
+/**
+ * @brief Operand formats of Y86 instructions
+ */
+typedef enum Y86Format
+{
+    FMT_NONE,   /**< @brief No operands (e.g., @c ret) */
+    FMT_RR,     /**< @brief rA, rB */
+    FMT_IR,     /**< @brief V, rB */
+    FMT_RM,     /**< @brief rA, D(rB) */
+    FMT_MR,     /**< @brief D(rB), rA */
+    FMT_DEST,   /**< @brief Dest */
+    FMT_R,      /**< @brief rA */
+    FMT_TRAP    /**< @brief Trap number */
+} Y86Format;
+
+/**
+ * @brief Y86 instruction encoding table entry
+ */
+typedef struct Y86Opcode
+{
+    const char* mnemonic;
+    uint8_t code;           /**< @brief First byte (icode and ifun) */
+    int size;               /**< @brief Encoded size in bytes */
+    Y86Format format;
+} Y86Opcode;
+
+static const Y86Opcode y86_opcodes[] = {
+    { "halt",   0x00,  1, FMT_NONE },
+    { "nop",    0x10,  1, FMT_NONE },
+    { "rrmovq", 0x20,  2, FMT_RR   },
+    { "cmovle", 0x21,  2, FMT_RR   },
+    { "cmovl",  0x22,  2, FMT_RR   },
+    { "cmove",  0x23,  2, FMT_RR   },
+    { "cmovne", 0x24,  2, FMT_RR   },
+    { "cmovge", 0x25,  2, FMT_RR   },
+    { "cmovg",  0x26,  2, FMT_RR   },
+    { "irmovq", 0x30, 10, FMT_IR   },
+    { "rmmovq", 0x40, 10, FMT_RM   },
+    { "mrmovq", 0x50, 10, FMT_MR   },
+    { "addq",   0x60,  2, FMT_RR   },
+    { "subq",   0x61,  2, FMT_RR   },
+    { "andq",   0x62,  2, FMT_RR   },
+    { "xorq",   0x63,  2, FMT_RR   },
+    { "jmp",    0x70,  9, FMT_DEST },
+    { "jle",    0x71,  9, FMT_DEST },
+    { "jl",     0x72,  9, FMT_DEST },
+    { "je",     0x73,  9, FMT_DEST },
+    { "jne",    0x74,  9, FMT_DEST },
+    { "jge",    0x75,  9, FMT_DEST },
+    { "jg",     0x76,  9, FMT_DEST },
+    { "call",   0x80,  9, FMT_DEST },
+    { "ret",    0x90,  1, FMT_NONE },
+    { "pushq",  0xA0,  2, FMT_R    },
+    { "popq",   0xB0,  2, FMT_R    },
+    { "iotrap", 0xE0,  1, FMT_TRAP },
+};
+
+#define NUM_Y86_OPCODES ((int)(sizeof(y86_opcodes) / sizeof(y86_opcodes[0])))
+
+/*
+ * ASSEMBLER
+ */
+
+/**
+ * @brief Label table entry
+ */
+typedef struct Y86Label
+{
+    char* name;
+    uint64_t address;
+} Y86Label;
+
+/**
+ * @brief Assembler state
+ */
+typedef struct Y86Assembler
+{
+    uint8_t* mem;           /**< @brief Memory image */
+    bool* used;             /**< @brief Bytes already assembled (to detect overlapping sections) */
+    uint64_t addr;          /**< @brief Current location counter */
+    int line_num;           /**< @brief Current source line (for error messages) */
+    bool resolve;           /**< @brief Second pass (labels are resolved and bytes are written) */
+    Y86Label* labels;       /**< @brief Open-addressing hash table of labels */
+    int cap_labels;
+    int num_labels;
+} Y86Assembler;
+
+void assembly_error (Y86Assembler* as, const char* format, ...)
+{
+    char buffer[MAX_LINE_LEN];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, MAX_LINE_LEN, format, args);
+    va_end(args);
+    printf("ERROR: Y86 assembly line %d: %s\n", as->line_num, buffer);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Find the hash table slot for a label (either its entry or an empty slot)
+ */
+Y86Label* find_label_slot (Y86Assembler* as, const char* name, size_t len)
+{
+    int mask = as->cap_labels - 1;
+    for (int s = (int)(hash_string(name, len) & mask); ; s = (s + 1) & mask) {
+        Y86Label* slot = &as->labels[s];
+        if (slot->name == NULL ||
+                (strlen(slot->name) == len && strncmp(slot->name, name, len) == 0)) {
+            return slot;
+        }
+    }
+}
+
+void define_label (Y86Assembler* as, const char* name, size_t len)
+{
+    if (2 * (as->num_labels + 1) > as->cap_labels) {
+        /* grow and rehash */
+        Y86Label* old = as->labels;
+        int old_cap = as->cap_labels;
+        as->cap_labels = (old_cap == 0 ? 64 : old_cap * 2);
+        as->labels = (Y86Label*)calloc(as->cap_labels, sizeof(Y86Label));
+        CHECK_MALLOC_PTR(as->labels);
+        for (int s = 0; s < old_cap; s++) {
+            if (old[s].name != NULL) {
+                *find_label_slot(as, old[s].name, strlen(old[s].name)) = old[s];
+            }
+        }
+        free(old);
+    }
+    Y86Label* slot = find_label_slot(as, name, len);
+    if (slot->name != NULL) {
+        assembly_error(as, "duplicate label '%s'", slot->name);
+    }
+    slot->name = (char*)malloc(len + 1);
+    CHECK_MALLOC_PTR(slot->name);
+    memcpy(slot->name, name, len);
+    slot->name[len] = '\0';
+    slot->address = as->addr;
+    as->num_labels++;
+}
+
+uint64_t lookup_label (Y86Assembler* as, const char* name)
+{
+    if (!as->resolve) {
+        return 0;       /* only sizes matter during the first pass */
+    }
+    Y86Label* slot = (as->cap_labels > 0 ? find_label_slot(as, name, strlen(name)) : NULL);
+    if (slot == NULL || slot->name == NULL) {
+        assembly_error(as, "undefined label '%s'", name);
+    }
+    return slot->address;
+}
+
+void put_byte (Y86Assembler* as, uint8_t byte)
+{
+    if (as->addr >= Y86_MEM_SIZE) {
+        assembly_error(as, "address 0x%lx is out of range", (unsigned long)as->addr);
+    }
+    if (as->resolve) {
+        if (as->used[as->addr]) {
+            assembly_error(as, "address 0x%lx overlaps earlier code or data", (unsigned long)as->addr);
+        }
+        as->used[as->addr] = true;
+        as->mem[as->addr] = byte;
+    }
+    as->addr++;
+}
+
+void put_quad (Y86Assembler* as, uint64_t value)
+{
+    for (int b = 0; b < 8; b++) {
+        put_byte(as, (uint8_t)(value >> (8 * b)));
+    }
+}
+
+/**
+ * @brief Remove leading and trailing whitespace (in place)
+ */
+char* trim (char* text)
+{
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    char* end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+    return text;
+}
+
+Y86Register parse_register (Y86Assembler* as, char* text)
+{
+    text = trim(text);
+    for (int r = 0; r < RNONE; r++) {
+        if (strcmp(text, y86_reg_names[r]) == 0) {
+            return (Y86Register)r;
+        }
+    }
+    assembly_error(as, "invalid register '%s'", text);
+    return RNONE;
+}
+
+/**
+ * @brief Parse an immediate (with or without '$'): a decimal/hex integer or a label
+ */
+uint64_t parse_value (Y86Assembler* as, char* text)
+{
+    text = trim(text);
+    if (*text == '$') {
+        text = trim(text + 1);
+    }
+    if (*text == '\0') {
+        return 0;
+    }
+    if (isdigit((unsigned char)*text) || *text == '-') {
+        char* end;
+        uint64_t value = (*text == '-' ? (uint64_t)strtoll(text, &end, 0)
+                                       : (uint64_t)strtoull(text, &end, 0));
+        if (*end != '\0') {
+            assembly_error(as, "invalid constant '%s'", text);
+        }
+        return value;
+    }
+    return lookup_label(as, text);
+}
+
+/**
+ * @brief Parse a memory operand of the form D(rB)
+ */
+void parse_memory (Y86Assembler* as, char* text, uint64_t* disp, Y86Register* base)
+{
+    char* open = strchr(text, '(');
+    char* close = (open != NULL ? strchr(open, ')') : NULL);
+    if (close == NULL || *trim(close + 1) != '\0') {
+        assembly_error(as, "invalid memory operand '%s'", trim(text));
+    }
+    *open = '\0';
+    *close = '\0';
+    *disp = parse_value(as, text);
+    *base = parse_register(as, open + 1);
+}
+
+/**
+ * @brief Split "a, b" into two operands (in place)
+ */
+void split_operands (Y86Assembler* as, char* text, char** first, char** second)
+{
+    char* comma = strchr(text, ',');
+    if (comma == NULL) {
+        assembly_error(as, "expected two operands in '%s'", trim(text));
+    }
+    *comma = '\0';
+    *first = text;
+    *second = comma + 1;
+}
+
+void assemble_string (Y86Assembler* as, char* text)
+{
+    text = trim(text);
+    size_t len = strlen(text);
+    if (len < 2 || text[0] != '"' || text[len - 1] != '"') {
+        assembly_error(as, "invalid string literal");
+    }
+    for (size_t i = 1; i < len - 1; i++) {
+        char c = text[i];
+        if (c == '\\' && i + 1 < len - 1) {
+            switch (text[++i]) {
+                case 'n':  c = '\n'; break;
+                case 't':  c = '\t'; break;
+                case '0':  c = '\0'; break;
+                default:   c = text[i]; break;
+            }
+        }
+        put_byte(as, (uint8_t)c);
+    }
+    put_byte(as, 0);
+}
+
+void assemble_directive (Y86Assembler* as, char* directive, char* args)
+{
+    if (strcmp(directive, ".pos") == 0) {
+        /* optional section name after the address is ignored */
+        char* space = strpbrk(trim(args), " \t");
+        if (space != NULL) {
+            *space = '\0';
+        }
+        as->addr = parse_value(as, args);
+    } else if (strcmp(directive, ".align") == 0) {
+        uint64_t align = parse_value(as, args);
+        if (align == 0 || (align & (align - 1)) != 0) {
+            assembly_error(as, "alignment must be a power of two");
+        }
+        while (as->addr & (align - 1)) {
+            put_byte(as, 0);
+        }
+    } else if (strcmp(directive, ".quad") == 0) {
+        put_quad(as, parse_value(as, args));
+    } else if (strcmp(directive, ".byte") == 0) {
+        put_byte(as, (uint8_t)parse_value(as, args));
+    } else if (strcmp(directive, ".string") == 0) {
+        assemble_string(as, args);
+    } else {
+        assembly_error(as, "unknown directive '%s'", directive);
+    }
+}
+
+void assemble_insn (Y86Assembler* as, char* mnemonic, char* args)
+{
+    const Y86Opcode* op = NULL;
+    for (int o = 0; o < NUM_Y86_OPCODES; o++) {
+        if (strcmp(mnemonic, y86_opcodes[o].mnemonic) == 0) {
+            op = &y86_opcodes[o];
+            break;
+        }
+    }
+    if (op == NULL) {
+        assembly_error(as, "unknown instruction '%s'", mnemonic);
+    }
+
+    /* the first pass only needs instruction sizes */
+    if (!as->resolve) {
+        as->addr += op->size;
+        return;
+    }
+
+    char *a, *b;
+    uint64_t value;
+    Y86Register ra, rb;
+    switch (op->format) {
+        case FMT_NONE:
+            put_byte(as, op->code);
+            break;
+        case FMT_RR:
+            split_operands(as, args, &a, &b);
+            put_byte(as, op->code);
+            put_byte(as, (uint8_t)(parse_register(as, a) << 4 | parse_register(as, b)));
+            break;
+        case FMT_IR:
+            split_operands(as, args, &a, &b);
+            value = parse_value(as, a);
+            put_byte(as, op->code);
+            put_byte(as, (uint8_t)(RNONE << 4 | parse_register(as, b)));
+            put_quad(as, value);
+            break;
+        case FMT_RM:
+            split_operands(as, args, &a, &b);
+            ra = parse_register(as, a);
+            parse_memory(as, b, &value, &rb);
+            put_byte(as, op->code);
+            put_byte(as, (uint8_t)(ra << 4 | rb));
+            put_quad(as, value);
+            break;
+        case FMT_MR:
+            split_operands(as, args, &a, &b);
+            parse_memory(as, a, &value, &rb);
+            ra = parse_register(as, b);
+            put_byte(as, op->code);
+            put_byte(as, (uint8_t)(ra << 4 | rb));
+            put_quad(as, value);
+            break;
+        case FMT_DEST:
+            value = parse_value(as, args);
+            put_byte(as, op->code);
+            put_quad(as, value);
+            break;
+        case FMT_R:
+            put_byte(as, op->code);
+            put_byte(as, (uint8_t)(parse_register(as, args) << 4 | RNONE));
+            break;
+        case FMT_TRAP:
+            value = parse_value(as, args);
+            if (value > FLUSH) {
+                assembly_error(as, "invalid I/O trap %lu", (unsigned long)value);
+            }
+            put_byte(as, (uint8_t)(op->code | value));
+            break;
+    }
+}
+
+void assemble_line (Y86Assembler* as, char* line)
+{
+    /* strip comments (but not '#' inside string literals) */
+    bool in_string = false;
+    for (char* c = line; *c != '\0'; c++) {
+        if (in_string && *c == '\\' && c[1] != '\0') {
+            c++;
+        } else if (*c == '"') {
+            in_string = !in_string;
+        } else if (*c == '#' && !in_string) {
+            *c = '\0';
+            break;
+        }
+    }
+    line = trim(line);
+
+    /* leading label */
+    char* p = line;
+    while (isalnum((unsigned char)*p) || *p == '_') {
+        p++;
+    }
+    if (p > line && *p == ':') {
+        if (!as->resolve) {
+            define_label(as, line, p - line);
+        }
+        line = trim(p + 1);
+    }
+    if (*line == '\0') {
+        return;
+    }
+
+    /* split mnemonic/directive from operands */
+    char* args = line;
+    while (*args != '\0' && !isspace((unsigned char)*args)) {
+        args++;
+    }
+    if (*args != '\0') {
+        *args++ = '\0';
+    }
+    if (line[0] == '.') {
+        assemble_directive(as, line, args);
+    } else {
+        assemble_insn(as, line, args);
+    }
+}
+
+uint8_t* assemble_y86 (const char* source)
+{
+    Y86Assembler as = { .mem = NULL };
+    as.mem = (uint8_t*)calloc(Y86_MEM_SIZE, 1);
+    as.used = (bool*)calloc(Y86_MEM_SIZE, sizeof(bool));
+    CHECK_MALLOC_PTR(as.mem);
+    CHECK_MALLOC_PTR(as.used);
+
+    /* pass 1 records label addresses; pass 2 encodes everything */
+    char* line = NULL;
+    size_t line_cap = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        as.resolve = (pass == 1);
+        as.addr = 0;
+        as.line_num = 0;
+        const char* start = source;
+        while (*start != '\0') {
+            const char* end = strchr(start, '\n');
+            size_t len = (end != NULL ? (size_t)(end - start) : strlen(start));
+            if (len >= line_cap) {
+                line_cap = (len + 1 > 2 * line_cap ? len + 1 : 2 * line_cap);
+                line = (char*)realloc(line, line_cap);
+                CHECK_MALLOC_PTR(line);
+            }
+            memcpy(line, start, len);
+            line[len] = '\0';
+            as.line_num++;
+            assemble_line(&as, line);
+            start += len + (end != NULL ? 1 : 0);
+        }
+    }
+    free(line);
+
+    for (int s = 0; s < as.cap_labels; s++) {
+        free(as.labels[s].name);
+    }
+    free(as.labels);
+    free(as.used);
+    return as.mem;
+}
+
+/*
+ * SIMULATOR
+ */
+
+/**
+ * @brief Y86 machine state
+ */
+typedef struct Y86Machine
+{
+    uint64_t reg[RNONE];    /**< @brief Register file */
+    bool zf, sf, of;        /**< @brief Condition codes */
+    uint64_t pc;            /**< @brief Program counter */
+    uint8_t* mem;           /**< @brief Address space */
+    FILE* output;           /**< @brief I/O trap output */
+    uint64_t stack_limit;   /**< @brief Lowest address the stack may grow to */
+    Y86Stats stats;
+} Y86Machine;
+
+void machine_error (Y86Machine* m, const char* message, uint64_t value)
+{
+    printf("ERROR: Y86 %s 0x%lx (pc=0x%lx)\n", message, (unsigned long)value, (unsigned long)m->pc);
+    exit(EXIT_FAILURE);
+}
+
+uint8_t read_byte (Y86Machine* m, uint64_t addr)
+{
+    if (addr >= Y86_MEM_SIZE) {
+        machine_error(m, "invalid address", addr);
+    }
+    return m->mem[addr];
+}
+
+uint64_t read_quad (Y86Machine* m, uint64_t addr)
+{
+    if (addr > Y86_MEM_SIZE - 8) {
+        machine_error(m, "invalid address", addr);
+    }
+    uint64_t value = 0;
+    for (int b = 7; b >= 0; b--) {
+        value = (value << 8) | m->mem[addr + b];
+    }
+    return value;
+}
+
+void write_quad (Y86Machine* m, uint64_t addr, uint64_t value)
+{
+    if (addr > Y86_MEM_SIZE - 8) {
+        machine_error(m, "invalid address", addr);
+    }
+    for (int b = 0; b < 8; b++) {
+        m->mem[addr + b] = (uint8_t)(value >> (8 * b));
+    }
+}
+
+/**
+ * @brief Push a quad onto the stack (which must stay within its budget)
+ */
+void push_quad (Y86Machine* m, uint64_t value)
+{
+    m->reg[RSP] -= 8;
+    if (m->reg[RSP] < m->stack_limit) {
+        machine_error(m, "stack overflow at address", m->reg[RSP]);
+    }
+    write_quad(m, m->reg[RSP], value);
+}
+
+/**
+ * @brief Evaluate a jump/move condition (function code 0-6)
+ */
+bool condition_holds (Y86Machine* m, int ifun)
+{
+    bool lt = (m->sf != m->of);
+    switch (ifun) {
+        case 0:  return true;
+        case 1:  return lt || m->zf;        /* le */
+        case 2:  return lt;                 /* l */
+        case 3:  return m->zf;              /* e */
+        case 4:  return !m->zf;             /* ne */
+        case 5:  return !lt;                /* ge */
+        case 6:  return !lt && !m->zf;      /* g */
+        default: machine_error(m, "invalid condition code", ifun);
+    }
+    return false;
+}
+
+/**
+ * @brief Decode the register specifier byte of the current instruction
+ */
+void decode_registers (Y86Machine* m, Y86Register* ra, Y86Register* rb, bool need_a, bool need_b)
+{
+    uint8_t regs = read_byte(m, m->pc + 1);
+    *ra = (Y86Register)(regs >> 4);
+    *rb = (Y86Register)(regs & 0xf);
+    if ((need_a && *ra == RNONE) || (need_b && *rb == RNONE)) {
+        machine_error(m, "invalid register specifier", regs);
+    }
+}
+
+void io_trap (Y86Machine* m, int trap)
+{
+    uint64_t src = m->reg[RSI];
+    uint64_t dst = m->reg[RDI];
+    switch (trap) {
+        case CHAROUT:
+            fputc(read_byte(m, src), m->output);
+            break;
+        case CHARIN: {
+            int c = getchar();
+            if (dst >= Y86_MEM_SIZE) {
+                machine_error(m, "invalid address", dst);
+            }
+            m->mem[dst] = (uint8_t)(c == EOF ? 0 : c);
+            break;
+        }
+        case DECOUT:
+            fprintf(m->output, "%ld", (long)read_quad(m, src));
+            break;
+        case DECIN: {
+            long value = 0;
+            if (scanf("%ld", &value) != 1) {
+                value = 0;
+            }
+            write_quad(m, dst, (uint64_t)value);
+            break;
+        }
+        case STROUT:
+            for (uint8_t c = read_byte(m, src); c != '\0'; c = read_byte(m, ++src)) {
+                fputc(c, m->output);
+            }
+            break;
+        case FLUSH:
+            fflush(m->output);
+            break;
+        default:
+            machine_error(m, "invalid I/O trap", trap);
+    }
+}
+
+/**
+ * @brief Run an assembled program, stopping with an error if the stack grows
+ * below a given address (see @ref simulate_y86)
+ */
+long simulate_y86_with_stack_limit (uint8_t* memory, FILE* output, Y86Stats* stats, uint64_t stack_limit)
+{
+    Y86Machine m = { .pc = 0, .mem = memory, .output = output, .stack_limit = stack_limit };
+
+    Y86Register last_load = RNONE;      /* destination of the previous load (if any) */
+    bool halted = false;
+    while (!halted) {
+        if (m.stats.instructions++ >= Y86_MAX_STEPS) {
+            machine_error(&m, "step limit exceeded at instruction", m.stats.instructions);
+        }
+
+        uint8_t code = read_byte(&m, m.pc);
+        int icode = code >> 4;
+        int ifun = code & 0xf;
+        Y86Register ra = RNONE, rb = RNONE;
+        Y86Register src_a = RNONE, src_b = RNONE, load = RNONE;
+        uint64_t val, addr, a, b, r;
+
+        switch (icode) {
+            case 0x0:   /* halt */
+                halted = true;
+                break;
+            case 0x1:   /* nop */
+                m.pc += 1;
+                break;
+            case 0x2:   /* rrmovq / cmovXX */
+                decode_registers(&m, &ra, &rb, true, true);
+                src_a = ra;
+                if (condition_holds(&m, ifun)) {
+                    m.reg[rb] = m.reg[ra];
+                }
+                m.pc += 2;
+                break;
+            case 0x3:   /* irmovq */
+                decode_registers(&m, &ra, &rb, false, true);
+                m.reg[rb] = read_quad(&m, m.pc + 2);
+                m.pc += 10;
+                break;
+            case 0x4:   /* rmmovq */
+                decode_registers(&m, &ra, &rb, true, true);
+                src_a = ra;
+                src_b = rb;
+                write_quad(&m, m.reg[rb] + read_quad(&m, m.pc + 2), m.reg[ra]);
+                m.stats.memory_writes++;
+                m.pc += 10;
+                break;
+            case 0x5:   /* mrmovq */
+                decode_registers(&m, &ra, &rb, true, true);
+                src_b = rb;
+                m.reg[ra] = read_quad(&m, m.reg[rb] + read_quad(&m, m.pc + 2));
+                m.stats.memory_reads++;
+                load = ra;
+                m.pc += 10;
+                break;
+            case 0x6:   /* OPq */
+                decode_registers(&m, &ra, &rb, true, true);
+                src_a = ra;
+                src_b = rb;
+                a = m.reg[ra];
+                b = m.reg[rb];
+                switch (ifun) {
+                    case 0:  r = b + a; m.of = ((int64_t)a < 0) == ((int64_t)b < 0) &&
+                                               ((int64_t)r < 0) != ((int64_t)a < 0); break;
+                    case 1:  r = b - a; m.of = ((int64_t)a < 0) != ((int64_t)b < 0) &&
+                                               ((int64_t)r < 0) != ((int64_t)b < 0); break;
+                    case 2:  r = b & a; m.of = false; break;
+                    case 3:  r = b ^ a; m.of = false; break;
+                    default: machine_error(&m, "invalid operation", code); r = 0; break;
+                }
+                m.reg[rb] = r;
+                m.zf = (r == 0);
+                m.sf = ((int64_t)r < 0);
+                m.pc += 2;
+                break;
+            case 0x7:   /* jXX */
+                if (condition_holds(&m, ifun)) {
+                    m.pc = read_quad(&m, m.pc + 1);
+                } else {
+                    /* PIPE always predicts taken */
+                    m.stats.mispredictions++;
+                    m.pc += 9;
+                }
+                break;
+            case 0x8:   /* call */
+                src_b = RSP;
+                val = read_quad(&m, m.pc + 1);
+                push_quad(&m, m.pc + 9);
+                m.stats.memory_writes++;
+                m.pc = val;
+                break;
+            case 0x9:   /* ret */
+                src_a = src_b = RSP;
+                m.pc = read_quad(&m, m.reg[RSP]);
+                m.reg[RSP] += 8;
+                m.stats.memory_reads++;
+                m.stats.returns++;
+                break;
+            case 0xA:   /* pushq */
+                decode_registers(&m, &ra, &rb, true, false);
+                src_a = ra;
+                src_b = RSP;
+                push_quad(&m, m.reg[ra]);
+                m.stats.memory_writes++;
+                m.pc += 2;
+                break;
+            case 0xB:   /* popq */
+                decode_registers(&m, &ra, &rb, true, false);
+                src_a = src_b = RSP;
+                addr = m.reg[RSP];
+                m.reg[RSP] += 8;
+                m.reg[ra] = read_quad(&m, addr);
+                m.stats.memory_reads++;
+                load = ra;
+                m.pc += 2;
+                break;
+            case 0xE:   /* iotrap */
+                src_a = RSI;
+                src_b = RDI;
+                io_trap(&m, ifun);
+                m.pc += 1;
+                break;
+            default:
+                machine_error(&m, "invalid instruction", code);
+        }
+
+        /* a value loaded from memory cannot be forwarded to the very next instruction */
+        if (last_load != RNONE && (src_a == last_load || src_b == last_load)) {
+            m.stats.load_use_stalls++;
+        }
+        last_load = load;
+    }
+
+    m.stats.cycles = m.stats.instructions + 4 + m.stats.load_use_stalls +
+                     2 * m.stats.mispredictions + 3 * m.stats.returns;
+    if (stats != NULL) {
+        *stats = m.stats;
+    }
+    return (long)m.reg[RAX];
+}
+
+long simulate_y86 (uint8_t* memory, FILE* output, Y86Stats* stats)
+{
+    return simulate_y86_with_stack_limit(memory, output, stats, 0);
+}
+
+long run_y86 (InsnList* iloc, Y86Layout* layout, FILE* output, Y86Stats* stats)
+{
+    /* generate assembly into a temporary file and read it back */
+    FILE* assembly = tmpfile();
+    if (assembly == NULL) {
+        printf("ERROR: Could not create temporary file for Y86 code\n");
+        exit(EXIT_FAILURE);
+    }
+    Y86Layout default_layout = Y86Layout_new(Y86_DEFAULT_STATIC_SIZE, Y86_DEFAULT_STACK_SIZE);
+    if (layout == NULL) {
+        layout = &default_layout;
+    }
+    emit_y86_with_layout(iloc, assembly, layout);
+    long size = ftell(assembly);
+    rewind(assembly);
+    char* source = (char*)malloc(size + 1);
+    CHECK_MALLOC_PTR(source);
+    size = (long)fread(source, 1, size, assembly);
+    source[size] = '\0';
+    fclose(assembly);
+
+    uint8_t* memory = assemble_y86(source);
+    free(source);
+    long value = simulate_y86_with_stack_limit(memory, output, stats,
+                                               layout->stack_addr - layout->stack_size);
+    free(memory);
+    return value;
+}
+
+void Y86Stats_print (Y86Stats* stats, FILE* output)
+{
+    fprintf(output, "Y86 instructions:        %ld\n", stats->instructions);
+    fprintf(output, "Y86 cycles (estimated):  %ld (CPI %.2f)\n", stats->cycles,
+            stats->instructions > 0 ? (double)stats->cycles / stats->instructions : 0.0);
+    fprintf(output, "  load/use stalls:       %ld\n", stats->load_use_stalls);
+    fprintf(output, "  mispredicted branches: %ld\n", stats->mispredictions);
+    fprintf(output, "  returns:               %ld\n", stats->returns);
+    fprintf(output, "  memory reads/writes:   %ld/%ld\n", stats->memory_reads, stats->memory_writes);
+}
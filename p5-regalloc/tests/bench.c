@@ -0,0 +1,829 @@
+/**
+ * @file bench.c
+ * @brief Register allocator benchmark
+ *
+ * Runs programs through @ref allocate_registers_with_stats for a range of
+ * register counts and reports the amount of spill code, the dynamic spill
+ * traffic in the ILOC simulator, and the allocation time as CSV. A previous
+ * CSV file can be given as a baseline to report what changed. With @c -x, small
+ * functions are allocated by @ref allocate_registers_optimal instead, which
+ * shows how far the usual allocation is from the best choice of dedicated
+ * registers (e.g., with a heuristic run as the baseline). With @c -s, programs
+ * are allocated by @ref allocate_registers_ssa instead.
+ *
+ * Inputs are Decaf programs (@c .decaf) or ILOC programs (@c .iloc or
+ * @c .ilocb), such as the integration test inputs. A run is correct if both
+ * its return value and its output match the program's expected result: the
+ * expected file for @c inputs/NAME.decaf (@c ../expected/NAME.txt or
+ * @c ../expected/refNAME.txt) if there is one, and otherwise a run of the
+ * program without register allocation (which is only reliable without
+ * recursion, since the simulator does not save virtual registers across
+ * calls). Every (program, register count) pair runs in a
+ * child process so that allocator or simulator failures are reported instead
+ * of ending the run.
+ *
+ * Usage: <tt>./bench [-O] [-s] [-x MAX] [-k MIN-MAX] [-n REPS] [-o FILE] [-c BASELINE] FILE...</tt>
+ */
+
+/* fork, pipes, and clock_gettime are POSIX, not C11 */
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "p1-lexer.h"
+#include "p2-parser.h"
+#include "p3-analysis.h"
+#include "p4-codegen.h"
+#include "p5-regalloc.h"
+#include "opt.h"
+#include "ilocbin.h"
+#include "ilocparse.h"
+
+jmp_buf decaf_error;
+
+void Error_throw_printf (const char* format, ...)
+{
+    longjmp(decaf_error, 1);
+}
+
+/**
+ * @brief Where a benchmark program comes from
+ */
+typedef enum BenchSource
+{
+    DECAF_SOURCE, ILOC_TEXT_FILE, ILOC_BINARY_FILE
+} BenchSource;
+
+/**
+ * @brief Program to benchmark
+ */
+typedef struct BenchProgram
+{
+    char name[MAX_LINE_LEN];    /**< @brief File name */
+    BenchSource source;         /**< @brief Kind of input */
+    char* text;                 /**< @brief Decaf code or ILOC file name */
+    bool has_expected;          /**< @brief Is the result known in advance? */
+    long expected;              /**< @brief Expected return value */
+    char* expected_output;      /**< @brief Expected output (@c NULL if not known in advance) */
+} BenchProgram;
+
+/**
+ * @brief Outcome of one allocation
+ */
+typedef enum BenchStatus
+{
+    BENCH_OK,           /**< @brief Correct return value and output */
+    BENCH_WRONG,        /**< @brief Incorrect return value or output */
+    BENCH_INVALID,      /**< @brief Unallocated or out-of-range registers remain */
+    BENCH_FAILED,       /**< @brief Allocator or simulator aborted */
+    NUM_STATUSES
+} BenchStatus;
+
+const char* status_names[] = { "ok", "wrong", "invalid", "failed" };
+
+/**
+ * @brief Measurements of one allocation (CSV columns after program, registers, and status)
+ */
+typedef enum BenchMetric
+{
+    RETURN_VALUE, STATIC_INSNS, INSERTED_INSNS, SPILL_STORES, SPILL_LOADS, STACK_SLOTS, REMATS,
+    SPILL_COST, DYNAMIC_INSNS, DYNAMIC_SPILL_STORES, DYNAMIC_SPILL_LOADS, DYNAMIC_REMATS, ALLOC_NSEC,
+    NUM_METRICS
+} BenchMetric;
+
+const char* metric_names[] = {
+    "return_value", "static_insns", "inserted_insns", "spill_stores", "spill_loads", "stack_slots", "remats",
+    "spill_cost", "dynamic_insns", "dynamic_spill_stores", "dynamic_spill_loads", "dynamic_remats", "alloc_nsec"
+};
+
+/**
+ * @brief Benchmark result (one CSV row)
+ */
+typedef struct BenchResult
+{
+    char program[MAX_LINE_LEN];
+    int registers;
+    BenchStatus status;
+    long metric[NUM_METRICS];
+} BenchResult;
+
+/**
+ * @brief Growable array of benchmark results
+ */
+typedef struct BenchResults
+{
+    BenchResult* rows;
+    int size;
+    int capacity;
+} BenchResults;
+
+void BenchResults_add (BenchResults* results, BenchResult* row)
+{
+    if (results->size == results->capacity) {
+        results->capacity = (results->capacity == 0 ? 64 : results->capacity * 2);
+        results->rows = (BenchResult*)realloc(results->rows, results->capacity * sizeof(BenchResult));
+        CHECK_MALLOC_PTR(results->rows);
+    }
+    results->rows[results->size++] = *row;
+}
+
+BenchResult* BenchResults_find (BenchResults* results, const char* program, int registers)
+{
+    for (int i = 0; i < results->size; i++) {
+        if (results->rows[i].registers == registers && strcmp(results->rows[i].program, program) == 0) {
+            return &results->rows[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Read an entire file into a new null-terminated string (or return @c NULL)
+ */
+char* read_whole_file (const char* filename, size_t* length)
+{
+    FILE* input = fopen(filename, "rb");
+    if (input == NULL) {
+        return NULL;
+    }
+    size_t capacity = 4096, size = 0, n;
+    char* text = (char*)malloc(capacity);
+    CHECK_MALLOC_PTR(text);
+    while ((n = fread(text + size, 1, capacity - size - 1, input)) > 0) {
+        size += n;
+        if (size + 1 == capacity) {
+            capacity *= 2;
+            text = (char*)realloc(text, capacity);
+            CHECK_MALLOC_PTR(text);
+        }
+    }
+    fclose(input);
+    text[size] = '\0';
+    if (length != NULL) {
+        *length = size;
+    }
+    return text;
+}
+
+bool has_suffix (const char* filename, const char* suffix)
+{
+    size_t length = strlen(filename), suffix_length = strlen(suffix);
+    return length >= suffix_length && strcmp(filename + length - suffix_length, suffix) == 0;
+}
+
+/**
+ * @brief Test whether a line of an expected output file belongs to the ILOC
+ * listing (an indented instruction or a label)
+ */
+bool is_listing_line (const char* line, size_t length)
+{
+    if (length >= 2 && line[0] == ' ' && line[1] == ' ') {
+        return true;
+    }
+    if (length < 2 || line[length - 1] != ':') {
+        return false;
+    }
+    for (size_t i = 0; i < length - 1; i++) {
+        if (!isalnum((unsigned char)line[i]) && line[i] != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Read the expected result of a Decaf input from its expected output
+ * file (@c ../expected/NAME.txt or @c ../expected/refNAME.txt relative to
+ * @c inputs/NAME.decaf)
+ *
+ * The file holds the compiler's ILOC listing, then the program's output, and
+ * finally a <tt>RETURN VALUE = N</tt> line. Files that do not have this form
+ * (e.g., simulator traces) are ignored.
+ */
+void read_expected_result (const char* filename, BenchProgram* program)
+{
+    const char* base = strrchr(filename, '/');
+    size_t dir_length = (base == NULL ? 0 : (size_t)(base - filename) + 1);
+    base = (base == NULL ? filename : base + 1);
+    const char* dot = strrchr(base, '.');
+    size_t stem_length = (dot == NULL ? strlen(base) : (size_t)(dot - base));
+    size_t path_length = dir_length + stem_length + 32;
+    char* path = (char*)malloc(path_length);
+    CHECK_MALLOC_PTR(path);
+    char* text = NULL;
+    const char* prefixes[] = { "", "ref" };
+    for (int p = 0; p < 2 && text == NULL; p++) {
+        snprintf(path, path_length, "%.*s../expected/%s%.*s.txt", (int)dir_length, filename,
+                 prefixes[p], (int)stem_length, base);
+        text = read_whole_file(path, NULL);
+    }
+    free(path);
+    if (text == NULL) {
+        return;
+    }
+
+    /* skip the listing; everything up to the return value is program output */
+    char* output = text;
+    while (*output != '\0') {
+        char* end = strchr(output, '\n');
+        size_t length = (end == NULL ? strlen(output) : (size_t)(end - output));
+        if (!is_listing_line(output, length)) {
+            break;
+        }
+        output += length + (end == NULL ? 0 : 1);
+    }
+    const char* marker = "RETURN VALUE = ";
+    char* result = NULL;
+    for (char* found = strstr(output, marker); found != NULL; found = strstr(found + 1, marker)) {
+        if (found == text || found[-1] == '\n') {
+            result = found;
+        }
+    }
+    char* end;
+    if (result != NULL) {
+        program->expected = strtol(result + strlen(marker), &end, 10);
+        if (end != result + strlen(marker) && (*end == '\n' || *end == '\0')) {
+            size_t length = (size_t)(result - output);
+            program->expected_output = (char*)malloc(length + 1);
+            CHECK_MALLOC_PTR(program->expected_output);
+            memcpy(program->expected_output, output, length);
+            program->expected_output[length] = '\0';
+            program->has_expected = true;
+        }
+    }
+    free(text);
+}
+
+/**
+ * @brief Add a Decaf or ILOC file to the program list
+ */
+void add_file (const char* filename, BenchProgram** programs, int* num_programs)
+{
+    BenchProgram program = { .has_expected = false, .expected_output = NULL };
+    const char* base = strrchr(filename, '/');
+    snprintf(program.name, MAX_LINE_LEN, "%s", base == NULL ? filename : base + 1);
+    if (has_suffix(filename, ".iloc")) {
+        program.source = ILOC_TEXT_FILE;
+        program.text = (char*)malloc(strlen(filename) + 1);
+        CHECK_MALLOC_PTR(program.text);
+        strcpy(program.text, filename);
+    } else if (has_suffix(filename, ".ilocb")) {
+        program.source = ILOC_BINARY_FILE;
+        program.text = (char*)malloc(strlen(filename) + 1);
+        CHECK_MALLOC_PTR(program.text);
+        strcpy(program.text, filename);
+    } else {
+        program.source = DECAF_SOURCE;
+        program.text = read_whole_file(filename, NULL);
+        if (program.text == NULL) {
+            fprintf(stderr, "Could not read file: %s\n", filename);
+            exit(EXIT_FAILURE);
+        }
+        read_expected_result(filename, &program);
+    }
+    *programs = (BenchProgram*)realloc(*programs, (*num_programs + 1) * sizeof(BenchProgram));
+    CHECK_MALLOC_PTR(*programs);
+    (*programs)[(*num_programs)++] = program;
+}
+
+/**
+ * @brief Produce a fresh (unallocated) ILOC version of a program
+ *
+ * @returns New instruction list or @c NULL if the program has errors
+ */
+InsnList* generate_program (BenchProgram* program, bool optimize_all)
+{
+    InsnList* iloc = NULL;
+    if (program->source == ILOC_BINARY_FILE) {
+        iloc = InsnList_load_binary(program->text, NULL);
+    } else if (program->source == ILOC_TEXT_FILE) {
+        size_t length;
+        char* text = read_whole_file(program->text, &length);
+        if (text != NULL && setjmp(decaf_error) == 0) {
+            iloc = parse_iloc(text, length);
+        }
+        free(text);
+    } else {
+        if (setjmp(decaf_error) != 0) {
+            return NULL;
+        }
+        ASTNode* tree = parse(lex(program->text));
+        NodeVisitor_traverse_and_free(SetParentVisitor_new(), tree);
+        NodeVisitor_traverse_and_free(CalcDepthVisitor_new(), tree);
+        NodeVisitor_traverse_and_free(BuildSymbolTablesVisitor_new(), tree);
+        ErrorList* errors = analyze(tree);
+        if (!ErrorList_is_empty(errors)) {
+            return NULL;
+        }
+        NodeVisitor_traverse_and_free(AllocateSymbolsVisitor_new(), tree);
+        iloc = generate_code(tree);
+    }
+    if (iloc != NULL && optimize_all) {
+        optimize(iloc, NULL);
+    }
+    return iloc;
+}
+
+InsnList* copy_program (InsnList* list)
+{
+    InsnList* copy = InsnList_new();
+    FOR_EACH (ILOCInsn*, insn, list) {
+        InsnList_add(copy, ILOCInsn_copy(insn));
+    }
+    return copy;
+}
+
+int compare_pointers (const void* a, const void* b)
+{
+    uintptr_t x = (uintptr_t)*(ILOCInsn* const*)a;
+    uintptr_t y = (uintptr_t)*(ILOCInsn* const*)b;
+    return (x > y) - (x < y);
+}
+
+long elapsed_nsec (struct timespec* start, struct timespec* end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000000000L + (end->tv_nsec - start->tv_nsec);
+}
+
+/**
+ * @brief Allocate and simulate a program (runs in a child process)
+ *
+ * With zero registers the program is simulated without allocation to find its
+ * reference return value and instruction count. Functions with at most
+ * @p max_candidates values live across blocks are allocated by exhaustive
+ * search (-1 for none). With @p ssa, every function is allocated by
+ * @ref allocate_registers_ssa instead.
+ */
+void measure (BenchProgram* program, bool optimize_all, int max_candidates, bool ssa, int registers,
+              int repetitions, long reference, BenchResult* result)
+{
+    InsnList* iloc = generate_program(program, optimize_all);
+    if (iloc == NULL) {
+        return;
+    }
+    result->status = BENCH_OK;
+
+    /* remember the original instructions (the allocator moves, but never copies, them) */
+    ILOCInsn** originals = (ILOCInsn**)calloc(iloc->size + 1, sizeof(ILOCInsn*));
+    CHECK_MALLOC_PTR(originals);
+    int num_originals = 0;
+    FOR_EACH (ILOCInsn*, insn, iloc) {
+        originals[num_originals++] = insn;
+    }
+    qsort(originals, num_originals, sizeof(ILOCInsn*), compare_pointers);
+
+    if (registers > 0) {
+        /* time several runs on copies and keep the fastest (the last run is on the original) */
+        RegAllocStats stats;
+        long best = -1;
+        for (int r = 0; r < repetitions; r++) {
+            InsnList* list = (r == repetitions - 1 ? iloc : copy_program(iloc));
+            struct timespec start, end;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            if (ssa) {
+                allocate_registers_ssa(list, registers, &stats);
+            } else if (max_candidates >= 0) {
+                allocate_registers_optimal(list, registers, max_candidates, &stats);
+            } else {
+                allocate_registers_with_stats(list, registers, &stats);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            if (best == -1 || elapsed_nsec(&start, &end) < best) {
+                best = elapsed_nsec(&start, &end);
+            }
+            if (list != iloc) {
+                InsnList_free(list);
+            }
+        }
+        result->metric[ALLOC_NSEC] = best;
+        result->metric[SPILL_STORES] = stats.spill_stores;
+        result->metric[SPILL_LOADS] = stats.spill_loads;
+        result->metric[STACK_SLOTS] = stats.stack_slots;
+        result->metric[REMATS] = stats.rematerializations;
+        result->metric[SPILL_COST] = stats.spill_cost;
+
+        /* every register must be allocated and in range */
+        FOR_EACH (ILOCInsn*, insn, iloc) {
+            for (int i = 0; i < 3; i++) {
+                if (insn->op[i].type == VIRTUAL_REG ||
+                    (insn->op[i].type == PHYSICAL_REG && insn->op[i].id >= registers)) {
+                    result->status = BENCH_INVALID;
+                }
+            }
+        }
+    }
+
+    /* classify instructions and count how often each one runs */
+    result->metric[STATIC_INSNS] = iloc->size;
+    long* counts = (long*)calloc(iloc->size + 1, sizeof(long));
+    CHECK_MALLOC_PTR(counts);
+    result->metric[RETURN_VALUE] = run_simulator_with_profile(iloc, false, counts);
+    int n = 0;
+    FOR_EACH (ILOCInsn*, insn, iloc) {
+        result->metric[DYNAMIC_INSNS] += counts[n];
+        if (bsearch(&insn, originals, num_originals, sizeof(ILOCInsn*), compare_pointers) == NULL) {
+            result->metric[INSERTED_INSNS]++;
+            if (insn->form == STORE_AI) {
+                result->metric[DYNAMIC_SPILL_STORES] += counts[n];
+            } else if (insn->form == LOAD_AI) {
+                result->metric[DYNAMIC_SPILL_LOADS] += counts[n];
+            } else if (insn->form == LOAD_I || insn->form == ADD_I) {
+                result->metric[DYNAMIC_REMATS] += counts[n];
+            }
+        }
+        n++;
+    }
+    if (registers > 0 && result->status == BENCH_OK && result->metric[RETURN_VALUE] != reference) {
+        result->status = BENCH_WRONG;
+    }
+
+    free(counts);
+    free(originals);
+    InsnList_free(iloc);
+}
+
+/**
+ * @brief Write a whole buffer to a pipe
+ */
+bool write_fully (int fd, const void* data, size_t length)
+{
+    size_t written = 0;
+    ssize_t n;
+    while (written < length && (n = write(fd, (const char*)data + written, length - written)) > 0) {
+        written += n;
+    }
+    return written == length;
+}
+
+/**
+ * @brief Read a whole buffer from a pipe
+ */
+bool read_fully (int fd, void* data, size_t length)
+{
+    size_t received = 0;
+    ssize_t n;
+    while (received < length && (n = read(fd, (char*)data + received, length - received)) > 0) {
+        received += n;
+    }
+    return received == length;
+}
+
+/**
+ * @brief Run @ref measure in a child process (so that a failure cannot end the benchmark)
+ *
+ * Everything the program writes to standard output (including simulator
+ * warnings) is captured; an allocated run whose output differs from
+ * @p reference_output (if given) is wrong.
+ *
+ * @param output Destination for the captured output (may be @c NULL; otherwise
+ * free it when done)
+ */
+void run_isolated (BenchProgram* program, bool optimize_all, int max_candidates, bool ssa, int registers,
+                   int repetitions, long reference, const char* reference_output, BenchResult* result,
+                   char** output)
+{
+    memset(result, 0, sizeof(BenchResult));
+    snprintf(result->program, MAX_LINE_LEN, "%s", program->name);
+    result->registers = registers;
+    result->status = BENCH_FAILED;
+    if (output != NULL) {
+        *output = NULL;
+    }
+
+    int channel[2];
+    if (pipe(channel) != 0) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    fflush(stdout);
+    fflush(stderr);
+    pid_t child = fork();
+    if (child < 0) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (child == 0) {
+        /* capture program output and discard allocator/simulator error messages */
+        close(channel[0]);
+        FILE* capture = tmpfile();
+        if (capture == NULL || dup2(fileno(capture), STDOUT_FILENO) < 0 ||
+                freopen("/dev/null", "w", stderr) == NULL) {
+            _exit(EXIT_FAILURE);
+        }
+        BenchResult measured = *result;
+        measure(program, optimize_all, max_candidates, ssa, registers, repetitions, reference, &measured);
+
+        fflush(stdout);
+        off_t end = lseek(fileno(capture), 0, SEEK_END);
+        size_t length = (end > 0 ? (size_t)end : 0);
+        char* text = (char*)malloc(length + 1);
+        CHECK_MALLOC_PTR(text);
+        if (pread(fileno(capture), text, length, 0) != (ssize_t)length) {
+            _exit(EXIT_FAILURE);
+        }
+        text[length] = '\0';
+        if (registers > 0 && measured.status == BENCH_OK && reference_output != NULL &&
+                strcmp(text, reference_output) != 0) {
+            measured.status = BENCH_WRONG;
+        }
+
+        bool sent = write_fully(channel[1], &measured, sizeof(BenchResult)) &&
+                    write_fully(channel[1], &length, sizeof(size_t)) &&
+                    write_fully(channel[1], text, length);
+        close(channel[1]);
+        _exit(sent ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(channel[1]);
+    BenchResult measured;
+    size_t length = 0;
+    char* text = NULL;
+    bool received = read_fully(channel[0], &measured, sizeof(BenchResult)) &&
+                    read_fully(channel[0], &length, sizeof(size_t));
+    if (received) {
+        text = (char*)malloc(length + 1);
+        CHECK_MALLOC_PTR(text);
+        received = read_fully(channel[0], text, length);
+        text[received ? length : 0] = '\0';
+    }
+    close(channel[0]);
+    int child_status;
+    waitpid(child, &child_status, 0);
+    if (received && WIFEXITED(child_status) && WEXITSTATUS(child_status) == 0) {
+        *result = measured;
+        if (output != NULL) {
+            *output = text;
+            text = NULL;
+        }
+    }
+    free(text);
+}
+
+void write_csv_header (FILE* output)
+{
+    fprintf(output, "program,registers,status");
+    for (int m = 0; m < NUM_METRICS; m++) {
+        fprintf(output, ",%s", metric_names[m]);
+    }
+    fprintf(output, "\n");
+}
+
+void write_csv_row (FILE* output, BenchResult* row)
+{
+    fprintf(output, "%s,%d,%s", row->program, row->registers, status_names[row->status]);
+    for (int m = 0; m < NUM_METRICS; m++) {
+        fprintf(output, ",%ld", row->metric[m]);
+    }
+    fprintf(output, "\n");
+}
+
+/**
+ * @brief Read a CSV file written by this program (columns are matched by name)
+ */
+void read_csv (const char* filename, BenchResults* results)
+{
+    char* text = read_whole_file(filename, NULL);
+    if (text == NULL) {
+        fprintf(stderr, "Could not read file: %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    int columns[NUM_METRICS + 3];
+    int num_columns = 0;
+    char* save = NULL;
+    for (char* line = strtok_r(text, "\r\n", &save); line != NULL; line = strtok_r(NULL, "\r\n", &save)) {
+        /* split the line into fields */
+        char* fields[NUM_METRICS + 3];
+        int num_fields = 0;
+        for (char* field = line; field != NULL && num_fields < NUM_METRICS + 3; ) {
+            fields[num_fields++] = field;
+            field = strchr(field, ',');
+            if (field != NULL) {
+                *field++ = '\0';
+            }
+        }
+
+        if (num_columns == 0) {
+            /* header: metric index of each column (-1 for program/registers/status/unknown) */
+            for (int f = 0; f < num_fields; f++) {
+                columns[f] = -1;
+                for (int m = 0; m < NUM_METRICS; m++) {
+                    if (strcmp(fields[f], metric_names[m]) == 0) {
+                        columns[f] = m;
+                    }
+                }
+            }
+            num_columns = num_fields;
+            continue;
+        }
+
+        BenchResult row = { .registers = 0 };
+        snprintf(row.program, MAX_LINE_LEN, "%s", fields[0]);
+        row.registers = (num_fields > 1 ? atoi(fields[1]) : 0);
+        row.status = BENCH_FAILED;
+        for (int s = 0; s < NUM_STATUSES && num_fields > 2; s++) {
+            if (strcmp(fields[2], status_names[s]) == 0) {
+                row.status = (BenchStatus)s;
+            }
+        }
+        for (int f = 3; f < num_fields && f < num_columns; f++) {
+            if (columns[f] != -1) {
+                row.metric[columns[f]] = strtol(fields[f], NULL, 10);
+            }
+        }
+        BenchResults_add(results, &row);
+    }
+    free(text);
+}
+
+/**
+ * @brief Print the rows whose results changed and the overall totals
+ *
+ * @returns Number of rows that were correct in the baseline but not anymore
+ */
+int compare (BenchResults* baseline, BenchResults* current, FILE* output)
+{
+    /* metrics that are compared row by row (timings are too noisy for that) */
+    const BenchMetric compared[] = {
+        INSERTED_INSNS, SPILL_STORES, SPILL_LOADS, REMATS, SPILL_COST,
+        DYNAMIC_SPILL_STORES, DYNAMIC_SPILL_LOADS, DYNAMIC_REMATS, DYNAMIC_INSNS
+    };
+    const int num_compared = (int)(sizeof(compared) / sizeof(BenchMetric));
+
+    long base_total[NUM_METRICS] = { 0 }, current_total[NUM_METRICS] = { 0 };
+    int matched = 0, regressions = 0, fixes = 0;
+    fprintf(output, "%-32s %4s  %-22s %12s %12s %9s\n",
+            "program", "regs", "metric", "baseline", "current", "change");
+    for (int i = 0; i < current->size; i++) {
+        BenchResult* now = &current->rows[i];
+        BenchResult* base = BenchResults_find(baseline, now->program, now->registers);
+        if (base == NULL) {
+            continue;
+        }
+        if (base->status != now->status) {
+            fprintf(output, "%-32s %4d  %-22s %12s %12s\n", now->program, now->registers,
+                    "status", status_names[base->status], status_names[now->status]);
+            regressions += (base->status == BENCH_OK ? 1 : 0);
+            fixes += (now->status == BENCH_OK ? 1 : 0);
+        }
+        if (base->status != BENCH_OK || now->status != BENCH_OK) {
+            continue;
+        }
+        matched++;
+        for (int c = 0; c < num_compared; c++) {
+            BenchMetric m = compared[c];
+            if (base->metric[m] != now->metric[m]) {
+                fprintf(output, "%-32s %4d  %-22s %12ld %12ld %+8.1f%%\n", now->program, now->registers,
+                        metric_names[m], base->metric[m], now->metric[m],
+                        base->metric[m] == 0 ? 100.0 :
+                        100.0 * (now->metric[m] - base->metric[m]) / base->metric[m]);
+            }
+        }
+        for (int m = 0; m < NUM_METRICS; m++) {
+            base_total[m] += base->metric[m];
+            current_total[m] += now->metric[m];
+        }
+    }
+
+    fprintf(output, "\nTotals over %d runs that are correct in both:\n", matched);
+    const BenchMetric totals[] = {
+        INSERTED_INSNS, SPILL_STORES, SPILL_LOADS, STACK_SLOTS, REMATS, SPILL_COST,
+        DYNAMIC_INSNS, DYNAMIC_SPILL_STORES, DYNAMIC_SPILL_LOADS, DYNAMIC_REMATS, ALLOC_NSEC
+    };
+    for (int t = 0; t < (int)(sizeof(totals) / sizeof(BenchMetric)); t++) {
+        BenchMetric m = totals[t];
+        fprintf(output, "  %-22s %14ld %14ld", metric_names[m], base_total[m], current_total[m]);
+        if (base_total[m] != 0) {
+            fprintf(output, " %+8.1f%%", 100.0 * (current_total[m] - base_total[m]) / base_total[m]);
+        }
+        fprintf(output, "\n");
+    }
+    fprintf(output, "Status: %d regression(s), %d fix(es)\n", regressions, fixes);
+    return regressions;
+}
+
+void usage (void)
+{
+    fprintf(stderr, "Usage: bench [-O] [-s] [-x MAX] [-k MIN-MAX] [-n REPS] [-o FILE] [-c BASELINE] FILE...\n"
+                    "  FILE         Decaf program or ILOC program (.iloc or .ilocb)\n"
+                    "  -O           optimize every program before allocation\n"
+                    "  -s           allocate with allocate_registers_ssa\n"
+                    "  -x MAX       search exhaustively in functions with at most MAX values live\n"
+                    "               across blocks (see allocate_registers_optimal)\n"
+                    "  -k MIN-MAX   range of register counts (default 2-%d)\n"
+                    "  -n REPS      allocations per measurement; the fastest is reported (default 5)\n"
+                    "  -o FILE      write CSV results to FILE (default: standard output)\n"
+                    "  -c BASELINE  compare with an earlier CSV file instead of printing CSV\n",
+            MAX_PHYSICAL_REGS);
+    exit(EXIT_FAILURE);
+}
+
+int main (int argc, char** argv)
+{
+    bool optimize_all = false;
+    int max_candidates = -1;
+    bool ssa = false;
+    int min_registers = 2, max_registers = MAX_PHYSICAL_REGS, repetitions = 5;
+    const char* output_filename = NULL;
+    const char* baseline_filename = NULL;
+    BenchProgram* programs = NULL;
+    int num_programs = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-O") == 0) {
+            optimize_all = true;
+        } else if (strcmp(argv[i], "-s") == 0) {
+            ssa = true;
+        } else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+            max_candidates = atoi(argv[++i]);
+            if (max_candidates < 0) {
+                usage();
+            }
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%d-%d", &min_registers, &max_registers) != 2 ||
+                    min_registers < 1 || max_registers > MAX_PHYSICAL_REGS || min_registers > max_registers) {
+                usage();
+            }
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            repetitions = atoi(argv[++i]);
+            if (repetitions < 1) {
+                usage();
+            }
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_filename = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            baseline_filename = argv[++i];
+        } else if (argv[i][0] == '-') {
+            usage();
+        } else {
+            add_file(argv[i], &programs, &num_programs);
+        }
+    }
+    if (num_programs == 0) {
+        usage();
+    }
+
+    FILE* csv = NULL;
+    if (output_filename != NULL) {
+        csv = fopen(output_filename, "w");
+        if (csv == NULL) {
+            fprintf(stderr, "Could not write file: %s\n", output_filename);
+            exit(EXIT_FAILURE);
+        }
+    } else if (baseline_filename == NULL) {
+        csv = stdout;
+    }
+    if (csv != NULL) {
+        write_csv_header(csv);
+    }
+
+    BenchResults results = { .size = 0 };
+    for (int p = 0; p < num_programs; p++) {
+        /* reference run without allocation */
+        BenchResult reference;
+        char* reference_output;
+        run_isolated(&programs[p], optimize_all, -1, false, 0, 1, 0, NULL, &reference, &reference_output);
+        if (reference.status == BENCH_FAILED) {
+            fprintf(stderr, "Skipping %s: could not compile or simulate it\n", programs[p].name);
+            continue;
+        }
+        long expected = (programs[p].has_expected ? programs[p].expected : reference.metric[RETURN_VALUE]);
+        const char* expected_output = (programs[p].has_expected ? programs[p].expected_output : reference_output);
+
+        for (int k = min_registers; k <= max_registers; k++) {
+            BenchResult row;
+            run_isolated(&programs[p], optimize_all, max_candidates, ssa, k, repetitions,
+                         expected, expected_output, &row, NULL);
+            if (csv != NULL) {
+                write_csv_row(csv, &row);
+                fflush(csv);
+            }
+            BenchResults_add(&results, &row);
+        }
+        free(reference_output);
+    }
+    if (csv != NULL && csv != stdout) {
+        fclose(csv);
+    }
+
+    int status = EXIT_SUCCESS;
+    if (baseline_filename != NULL) {
+        BenchResults baseline = { .size = 0 };
+        read_csv(baseline_filename, &baseline);
+        if (compare(&baseline, &results, stdout) > 0) {
+            status = EXIT_FAILURE;
+        }
+        free(baseline.rows);
+    }
+
+    for (int p = 0; p < num_programs; p++) {
+        free(programs[p].text);
+        free(programs[p].expected_output);
+    }
+    free(programs);
+    free(results.rows);
+    return status;
+}
@@ -5,6 +5,11 @@
  * This file provides a few basic sanity test cases and a location to add new tests.
  */
 
+/* mkstemp is POSIX, not C11 */
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+
 #include "testsuite.h"
 
 #ifndef SKIP_IN_DOXYGEN
@@ -51,6 +56,1097 @@ TEST_PROGRAM(B_spilled_regs, 72,
         "  return (((1+2)+(3+4))+((5+6)+(7+8)))+"
         "         (((1+2)+(3+4))+((5+6)+(7+8))); }")
 
+TEST_OPTIMIZED_PROGRAM(B_dce_unreachable, 5,
+        "def int main() { "
+        "  int a; a = 0; "
+        "  while (a < 10) { if (a == 5) { break; } a = a + 1; continue; } "
+        "  return a; }")
+
+TEST_OPTIMIZED_PROGRAM(B_dce_calls, 7,
+        "def int f(int x) { print_int(x); return x + 1; } "
+        "def int main() { f(1); return f(6); }")
+
+START_TEST (B_dce_removed_count)
+{
+    InsnList* iloc = generate_iloc(
+            "def int main() { "
+            "  while (true) { return 1; } "
+            "  return 2; }");
+    ck_assert_int_gt (eliminate_dead_code(iloc), 0);
+    ck_assert_int_eq (eliminate_dead_code(iloc), 0);
+    ck_assert_int_eq (run_allocated_iloc(iloc, DEFAULT_NUM_REGISTERS), 1);
+}
+END_TEST
+
+TEST_OPTIMIZED_PROGRAM(B_ssa_swap, 21,
+        "def int main() { "
+        "  int a; int b; int t; int i; a = 1; b = 2; i = 0; "
+        "  while (i < 3) { t = a; a = b; b = t; i = i + 1; } "
+        "  return a * 10 + b; }")
+
+TEST_OPTIMIZED_PROGRAM(B_ssa_recursion, 55,
+        "def int fib(int n) { "
+        "  if (n < 2) { return n; } "
+        "  return fib(n - 1) + fib(n - 2); } "
+        "def int main() { return fib(10); }")
+
+START_TEST (B_ssa_round_trip)
+{
+    InsnList* iloc = generate_iloc(
+            "def int main() { "
+            "  int i; int j; int s; s = 0; i = 0; "
+            "  while (i < 4) { j = 0; "
+            "    while (j < i) { if (j == 2) { s = s + 10; } else { s = s + 1; } j = j + 1; } "
+            "    i = i + 1; } "
+            "  return s; }");
+    CFGList* cfgs = CFGList_build(iloc);
+    CFG* cfg = cfgs->head;
+    ck_assert_int_eq (CFG_promote_stack_slots(cfg), 3);
+    ck_assert_int_gt (CFG_to_ssa(cfg), 0);
+    ck_assert_int_eq (CFG_from_ssa(cfg), 0);      /* every copy is coalesced */
+    CFGList_linearize(cfgs, iloc);
+    CFGList_free(cfgs);
+    FOR_EACH (ILOCInsn*, insn, iloc) {
+        ck_assert (insn->form != PHI);
+        ck_assert (insn->form != I2I || insn->op[0].type != VIRTUAL_REG ||
+                   insn->op[1].type != VIRTUAL_REG);
+    }
+    ck_assert_int_eq (run_allocated_iloc(iloc, 3), 15);
+}
+END_TEST
+
+START_TEST (B_regalloc_empty_frame)
+{
+    InsnList* iloc = generate_iloc("def int main() { int a; a = 3; return a; }");
+    optimize(iloc, NULL);
+    allocate_registers(iloc, DEFAULT_NUM_REGISTERS);
+    FOR_EACH (ILOCInsn*, insn, iloc) {
+        ck_assert (insn->form != ADD_I || insn->op[2].type != STACK_REG);
+        ck_assert (insn->form != I2I || insn->op[0].type != PHYSICAL_REG ||
+                   insn->op[1].type != PHYSICAL_REG || insn->op[0].id != insn->op[1].id);
+    }
+    ck_assert_int_eq (run_simulator(iloc, false), 3);
+}
+END_TEST
+
+TEST_OPTIMIZED_PROGRAM(B_sccp_dead_arm, 11,
+        "def int main() { "
+        "  int a; int i; a = 1; i = 0; "
+        "  while (i < 5) { if (false) { a = a * 100; } else { a = a + 2; } i = i + 1; } "
+        "  return a; }")
+
+TEST_OPTIMIZED_PROGRAM(B_sccp_dead_loop, 7,
+        "def int main() { "
+        "  int a; a = 7; "
+        "  while (a < 5) { a = a + 1; } "
+        "  return a; }")
+
+START_TEST (B_sccp_folds_branches)
+{
+    InsnList* iloc = generate_iloc(
+            "def int main() { "
+            "  int a; a = 2; "
+            "  if (a * 3 == 6) { a = a + 1; } else { a = 0; } "
+            "  if (true) { return a + 1; } else { return a - 1; } }");
+    optimize(iloc, NULL);
+    FOR_EACH (ILOCInsn*, insn, iloc) {
+        ck_assert (insn->form != CBR && insn->form != PHI);
+    }
+    ck_assert_int_eq (run_allocated_iloc(iloc, DEFAULT_NUM_REGISTERS), 4);
+}
+END_TEST
+
+TEST_OPTIMIZED_PROGRAM(B_licm_invariant_loads, 120,
+        "int g; int arr[5]; "
+        "def int main() { "
+        "  int i; int s; g = 3; arr[2] = 4; i = 0; s = 0; "
+        "  while (i < 10) { s = s + g * arr[2]; i = i + 1; } "
+        "  return s; }")
+
+TEST_OPTIMIZED_PROGRAM(B_licm_stores_in_loop, 8,
+        "int g; "
+        "def int main() { "
+        "  int i; g = 5; i = 0; "
+        "  while (i < 3) { g = g + 1; i = i + 1; } "
+        "  return g; }")
+
+START_TEST (B_licm_hoists_to_preheader)
+{
+    InsnList* iloc = generate_iloc(
+            "int g; "
+            "def int main() { "
+            "  int i; int j; int s; g = 2; s = 0; i = 0; "
+            "  while (i < 3) { j = 0; while (j < 4) { s = s + g * 5; j = j + 1; } i = i + 1; } "
+            "  return s; }");
+    CFGList* cfgs = CFGList_build(iloc);
+    CFG* cfg = cfgs->head;
+    CFG_promote_stack_slots(cfg);
+    CFG_to_ssa(cfg);
+    ck_assert_int_gt (CFG_hoist_loop_invariants(cfg), 0);
+    ck_assert_int_eq (LoopList_size(cfg->loops), 2);
+    ck_assert_int_eq (CFG_hoist_loop_invariants(cfg), 0);
+    CFG_from_ssa(cfg);
+    CFGList_linearize(cfgs, iloc);
+    CFGList_free(cfgs);
+    ck_assert_int_eq (run_allocated_iloc(iloc, DEFAULT_NUM_REGISTERS), 120);
+}
+END_TEST
+
+TEST_OPTIMIZED_PROGRAM(B_ivsr_array_sum, 9900,
+        "int nums[100]; "
+        "def int main() { "
+        "  int i; int s; i = 0; "
+        "  while (i < 100) { nums[i] = i * 2; i = i + 1; } "
+        "  s = 0; i = 0; "
+        "  while (i < 100) { s = s + nums[i]; i = i + 1; } "
+        "  return s; }")
+
+TEST_OPTIMIZED_PROGRAM(B_ivsr_nested_strided, 378,
+        "int a[20]; "
+        "def int main() { "
+        "  int i; int j; int s; i = 19; "
+        "  while (i >= 0) { a[i] = i; i = i - 1; } "
+        "  s = 0; i = 0; "
+        "  while (i < 4) { j = 0; "
+        "    while (j < 20) { s = s + a[j] * a[i]; j = j + 3; a[i] = a[i]; } "
+        "    i = i + 1; } "
+        "  return s; }")
+
+START_TEST (B_ivsr_no_multiplies_in_loop)
+{
+    InsnList* iloc = generate_iloc(
+            "int nums[50]; "
+            "def int main() { "
+            "  int i; i = 0; "
+            "  while (i < 50) { nums[i] = nums[i] + i; i = i + 1; } "
+            "  return nums[49]; }");
+    CFGList* cfgs = CFGList_build(iloc);
+    CFG* cfg = cfgs->head;
+    CFG_promote_stack_slots(cfg);
+    CFG_to_ssa(cfg);
+    CFG_propagate_constants(cfg);
+    CFG_hoist_loop_invariants(cfg);
+    ck_assert_int_eq (CFG_reduce_induction_vars(cfg), 2);
+    FOR_EACH (Loop*, loop, cfg->loops) {
+        for (int b = 0; b < cfg->num_blocks; b++) {
+            if (BitSet_contains(loop->blocks, b)) {
+                FOR_EACH (ILOCInsn*, insn, cfg->blocks[b]->insns) {
+                    ck_assert (insn->form != MULT && insn->form != MULT_I);
+                }
+            }
+        }
+    }
+    CFG_from_ssa(cfg);
+    CFGList_linearize(cfgs, iloc);
+    CFGList_free(cfgs);
+    ck_assert_int_eq (run_allocated_iloc(iloc, DEFAULT_NUM_REGISTERS), 49);
+}
+END_TEST
+
+START_TEST (B_ivsr_frame_base)
+{
+    /* the array base is BP, not virtual register r0 */
+    const char* text =
+        "main:\n"
+        "  push BP\n"
+        "  i2i SP => BP\n"
+        "  addI SP, -64 => SP\n"
+        "  loadI 4000 => r0\n"
+        "  loadI 5 => r1\n"
+        "  storeAI r1 => [BP-16]\n"
+        "  loadI 7 => r2\n"
+        "  storeAI r2 => [BP-8]\n"
+        "  loadI -2 => r3\n"
+        "  loadI 0 => r4\n"
+        "l1:\n"
+        "  loadI 0 => r9\n"
+        "  cmp_LT r3, r9 => r5\n"
+        "  cbr r5 => l2, l3\n"
+        "l2:\n"
+        "  multI r3, 8 => r6\n"
+        "  loadAO [BP+r6] => r8\n"
+        "  add r4, r8 => r4\n"
+        "  addI r3, 1 => r3\n"
+        "  jump l1\n"
+        "l3:\n"
+        "  add r0, r4 => r7\n"
+        "  i2i r7 => RET\n"
+        "  i2i BP => SP\n"
+        "  pop BP\n"
+        "  return\n";
+    InsnList* iloc = parse_iloc_text(text);
+    ck_assert_ptr_nonnull (iloc);
+    optimize(iloc, NULL);
+    ck_assert_int_eq (run_allocated_iloc(iloc, DEFAULT_NUM_REGISTERS), 4012);
+}
+END_TEST
+
+START_TEST (B_y86_mult_imm_inline)
+{
+    long factors[] = { 8, 10, -4, 1000003 };
+    InsnList* iloc = InsnList_new();
+    InsnList_add(iloc, ILOCInsn_new_1op(LABEL, call_label("main")));
+    for (int f = 0; f < 4; f++) {
+        InsnList_add(iloc, ILOCInsn_new_3op(MULT_I, physical_register(0),
+                    int_const(factors[f]), physical_register(1)));
+    }
+    InsnList_add(iloc, ILOCInsn_new_0op(RETURN));
+
+    FILE* output = tmpfile();
+    emit_y86(iloc, output);
+    rewind(output);
+    char line[256];
+    int calls = 0;
+    while (fgets(line, sizeof(line), output) != NULL) {
+        if (strstr(line, "call _builtin_mult") != NULL) {
+            calls++;
+        }
+    }
+    fclose(output);
+    InsnList_free(iloc);
+
+    /* only the large constant needs the helper routine */
+    ck_assert_int_eq (calls, 1);
+}
+END_TEST
+
+START_TEST (B_y86_mult_imm_large_power)
+{
+    /* 2^62 would be 62 doublings inline, so it goes to the helper routine */
+    long factor = 1l << 62;
+    InsnList* iloc = InsnList_new();
+    InsnList_add(iloc, ILOCInsn_new_1op(LABEL, call_label("main")));
+    InsnList_add(iloc, ILOCInsn_new_2op(LOAD_I, int_const(1), physical_register(0)));
+    InsnList_add(iloc, ILOCInsn_new_3op(MULT_I, physical_register(0),
+                int_const(factor), physical_register(1)));
+    InsnList_add(iloc, ILOCInsn_new_2op(I2I, physical_register(1), return_register()));
+    InsnList_add(iloc, ILOCInsn_new_0op(RETURN));
+
+    FILE* output = tmpfile();
+    emit_y86(iloc, output);
+    rewind(output);
+    char line[256];
+    int calls = 0, adds = 0;
+    while (fgets(line, sizeof(line), output) != NULL) {
+        calls += (strstr(line, "call _builtin_mult") != NULL ? 1 : 0);
+        adds += (strstr(line, "addq") != NULL ? 1 : 0);
+    }
+    fclose(output);
+    ck_assert_int_eq (calls, 1);
+    ck_assert_int_lt (adds, 20);
+
+    FILE* discard = tmpfile();
+    ck_assert_int_eq (run_y86(iloc, NULL, discard, NULL), factor);
+    fclose(discard);
+    InsnList_free(iloc);
+}
+END_TEST
+
+START_TEST (B_y86_peephole)
+{
+    InsnList* iloc = generate_iloc(
+            "def int main() { "
+            "  int i; int s; i = 0; s = 0; "
+            "  while (i < 10) { if (i != 4) { s = s + i; } i = i + 1; } "
+            "  return s; }");
+    optimize(iloc, NULL);
+    allocate_registers(iloc, DEFAULT_NUM_REGISTERS);
+
+    FILE* output = tmpfile();
+    emit_y86(iloc, output);
+    rewind(output);
+    char prev[256] = "", line[256];
+    int cmovs = 0;
+    while (fgets(line, sizeof(line), output) != NULL) {
+        char target[64], label[64];
+        if (strstr(line, "cmov") != NULL) {
+            cmovs++;
+        }
+        /* no jumps to the next label */
+        if (sscanf(prev, " jmp %63s", target) == 1 && sscanf(line, "%63[^:]:", label) == 1) {
+            ck_assert_str_ne (target, label);
+        }
+        strcpy(prev, line);
+    }
+    fclose(output);
+    InsnList_free(iloc);
+
+    /* both comparisons only feed branches */
+    ck_assert_int_eq (cmovs, 0);
+}
+END_TEST
+
+START_TEST (B_y86_register_file)
+{
+    InsnList* plain = generate_iloc("def int main() { int a; a = 6; return a + 8; }");
+    InsnList* io    = generate_iloc("def int main() { print_str(\"hi\"); return 0; }");
+    InsnList* mult  = generate_iloc("def int f(int a) { return a * a; } def int main() { return f(3); }");
+    ck_assert_int_eq (y86_register_file(plain).num_registers, Y86_MAX_REGISTERS);
+    ck_assert_int_eq (y86_register_file(io).num_registers, Y86_MAX_REGISTERS - 1);
+    ck_assert_int_eq (y86_register_file(mult).num_registers, Y86_MAX_REGISTERS - 3);
+    InsnList_free(plain);
+    InsnList_free(io);
+    InsnList_free(mult);
+}
+END_TEST
+
+TEST_Y86_PROGRAM(B_y86_sim_recursion, 55,
+        "def int fib(int n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); } "
+        "def int main() { return fib(10); }")
+
+TEST_Y86_PROGRAM(B_y86_sim_signed_arith, -9,
+        "def int main() { int a; a = 0 - 7; return a / 2 * 3; }")
+
+TEST_Y86_PROGRAM(B_y86_sim_deep_recursion, 45150,
+        "def int sum(int n) { if (n == 0) { return 0; } return n + sum(n - 1); } "
+        "def int main() { return sum(300); }")
+
+START_TEST (B_y86_sim_output_and_stats)
+{
+    FILE* output = tmpfile();
+    Y86Stats stats;
+    ck_assert_int_eq (run_y86_program(
+            "def int main() { print_int(42); print_str(\" done\\n\"); return 1; }",
+            output, &stats), 1);
+    rewind(output);
+    char line[64] = "";
+    ck_assert_ptr_nonnull (fgets(line, sizeof(line), output));
+    fclose(output);
+    ck_assert_str_eq (line, "42 done\n");
+
+    ck_assert_int_gt (stats.instructions, 0);
+    ck_assert_int_ge (stats.cycles, stats.instructions + 4 + 3 * stats.returns);
+    ck_assert_int_eq (stats.returns, 1);
+}
+END_TEST
+
+START_TEST (B_y86_sim_string_pool)
+{
+    /* more distinct literals than the old fixed table held, each printed twice */
+    char* text = (char*)malloc(32768);
+    int len = sprintf(text, "def int main() {");
+    for (int i = 0; i < 300; i++) {
+        len += sprintf(text + len, " print_str(\"s%d\"); print_str(\"s%d\");", i, i);
+    }
+    sprintf(text + len, " return 7; }");
+
+    FILE* output = tmpfile();
+    ck_assert_int_eq (run_y86_program(text, output, NULL), 7);
+    rewind(output);
+    char line[64] = "";
+    ck_assert_ptr_nonnull (fgets(line, 13, output));
+    fclose(output);
+    free(text);
+    ck_assert_str_eq (line, "s0s0s1s1s2s2");
+}
+END_TEST
+
+START_TEST (B_y86_long_lines)
+{
+    /* "call <name>" is longer than a fixed MAX_LINE_LEN line buffer */
+    char name[MAX_ID_LEN];
+    memset(name, 'f', MAX_ID_LEN - 2);
+    name[MAX_ID_LEN - 2] = '\0';
+    char* text = (char*)malloc(4 * MAX_ID_LEN);
+    sprintf(text, "def int %s(int x) { return x + 1; } "
+                  "def int main() { return %s(%s(5)); }", name, name, name);
+    ck_assert_int_eq (run_y86_program(text, NULL, NULL), 7);
+    free(text);
+}
+END_TEST
+
+START_TEST (B_y86_layout_static_data)
+{
+    /* 1608 bytes of globals would overlap the code in the default 0x300-byte data region */
+    InsnList* iloc = generate_iloc(
+            "int a[200]; int b; "
+            "def int main() { a[199] = 40; b = 2; return a[199] + b; }");
+    allocate_registers(iloc, y86_register_file(iloc).num_registers);
+    Y86Layout layout = Y86Layout_new(201 * WORD_SIZE, 512);
+    FILE* discard = tmpfile();
+    ck_assert_int_eq (run_y86(iloc, &layout, discard, NULL), 42);
+    fclose(discard);
+    InsnList_free(iloc);
+
+    ck_assert_int_eq (layout.code_addr, STATIC_VAR_OFFSET + 201 * WORD_SIZE);
+    ck_assert_int_gt (layout.code_size, 0);
+    ck_assert_int_ge (layout.rodata_addr, layout.code_addr + layout.code_size);
+    ck_assert_int_eq (layout.rodata_addr % WORD_SIZE, 0);
+    /* the stack budget starts right after the string table */
+    long rodata_end = layout.rodata_addr + layout.rodata_size;
+    ck_assert_int_eq (layout.stack_addr, (rodata_end + WORD_SIZE - 1) / WORD_SIZE * WORD_SIZE + 512);
+    ck_assert_int_le (layout.stack_addr, Y86_MEM_SIZE);
+}
+END_TEST
+
+START_TEST (B_writer_formatting)
+{
+    Writer* writer = Writer_new_memory();
+    Writer_int(writer, INT64_MIN);
+    Writer_putc(writer, ' ');
+    Writer_int(writer, 0);
+    Writer_printf(writer, " %ld %d 0x%lx [%-4s] %s%%", 1234567890123L, -7, 0xa00ul, "ab", "x");
+    ck_assert_str_eq (Writer_contents(writer), "-9223372036854775808 0 1234567890123 -7 0xa00 [ab  ] x%");
+
+    /* same text as the FILE-based printer */
+    InsnList* iloc = generate_iloc("def int main() { print_str(\"a\\tb\"); return -3; }");
+    Writer_reset(writer);
+    InsnList_write(iloc, writer);
+    FILE* output = tmpfile();
+    InsnList_print(iloc, output);
+    long size = ftell(output);
+    rewind(output);
+    char* expected = (char*)calloc(size + 1, 1);
+    ck_assert_int_eq (fread(expected, 1, size, output), size);
+    fclose(output);
+    ck_assert_str_eq (Writer_contents(writer), expected);
+    free(expected);
+    InsnList_free(iloc);
+    Writer_free(writer);
+}
+END_TEST
+
+START_TEST (B_iloc_binary_roundtrip)
+{
+    InsnList* iloc = generate_iloc(
+            "int g[4]; "
+            "def int f(int x) { return x * 3; } "
+            "def int main() { g[2] = f(5); print_str(\"v=\\n\"); return g[2] - 1; }");
+    /* the image is mapped by name, so give it a private temporary file */
+    char path[] = "/tmp/roundtrip-XXXXXX";
+    int fd = mkstemp(path);
+    ck_assert_int_ge (fd, 0);
+    FILE* output = fdopen(fd, "wb");
+    ck_assert_ptr_nonnull (output);
+    ck_assert (InsnList_write_binary(iloc, 4 * WORD_SIZE, output));
+    fclose(output);
+
+    /* the mapped image exposes the sections directly */
+    ILOCImage* image = ILOCImage_open(path);
+    ck_assert_ptr_nonnull (image);
+    ck_assert_int_eq (image->header->num_insns, InsnList_size(iloc));
+    ck_assert_int_eq (image->header->num_functions, 2);
+    ck_assert_int_eq (image->header->static_size, 4 * WORD_SIZE);
+    ck_assert_str_eq (ILOCImage_string(image, image->functions[1].name), "main");
+
+    /* decoding gives back the same program */
+    InsnList* copy = ILOCImage_to_insn_list(image);
+    ILOCImage_close(image);
+    Writer* expected = Writer_new_memory();
+    Writer* actual = Writer_new_memory();
+    InsnList_write(iloc, expected);
+    InsnList_write(copy, actual);
+    ck_assert_str_eq (Writer_contents(actual), Writer_contents(expected));
+    Writer_free(expected);
+    Writer_free(actual);
+    ck_assert_int_eq (run_allocated_iloc(copy, DEFAULT_NUM_REGISTERS), 14);
+    InsnList_free(copy);
+    InsnList_free(iloc);
+
+    /* read the file back to damage it */
+    FILE* input = fopen(path, "rb");
+    ck_assert_ptr_nonnull (input);
+    fseek(input, 0, SEEK_END);
+    size_t size = (size_t)ftell(input);
+    rewind(input);
+    char* bytes = (char*)malloc(size);
+    ck_assert_ptr_nonnull (bytes);
+    ck_assert_int_eq (fread(bytes, 1, size, input), size);
+    fclose(input);
+    ILOCBinaryInsn* insns = (ILOCBinaryInsn*)(bytes + sizeof(ILOCBinaryHeader));
+    int reg = 0;
+    while (insns[reg].type[0] != VIRTUAL_REG) {
+        reg++;
+    }
+
+    /* truncated files are rejected */
+    output = fopen(path, "wb");
+    fwrite(bytes, 1, size - 1, output);
+    fclose(output);
+    ck_assert_ptr_null (InsnList_load_binary(path, NULL));
+
+    /* so are register IDs that do not fit in an operand */
+    insns[reg].value[0] = (int64_t)INT32_MAX + 1;
+    output = fopen(path, "wb");
+    fwrite(bytes, 1, size, output);
+    fclose(output);
+    ck_assert_ptr_null (InsnList_load_binary(path, NULL));
+
+    /* and IDs past the limit for ILOC text, which would size tables by them */
+    insns[reg].value[0] = ILOC_MAX_PARSED_ID;
+    output = fopen(path, "wb");
+    fwrite(bytes, 1, size, output);
+    fclose(output);
+    InsnList* largest = InsnList_load_binary(path, NULL);
+    ck_assert_ptr_nonnull (largest);
+    InsnList_free(largest);
+    insns[reg].value[0] = ILOC_MAX_PARSED_ID + 1;
+    output = fopen(path, "wb");
+    fwrite(bytes, 1, size, output);
+    fclose(output);
+    ck_assert_ptr_null (InsnList_load_binary(path, NULL));
+    insns[reg].value[0] = 0;
+    int label = 0;
+    while (insns[label].type[0] != JUMP_LABEL) {
+        label++;
+    }
+    int64_t label_id = insns[label].value[0];
+    insns[label].value[0] = ILOC_MAX_PARSED_ID + 1;
+    output = fopen(path, "wb");
+    fwrite(bytes, 1, size, output);
+    fclose(output);
+    ck_assert_ptr_null (InsnList_load_binary(path, NULL));
+    insns[label].value[0] = label_id;
+
+    /* and physical registers that do not exist */
+    insns[reg].type[0] = PHYSICAL_REG;
+    insns[reg].value[0] = MAX_PHYSICAL_REGS;
+    output = fopen(path, "wb");
+    fwrite(bytes, 1, size, output);
+    fclose(output);
+    ck_assert_ptr_null (InsnList_load_binary(path, NULL));
+    free(bytes);
+    remove(path);
+}
+END_TEST
+
+START_TEST (B_iloc_text_roundtrip)
+{
+    InsnList* iloc = generate_iloc(
+            "int g[4]; "
+            "def int f(int x) { return x * 3 - 20; } "
+            "def int main() { g[2] = f(5); print_str(\"q\\\"\\\\\\n\"); return g[2] - 1; }");
+    Writer* expected = Writer_new_memory();
+    InsnList_write(iloc, expected);
+
+    /* parsing the printed program gives back the same program */
+    const char* text = Writer_contents(expected);
+    InsnList* copy = parse_iloc_text(text);
+    ck_assert_ptr_nonnull (copy);
+    Writer* actual = Writer_new_memory();
+    InsnList_write(copy, actual);
+    ck_assert_str_eq (Writer_contents(actual), text);
+    ck_assert_int_eq (run_allocated_iloc(copy, DEFAULT_NUM_REGISTERS), -6);
+    Writer_free(expected);
+    Writer_free(actual);
+    InsnList_free(copy);
+    InsnList_free(iloc);
+
+    /* malformed text and out-of-range numbers are reported through the error handler */
+    const char* malformed[] = {
+        "main:\n  loadI 5 =>\n",
+        "main:\n  loadI 1 => r4294967301\n",
+        "main:\n  loadI 1 => r300000000\n",
+        "main:\n  loadI 1 => R32\n",
+        "main:\n  jump l2147483648\n",
+    };
+    for (int i = 0; i < 5; i++) {
+        ck_assert_ptr_null (parse_iloc_text(malformed[i]));
+    }
+}
+END_TEST
+
+START_TEST (B_regalloc_stats_and_profile)
+{
+    /* every inserted spill and reload is counted */
+    RegAllocStats stats;
+    InsnList* iloc = generate_iloc(
+            "def int main() { "
+            "  return (((1+2)+(3+4))+((5+6)+(7+8)))+"
+            "         (((1+2)+(3+4))+((5+6)+(7+8))); }");
+    allocate_registers_with_stats(iloc, 3, &stats);
+    int stores = 0, loads = 0;
+    FOR_EACH (ILOCInsn*, insn, iloc) {
+        stores += (insn->form == STORE_AI ? 1 : 0);
+        loads += (insn->form == LOAD_AI ? 1 : 0);
+    }
+    ck_assert_int_gt (stats.spill_stores, 0);
+    ck_assert_int_eq (stats.spill_stores, stores);
+    ck_assert_int_eq (stats.spill_loads, loads);
+    ck_assert_int_gt (stats.stack_slots, 0);
+    ck_assert_int_eq (run_simulator(iloc, false), 72);
+    InsnList_free(iloc);
+
+    /* the loop condition is checked eleven times (and nothing runs more often) */
+    iloc = generate_iloc(
+            "def int main() { "
+            "  int a; a = 0; "
+            "  while (a < 10) { a = a + 1; } "
+            "  return a; }");
+    long counts[iloc->size];
+    ck_assert_int_eq (run_simulator_with_profile(iloc, false, counts), 10);
+    long most = 0;
+    for (int i = 0; i < iloc->size; i++) {
+        most = (counts[i] > most ? counts[i] : most);
+    }
+    ck_assert_int_eq (counts[0], 0);
+    ck_assert_int_eq (most, 11);
+    InsnList_free(iloc);
+}
+END_TEST
+
+START_TEST (B_regalloc_remat_constants)
+{
+    /* the constant is dropped under pressure and recomputed instead of spilled */
+    const char* text =
+        "main:\n"
+        "  loadI 7 => r1\n"
+        "  loadI 1 => r2\n"
+        "  loadI 2 => r3\n"
+        "  add r2, r3 => r4\n"
+        "  add r4, r1 => r5\n"
+        "  i2i r5 => RET\n"
+        "  return\n";
+    InsnList* iloc = parse_iloc_text(text);
+    ck_assert_ptr_nonnull (iloc);
+    RegAllocStats stats;
+    allocate_registers_with_stats(iloc, 2, &stats);
+    ck_assert_int_eq (stats.spill_stores, 0);
+    ck_assert_int_eq (stats.spill_loads, 0);
+    ck_assert_int_eq (stats.rematerializations, 1);
+    ck_assert_int_eq (run_simulator(iloc, false), 10);
+    InsnList_free(iloc);
+}
+END_TEST
+
+START_TEST (B_regalloc_stack_slot_reuse)
+{
+    /* six statements spill, but never more than a few values at once */
+    RegAllocStats stats;
+    InsnList* iloc = generate_iloc(
+            "def int main() { int a; a = 0; "
+            "  a = a + (((1+2)+(3+4))+((5+6)+(7+8))); "
+            "  a = a + (((1+2)+(3+4))+((5+6)+(7+8))); "
+            "  a = a + (((1+2)+(3+4))+((5+6)+(7+8))); "
+            "  a = a + (((1+2)+(3+4))+((5+6)+(7+8))); "
+            "  a = a + (((1+2)+(3+4))+((5+6)+(7+8))); "
+            "  a = a + (((1+2)+(3+4))+((5+6)+(7+8))); "
+            "  return a; }");
+    allocate_registers_with_stats(iloc, 2, &stats);
+    ck_assert_int_ge (stats.spill_stores, 18);
+    ck_assert_int_le (stats.stack_slots, 3);
+
+    /* the frame holds the local variable plus the shared slots */
+    long frame_size = 0;
+    FOR_EACH (ILOCInsn*, insn, iloc) {
+        if (insn->form == ADD_I && insn->op[0].type == STACK_REG && frame_size == 0) {
+            frame_size = -insn->op[1].imm;
+        }
+    }
+    ck_assert_int_eq (frame_size, WORD_SIZE * (1 + stats.stack_slots));
+    ck_assert_int_eq (run_simulator(iloc, false), 216);
+    InsnList_free(iloc);
+}
+END_TEST
+
+START_TEST (B_regalloc_clean_reload)
+{
+    /* r1 is evicted twice but only stored the first time (after that, its
+     * register still matches its stack slot) */
+    const char* text =
+        "main:\n"
+        "  push BP\n"
+        "  i2i SP => BP\n"
+        "  addI SP, -8 => SP\n"
+        "  loadI 2 => r0\n"
+        "  loadI 3 => r9\n"
+        "  add r0, r9 => r1\n"
+        "  loadI 10 => r2\n"
+        "  loadI 20 => r3\n"
+        "  add r2, r3 => r4\n"
+        "  add r4, r1 => r5\n"
+        "  loadI 1 => r6\n"
+        "  loadI 2 => r7\n"
+        "  add r6, r7 => r8\n"
+        "  add r8, r1 => r10\n"
+        "  add r10, r5 => r11\n"
+        "  i2i r11 => RET\n"
+        "  i2i BP => SP\n"
+        "  pop BP\n"
+        "  return\n";
+    InsnList* iloc = parse_iloc_text(text);
+    ck_assert_ptr_nonnull (iloc);
+    RegAllocStats stats;
+    allocate_registers_with_stats(iloc, 2, &stats);
+    ck_assert_int_gt (stats.spill_stores, 0);
+    ck_assert_int_lt (stats.spill_stores, stats.spill_loads);
+    ck_assert_int_eq (run_simulator(iloc, false), 43);
+    InsnList_free(iloc);
+}
+END_TEST
+
+START_TEST (B_regalloc_update_in_place)
+{
+    /* the loop counter is reloaded and then updated in the same register, so
+     * the register no longer matches its slot and must be written back */
+    const char* text =
+        "main:\n"
+        "  push BP\n"
+        "  i2i SP => BP\n"
+        "  addI SP, -8 => SP\n"
+        "  loadI 1 => r0\n"
+        "  loadI 2 => r1\n"
+        "  loadI 0 => r2\n"
+        "l0:\n"
+        "  add r0, r1 => r3\n"
+        "  addI r2, 1 => r2\n"
+        "  loadI 3 => r4\n"
+        "  cmp_LT r2, r4 => r5\n"
+        "  cbr r5 => l0, l1\n"
+        "l1:\n"
+        "  loadI 0 => r2\n"
+        "  add r3, r2 => r6\n"
+        "  i2i r6 => RET\n"
+        "  i2i BP => SP\n"
+        "  pop BP\n"
+        "  return\n";
+    for (int k = 2; k <= 4; k++) {
+        InsnList* iloc = parse_iloc_text(text);
+        ck_assert_ptr_nonnull (iloc);
+        ck_assert_int_eq (run_allocated_iloc(iloc, k), 3);
+        InsnList_free(iloc);
+    }
+}
+END_TEST
+
+START_TEST (B_regalloc_call_saves)
+{
+    /* each value is saved once before the first call it is live across and
+     * reloaded once, at its first use */
+    const char* text =
+        "f:\n"
+        "  loadI 1 => r20\n"
+        "  i2i r20 => RET\n"
+        "  return\n"
+        "main:\n"
+        "  push BP\n"
+        "  i2i SP => BP\n"
+        "  addI SP, -8 => SP\n"
+        "  loadI 2 => r0\n"
+        "  loadI 3 => r9\n"
+        "  add r0, r9 => r1\n"
+        "  call f\n"
+        "  i2i RET => r2\n"
+        "  call f\n"
+        "  i2i RET => r3\n"
+        "  add r2, r3 => r4\n"
+        "  add r4, r1 => r5\n"
+        "  i2i r5 => RET\n"
+        "  i2i BP => SP\n"
+        "  pop BP\n"
+        "  return\n";
+    InsnList* iloc = parse_iloc_text(text);
+    ck_assert_ptr_nonnull (iloc);
+    RegAllocStats stats;
+    allocate_registers_with_stats(iloc, 4, &stats);
+    ck_assert_int_eq (stats.spill_stores, 2);
+    ck_assert_int_eq (stats.spill_loads, 2);
+    ck_assert_int_eq (run_simulator(iloc, false), 7);
+    InsnList_free(iloc);
+
+    /* pinned loop invariants are restored lazily after calls */
+    iloc = generate_iloc(
+            "def int f(int x) { return x + 1; } "
+            "def int main() { int i; int s; int a; int b; "
+            "  a = 3; b = 4; s = 0; i = 0; "
+            "  while (i < 10) { s = s + f(i); s = s + f(s); s = s + a * b; i = i + 1; } "
+            "  return s; }");
+    optimize(iloc, NULL);
+    ck_assert_int_eq (run_allocated_iloc(iloc, 6), 17371);
+    InsnList_free(iloc);
+}
+END_TEST
+
+START_TEST (B_regalloc_callee_saved)
+{
+    /* n and s are live across both calls in the loop; f is a leaf */
+    char* text =
+        "def int f(int x) { return x + 1; } "
+        "def int g(int n) { int i; int s; s = 0; i = 0; "
+        "  while (i < n) { s = s + f(i); s = s + f(s); i = i + 1; } "
+        "  return s; } "
+        "def int main() { return g(10); }";
+    RegAllocStats caller_stats, callee_stats;
+    InsnList* iloc = generate_iloc(text);
+    optimize(iloc, NULL);
+    allocate_registers_with_stats(iloc, 6, &caller_stats);
+    ck_assert_int_eq (run_simulator(iloc, false), 5095);
+    InsnList_free(iloc);
+
+    iloc = generate_iloc(text);
+    optimize(iloc, NULL);
+    CallingConvention convention = CallingConvention_new(6, 3);
+    allocate_registers_with_convention(iloc, &convention, &callee_stats);
+    ck_assert_int_eq (run_simulator(iloc, false), 5095);
+    ck_assert_int_lt (callee_stats.spill_loads, caller_stats.spill_loads);
+
+    /* only g keeps values in callee-saved registers (f is a leaf and main is
+     * the entry point) */
+    ck_assert_int_gt (callee_stats.callee_saved_registers, 0);
+    ck_assert_int_eq (caller_stats.callee_saved_registers, 0);
+    InsnList_free(iloc);
+}
+END_TEST
+
+/**
+ * @brief Run ILOC text in the simulator and report whether it warned about an
+ * uninitialized register (simulator messages go to stdout)
+ */
+bool simulator_warns_uninitialized (const char* text)
+{
+    InsnList* iloc = parse_iloc_text(text);
+    ck_assert_ptr_nonnull (iloc);
+    FILE* capture = tmpfile();
+    ck_assert_ptr_nonnull (capture);
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    dup2(fileno(capture), STDOUT_FILENO);
+    run_simulator(iloc, false);
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    InsnList_free(iloc);
+
+    char line[MAX_LINE_LEN];
+    bool warned = false;
+    rewind(capture);
+    while (fgets(line, sizeof(line), capture) != NULL) {
+        if (strstr(line, "uninitialized read") != NULL) {
+            warned = true;
+        }
+    }
+    fclose(capture);
+    return warned;
+}
+
+START_TEST (B_iloc_sim_uninit_spill)
+{
+    /* spilling a register that was never written is still reported */
+    ck_assert (simulator_warns_uninitialized(
+            "main:\n  push BP\n  i2i SP => BP\n  addI SP, -8 => SP\n"
+            "  storeAI R1 => [BP-8]\n"
+            "  loadI 0 => RET\n  i2i BP => SP\n  pop BP\n  return\n"));
+
+    /* only a marked prologue save of a callee-saved register is exempt */
+    ck_assert (!simulator_warns_uninitialized(
+            "main:\n  push BP\n  i2i SP => BP\n  addI SP, -8 => SP\n"
+            "  storeAI R1 => [BP-8]  ; " CALLEE_SAVE_COMMENT "\n"
+            "  loadI 0 => RET\n  i2i BP => SP\n  pop BP\n  return\n"));
+}
+END_TEST
+
+TEST_Y86_PROGRAM(B_y86_callee_saved_loop, 5095,
+        "def int f(int x) { return x + 1; } "
+        "def int g(int n) { int i; int s; s = 0; i = 0; "
+        "  while (i < n) { s = s + f(i); s = s + f(s); i = i + 1; } "
+        "  return s; } "
+        "def int main() { return g(10); }")
+
+START_TEST (B_regalloc_loop_carried_pinned)
+{
+    /* the induction variables and the sum are written in the loops, but with
+     * enough registers they never go through the stack */
+    char* text =
+        "def int main() { int i; int j; int s; s = 0; i = 0; "
+        "  while (i < 10) { j = 0; "
+        "    while (j < i) { s = s + j; j = j + 1; } "
+        "    i = i + 1; } "
+        "  return s; }";
+    RegAllocStats stats;
+    InsnList* iloc = generate_iloc(text);
+    optimize(iloc, NULL);
+    allocate_registers_with_stats(iloc, 8, &stats);
+    ck_assert_int_eq (run_simulator(iloc, false), 120);
+    ck_assert_int_eq (stats.spill_stores, 0);
+    ck_assert_int_eq (stats.spill_loads, 0);
+    InsnList_free(iloc);
+}
+END_TEST
+
+START_TEST (B_regalloc_redefined_before_call)
+{
+    /* the loop values are only defined after the recursive call, so they must
+     * not be saved before it (their slots may be shared with len, which is
+     * live across the call) */
+    char* text =
+        "int nums[5]; "
+        "def void sort(int len) { int temp; if (len < 1) { return; } "
+        "  sort(len - 1); "
+        "  while (len >= 1 && nums[len] < nums[len - 1]) { "
+        "    temp = nums[len]; nums[len] = nums[len - 1]; nums[len - 1] = temp; "
+        "    len = len - 1; } } "
+        "def int main() { nums[0] = 5; nums[1] = 3; nums[2] = 8; nums[3] = 1; nums[4] = 4; "
+        "  sort(4); "
+        "  return nums[0] * 10000 + nums[1] * 1000 + nums[2] * 100 + nums[3] * 10 + nums[4]; }";
+    for (int k = 4; k <= 8; k++) {
+        InsnList* iloc = generate_iloc(text);
+        optimize(iloc, NULL);
+        allocate_registers(iloc, k);
+        ck_assert_int_eq (run_simulator(iloc, false), 13458);
+        InsnList_free(iloc);
+    }
+}
+END_TEST
+
+/**
+ * @brief Program with a busy loop followed by a light one (returns 9610)
+ */
+static char* two_loop_program =
+        "def int main() { int i; int a; int b; int c; int d; int s; int t; "
+        "  a = 1; b = 2; c = 3; d = 4; s = 0; t = 0; i = 0; "
+        "  while (i < 20) { s = s + a * b + c * d + i; i = i + 1; } "
+        "  i = 0; "
+        "  while (i < 20) { t = t + s + a; a = a + 1; i = i + 1; } "
+        "  return t; }";
+
+START_TEST (B_regalloc_split_at_loops)
+{
+    /* a and s are live through the busy first loop but only needed in registers
+     * in the second one, so their ranges are split at its boundaries */
+    for (int k = 4; k <= 6; k++) {
+        InsnList* iloc = generate_iloc(two_loop_program);
+        optimize(iloc, NULL);
+        RegAllocStats stats;
+        allocate_registers_with_stats(iloc, k, &stats);
+        ck_assert_int_gt (stats.live_range_splits, 0);
+        ck_assert_int_eq (run_simulator(iloc, false), 9610);
+        InsnList_free(iloc);
+    }
+}
+END_TEST
+
+START_TEST (B_regalloc_optimal_baseline)
+{
+    /* the exhaustive search tries the usual choice of pinned values too, so it
+     * can only find cheaper spill code */
+    for (int k = 4; k <= 6; k++) {
+        InsnList* iloc = generate_iloc(two_loop_program);
+        optimize(iloc, NULL);
+        RegAllocStats stats;
+        allocate_registers_with_stats(iloc, k, &stats);
+        InsnList_free(iloc);
+
+        iloc = generate_iloc(two_loop_program);
+        optimize(iloc, NULL);
+        RegAllocStats optimal_stats;
+        allocate_registers_optimal(iloc, k, 12, &optimal_stats);
+        ck_assert_int_eq (optimal_stats.optimal_functions, 1);
+        ck_assert_int_le (optimal_stats.spill_cost, stats.spill_cost);
+        ck_assert_int_eq (run_simulator(iloc, false), 9610);
+        InsnList_free(iloc);
+    }
+}
+END_TEST
+
+START_TEST (B_regalloc_ssa)
+{
+    /* the loop swaps values (a cycle of PHI copies) and calls a function */
+    char* text =
+        "def int sq(int x) { return x * x; } "
+        "def int main() { int a; int b; int t; int i; int s; "
+        "  a = 0; b = 1; i = 0; s = 0; "
+        "  while (i < 20) { t = a + b; a = b; b = t; s = s + sq(i) + a; i = i + 1; } "
+        "  return s + a; }";
+    for (int k = 2; k <= 8; k++) {
+        InsnList* iloc = generate_iloc(text);
+        optimize(iloc, NULL);
+        RegAllocStats stats;
+        allocate_registers_ssa(iloc, k, &stats);
+        FOR_EACH (ILOCInsn*, insn, iloc) {
+            ck_assert_int_ne (insn->form, PHI);
+            for (int i = 0; i < 3; i++) {
+                ck_assert_int_ne (insn->op[i].type, VIRTUAL_REG);
+                ck_assert (insn->op[i].type != PHYSICAL_REG || insn->op[i].id < k);
+            }
+        }
+        ck_assert_int_eq (run_simulator(iloc, false), 26945);
+        InsnList_free(iloc);
+    }
+}
+END_TEST
+
+/**
+ * @brief Program where r1 and r2 are both live out of the first block, but r1
+ * is read first on both branches (returns 33)
+ */
+static const char* branch_next_use_program =
+        "main:\n"
+        "  push BP\n"
+        "  i2i SP => BP\n"
+        "  addI SP, -16 => SP\n"
+        "  loadI 5 => r8\n"
+        "  storeAI r8 => [BP-8]\n"
+        "  loadI 7 => r9\n"
+        "  storeAI r9 => [BP-16]\n"
+        "  loadAI [BP-8] => r2\n"
+        "  loadAI [BP-16] => r1\n"
+        "  loadI 1 => r3\n"
+        "  cbr r3 => l1, l2\n"
+        "l1:\n"
+        "  add r1, r1 => r4\n"
+        "  add r4, r1 => r5\n"
+        "  add r5, r1 => r6\n"
+        "  add r6, r2 => r7\n"
+        "  jump l3\n"
+        "l2:\n"
+        "  add r1, r1 => r7\n"
+        "  jump l4\n"
+        "l3:\n"
+        "  i2i r7 => RET\n"
+        "  i2i BP => SP\n"
+        "  pop BP\n"
+        "  return\n"
+        "l4:\n"
+        "  add r7, r2 => r7\n"
+        "  jump l3\n";
+
+START_TEST (B_regalloc_branch_next_use)
+{
+    /* the distances continue past the branch, so r2 (loaded from BP-8) is the
+     * one evicted for r3, and r1 (loaded from BP-16) stays in its register */
+    InsnList* iloc = parse_iloc_text(branch_next_use_program);
+    ck_assert_ptr_nonnull (iloc);
+    RegAllocStats stats;
+    allocate_registers_with_stats(iloc, 2, &stats);
+    int r1_reg = -1, r2_reg = -1, r3_reg = -1;
+    int evicted_reg = -1;
+    ILOCInsn* prev = NULL;
+    FOR_EACH (ILOCInsn*, insn, iloc) {
+        if (insn->form == LOAD_AI && insn->op[0].type == BASE_REG && insn->op[1].imm == -8) {
+            r2_reg = insn->op[2].id;
+        }
+        if (insn->form == LOAD_AI && insn->op[0].type == BASE_REG && insn->op[1].imm == -16) {
+            r1_reg = insn->op[2].id;
+        }
+        if (insn->form == LOAD_I && insn->op[0].imm == 1 && r3_reg == -1) {
+            r3_reg = insn->op[1].id;
+            evicted_reg = (prev->form == STORE_AI ? prev->op[0].id : -1);
+        }
+        prev = insn;
+    }
+    ck_assert_int_ne (r2_reg, -1);
+    ck_assert_int_eq (evicted_reg, r2_reg);
+    ck_assert_int_eq (r3_reg, r2_reg);
+    ck_assert_int_ne (r3_reg, r1_reg);
+    ck_assert_int_eq (run_simulator(iloc, false), 33);
+    InsnList_free(iloc);
+}
+END_TEST
+
+START_TEST (B_regalloc_ssa_branch_next_use)
+{
+    /* the SSA allocator measures the same distances when it spills */
+    InsnList* iloc = parse_iloc_text(branch_next_use_program);
+    ck_assert_ptr_nonnull (iloc);
+    RegAllocStats stats;
+    allocate_registers_ssa(iloc, 2, &stats);
+    ck_assert_int_eq (stats.spill_stores, 1);
+    ck_assert_int_eq (stats.spill_loads, 2);
+    ck_assert_int_eq (run_simulator(iloc, false), 33);
+    InsnList_free(iloc);
+}
+END_TEST
+
 #endif
 
 /**
@@ -77,6 +1173,54 @@ void public_tests (Suite *s)
     TEST(B_func_call);
     TEST(B_spilled_regs);
 
+    TEST(B_dce_unreachable);
+    TEST(B_dce_calls);
+    TEST(B_dce_removed_count);
+    TEST(B_ssa_swap);
+    TEST(B_ssa_recursion);
+    TEST(B_ssa_round_trip);
+    TEST(B_regalloc_empty_frame);
+    TEST(B_sccp_dead_arm);
+    TEST(B_sccp_dead_loop);
+    TEST(B_sccp_folds_branches);
+    TEST(B_licm_invariant_loads);
+    TEST(B_licm_stores_in_loop);
+    TEST(B_licm_hoists_to_preheader);
+    TEST(B_ivsr_array_sum);
+    TEST(B_ivsr_nested_strided);
+    TEST(B_ivsr_no_multiplies_in_loop);
+    TEST(B_ivsr_frame_base);
+    TEST(B_y86_mult_imm_inline);
+    TEST(B_y86_mult_imm_large_power);
+    TEST(B_y86_peephole);
+    TEST(B_y86_register_file);
+    TEST(B_y86_sim_recursion);
+    TEST(B_y86_sim_signed_arith);
+    TEST(B_y86_sim_deep_recursion);
+    TEST(B_y86_sim_output_and_stats);
+    TEST(B_y86_sim_string_pool);
+    TEST(B_y86_long_lines);
+    TEST(B_y86_layout_static_data);
+    TEST(B_writer_formatting);
+    TEST(B_iloc_binary_roundtrip);
+    TEST(B_iloc_text_roundtrip);
+    TEST(B_regalloc_stats_and_profile);
+    TEST(B_regalloc_remat_constants);
+    TEST(B_regalloc_stack_slot_reuse);
+    TEST(B_regalloc_clean_reload);
+    TEST(B_regalloc_update_in_place);
+    TEST(B_regalloc_call_saves);
+    TEST(B_regalloc_callee_saved);
+    TEST(B_iloc_sim_uninit_spill);
+    TEST(B_y86_callee_saved_loop);
+    TEST(B_regalloc_loop_carried_pinned);
+    TEST(B_regalloc_redefined_before_call);
+    TEST(B_regalloc_split_at_loops);
+    TEST(B_regalloc_optimal_baseline);
+    TEST(B_regalloc_ssa);
+    TEST(B_regalloc_branch_next_use);
+    TEST(B_regalloc_ssa_branch_next_use);
+
     suite_add_tcase (s, tc);
 }
 
@@ -12,26 +12,39 @@ long run_program (char* text)
     return run_program_with_allocation(text, DEFAULT_NUM_REGISTERS);
 }
 
-long run_program_with_allocation (char* text, int num_registers)
+InsnList* generate_iloc (char* text)
 {
     ASTNode* tree = NULL;
     if (setjmp(decaf_error) == 0) {
         /* no error */
         tree = parse(lex(text));
     } else {
-        /* parsing error; return code */
-        return ERROR_RETURN_CODE;
+        /* parsing error */
+        return NULL;
     }
     NodeVisitor_traverse_and_free(SetParentVisitor_new(), tree);
     NodeVisitor_traverse_and_free(CalcDepthVisitor_new(), tree);
     NodeVisitor_traverse_and_free(BuildSymbolTablesVisitor_new(), tree);
     ErrorList* errors = analyze(tree);
     if (!ErrorList_is_empty(errors)) {
-        /* static analysis error; return code */
-        return ERROR_RETURN_CODE;
+        /* static analysis error */
+        return NULL;
     }
     NodeVisitor_traverse_and_free(AllocateSymbolsVisitor_new(), tree);
-    InsnList* iloc = generate_code(tree);
+    return generate_code(tree);
+}
+
+InsnList* parse_iloc_text (const char* text)
+{
+    InsnList* iloc = NULL;
+    if (setjmp(decaf_error) == 0) {
+        iloc = parse_iloc(text, strlen(text));
+    }
+    return iloc;
+}
+
+long run_allocated_iloc (InsnList* iloc, int num_registers)
+{
     allocate_registers(iloc, num_registers);
     FOR_EACH (ILOCInsn*, insn, iloc) {
         for (int i = 0; i < 3; i++) {
@@ -45,6 +58,42 @@ long run_program_with_allocation (char* text, int num_registers)
     return run_simulator(iloc, false);
 }
 
+long run_program_with_allocation (char* text, int num_registers)
+{
+    InsnList* iloc = generate_iloc(text);
+    if (iloc == NULL) {
+        return ERROR_RETURN_CODE;
+    }
+    return run_allocated_iloc(iloc, num_registers);
+}
+
+long run_optimized_program (char* text)
+{
+    InsnList* iloc = generate_iloc(text);
+    if (iloc == NULL) {
+        return ERROR_RETURN_CODE;
+    }
+    optimize(iloc, NULL);
+    return run_allocated_iloc(iloc, DEFAULT_NUM_REGISTERS);
+}
+
+long run_y86_program (char* text, FILE* output, Y86Stats* stats)
+{
+    InsnList* iloc = generate_iloc(text);
+    if (iloc == NULL) {
+        return ERROR_RETURN_CODE;
+    }
+    CallingConvention convention = y86_calling_convention(iloc);
+    allocate_registers_with_convention(iloc, &convention, NULL);
+    FILE* discard = (output == NULL ? tmpfile() : NULL);
+    long value = run_y86(iloc, NULL, (output == NULL ? discard : output), stats);
+    if (discard != NULL) {
+        fclose(discard);
+    }
+    InsnList_free(iloc);
+    return value;
+}
+
 long run_main(char* text)
 {
     char code[MAX_FILE_SIZE+128];
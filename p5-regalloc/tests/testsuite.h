@@ -17,6 +17,16 @@
 #include "p3-analysis.h"
 #include "p4-codegen.h"
 #include "p5-regalloc.h"
+#include "opt.h"
+#include "y86.h"
+#include "y86sim.h"
+#include "ilocbin.h"
+#include "ilocparse.h"
+
+/**
+ * @brief Error handler target for @ref Error_throw_printf (defined in testsuite.c)
+ */
+extern jmp_buf decaf_error;
 
 /**
  * @brief Number of physical registers for most tests
@@ -42,6 +52,20 @@ END_TEST
 { ck_assert_int_eq (run_program_with_allocation(TEXT, NREGS), RVAL); } \
 END_TEST
 
+/**
+ * @brief Define a test case with an entire program that is optimized before register allocation
+ */
+#define TEST_OPTIMIZED_PROGRAM(NAME,RVAL,TEXT) START_TEST (NAME) \
+{ ck_assert_int_eq (run_optimized_program(TEXT), RVAL); } \
+END_TEST
+
+/**
+ * @brief Define a test case with an entire program that is compiled to Y86 and simulated
+ */
+#define TEST_Y86_PROGRAM(NAME,RVAL,TEXT) START_TEST (NAME) \
+{ ck_assert_int_eq (run_y86_program(TEXT, NULL, NULL), RVAL); } \
+END_TEST
+
 /**
  * @brief Define a test case with only a 'main' function
  */
@@ -82,6 +106,31 @@ END_TEST
  */
 #define TEST(NAME) tcase_add_test (tc, NAME)
 
+/**
+ * @brief Run lexer, parser, analysis, and code generation on given program
+ *
+ * @param text Code to lex, parse, analyze, and generate
+ * @returns Generated ILOC program or @c NULL if there was an error
+ */
+InsnList* generate_iloc (char* text);
+
+/**
+ * @brief Run the ILOC text parser on given code
+ *
+ * @param text ILOC code to parse
+ * @returns Parsed ILOC program or @c NULL if there was an error
+ */
+InsnList* parse_iloc_text (const char* text);
+
+/**
+ * @brief Run register allocation and the simulator on a generated ILOC program
+ *
+ * @param iloc ILOC program (modified in place)
+ * @param num_registers Number of physical registers
+ * @returns Return value or @c ERROR_RETURN_CODE if there was an error
+ */
+long run_allocated_iloc (InsnList* iloc, int num_registers);
+
 /**
  * @brief Run lexer, parser, analysis, code generation, and register allocation on given program
  * 
@@ -101,6 +150,27 @@ long run_program (char* text);
  */
 long run_program_with_allocation (char* text, int num_registers);
 
+/**
+ * @brief Run the compiler with all ILOC optimizations enabled on given program
+ *
+ * Uses @ref DEFAULT_NUM_REGISTERS for the number of physical registers
+ *
+ * @param text Code to lex, parse, analyze, generate, optimize, and allocate
+ * @returns Return value or @c ERROR_RETURN_CODE if there was an error
+ */
+long run_optimized_program (char* text);
+
+/**
+ * @brief Compile a program to Y86 (allocating every available Y86 register) and run it
+ * in the Y86 simulator
+ *
+ * @param text Code to lex, parse, analyze, generate, allocate, and emit
+ * @param output File stream for program output (discarded if @c NULL)
+ * @param stats Execution statistics (may be @c NULL)
+ * @returns Return value or @c ERROR_RETURN_CODE if there was an error
+ */
+long run_y86_program (char* text, FILE* output, Y86Stats* stats);
+
 /**
  * @brief Run lexer, parser, analysis, code generation, and register allocation on given 'main' function
  *